@@ -15,7 +15,10 @@ set(STUB_KALLSYMS_C [=[
 
 const kallsyms_t mos_kallsyms[] = {
     { .address = 0, .name = "stub" },
+    { .address = 0, .name = NULL },
 }\;
+
+const size_t mos_kallsyms_count = 1\;
 ]=])
 
 file(WRITE ${KALLSYMS_DIR}/stub_kallsyms.cpp ${STUB_KALLSYMS_C})
@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mos/device/clocksource.hpp"
+#include "mos/device/timer.hpp"
 #include "mos/interrupt/interrupt.hpp"
+#include "mos/misc/sampler.hpp"
 #include "mos/mm/paging/table_ops.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/riscv64/cpu/cpu.hpp"
@@ -76,11 +78,14 @@ handle_bp:
 
 handle_timer:
 {
-    const reg_t stime = read_csr(time);
-    write_csr(stimecmp, stime + 1000 * 10); // 10ms
-    spinlock_acquire(&current_thread->state_lock);
-    clocksource_tick(&goldfish);
-    reschedule();
+    if (timer_interrupt())
+    {
+        sched_account_tick(is_userspace);
+        sampler_tick(regs);
+        spinlock_acquire(&current_thread->state_lock);
+        clocksource_tick(&goldfish);
+        reschedule();
+    }
     goto leave;
 }
 
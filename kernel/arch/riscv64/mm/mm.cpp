@@ -105,6 +105,13 @@ VMFlags platform_pml1e_get_flags(const pml1e_t *pml1e) // get bits in the flags
     return pte_get_flags(pte);
 }
 
+bool platform_pml1e_test_and_clear_accessed(pml1e_t *pml1e)
+{
+    // like the rest of the kernel, this relies on the hardware updating the A/D bits (Svadu)
+    const pte_content_t old = __atomic_fetch_and(&pml1e->content, ~(pte_content_t) BIT(6), __ATOMIC_RELAXED);
+    return cast<sv48_pte_t>(&old)->accessed;
+}
+
 pml1_t platform_pml2e_get_pml1(const pml2e_t *pml2e)
 {
     return { .table = (pml1e_t *) pfn_va(cast<sv48_pte_t>(pml2e)->ppn) };
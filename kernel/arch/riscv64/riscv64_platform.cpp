@@ -4,6 +4,7 @@
 #include "mos/device/clocksource.hpp"
 #include "mos/device/serial.hpp"
 #include "mos/device/serial_console.hpp"
+#include "mos/device/timer.hpp"
 #include "mos/interrupt/interrupt.hpp"
 #include "mos/mm/mm.hpp"
 #include "mos/mm/paging/pmlx/pml3.hpp"
@@ -100,7 +101,7 @@ void platform_startup_setup_kernel_mm()
 clocksource_t goldfish{
     .name = "goldfish",
     .ticks = 0,
-    .frequency = 500,
+    .frequency = MOS_SCHED_TICK_HZ, // ticks with the scheduler
 };
 
 void platform_startup_late()
@@ -110,4 +111,5 @@ void platform_startup_late()
     interrupt_handler_register(UART0_IRQ, serial_console_irq_handler, &uart_console);
 
     clocksource_register(&goldfish);
+    timer_cpu_start();
 }
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mos/assert.hpp"
+#include "mos/mm/paging/paging.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/platform/platform_defs.hpp"
 #include "mos/riscv64/cpu/cpu.hpp"
@@ -55,7 +56,8 @@ u32 platform_current_cpu_id()
 
 void platform_cpu_idle()
 {
-    __asm__ volatile("wfi");
+    __asm__ volatile("wfi"); // wakes up on a pending interrupt even if they're disabled
+    platform_interrupt_enable();
 }
 
 void platform_dump_regs(const platform_regs_t *regs)
@@ -145,6 +147,29 @@ void platform_interrupt_enable()
     write_csr(sstatus, sstatus | SSTATUS_SIE);
 }
 
+bool platform_irq_enable(u32 irq)
+{
+    MOS_UNUSED(irq);
+    return false; // not supported yet
+}
+
+void platform_irq_disable(u32 irq)
+{
+    MOS_UNUSED(irq);
+}
+
+long platform_msi_alloc(u64 *address, u32 *data)
+{
+    MOS_UNUSED(address);
+    MOS_UNUSED(data);
+    return -ENOTSUP;
+}
+
+void platform_msi_free(u32 irq)
+{
+    MOS_UNUSED(irq);
+}
+
 void platform_switch_mm(const MMContext *new_mm)
 {
     write_csr(satp, make_satp(SATP_MODE_SV48, 0, pgd_pfn(new_mm->pgd)));
@@ -311,6 +336,40 @@ void platform_dump_stack(const platform_regs_t *regs)
     }
 }
 
+size_t platform_unwind_stack(const platform_regs_t *regs, ptr_t *ips, size_t max, bool *user)
+{
+    *user = (regs->sstatus & SSTATUS_SPP) == 0;
+    if (max == 0)
+        return 0;
+
+    size_t n = 0;
+    ips[n++] = regs->sepc;
+
+    MMContext *const mm = current_cpu->mm_context;
+    if (!mm)
+        return n;
+
+    // the return address is at fp - 8, the caller's fp at fp - 16, as in platform_dump_stack
+    ptr_t fp = regs->fp;
+    while (n < max && fp && is_aligned(fp, 16) && mm_get_phys_addr(mm, fp - 16) / MOS_PAGE_SIZE)
+    {
+        if ((fp >= MOS_KERNEL_START_VADDR) == *user)
+            break;
+
+        const ptr_t ra = *((ptr_t *) fp - 1);
+        const ptr_t caller_fp = *((ptr_t *) fp - 2);
+        if (!ra)
+            break;
+
+        ips[n++] = ra;
+        if (caller_fp <= fp) // frames only go up the stack
+            break;
+        fp = caller_fp;
+    }
+
+    return n;
+}
+
 void platform_syscall_setup_restart_context(platform_regs_t *regs, reg_t syscall_nr)
 {
     regs->a7 = syscall_nr;
@@ -353,7 +412,17 @@ void platform_restore_from_signal_handler(void *sp)
 
 u64 platform_get_timestamp()
 {
-    return 0;
+    return read_csr(time);
+}
+
+u64 platform_get_timestamp_frequency()
+{
+    return 10 * 1000 * 1000; // the timebase-frequency of QEMU's virt machine
+}
+
+void platform_timer_set_deadline(u64 timestamp)
+{
+    write_csr(stimecmp, timestamp ?: (reg_t) -1); // Sstc
 }
 
 void platform_get_time(timeval_t *tv)
@@ -4,6 +4,7 @@
 
 #include "mos/x86/cpu/ap_entry.hpp"
 
+#include "mos/misc/boottime.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/syslog/printk.hpp"
 #include "mos/tasks/schedule.hpp"
@@ -32,6 +33,7 @@ void platform_ap_entry(u64 arg)
     while (aps_blocked)
         __asm__ volatile("pause");
 
+    const u64 start = platform_get_timestamp();
     x86_init_percpu_gdt();
     x86_init_percpu_tss();
     x86_init_percpu_idt();
@@ -54,5 +56,6 @@ void platform_ap_entry(u64 arg)
     current_cpu->id = lapic_id;
 
     x86_setup_lapic_timer();
+    boottime_record("ap", "platform_ap_entry", start, platform_get_timestamp());
     enter_scheduler();
 }
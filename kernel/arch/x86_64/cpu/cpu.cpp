@@ -50,11 +50,6 @@ void x86_cpu_setup_xsave_area(void)
     x86_cpu_set_cr4(cr4);
 
     reg_t xcr0 = XCR0_X87 | XCR0_SSE; // bit 0, 1
-    size_t xsave_size = 512;          // X87 + SSE
-
-    // SSE
-    xcr0 |= XCR0_SSE; // bit 1
-    xsave_size += 64; // XSAVE header
 
     // AVX
     if (cpu_has_feature(CPU_FEATURE_AVX))
@@ -83,15 +78,10 @@ void x86_cpu_setup_xsave_area(void)
             pr_dinfo2(x86_startup, "XSAVE state component '%s': size=%d, offset=%d", name, size, offset);
 
             if (xcr0 & BIT(state_component))
-            {
                 pr_dcont(x86_startup, " (enabled)");
-                xsave_size += size;
-            }
         }
     }
 
-    pr_dinfo2(x86_startup, "XSAVE area size: %zu", xsave_size);
-
     __asm__ volatile("xsetbv" : : "c"(0), "a"(xcr0), "d"(xcr0 >> 32));
-    xsave_area_slab.ent_size = xsave_size;
+    x86_xsave_setup(xcr0);
 }
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/x86/devices/tsc.hpp"
+
+#include "mos/syslog/printk.hpp"
+#include "mos/x86/cpu/cpu.hpp"
+#include "mos/x86/delays.hpp"
+#include "mos/x86/devices/port.hpp"
+#include "mos/x86/interrupt/apic.hpp"
+
+#define PIT_FREQUENCY       1193182
+#define PIT_PORT_CHANNEL2   0x42
+#define PIT_PORT_COMMAND    0x43
+#define PIT_PORT_GATE       0x61 // also the PC speaker, bit 0 gates channel 2, bit 5 is its output
+#define PIT_CALIBRATE_MS    10
+#define PIT_CALIBRATE_LATCH (PIT_FREQUENCY * PIT_CALIBRATE_MS / 1000)
+
+u64 x86_tsc_frequency = 0;
+u64 x86_lapic_timer_frequency = 0;
+
+void x86_timer_calibrate(void)
+{
+    // channel 2 counts down once from the latch (mode 0), with the speaker disconnected
+    port_outb(PIT_PORT_GATE, (port_inb(PIT_PORT_GATE) & ~0x02) | 0x01);
+    port_outb(PIT_PORT_COMMAND, 0xB0); // channel 2, lobyte/hibyte, mode 0, binary
+    port_outb(PIT_PORT_CHANNEL2, PIT_CALIBRATE_LATCH & 0xFF);
+    port_outb(PIT_PORT_CHANNEL2, PIT_CALIBRATE_LATCH >> 8);
+
+    lapic_timer_calibrate_start();
+    const u64 tsc_start = rdtsc();
+    while (!(port_inb(PIT_PORT_GATE) & 0x20)) // the output goes high at the terminal count
+        ;
+    const u64 tsc_end = rdtsc();
+    const u32 lapic_ticks = lapic_timer_calibrate_stop();
+
+    x86_tsc_frequency = (tsc_end - tsc_start) * 1000 / PIT_CALIBRATE_MS;
+    x86_lapic_timer_frequency = (u64) lapic_ticks * 1000 / PIT_CALIBRATE_MS;
+
+    // CPUs that enumerate their crystal clock tell the exact TSC frequency
+    if (x86_cpuid(a, 0, 0) >= 0x15)
+    {
+        const u32 denominator = x86_cpuid(a, 0x15, 0), numerator = x86_cpuid(b, 0x15, 0), crystal_hz = x86_cpuid(c, 0x15, 0);
+        if (denominator && numerator && crystal_hz)
+            x86_tsc_frequency = (u64) crystal_hz * numerator / denominator;
+    }
+
+    pr_info("tsc: %llu kHz, lapic timer: %llu kHz", x86_tsc_frequency / 1000, x86_lapic_timer_frequency / 1000);
+}
@@ -62,7 +62,8 @@ typedef struct _platform_process_options
 typedef struct _platform_thread_options
 {
     ptr_t fs_base, gs_base;
-    u8 *xsaveptr;
+    u8 *xsaveptr;  ///< NULL for kernel threads, they never touch the extended state
+    u32 xsave_cpu; ///< the CPU that last loaded the extended state of the thread, \see x86_xsave_switch
 } platform_thread_options_t;
 
 typedef struct _platform_cpuinfo
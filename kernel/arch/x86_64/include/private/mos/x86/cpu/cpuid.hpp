@@ -56,6 +56,8 @@ static constexpr auto __CPU_FEATURE_START_LINE_ = __COUNTER__ + __LINE__;
 #define CPU_FEATURE_AVX2         7, 0, b, 5           // Advanced Vector Extensions 2
 #define CPU_FEATURE_FSGSBASE     7, 0, b, 0           // RDFSBASE, RDGSBASE, WRFSBASE, WRGSBASE
 #define CPU_FEATURE_LA57         7, 0, c, 16          // 5-Level Paging
+#define CPU_FEATURE_XSAVEOPT     0xd, 1, a, 0         // XSAVEOPT
+#define CPU_FEATURE_XSAVEC       0xd, 1, a, 1         // XSAVEC, the compacted form of XSAVE
 #define CPU_FEATURE_XSAVES       0xd, 1, a, 3         // XSAVES, XSTORS, and IA32_XSS
 #define CPU_FEATURE_NX           0x80000001, 0, d, 20 // No-Execute Bit
 #define CPU_FEATURE_PDPE1GB      0x80000001, 0, d, 26 // GB pages
@@ -68,7 +70,7 @@ static constexpr auto __CPU_FEATURE_END_LINE_ = __LINE__;
     M(ACPI)     M(MMX)      M(FXSR)     M(SSE)  M(SSE2)     M(SS)       M(HTT)          M(TM1)      M(IA64)     M(PBE)          \
     M(SSE3)     M(SSSE3)    M(PCID)     M(DCA)  M(SSE4_1)   M(SSE4_2)   M(X2APIC)       M(MOVBE)    M(POPCNT)   M(TSC_DEADLINE) \
     M(AES_NI)   M(XSAVE)    M(OSXSAVE)  M(AVX)  M(F16C)     M(RDRAND)   M(HYPERVISOR)   M(AVX2)     M(FSGSBASE) M(LA57)         \
-    M(XSAVES)   M(NX)       M(PDPE1GB)
+    M(XSAVEOPT) M(XSAVEC)   M(XSAVES)   M(NX)   M(PDPE1GB)
 // clang-format on
 
 #define _do_count(leaf) , __COUNTER__
@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.hpp>
+
+extern u64 x86_tsc_frequency;         ///< TSC ticks per second
+extern u64 x86_lapic_timer_frequency; ///< LAPIC timer ticks per second, after its divider
+
+/**
+ * @brief Measure the frequencies of the TSC and of the LAPIC timer against the PIT
+ * @note Called once, on the BSP with its LAPIC enabled, all CPUs are assumed to run at the same rate.
+ */
+void x86_timer_calibrate(void);
@@ -66,7 +66,18 @@ void ioapic_init(void);
 void ioapic_enable_with_mode(u32 irq, u32 cpu, ioapic_trigger_mode_t trigger_mode, ioapic_polarity_t polarity);
 void ioapic_disable(u32 irq);
 
-void lapic_set_timer(u32 initial_count);
+void lapic_timer_calibrate_start(void);
+u32 lapic_timer_calibrate_stop(void); ///< LAPIC timer ticks since lapic_timer_calibrate_start
+
+/**
+ * @brief Set up the LAPIC timer of the current CPU for one-shot deadlines, in TSC-deadline mode if it's supported
+ */
+void lapic_timer_init(void);
+
+/**
+ * @brief Fire the LAPIC timer once, when the TSC reaches the given value, 0 disarms it
+ */
+void lapic_timer_set_deadline(u64 tsc);
 
 should_inline void ioapic_enable_interrupt(u32 irq, u32 lapic_id)
 {
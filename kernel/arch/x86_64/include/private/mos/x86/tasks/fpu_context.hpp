@@ -6,7 +6,36 @@
 
 #include <mos/allocator.hpp>
 
+#define XSAVE_CPU_NONE ((u32) -1) ///< the extended state of the thread isn't loaded on any CPU
+
 extern mos::Slab<u8> xsave_area_slab;
 
+/**
+ * @brief Choose the XSAVE variant and size the save areas, once XCR0 has been set on the current CPU
+ */
+void x86_xsave_setup(u64 xcr0);
+
+/**
+ * @brief Allocate a save area holding the initial extended state
+ */
+u8 *x86_xsave_area_create(void);
+
+/**
+ * @brief Save the extended state of the current thread to its save area
+ */
 void x86_xsave_thread(Thread *thread);
+
+/**
+ * @brief Load the extended state of a thread into the registers of the current CPU
+ */
 void x86_xrstor_thread(Thread *thread);
+
+/**
+ * @brief Switch the extended state from one thread to another on the current CPU
+ *
+ * @details The state of a user thread is saved when it's switched out, and only loaded again when
+ *          the registers don't still hold it, i.e. when another user thread has been running on the
+ *          CPU since, or the thread has been running on another CPU. Kernel threads never touch
+ *          the extended state, so switching to or from them costs nothing.
+ */
+void x86_xsave_switch(Thread *prev, Thread *next);
@@ -10,9 +10,13 @@
 
 #define IRQ_BASE 0x20
 #define IPI_BASE 0x50
+#define MSI_BASE 0x60 // vectors handed out for message-signalled interrupts
+
+#define X86_MSI_ADDRESS_BASE 0xFEE00000
 
 #define ISR_MAX_COUNT   32
 #define IRQ_MAX_COUNT   16
+#define MSI_MAX_COUNT   32
 #define IDT_ENTRY_COUNT 256
 
 typedef enum
@@ -72,6 +76,7 @@ typedef enum
 } x86_irq_enum_t;
 
 MOS_STATIC_ASSERT(IRQ_MAX_COUNT == IRQ_MAX, "IRQ_MAX_COUNT is not equal to IRQ_MAX");
+MOS_STATIC_ASSERT(MSI_BASE + MSI_MAX_COUNT <= MOS_SYSCALL_INTR, "MSI vectors overlap with the syscall vector");
 
 void pic_remap_irq(void);
 
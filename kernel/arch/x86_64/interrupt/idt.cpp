@@ -52,6 +52,9 @@ void x86_idt_init()
     for (u8 ipi_n = 0; ipi_n < IPI_TYPE_MAX; ipi_n++)
         idt_set_descriptor(ipi_n + IPI_BASE, isr_stub_table[ipi_n + IPI_BASE], false, false);
 
+    for (u8 msi_n = 0; msi_n < MSI_MAX_COUNT; msi_n++)
+        idt_set_descriptor(msi_n + MSI_BASE, isr_stub_table[msi_n + MSI_BASE], false, false);
+
     idtr.base = &idt[0];
     idtr.limit = (u16) sizeof(idt_entry_t) * IDT_ENTRY_COUNT - 1;
 }
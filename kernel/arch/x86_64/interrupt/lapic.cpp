@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <algorithm>
 #include <mos/mm/paging/paging.hpp>
 #include <mos/mm/physical/pmm.hpp>
 #include <mos/mos_global.h>
@@ -8,6 +9,8 @@
 #include <mos/x86/acpi/madt.hpp>
 #include <mos/x86/cpu/cpu.hpp>
 #include <mos/x86/cpu/cpuid.hpp>
+#include <mos/x86/delays.hpp>
+#include <mos/x86/devices/tsc.hpp>
 #include <mos/x86/interrupt/apic.hpp>
 #include <mos/x86/mm/paging_impl.hpp>
 #include <mos/x86/x86_platform.hpp>
@@ -49,9 +52,15 @@
 #define APIC_INTERRUPT_COMMAND_REG_BEGIN 0x300
 #define APIC_INTERRUPT_COMMAND_REG_END   0x310
 
-#define IA32_APIC_BASE_MSR 0x1B
+#define APIC_LVT_MASKED             BIT(16)
+#define APIC_LVT_TIMER_ONESHOT      (0 << 17)
+#define APIC_LVT_TIMER_TSC_DEADLINE (2 << 17)
+
+#define IA32_APIC_BASE_MSR    0x1B
+#define IA32_TSC_DEADLINE_MSR 0x6E0
 
 static ptr_t lapic_regs = 0;
+static bool lapic_timer_tsc_deadline = false;
 
 u32 lapic_read32(u32 offset)
 {
@@ -148,11 +157,51 @@ void lapic_enable(void)
     lapic_write32(APIC_REG_SPURIOUS_INTR_VEC, spurious_intr_vec);
 }
 
-void lapic_set_timer(u32 initial_count)
+void lapic_timer_calibrate_start(void)
+{
+    lapic_write32(APIC_REG_TIMER_DIVIDE_CONFIG, 0x3);        // divide by 16
+    lapic_write32(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);      // one-shot, without interrupting
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, 0xFFFFFFFF); // count down from the top
+}
+
+u32 lapic_timer_calibrate_stop(void)
+{
+    const u32 elapsed = 0xFFFFFFFF - lapic_read32(APIC_REG_TIMER_CURRENT_COUNT);
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, 0);
+    return elapsed;
+}
+
+void lapic_timer_init(void)
+{
+    // all CPUs are the same model, the answer is the same for each of them
+    lapic_timer_tsc_deadline = cpu_has_feature(CPU_FEATURE_TSC_DEADLINE);
+
+    lapic_write32(APIC_REG_TIMER_DIVIDE_CONFIG, 0x3); // divide by 16
+    lapic_write32(APIC_REG_LVT_TIMER, (lapic_timer_tsc_deadline ? APIC_LVT_TIMER_TSC_DEADLINE : APIC_LVT_TIMER_ONESHOT) | 32);
+
+    // the LVT write must land before the first write to IA32_TSC_DEADLINE, or the latter is ignored
+    __asm__ volatile("mfence" ::: "memory");
+}
+
+void lapic_timer_set_deadline(u64 tsc)
 {
-    lapic_write32(APIC_REG_TIMER_DIVIDE_CONFIG, 0x3);           // divide by 16
-    lapic_write32(APIC_REG_LVT_TIMER, 0x20000 | 32);            // periodic timer mode
-    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, initial_count); // start the timer
+    if (lapic_timer_tsc_deadline)
+    {
+        cpu_wrmsr(IA32_TSC_DEADLINE_MSR, tsc); // 0 disarms the timer
+        return;
+    }
+
+    if (!tsc)
+    {
+        lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, 0);
+        return;
+    }
+
+    // at most a second ahead to keep the count in range, firing early only makes the timer reprogram itself
+    const u64 now = rdtsc();
+    const u64 delta = std::min(tsc > now ? tsc - now : 1, x86_tsc_frequency);
+    const u64 count = delta * x86_lapic_timer_frequency / x86_tsc_frequency;
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, std::max<u64>(count, 1));
 }
 
 void lapic_eoi(void)
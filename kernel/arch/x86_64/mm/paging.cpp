@@ -106,6 +106,13 @@ VMFlags platform_pml1e_get_flags(const pml1e_t *pml1e)
     return flags;
 }
 
+bool platform_pml1e_test_and_clear_accessed(pml1e_t *pml1e)
+{
+    // the CPU may set the dirty bit concurrently, so don't write the entry back as a whole
+    const pte_content_t old = __atomic_fetch_and(&pml1e->content, ~(pte_content_t) BIT(5), __ATOMIC_RELAXED);
+    return cast<x86_pte64_t>(&old)->accessed;
+}
+
 // PML2
 
 pml1_t platform_pml2e_get_pml1(const pml2e_t *pml2e)
@@ -43,7 +43,9 @@ static void x86_start_user_thread()
 static platform_regs_t *x86_setup_thread_common(Thread *thread)
 {
     MOS_ASSERT_X(thread->platform_options.xsaveptr == NULL, "xsaveptr should be NULL");
-    thread->platform_options.xsaveptr = xsave_area_slab.create();
+    if (thread->mode == THREAD_MODE_USER)
+        thread->platform_options.xsaveptr = x86_xsave_area_create();
+    thread->platform_options.xsave_cpu = XSAVE_CPU_NONE;
     thread->k_stack.head -= sizeof(platform_regs_t);
     platform_regs_t *regs = platform_thread_regs(thread);
     *regs = (platform_regs_t) {};
@@ -70,6 +72,10 @@ void platform_context_setup_main_thread(Thread *thread, ptr_t entry, ptr_t sp, i
     regs->si = argv;
     regs->dx = envp;
     regs->sp = sp;
+
+    // an execve'd image starts with the initial extended state, not with what the old image left in the registers
+    if (thread == current_thread)
+        x86_xrstor_thread(thread);
 }
 
 void platform_context_cleanup(Thread *thread)
@@ -77,6 +83,7 @@ void platform_context_cleanup(Thread *thread)
     if (thread->mode == THREAD_MODE_USER)
         if (thread->platform_options.xsaveptr)
             kfree(thread->platform_options.xsaveptr), thread->platform_options.xsaveptr = NULL;
+    thread->platform_options.xsave_cpu = XSAVE_CPU_NONE;
 }
 
 void platform_context_setup_child_thread(Thread *thread, thread_entry_t entry, void *arg)
@@ -105,10 +112,13 @@ void platform_context_clone(Thread *from, Thread *to)
     if (to->mode == THREAD_MODE_USER)
     {
         to->u_stack.head = to_regs->sp;
+        if (from == current_thread)
+            x86_xsave_thread(from); // the save area is only up to date once the thread has been switched out
         to->platform_options.xsaveptr = xsave_area_slab.create();
         memcpy(to->platform_options.xsaveptr, from->platform_options.xsaveptr, xsave_area_slab.size());
     }
 
+    to->platform_options.xsave_cpu = XSAVE_CPU_NONE;
     to->platform_options.fs_base = from->platform_options.fs_base;
     to->platform_options.gs_base = from->platform_options.gs_base;
     to->k_stack.head -= sizeof(platform_regs_t);
@@ -126,10 +136,7 @@ void platform_switch_to_thread(Thread *current, Thread *new_thread, ContextSwitc
         }
     }();
 
-    if (current)
-        x86_xsave_thread(current);
-
-    x86_xrstor_thread(new_thread);
+    x86_xsave_switch(current, new_thread);
     x86_set_fsbase(new_thread);
 
     current_cpu->thread = new_thread;
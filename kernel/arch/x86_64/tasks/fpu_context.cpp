@@ -5,14 +5,92 @@
 #include "mos/platform/platform.hpp"
 #include "mos/syslog/printk.hpp"
 #include "mos/tasks/task_types.hpp"
+#include "mos/x86/cpu/cpu.hpp"
+#include "mos/x86/cpu/cpuid.hpp"
 
 #include <mos/allocator.hpp>
 #include <mos_stdlib.hpp>
 
+#define IA32_XSS_MSR 0xDA0
+
+#define XSAVE_ALIGN        64
+#define XSAVE_XCOMP_BV     520     // offset of XCOMP_BV in the XSAVE header
+#define XCOMP_BV_COMPACTED BIT(63) // the area is in the compacted form
+
+typedef enum
+{
+    XSAVE_INSN_XSAVE,
+    XSAVE_INSN_XSAVEOPT, // skips the components that haven't been modified since they were loaded
+    XSAVE_INSN_XSAVEC,   // compacted form, skips the components in their initial state
+    XSAVE_INSN_XSAVES,   // both of the above
+} xsave_insn_t;
+
+static xsave_insn_t xsave_insn = XSAVE_INSN_XSAVE;
+static u64 xsave_features = 0; // XCR0
+
+static PER_CPU_DECLARE(Thread *, xsave_owner); // the thread whose extended state the registers were last loaded with
+
 static const u64 RFBM = ~0ULL;
 const reg32_t low = RFBM & 0xFFFFFFFF;
 const reg32_t high = RFBM >> 32;
 
+void x86_xsave_setup(u64 xcr0)
+{
+    xsave_features = xcr0;
+    if (cpu_has_feature(CPU_FEATURE_XSAVES))
+    {
+        xsave_insn = XSAVE_INSN_XSAVES;
+        cpu_wrmsr(IA32_XSS_MSR, 0); // no supervisor state
+    }
+    else if (cpu_has_feature(CPU_FEATURE_XSAVEOPT))
+        xsave_insn = XSAVE_INSN_XSAVEOPT;
+    else if (cpu_has_feature(CPU_FEATURE_XSAVEC))
+        xsave_insn = XSAVE_INSN_XSAVEC;
+    else
+        xsave_insn = XSAVE_INSN_XSAVE;
+
+    // EBX of sub-leaf 0 is the size of the standard form for the components enabled in XCR0,
+    // EBX of sub-leaf 1 is the size of the compacted form for XCR0 | IA32_XSS
+    const bool compacted = xsave_insn == XSAVE_INSN_XSAVES || xsave_insn == XSAVE_INSN_XSAVEC;
+    reg32_t eax, size, ecx, edx;
+    __cpuid_count(0xd, compacted ? 1 : 0, eax, size, ecx, edx);
+
+    // the slab places the objects at multiples of their size, so this keeps them 64-byte aligned
+    const size_t xsave_size = ALIGN_UP(size, XSAVE_ALIGN);
+    MOS_ASSERT_X(xsave_size <= MOS_PAGE_SIZE / 2, "XSAVE area too large for the slab: %zu", xsave_size);
+    xsave_area_slab.ent_size = xsave_size;
+
+    static const char *const insn_names[] = { "xsave", "xsaveopt", "xsavec", "xsaves" };
+    pr_dinfo2(x86_startup, "XSAVE area size: %zu, saved with %s", xsave_size, insn_names[xsave_insn]);
+}
+
+u8 *x86_xsave_area_create(void)
+{
+    u8 *area = xsave_area_slab.create(); // zeroed, i.e. XSTATE_BV is 0, all components are in their initial state
+    if (xsave_insn == XSAVE_INSN_XSAVES || xsave_insn == XSAVE_INSN_XSAVEC)
+        *(u64 *) (area + XSAVE_XCOMP_BV) = XCOMP_BV_COMPACTED | xsave_features; // XRSTORS only accepts the compacted form
+    return area;
+}
+
+static void xsave_area_save(u8 *area)
+{
+    switch (xsave_insn)
+    {
+        case XSAVE_INSN_XSAVE: __asm__ volatile("xsave64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVEOPT: __asm__ volatile("xsaveopt64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVEC: __asm__ volatile("xsavec64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVES: __asm__ volatile("xsaves64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory"); break;
+    }
+}
+
+static void xsave_area_restore(const u8 *area)
+{
+    if (xsave_insn == XSAVE_INSN_XSAVES)
+        __asm__ volatile("xrstors64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory");
+    else
+        __asm__ volatile("xrstor64 (%0)" ::"r"(area), "a"(low), "d"(high) : "memory"); // both forms
+}
+
 void x86_xsave_thread(Thread *thread)
 {
     if (!thread || thread->mode == THREAD_MODE_KERNEL)
@@ -22,7 +100,7 @@ void x86_xsave_thread(Thread *thread)
         return; // this happens when the thread is being execve'd
 
     pr_dcont(scheduler, "saved.");
-    __asm__ volatile("xsave %0" ::"m"(*thread->platform_options.xsaveptr), "a"(low), "d"(high));
+    xsave_area_save(thread->platform_options.xsaveptr);
 }
 
 void x86_xrstor_thread(Thread *thread)
@@ -34,5 +112,23 @@ void x86_xrstor_thread(Thread *thread)
         return; // this happens when the thread is being execve'd
 
     pr_dcont(scheduler, "restored.");
-    __asm__ volatile("xrstor %0" ::"m"(*thread->platform_options.xsaveptr), "a"(low), "d"(high));
+    xsave_area_restore(thread->platform_options.xsaveptr);
+    *per_cpu(xsave_owner) = thread;
+    thread->platform_options.xsave_cpu = platform_current_cpu_id();
+}
+
+void x86_xsave_switch(Thread *prev, Thread *next)
+{
+    // a running user thread always has its state in the registers, save it in case it runs on another CPU next
+    x86_xsave_thread(prev);
+
+    if (next->mode == THREAD_MODE_KERNEL || !next->platform_options.xsaveptr)
+        return; // whatever is loaded stays loaded
+
+    // the registers still hold the state if no other user thread has been loaded here since, and the thread
+    // hasn't been loaded on another CPU, whose changes would be in the save area but not in our registers
+    if (*per_cpu(xsave_owner) == next && next->platform_options.xsave_cpu == platform_current_cpu_id())
+        return;
+
+    x86_xrstor_thread(next);
 }
@@ -5,7 +5,9 @@
 #include "mos/device/console.hpp"
 #include "mos/device/serial.hpp"
 #include "mos/device/serial_console.hpp"
+#include "mos/device/timer.hpp"
 #include "mos/interrupt/interrupt.hpp"
+#include "mos/misc/sampler.hpp"
 #include "mos/mm/mm.hpp"
 #include "mos/mm/paging/paging.hpp"
 #include "mos/syslog/printk.hpp"
@@ -18,6 +20,7 @@
 #include "mos/x86/descriptors/descriptors.hpp"
 #include "mos/x86/devices/port.hpp"
 #include "mos/x86/devices/rtc.hpp"
+#include "mos/x86/devices/tsc.hpp"
 #include "mos/x86/interrupt/apic.hpp"
 #include "mos/x86/mm/paging_impl.hpp"
 #include "mos/x86/x86_interrupt.hpp"
@@ -96,6 +99,11 @@ static bool x86_pit_timer_handler(u32 irq, void *data)
 {
     MOS_UNUSED(data);
     MOS_ASSERT(irq == IRQ_PIT_TIMER);
+    if (!timer_interrupt())
+        return true; // only timers have expired, the scheduler tick isn't due yet
+
+    sched_account_tick(current_cpu->interrupt_regs->cs & 0x3);
+    sampler_tick(current_cpu->interrupt_regs);
     spinlock_acquire(&current_thread->state_lock);
     reschedule();
     return true;
@@ -103,7 +111,8 @@ static bool x86_pit_timer_handler(u32 irq, void *data)
 
 void x86_setup_lapic_timer()
 {
-    lapic_set_timer(1000000);
+    lapic_timer_init();
+    timer_cpu_start();
 }
 
 typedef struct _frame
@@ -112,6 +121,12 @@ typedef struct _frame
     ptr_t ip;
 } frame_t;
 
+static bool x86_frame_is_mapped(MMContext *mm, const frame_t *frame)
+{
+    // a frame may straddle two pages
+    return mm_get_phys_addr(mm, (ptr_t) frame) / MOS_PAGE_SIZE && mm_get_phys_addr(mm, (ptr_t) (frame + 1) - 1) / MOS_PAGE_SIZE;
+}
+
 void x86_dump_stack_at(ptr_t this_frame, bool can_access_vmaps)
 {
     frame_t *frame = (frame_t *) this_frame;
@@ -129,14 +144,10 @@ void x86_dump_stack_at(ptr_t this_frame, bool can_access_vmaps)
     for (u32 i = 0; frame; i++)
     {
 #define TRACE_FMT "  %-3d [" PTR_FMT "]: "
-        if (do_mapped_check)
+        if (do_mapped_check && !x86_frame_is_mapped(current_cpu->mm_context, frame))
         {
-            const pfn_t pfn = mm_get_phys_addr(current_cpu->mm_context, (ptr_t) frame) / MOS_PAGE_SIZE;
-            if (!pfn)
-            {
-                pr_emerg(TRACE_FMT "<corrupted>, aborting backtrace", i, (ptr_t) frame);
-                break;
-            }
+            pr_emerg(TRACE_FMT "<corrupted>, aborting backtrace", i, (ptr_t) frame);
+            break;
         }
 
         if (frame->bp == 0)
@@ -207,6 +218,36 @@ void platform_dump_stack(const platform_regs_t *regs)
     x86_dump_stack_at(regs->bp, true);
 }
 
+size_t platform_unwind_stack(const platform_regs_t *regs, ptr_t *ips, size_t max, bool *user)
+{
+    *user = regs->cs & 0x3;
+    if (max == 0)
+        return 0;
+
+    size_t n = 0;
+    ips[n++] = regs->ip;
+
+    MMContext *const mm = current_cpu->mm_context;
+    if (!mm)
+        return n;
+
+    // the same walk as x86_dump_stack_at, without the diagnostics
+    const frame_t *frame = (const frame_t *) regs->bp;
+    while (n < max && frame && x86_frame_is_mapped(mm, frame))
+    {
+        // don't follow a kernel stack into userspace, or the other way around
+        if (((ptr_t) frame >= MOS_KERNEL_START_VADDR) == *user || !frame->ip)
+            break;
+
+        ips[n++] = frame->ip;
+        if (frame->bp <= frame) // frames only go up the stack, anything else is garbage
+            break;
+        frame = frame->bp;
+    }
+
+    return n;
+}
+
 void platform_startup_early()
 {
     COM2Console.Register();
@@ -282,6 +323,7 @@ void platform_startup_late()
     ioapic_enable_interrupt(IRQ_CMOS_RTC, x86_platform.boot_cpu_id);
     ioapic_enable_interrupt(IRQ_COM1, x86_platform.boot_cpu_id);
 
+    x86_timer_calibrate();
     x86_setup_lapic_timer();
 
     x86_unblock_aps();
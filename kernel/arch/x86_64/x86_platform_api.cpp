@@ -15,9 +15,11 @@
 #include <mos/syslog/printk.hpp>
 #include <mos/tasks/process.hpp>
 #include <mos/tasks/task_types.hpp>
+#include <mos/x86/acpi/madt.hpp>
 #include <mos/x86/cpu/cpu.hpp>
 #include <mos/x86/delays.hpp>
 #include <mos/x86/devices/port.hpp>
+#include <mos/x86/devices/tsc.hpp>
 #include <mos/x86/interrupt/apic.hpp>
 #include <mos/x86/mm/paging_impl.hpp>
 #include <mos/x86/tasks/context.hpp>
@@ -56,7 +58,7 @@ u32 platform_current_cpu_id(void)
 
 void platform_cpu_idle(void)
 {
-    __asm__ volatile("hlt");
+    __asm__ volatile("sti; hlt"); // sti takes effect after hlt, no interrupt can slip in between
 }
 
 u64 platform_get_timestamp()
@@ -64,6 +66,16 @@ u64 platform_get_timestamp()
     return rdtsc();
 }
 
+u64 platform_get_timestamp_frequency()
+{
+    return x86_tsc_frequency;
+}
+
+void platform_timer_set_deadline(u64 timestamp)
+{
+    lapic_timer_set_deadline(timestamp);
+}
+
 datetime_str_t *platform_get_datetime_str(void)
 {
     static PER_CPU_DECLARE(datetime_str_t, datetime_str);
@@ -84,6 +96,56 @@ void platform_interrupt_disable(void)
     __asm__ volatile("cli");
 }
 
+bool platform_irq_enable(u32 irq)
+{
+    if (irq >= IRQ_MAX)
+        return false;
+
+    ioapic_enable_interrupt(irq, x86_platform.boot_cpu_id);
+    return true;
+}
+
+void platform_irq_disable(u32 irq)
+{
+    if (irq < IRQ_MAX)
+        ioapic_disable(x86_ioapic_get_irq_override(irq));
+}
+
+static spinlock_t msi_lock;
+static u32 msi_allocated; // one bit for each vector starting at MSI_BASE
+MOS_STATIC_ASSERT(MSI_MAX_COUNT <= sizeof(msi_allocated) * 8, "msi_allocated is too small");
+
+long platform_msi_alloc(u64 *address, u32 *data)
+{
+    spinlock_acquire(&msi_lock);
+    for (u32 i = 0; i < MSI_MAX_COUNT; i++)
+    {
+        if (msi_allocated & BIT(i))
+            continue;
+
+        msi_allocated |= BIT(i);
+        spinlock_release(&msi_lock);
+
+        // fixed delivery to the boot cpu, physical destination mode, edge-triggered
+        *address = X86_MSI_ADDRESS_BASE | ((u64) x86_platform.boot_cpu_id << 12);
+        *data = MSI_BASE + i;
+        return MSI_BASE + i - IRQ_BASE;
+    }
+    spinlock_release(&msi_lock);
+    return -ENOSPC;
+}
+
+void platform_msi_free(u32 irq)
+{
+    const u32 vector = irq + IRQ_BASE;
+    if (vector < MSI_BASE || vector >= MSI_BASE + MSI_MAX_COUNT)
+        return;
+
+    spinlock_acquire(&msi_lock);
+    msi_allocated &= ~BIT(vector - MSI_BASE);
+    spinlock_release(&msi_lock);
+}
+
 void platform_switch_mm(const MMContext *mm)
 {
     x86_cpu_set_cr3(pgd_pfn(mm->pgd) * MOS_PAGE_SIZE);
@@ -2,8 +2,6 @@
 
 #include "mos/device/clocksource.hpp"
 
-#include "mos/device/timer.hpp"
-
 list_head clocksources;
 clocksource_t *active_clocksource;
 
@@ -17,5 +15,4 @@ void clocksource_register(clocksource_t *clocksource)
 void clocksource_tick(clocksource_t *clocksource)
 {
     clocksource->ticks++;
-    timer_tick();
 }
@@ -2,72 +2,200 @@
 
 #include "mos/device/timer.hpp"
 
-#include "mos/device/clocksource.hpp"
 #include "mos/lib/structures/list.hpp"
 #include "mos/lib/sync/spinlock.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/tasks/schedule.hpp"
 #include "mos/tasks/signal.hpp"
 
-static list_head timer_queue; ///< list of timers that are waiting to be executed
-static spinlock_t timer_queue_lock;
+#include <algorithm>
 
-static bool timer_do_wakeup(ktimer_t *timer, void *arg)
+#define NSEC_PER_SEC  1000000000ull
+#define NSEC_PER_MSEC 1000000ull
+#define NSEC_PER_USEC 1000ull // the unit of the timer wheels
+
+typedef struct
 {
-    MOS_UNUSED(arg);
+    spinlock_t lock;
+    timer_wheel_t wheel; ///< pending timers of this CPU, in microseconds
+    bool tick_stopped;   ///< the CPU is idle, no scheduler tick is needed
+    u64 next_tick;       ///< when the next scheduler tick is due, in nanoseconds
+    u64 deadline;        ///< what the hardware timer is programmed for, in nanoseconds
+} timer_cpu_t;
 
-    if (timer->thread)
-        scheduler_wake_thread(timer->thread);
+static PER_CPU_DECLARE(timer_cpu_t, timer_cpus);
 
-    return true;
+static u64 timestamp_frequency = 0; ///< 0 until the first CPU starts its timer
+static u64 tick_period_ns = NSEC_PER_SEC / MOS_SCHED_TICK_HZ;
+
+// sleeps are clamped to about a century, so that neither the deadline nor its conversions can overflow
+static constexpr u64 TIMER_MAX_SLEEP_NS = 100ULL * 365 * 24 * 3600 * NSEC_PER_SEC;
+
+// the hardware timer is never programmed further ahead than this, it's simply reprogrammed when it fires
+static constexpr u64 TIMER_MAX_PROGRAM_NS = 10 * NSEC_PER_SEC;
+
+static u64 timestamp_to_ns(u64 timestamp)
+{
+    // split into seconds so that nothing overflows
+    const u64 secs = timestamp / timestamp_frequency, rem = timestamp % timestamp_frequency;
+    return secs * NSEC_PER_SEC + rem * NSEC_PER_SEC / timestamp_frequency;
 }
 
-void timer_tick()
+static u64 ns_to_timestamp_delta(u64 ns)
 {
-    spinlock_acquire(&timer_queue_lock);
-    list_foreach(ktimer_t, timer, timer_queue)
+    const u64 secs = ns / NSEC_PER_SEC, rem = ns % NSEC_PER_SEC;
+    return secs * timestamp_frequency + (rem * timestamp_frequency + NSEC_PER_SEC - 1) / NSEC_PER_SEC; // never early
+}
+
+u64 timer_now_ns(void)
+{
+    if (unlikely(!timestamp_frequency))
+        return 0;
+    return timestamp_to_ns(platform_get_timestamp());
+}
+
+// program the hardware timer for the earliest of the scheduler tick and the pending timers
+static void timer_program(timer_cpu_t *tc)
+{
+    const u64 next_expiry = timer_wheel_next_expiry(&tc->wheel);
+    u64 deadline = next_expiry == TIMER_WHEEL_NEVER ? TIMER_WHEEL_NEVER : next_expiry * NSEC_PER_USEC;
+    if (!tc->tick_stopped)
+        deadline = std::min(deadline, tc->next_tick);
+
+    tc->deadline = deadline;
+    if (deadline == TIMER_WHEEL_NEVER)
     {
-        if (active_clocksource_ticks() >= (u64) timer->timeout)
-        {
-            if (timer->callback(timer, timer->arg))
-                timer->ticked = true, list_remove(timer);
-        }
+        platform_timer_set_deadline(0);
+        return;
     }
-    spinlock_release(&timer_queue_lock);
+
+    // convert the distance rather than the absolute time, so that rounding errors don't add up
+    const u64 now_ts = platform_get_timestamp();
+    const u64 now = timestamp_to_ns(now_ts);
+    platform_timer_set_deadline(now_ts + (deadline > now ? ns_to_timestamp_delta(std::min(deadline - now, TIMER_MAX_PROGRAM_NS)) : 1));
 }
 
-long timer_msleep(u64 ms)
+void timer_cpu_start(void)
 {
-    if (!active_clocksource)
-        return -ENOTSUP;
+    if (once())
+        timestamp_frequency = platform_get_timestamp_frequency();
+
+    timer_cpu_t *tc = per_cpu(timer_cpus);
+    SpinLocker lock(&tc->lock);
+    const u64 now = timer_now_ns();
+    timer_wheel_init(&tc->wheel, now / NSEC_PER_USEC);
+    tc->tick_stopped = false;
+    tc->next_tick = now + tick_period_ns;
+    timer_program(tc);
+}
 
-    const u64 offset = ms * active_clocksource->frequency / 1000;
-    const u64 target_val = active_clocksource_ticks() + offset;
+bool timer_interrupt(void)
+{
+    timer_cpu_t *tc = per_cpu(timer_cpus);
+    const u64 now = timer_now_ns();
+
+    SpinLocker lock(&tc->lock);
+    list_head expired;
+    timer_wheel_advance(&tc->wheel, now / NSEC_PER_USEC, &expired);
+    list_foreach(timer_wheel_entry_t, entry, expired)
+    {
+        list_remove(entry);
+        ktimer_t *timer = container_of(entry, ktimer_t, entry);
+        timer->ticked = true;
+        timer->callback(timer, timer->arg);
+    }
+
+    bool tick = false;
+    if (!tc->tick_stopped && now >= tc->next_tick)
+    {
+        tick = true;
+        tc->next_tick = now + tick_period_ns;
+    }
+
+    timer_program(tc);
+    return tick;
+}
+
+void timer_tick_stop(void)
+{
+    timer_cpu_t *tc = per_cpu(timer_cpus);
+    SpinLocker lock(&tc->lock);
+    tc->tick_stopped = true;
+    timer_program(tc);
+}
+
+void timer_tick_restart(void)
+{
+    timer_cpu_t *tc = per_cpu(timer_cpus);
+    if (likely(!tc->tick_stopped))
+        return; // only this CPU changes it
+
+    SpinLocker lock(&tc->lock);
+    tc->tick_stopped = false;
+    tc->next_tick = timer_now_ns() + tick_period_ns;
+    timer_program(tc);
+}
+
+void timer_add(ktimer_t *timer)
+{
+    timer->ticked = false;
+    timer->cpu = platform_current_cpu_id();
+    timer->entry.expires = (timer->timeout + NSEC_PER_USEC - 1) / NSEC_PER_USEC; // never early
+
+    timer_cpu_t *tc = per_cpu(timer_cpus);
+    SpinLocker lock(&tc->lock);
+    timer_wheel_add(&tc->wheel, &timer->entry);
+    if (timer->entry.expires * NSEC_PER_USEC < tc->deadline)
+        timer_program(tc);
+}
+
+void timer_cancel(ktimer_t *timer)
+{
+    // the hardware timer is left as it is, a spurious interrupt is cheaper than reprogramming it from another CPU
+    timer_cpu_t *tc = &timer_cpus.percpu_value[timer->cpu];
+    SpinLocker lock(&tc->lock);
+    if (!list_is_empty(list_node(&timer->entry)))
+        timer_wheel_remove(&tc->wheel, &timer->entry);
+}
+
+static void timer_do_wakeup(ktimer_t *timer, void *arg)
+{
+    MOS_UNUSED(arg);
+
+    if (timer->thread)
+        scheduler_wake_thread(timer->thread);
+}
+
+long timer_nsleep(u64 ns)
+{
+    if (!timestamp_frequency)
+        return -ENOTSUP;
 
     ktimer_t timer = {
-        .timeout = target_val,
+        .timeout = timer_now_ns() + std::min(ns, TIMER_MAX_SLEEP_NS),
         .thread = current_thread,
         .ticked = false,
         .callback = timer_do_wakeup,
         .arg = NULL,
     };
 
-    spinlock_acquire(&timer_queue_lock);
-    list_node_append(&timer_queue, list_node(&timer));
-    spinlock_release(&timer_queue_lock);
+    timer_add(&timer);
 
-    while (!timer.ticked)
+    while (!READ_ONCE(timer.ticked))
     {
         blocked_reschedule();
         if (signal_has_pending())
         {
-            spinlock_acquire(&timer_queue_lock);
-            list_remove(&timer);
-            spinlock_release(&timer_queue_lock);
+            timer_cancel(&timer);
             return -EINTR; // interrupted by signal
         }
     }
 
-    MOS_ASSERT(list_is_empty(list_node(&timer)));
+    timer_cancel(&timer); // the interrupt that fired it may still be running the callback
     return 0;
 }
+
+long timer_msleep(u64 ms)
+{
+    return timer_nsleep(ms > TIMER_MAX_SLEEP_NS / NSEC_PER_MSEC ? TIMER_MAX_SLEEP_NS : ms * NSEC_PER_MSEC);
+}
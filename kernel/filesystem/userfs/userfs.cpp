@@ -139,7 +139,7 @@ static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state,
 
     const pf_point_t ev = profile_enter();
     const int result = fs_client_readdir(ufs->rpc_server, &req, &resp);
-    profile_leave(ev, "userfs.'%s'.readdir", userfs->rpc_server_name);
+    profile_leave(ev, "userfs.'%s'.readdir", ufs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_readdir_response_fields, &resp);
 
@@ -176,7 +176,7 @@ static bool userfs_iop_lookup(inode_t *dir, dentry_t *dentry)
     mosrpc_fs_lookup_response resp = {};
     const pf_point_t ev = profile_enter();
     const int result = fs_client_lookup(fs->rpc_server, &req, &resp);
-    profile_leave(ev, "userfs.'%s'.lookup", ufs->rpc_server_name);
+    profile_leave(ev, "userfs.'%s'.lookup", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_lookup_response_fields, &resp);
 
@@ -214,7 +214,7 @@ static bool userfs_iop_mkdir(inode_t *dir, dentry_t *dentry, file_perm_t perm)
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_make_dir(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.make_dir", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.make_dir", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_make_dir_response_fields, &resp);
 
@@ -269,7 +269,7 @@ static bool userfs_iop_newfile(inode_t *dir, dentry_t *dentry, file_type_t type,
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_create_file(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.create_file", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.create_file", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_create_file_response_fields, &resp);
 
@@ -306,7 +306,7 @@ static size_t userfs_iop_readlink(dentry_t *dentry, char *buffer, size_t buflen)
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_readlink(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.readlink", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.readlink", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_readlink_response_fields, &resp);
 
@@ -383,7 +383,7 @@ static bool userfs_iop_unlink(inode_t *dir, dentry_t *dentry)
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_unlink(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.unlink", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.unlink", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_unlink_response_fields, &resp);
 
@@ -448,7 +448,7 @@ static PtrResult<phyframe_t> userfs_inode_cache_fill_cache(inode_cache_t *cache,
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_get_page(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.getpage", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.getpage", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_getpage_response_fields, &resp);
 
@@ -494,7 +494,7 @@ long userfs_inode_cache_flush_page(inode_cache_t *cache, uint64_t pgoff, phyfram
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_put_page(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.putpage", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.putpage", fs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_putpage_request_fields, &req);
     AutoCleanup cleanup2(mosrpc_fs_putpage_response_fields, &resp);
@@ -532,7 +532,7 @@ long userfs_sync_inode(inode_t *inode)
     mosrpc_fs_sync_inode_response resp = {};
     const pf_point_t pp = profile_enter();
     const int result = fs_client_sync_inode(fs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.sync_inode", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.sync_inode", fs->rpc_server_name.c_str());
 
     if (result != RPC_RESULT_OK)
     {
@@ -568,7 +568,7 @@ PtrResult<dentry_t> userfs_fsop_mount(filesystem_t *fs, const char *device, cons
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_mount(userfs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.mount", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.'%s'.mount", userfs->rpc_server_name.c_str());
 
     AutoCleanup cleanup(mosrpc_fs_mount_response_fields, &resp);
 
@@ -201,6 +201,7 @@ static vmfault_result_t vfs_fault_handler(vmap_t *vmap, ptr_t fault_addr, pagefa
     // * currently, only CoW pages have this property, we treat this as a CoW page
     if (info->is_present && info->is_write)
     {
+        info->type = VMFAULT_TYPE_COW;
         if (pagecache_page == info->faulting_page)
             vmap_stat_dec(vmap, pagecache); // the faulting page is a pagecache page
         else
@@ -209,6 +210,7 @@ static vmfault_result_t vfs_fault_handler(vmap_t *vmap, ptr_t fault_addr, pagefa
         return mm_resolve_cow_fault(vmap, fault_addr, info); // resolve by copying data page into prevate page
     }
 
+    info->type = VMFAULT_TYPE_FILE;
     info->backing_page = pagecache_page.get();
     if (vmap->type == VMAP_TYPE_PRIVATE)
     {
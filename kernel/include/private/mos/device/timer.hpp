@@ -2,23 +2,66 @@
 
 #pragma once
 
-#include "mos/lib/structures/list.hpp"
+#include "mos/lib/structures/timer_wheel.hpp"
 #include "mos/platform/platform.hpp"
 
 typedef struct _ktimer ktimer_t;
 
-typedef bool (*timer_callback_t)(ktimer_t *timer, void *arg);
+/**
+ * @brief Called from the timer interrupt when the timer expires
+ * @note The CPU's timer lock is held, the callback must not add or cancel timers.
+ */
+typedef void (*timer_callback_t)(ktimer_t *timer, void *arg);
 
 typedef struct _ktimer
 {
-    as_linked_list;
-    u64 timeout;
+    timer_wheel_entry_t entry;
+    u64 timeout; ///< in nanoseconds, \see timer_now_ns
     Thread *thread;
-    bool ticked;
+    bool ticked; ///< set before the callback is called
     timer_callback_t callback;
     void *arg;
+    u32 cpu; ///< the CPU whose timer wheel holds the timer
 } ktimer_t;
 
-void timer_tick(void);
+/**
+ * @brief Nanoseconds since boot, derived from the platform timestamp
+ */
+u64 timer_now_ns(void);
 
+/**
+ * @brief Arm a timer on the current CPU, timer->timeout, callback and arg must be set
+ */
+void timer_add(ktimer_t *timer);
+
+/**
+ * @brief Disarm a timer, if it's still pending
+ * @details Once this returns, the callback of the timer is not running on any CPU.
+ */
+void timer_cancel(ktimer_t *timer);
+
+/**
+ * @brief Start the timers and the scheduler tick on the current CPU
+ * @note Called by the platform once its timer can be programmed with platform_timer_set_deadline.
+ */
+void timer_cpu_start(void);
+
+/**
+ * @brief Handle a timer interrupt: run the expired timers and program the next deadline
+ *
+ * @return true if a scheduler tick is due, the caller should then reschedule
+ */
+bool timer_interrupt(void);
+
+/**
+ * @brief Stop the scheduler tick on the current CPU, until it leaves the idle thread
+ */
+void timer_tick_stop(void);
+
+/**
+ * @brief Restart the scheduler tick on the current CPU, if it's been stopped
+ */
+void timer_tick_restart(void);
+
+long timer_nsleep(u64 ns);
 long timer_msleep(u64 ms);
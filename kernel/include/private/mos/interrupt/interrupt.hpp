@@ -20,3 +20,15 @@ void interrupt_entry(u32 irq);
  * @param data Data to pass to the handler
  */
 void interrupt_handler_register(u32 irq, irq_serve_t handler, void *data);
+
+/**
+ * @brief Register an interrupt handler, unless the interrupt already has one
+ *
+ * @return true if the handler was registered, false if the interrupt is taken
+ */
+bool interrupt_handler_register_exclusive(u32 irq, irq_serve_t handler, void *data);
+
+/**
+ * @brief Unregister an interrupt handler previously registered with the same arguments
+ */
+void interrupt_handler_unregister(u32 irq, irq_serve_t handler, void *data);
@@ -23,4 +23,10 @@ MOS_STATIC_ASSERT(IPI_TYPE_MAX <= (u8) 0xFF, "IPI_TYPE_MAX must fit in a u8");
 
 void ipi_send(u8 target, ipi_type_t type);
 void ipi_send_all(ipi_type_t type);
+
+/**
+ * @brief Flush the TLB of every CPU, and wait until all of them have done so
+ * @note Call it with interrupts enabled and no spinlocks held, other CPUs may be waiting for them
+ */
+void ipi_invalidate_tlb_sync(void);
 void ipi_do_handle(ipi_type_t type);
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/io/io.hpp"
+
+#include <mos/types.hpp>
+
+/**
+ * @brief Open an IO that a userspace driver reads to wait for a legacy interrupt line
+ *
+ * @details A read of at least 8 bytes blocks until the interrupt fires, and returns
+ *          the number of interrupts (as a u64) since the previous read.
+ *
+ * @param irq The interrupt line, which must not already have a handler
+ * @return PtrResult<IO> The IO, or an error code
+ */
+PtrResult<IO> irq_io_open(u32 irq);
+
+/**
+ * @brief Allocate a message-signalled interrupt and open an IO to wait for it
+ *
+ * @param address Receives the address the device should write to, e.g. for an MSI-X table entry
+ * @param data Receives the data the device should write
+ * @return PtrResult<IO> The IO, which is read in the same way as for irq_io_open, or an error code
+ */
+PtrResult<IO> irq_io_open_msi(u64 *address, u32 *data);
@@ -22,6 +22,8 @@ typedef enum
     IO_IPC,     // an IPC channel
     IO_PIPE,    // an end of a pipe
     IO_CONSOLE, // a console
+    IO_IRQ,     // a device interrupt
+    IO_IPC_ACT, // an IPC server name registered to be served on demand
 } io_type_t;
 
 typedef enum
@@ -3,12 +3,18 @@
 #pragma once
 
 #include "mos/filesystem/vfs_types.hpp"
+#include "mos/mm/physical/pmm.hpp"
 #include "mos/types.hpp"
 
+#include <mos/ipc/ipc_types.h>
 #include <stddef.h>
 
+struct IO;
 struct IpcDescriptor;
 struct IPCServer;
+struct IpcActivation;
+
+MOS_ENUM_FLAGS(ipc_connect_flags_t, IpcConnectFlags);
 
 extern const file_ops_t ipc_sysfs_file_ops;
 
@@ -16,11 +22,49 @@ PtrResult<IPCServer> ipc_server_create(mos::string_view name, size_t max_pending
 
 PtrResult<IPCServer> ipc_get_server(mos::string_view name);
 
-PtrResult<IpcDescriptor> ipc_server_accept(IPCServer *server);
+/**
+ * @brief Accept a pending connection
+ * @param flags The features the server supports, a feature is only set up if the client asked for it too,
+ *              e.g. the shared-memory rings, which the server must be ready to attach to
+ */
+PtrResult<IpcDescriptor> ipc_server_accept(IPCServer *server, IpcConnectFlags flags = IPC_CONNECT_NONE);
 
 void ipc_server_close(IPCServer *server);
 
-PtrResult<IpcDescriptor> ipc_connect_to_server(mos::string name, size_t buffer_size);
+/**
+ * @brief Register a server name that is served on demand
+ * @details Clients connecting to the name are queued as if the server existed, and the first of them
+ *          wakes up the registrant (see ipc_activation_wait), who is expected to start the real server.
+ *          The real server then takes over the name and its pending connections with ipc_server_create, if the
+ *          registrant has allowed its process to, see ipc_activation_authorize.
+ *
+ * @param name The name of the server
+ * @param max_pending_connections The maximum number of connections to queue until the name is served
+ * @return PtrResult<IpcActivation> The registration, or -EEXIST if the name is already registered or served
+ */
+PtrResult<IpcActivation> ipc_activation_create(mos::string_view name, size_t max_pending_connections);
+
+/**
+ * @brief Allow a process to take over a registered name, no other process can serve it while it's registered
+ *
+ * @return long 0, or -EBUSY if the name has already been taken over
+ */
+long ipc_activation_authorize(IpcActivation *activation, pid_t pid);
+
+/**
+ * @brief Wait for a registered name to be needed, and then for it to be served
+ *
+ * @return long The number of pending connections once the first client has connected, then 0 once a server
+ *         has taken over the name, -EINTR, or -EBADF if the registration has been closed meanwhile
+ */
+long ipc_activation_wait(IpcActivation *activation);
+
+/**
+ * @brief Drop a registration, connections pending on a name that hasn't been taken over are refused
+ */
+void ipc_activation_close(IpcActivation *activation);
+
+PtrResult<IpcDescriptor> ipc_connect_to_server(mos::string name, size_t buffer_size, IpcConnectFlags flags = IPC_CONNECT_NONE);
 
 size_t ipc_client_read(IpcDescriptor *ipc, void *buffer, size_t size);
 size_t ipc_client_write(IpcDescriptor *ipc, const void *buffer, size_t size);
@@ -29,3 +73,38 @@ size_t ipc_server_write(IpcDescriptor *ipc, const void *buffer, size_t size);
 
 void ipc_client_close_channel(IpcDescriptor *ipc);
 void ipc_server_close_channel(IpcDescriptor *ipc);
+
+/**
+ * @brief Attach an IO to a connection, for the peer to pick up with ipc_detach_io
+ *
+ * @param ipc The IPC connection
+ * @param from_server Whether the IO is sent by the server end
+ * @param io The IO to send, a new reference is taken
+ * @return long A non-zero handle identifying the IO, or a negative error code
+ */
+long ipc_attach_io(IpcDescriptor *ipc, bool from_server, IO *io);
+
+/**
+ * @brief Take an IO that the peer has attached to a connection
+ *
+ * @param ipc The IPC connection
+ * @param to_server Whether the IO is received by the server end
+ * @param handle The handle returned by ipc_attach_io
+ * @return PtrResult<IO> The IO, the caller owns the reference, or -ENOENT
+ */
+PtrResult<IO> ipc_detach_io(IpcDescriptor *ipc, bool to_server, u32 handle);
+
+/**
+ * @brief Get a page of the shared-memory ring area of a connection
+ *
+ * @param ipc The IPC connection
+ * @param pgoff The page offset into the area
+ * @return phyframe_t* The page, or NULL if the connection has no such page
+ */
+phyframe_t *ipc_shm_get_page(const IpcDescriptor *ipc, size_t pgoff);
+
+/**
+ * @brief Get the size of the shared-memory ring area of a connection, in pages
+ * @return size_t The number of pages, or 0 if the connection was not created with IPC_CONNECT_SHM_RING
+ */
+size_t ipc_shm_npages(const IpcDescriptor *ipc);
@@ -4,16 +4,25 @@
 
 #include "mos/io/io.hpp"
 #include "mos/ipc/ipc.hpp"
+#include "mos/mm/mm.hpp"
 
 #include <mos/allocator.hpp>
 
 struct IpcConnectionIO : IO
 {
-    IpcConnectionIO(IpcDescriptor *descriptor) : IO(IO_READABLE | IO_WRITABLE, IO_IPC), descriptor(descriptor) {};
+    IpcConnectionIO(IpcDescriptor *descriptor, bool is_server_side)
+        : IO(IOFlags(IO_READABLE | IO_WRITABLE) | (ipc_shm_npages(descriptor) ? IO_MMAPABLE : IO_NONE), IO_IPC), descriptor(descriptor),
+          is_server_side(is_server_side) {};
     virtual ~IpcConnectionIO() {};
 
-  protected:
+    bool on_mmap(vmap_t *vmap, off_t offset) override;
+    bool on_munmap(vmap_t *vmap, bool *unmapped) override;
+
     IpcDescriptor *const descriptor;
+    const bool is_server_side;
+
+  private:
+    static vmfault_result_t on_shm_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info);
 };
 
 /**
@@ -26,20 +35,37 @@ struct IpcConnectionIO : IO
  */
 PtrResult<IO> ipc_create(const char *name, size_t max_pending_connections);
 
+/**
+ * @brief Register an IPC server name to be served on demand, \see ipc_activation_create
+ * @param name The name of the server
+ * @param max_pending_connections The maximum number of connections to queue until the name is served
+ * @return A new IO object that represents the registration, or an error code on failure
+ *
+ * @note Reading 8 bytes from the IO blocks until the first client connects, and returns the number of pending connections,
+ *       after which a read blocks until a server has taken over the name, and returns 0. Closing it drops the registration.
+ *       Writing a pid_t to it allows that process to take over the name.
+ */
+PtrResult<IO> ipc_register(const char *name, size_t max_pending_connections);
+
 /**
  * @brief Accept a new connection on an IPC server
  * @param server The server to accept a connection on
+ * @param flags The connection features the server supports, \see ipc_server_accept
  * @return An IO for the server side of the connection, or an error code on failure
  */
-PtrResult<IO> ipc_accept(IO *server);
+PtrResult<IO> ipc_accept(IO *server, IpcConnectFlags flags = IPC_CONNECT_NONE);
 
 /**
  * @brief Connect to an IPC servers
  * @param name The name of the server to connect to
  * @param buffer_size The size of a shared-memory buffer to use for the connection
+ * @param flags Connection flags, \see ipc_connect_flags_t
  * @return A new IO object that represents the connection, or an error code on failure
+ *
+ * @note With IPC_CONNECT_SHM_RING, both ends may mmap the returned IO to get the shared-memory rings,
+ *       the stream interface (read/write) remains usable regardless.
  */
-PtrResult<IO> ipc_connect(const char *name, size_t buffer_size);
+PtrResult<IO> ipc_connect(const char *name, size_t buffer_size, IpcConnectFlags flags = IPC_CONNECT_NONE);
 
 /**
  * @brief Create a new IPC connection io descriptor
@@ -49,3 +75,21 @@ PtrResult<IO> ipc_connect(const char *name, size_t buffer_size);
  * @return ipc_conn_io_t* A new IPC connection io descriptor
  */
 PtrResult<IpcConnectionIO> ipc_conn_io_create(IpcDescriptor *ipc, bool is_server_side);
+
+/**
+ * @brief Send an IO to the peer of an IPC connection
+ *
+ * @param conn The IPC connection, either end
+ * @param io The IO to send, the connection takes a new reference
+ * @return long A non-zero handle to be passed to the peer, who calls ipc_receive_io with it, or an error code
+ */
+long ipc_send_io(IO *conn, IO *io);
+
+/**
+ * @brief Receive an IO that the peer of an IPC connection has sent
+ *
+ * @param conn The IPC connection, either end
+ * @param handle The handle returned by the peer's ipc_send_io
+ * @return PtrResult<IO> The IO, the caller owns the reference, or an error code on failure
+ */
+PtrResult<IO> ipc_receive_io(IO *conn, u32 handle);
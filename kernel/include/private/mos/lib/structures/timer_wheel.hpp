@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/lib/structures/list.hpp>
+#include <mos/moslib_global.hpp>
+#include <mos/types.hpp>
+
+/**
+ * @defgroup timer_wheel libs.TimerWheel
+ * @ingroup libs
+ * @brief A hierarchical timer wheel, with O(1) insertion and removal.
+ *
+ * @details Level L has TIMER_WHEEL_SLOTS slots, each covering 64^L units of time, so an entry
+ *          lands in a slot of the level matching how far away it expires. Entries of the higher
+ *          levels are cascaded into the lower ones when the wheel reaches their slot, and entries
+ *          expire from level 0, whose slots are a single unit wide, so expiry is exact.
+ *          The wheel is not thread-safe, the caller provides the locking.
+ * @{
+ */
+
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 6
+
+/// entries further away than this are parked in the last level, and re-cascaded until they're due
+#define TIMER_WHEEL_MAX_DELTA ((1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+#define TIMER_WHEEL_NEVER ((u64) -1)
+#define TIMER_WHEEL_DUE   (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS) ///< index of entries added after they expired
+
+typedef struct
+{
+    as_linked_list;
+    u64 expires; ///< in the units of the wheel
+    u16 index;   ///< level * TIMER_WHEEL_SLOTS + slot, or TIMER_WHEEL_DUE, valid while the entry is in the wheel
+} timer_wheel_entry_t;
+
+typedef struct
+{
+    u64 clk;                         ///< the next unit of time to be processed
+    u64 pending[TIMER_WHEEL_LEVELS]; ///< a bit for each non-empty slot
+    list_head slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    list_head due; ///< entries that expired before they were added
+    size_t count;  ///< number of entries in the wheel
+} timer_wheel_t;
+
+MOSAPI void timer_wheel_init(timer_wheel_t *wheel, u64 now);
+
+/**
+ * @brief Add an entry to the wheel, entry->expires must be set
+ * @note An entry that has already expired expires on the next timer_wheel_advance
+ */
+MOSAPI void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_entry_t *entry);
+
+/**
+ * @brief Remove an entry from the wheel, it must be in the wheel
+ */
+MOSAPI void timer_wheel_remove(timer_wheel_t *wheel, timer_wheel_entry_t *entry);
+
+/**
+ * @brief Get the earliest expiry time of all entries, or TIMER_WHEEL_NEVER if the wheel is empty
+ */
+MOSAPI u64 timer_wheel_next_expiry(const timer_wheel_t *wheel);
+
+/**
+ * @brief Advance the wheel to 'now', moving all entries that expire at or before 'now' to 'expired'
+ *
+ * @return number of expired entries
+ */
+MOSAPI size_t timer_wheel_advance(timer_wheel_t *wheel, u64 now, list_head *expired);
+
+/** @} */
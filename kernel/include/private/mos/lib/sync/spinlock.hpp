@@ -68,6 +68,13 @@ struct spinlock_t
 #define spinlock_acquire_nodebug(lock) _spinlock_real_acquire(lock)
 #define spinlock_release_nodebug(lock) _spinlock_real_release(lock)
 
+/// acquire the lock only if it's free, returns whether it was acquired (the debug file/line isn't recorded)
+should_inline bool spinlock_try_acquire(spinlock_t *lock)
+{
+    barrier();
+    return !__atomic_test_and_set(&lock->flag, __ATOMIC_ACQUIRE);
+}
+
 should_inline bool spinlock_is_locked(const spinlock_t *lock)
 {
     return lock->flag;
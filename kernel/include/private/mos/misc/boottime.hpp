@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.hpp>
+
+#define BOOTTIME_MAX_RECORDS 512
+
+/**
+ * @brief Record a boot stage in the boot timeline, exported as /sys/boottime/timeline
+ *
+ * @details Usable from the very beginning of the boot, before any allocator is available.
+ *
+ * @param stage the kind of the stage, e.g. "init.vfs", "setup" or "ap", must be a static string
+ * @param name what ran in the stage, must be a static string
+ * @param start timestamp (\see platform_get_timestamp) of the beginning of the stage
+ * @param end timestamp of the end of the stage
+ */
+void boottime_record(const char *stage, const char *name, u64 start, u64 end);
@@ -10,7 +10,8 @@ typedef struct
     const char *name;
 } kallsyms_t;
 
-extern const kallsyms_t mos_kallsyms[];
+extern const kallsyms_t mos_kallsyms[]; ///< sorted by address, terminated by a NULL name
+extern const size_t mos_kallsyms_count;   ///< not counting the terminator
 
 #define mos_caller() (kallsyms_get_symbol_name((ptr_t) __builtin_return_address(0)))
 
@@ -10,11 +10,37 @@ typedef u64 pf_point_t;
 #if MOS_CONFIG(MOS_PROFILING)
 #include "mos/platform/platform.hpp"
 
+#include <mos/misc/profiling.h>
+#include <mos_stdio.hpp>
+
+#define PROFILE_NAME_MAX_ARGS 4
+#define PROFILE_NAME_MAX_LEN  64
+
+extern bool profile_enabled;
+
+/**
+ * @brief Look up the name id of an event, by its format string and the raw values of its arguments
+ *
+ * @return the id, or 0 if the name hasn't been interned yet
+ */
+u32 profile_name_lookup(const char *fmt, const u64 *args, size_t nargs);
+
+/**
+ * @brief Add the formatted name of an event to the name table
+ *
+ * @return the id of the name, PROFILE_NAME_OTHER if the table is full
+ */
+u32 profile_name_intern(const char *fmt, const u64 *args, size_t nargs, const char *name);
+
+/**
+ * @brief Record an event in the current CPU's ring
+ */
+void profile_record(pf_point_t start, pf_point_t end, u32 name);
+
 /**
  * @brief Enter a profiling scope
  *
- * @param name Scope name
- * @return id_t The scope ID used to exit the scope
+ * @return pf_point_t The start of the scope, to be passed to profile_leave
  */
 should_inline pf_point_t profile_enter(void)
 {
@@ -24,9 +50,32 @@ should_inline pf_point_t profile_enter(void)
 /**
  * @brief Exit a profiling scope
  *
- * @param id Scope ID
+ * @details The name is only formatted the first time a format string is seen with these arguments, the
+ *          event then refers to it by id. Strings are compared by address, they must not change.
+ *
+ * @param start The start of the scope
+ * @param fmt Format of the name of the event
  */
-void profile_leave(pf_point_t point, const char *fmt, ...) __printf(2, 3);
+template<typename... Args>
+void profile_leave(pf_point_t start, const char *fmt, Args... args)
+{
+    static_assert(sizeof...(Args) <= PROFILE_NAME_MAX_ARGS, "too many arguments for a profiling event");
+
+    const pf_point_t end = platform_get_timestamp();
+    if (!profile_enabled)
+        return;
+
+    const u64 key[] = { (u64) args..., 0 }; // never empty
+    u32 name = profile_name_lookup(fmt, key, sizeof...(Args));
+    if (unlikely(!name))
+    {
+        char buf[PROFILE_NAME_MAX_LEN];
+        snprintf(buf, sizeof(buf), fmt, args...);
+        name = profile_name_intern(fmt, key, sizeof...(Args), buf);
+    }
+
+    profile_record(start, end, name);
+}
 
 #else
 
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/platform/platform.hpp"
+
+#include <mos/types.hpp>
+
+#define SAMPLER_MAX_DEPTH 16
+
+/**
+ * @brief Take a sample of the interrupted context, if the sampling profiler is running
+ *
+ * @details Called by the platform's timer interrupt handler, on every tick.
+ */
+void sampler_tick(const platform_regs_t *regs);
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Per-CPU rings of binary trace events, and writing them out to sysfs as a trace (see mos/misc/trace.h)
+
+#pragma once
+
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/platform/platform.hpp"
+
+#include <algorithm>
+#include <mos/misc/trace.h>
+#include <mos_string.hpp>
+
+/**
+ * @brief A ring of trace events of one CPU, the oldest events are overwritten when it's full
+ */
+template<typename TEvent, size_t N>
+struct TraceRing
+{
+    u64 head; ///< total number of events recorded, the ring holds the last N of them
+    TEvent events[N];
+
+    /**
+     * @brief Claim the slot of the next event, on the current CPU
+     *
+     * @details An interrupt may claim another slot before this one is filled in.
+     */
+    TEvent *next()
+    {
+        const u64 index = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+        return &events[index % N];
+    }
+};
+
+/**
+ * @brief Take the heads of all the rings and fill in the header of a trace of them
+ *
+ * @details The events are then written with trace_rings_put_events, using the same heads. Events recorded
+ *          meanwhile may be torn, recording should be stopped first for a consistent trace.
+ *
+ * @param heads receives the head of each CPU's ring, room for MOS_MAX_CPU_COUNT
+ */
+template<typename TEvent, size_t N, size_t NCPU>
+trace_header_t trace_rings_snapshot(const TraceRing<TEvent, N> (&rings)[NCPU], const char *magic, u32 version, u64 *heads)
+{
+    trace_header_t header = {
+        .version = version,
+        .n_cpus = platform_info->num_cpus,
+        .timestamp_hz = platform_get_timestamp_frequency(),
+    };
+    memcpy(header.magic, magic, sizeof(header.magic));
+
+    u64 n_events = 0;
+    for (u32 cpu = 0; cpu < header.n_cpus; cpu++)
+    {
+        heads[cpu] = __atomic_load_n(&rings[cpu].head, __ATOMIC_ACQUIRE);
+        n_events += std::min<u64>(heads[cpu], N);
+        header.lost += heads[cpu] > N ? heads[cpu] - N : 0;
+    }
+    header.n_events = (u32) n_events;
+    return header;
+}
+
+/**
+ * @brief Write out the events of all the rings up to the heads, CPU after CPU, each from the oldest to the newest
+ */
+template<typename TEvent, size_t N, size_t NCPU>
+void trace_rings_put_events(sysfs_file_t *f, const TraceRing<TEvent, N> (&rings)[NCPU], const u64 *heads)
+{
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const TraceRing<TEvent, N> *ring = &rings[cpu];
+        const u64 head = heads[cpu];
+        const u64 first = head > N ? head - N : 0;
+
+        // at most two contiguous runs, before and after the wrap-around
+        const size_t start = first % N, count = head - first;
+        const size_t run = std::min<size_t>(count, N - start);
+        sysfs_put_data(f, &ring->events[start], run * sizeof(TEvent));
+        sysfs_put_data(f, &ring->events[0], (count - run) * sizeof(TEvent));
+    }
+}
+
+/**
+ * @brief Empty all the rings, to start a new trace
+ */
+template<typename TEvent, size_t N, size_t NCPU>
+void trace_rings_reset(TraceRing<TEvent, N> (&rings)[NCPU])
+{
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+        __atomic_store_n(&rings[cpu].head, 0, __ATOMIC_RELEASE);
+}
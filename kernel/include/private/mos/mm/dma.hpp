@@ -2,8 +2,11 @@
 
 #pragma once
 
+#include <mos/mm/mm_types.h>
 #include <mos/types.hpp>
 
+struct MMContext;
+
 /**
  * @brief Allocate DMA pages
  *
@@ -18,3 +21,30 @@ bool dmabuf_free(ptr_t vaddr, ptr_t paddr);
 pfn_t dmabuf_share(void *buffer, size_t size);
 
 bool dmabuf_unshare(ptr_t phys, size_t size, void *virt);
+
+/**
+ * @brief Pin the pages of a user buffer, so that a device can access them in place
+ *
+ * @details The pages are faulted in (and copied-on-write first, if the device will write to them),
+ *          and stay allocated until dmabuf_unpin() is called or the address space is destroyed.
+ *          Physically adjacent pages are described by a single segment.
+ *
+ * @param buffer The user buffer
+ * @param size Size of the buffer, in bytes
+ * @param device_writes Whether the device will write to the buffer
+ * @param segments Receives the physical segments of the buffer
+ * @param max_segments Capacity of segments
+ * @return the number of segments describing the buffer, or a negative error code. If it's larger than
+ *         max_segments the buffer is not pinned, so the caller can retry with a larger array or bounce.
+ */
+long dmabuf_pin(void *buffer, size_t size, bool device_writes, dma_segment_t *segments, size_t max_segments);
+
+/**
+ * @brief Unpin a buffer previously pinned with dmabuf_pin(), with the same address and size
+ */
+bool dmabuf_unpin(void *buffer, size_t size);
+
+/**
+ * @brief Drop all pins of an address space that is being destroyed
+ */
+void dmabuf_release_pins(MMContext *mmctx);
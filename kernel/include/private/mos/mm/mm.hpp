@@ -41,6 +41,7 @@ typedef struct
     const platform_regs_t *regs;    ///< the registers of the moment that caused the fault
     phyframe_t *faulting_page;      ///< the frame that contains the copy-on-write data (if any)
     const phyframe_t *backing_page; ///< the frame that contains the data for this page, the on_fault handler should set this
+    vmfault_type_t type;            ///< what the fault is, the on_fault handler should set this, VMFAULT_TYPE_OTHER by default
 } pagefault_t;
 
 typedef enum
@@ -72,6 +73,7 @@ struct vmap_t : mos::NamedType<"VMap">
     vmap_content_t content;
     vmap_type_t type;
     vmap_stat_t stat;
+    vmfault_stat_t fault_stat;
     vmfault_handler_t on_fault;
 
     friend mos::SyslogStreamWriter operator<<(mos::SyslogStreamWriter stream, const vmap_t *vmap)
@@ -88,8 +90,23 @@ struct vmap_t : mos::NamedType<"VMap">
 
 phyframe_t *mm_get_free_page(void);
 phyframe_t *mm_get_free_page_raw(void);
+phyframe_t *mm_get_free_user_page(void); // zeroed, never sleeps, see mm_wait_for_user_pages
 phyframe_t *mm_get_free_pages(size_t npages);
 
+/**
+ * @brief When memory runs low, give kswapd a chance to make room before user pages are allocated from the reserve
+ * @note This sleeps, so it must be called without any locks held, e.g. before a fault takes the mm locks
+ */
+void mm_wait_for_user_pages(void);
+
+/**
+ * @brief Copy to or from a buffer in the current process, which must be mapped (and writable, to copy to it)
+ *
+ * @return long 0 on success, -EFAULT if the buffer isn't (entirely) a valid user buffer
+ */
+long mm_copy_to_user(void *user_dst, const void *src, size_t size);
+long mm_copy_from_user(void *dst, const void *user_src, size_t size);
+
 #define mm_free_page(frame)          pmm_free_frames(frame, 1)
 #define mm_free_pages(frame, npages) pmm_free_frames(frame, npages)
 
@@ -181,7 +198,7 @@ void vmap_finalise_init(vmap_t *vmap, vmap_content_t content, vmap_type_t type);
  * @param vmap The vmap object
  * @param fault_addr The fault address
  * @param info The page fault info
- * @return vmfault_result_t always VMFAULT_COMPLETE
+ * @return vmfault_result_t VMFAULT_COMPLETE, or VMFAULT_CANNOT_HANDLE if there's no memory for the copy
  */
 [[nodiscard("resolve completed")]] vmfault_result_t mm_resolve_cow_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info);
 
@@ -59,13 +59,58 @@ void mmstat_dec(mmstat_type_t type, size_t size);
  *  Shared Anonymous:
  *      NOT IMPLEMENTED (yet)
  *
+ *  Private Anonymous pages can also be swapped out:
+ *      Swapped out regular--, swap++ (the page is no longer mapped, its PTE holds the swap slot)
+ *      Swapped in  swap--, regular++
+ *
  */
 typedef struct
 {
     size_t regular;   ///< regular pages with no special flags being set or unset
     size_t pagecache; ///< pages that are in the page cache (file-backed only)
     size_t cow;       ///< pages that are copy-on-write
+    size_t swap;      ///< pages that are swapped out (private anonymous only)
 } vmap_stat_t;
 
 #define vmap_stat_inc(vmap, type) (vmap)->stat.type += 1
 #define vmap_stat_dec(vmap, type) (vmap)->stat.type -= 1
+
+/**
+ * @brief What a page fault turned out to be.
+ *
+ * @details mm_handle_fault classifies swap-ins, exec fixups and unhandled faults itself, the
+ *          vmap's on_fault handler classifies the rest by setting pagefault_t::type.
+ */
+typedef enum
+{
+    VMFAULT_TYPE_OTHER,   ///< handled by a vmap-specific handler (e.g. IPC shared memory)
+    VMFAULT_TYPE_ZERO,    ///< read of an anonymous page, the zero page is mapped
+    VMFAULT_TYPE_ZOD,     ///< write of an anonymous page, a new page is allocated (zero-on-demand)
+    VMFAULT_TYPE_COW,     ///< write of a copy-on-write page, it is copied
+    VMFAULT_TYPE_FILE,    ///< a file page is mapped, or copied for a private write
+    VMFAULT_TYPE_SWAP,    ///< a swapped-out page is read back
+    VMFAULT_TYPE_EXEC,    ///< a page is made executable, after the vmap has been made executable
+    VMFAULT_TYPE_INVALID, ///< the fault couldn't be handled
+
+    _VMFAULT_TYPE_MAX,
+} vmfault_type_t;
+
+extern const char *vmfault_type_names[_VMFAULT_TYPE_MAX];
+
+/**
+ * @brief Page fault statistics, of a vmap or of a process.
+ */
+typedef struct
+{
+    u64 count[_VMFAULT_TYPE_MAX];
+    u64 time;           ///< total time spent handling faults, in platform timestamp ticks
+    u64 time_max;       ///< the slowest fault
+    u64 tlb_shootdowns; ///< IPIs sent to the other CPUs to invalidate their TLBs
+} vmfault_stat_t;
+
+/**
+ * @brief Account a page fault.
+ *
+ * @details Updated atomically, a process's threads may fault on different CPUs at once.
+ */
+void vmfault_stat_add(vmfault_stat_t *stat, vmfault_type_t type, u64 time, bool tlb_shootdown);
@@ -15,3 +15,10 @@ pml1e_t *pml1_entry(pml1_t pml1, ptr_t vaddr);
 bool pml1e_is_present(const pml1e_t *pml1e);
 
 pfn_t pml1e_get_pfn(const pml1e_t *pml1e);
+
+// a non-present entry may instead hold the slot a page was swapped out to, \see swap.hpp
+bool pml1e_is_swap(const pml1e_t *pml1e);
+
+u64 pml1e_get_swap(const pml1e_t *pml1e);
+
+void pml1e_set_swap(pml1e_t *pml1e, u64 slot);
@@ -13,3 +13,4 @@ void mm_do_copy(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages);
 pfn_t mm_do_get_pfn(pgd_t top, ptr_t vaddr);
 VMFlags mm_do_get_flags(pgd_t max, ptr_t vaddr);
 bool mm_do_get_present(pgd_t max, ptr_t vaddr);
+pml1e_t *mm_do_get_pml1e(pgd_t max, ptr_t vaddr); // NULL if there's no page table for it (yet)
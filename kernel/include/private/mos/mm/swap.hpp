@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/mm/mm.hpp"
+#include "mos/mm/paging/pml_types.hpp"
+
+#include <mos/mm/swap.h>
+
+/**
+ * @defgroup swap Swap
+ * @ingroup mm
+ * @brief Swapping anonymous memory out to a block device
+ *
+ * @details When free memory drops below a low watermark, kswapd looks for cold private anonymous pages and writes
+ *          them to a swap area on a block device (through the blockdev manager), until free memory is back above a
+ *          high watermark. Address spaces are scanned round-robin with a clock: a page accessed since the last
+ *          visit gets its accessed bit cleared and a second chance. An evicted page's PTE holds its slot instead,
+ *          the next fault on it reads it back.
+ *
+ *          Pages being written stay in the swap cache, a fault on them meanwhile takes the page back from there.
+ * @{
+ */
+
+/**
+ * @brief Start swapping to a block device formatted by mkswap
+ *
+ * @param device The name of the device in the blockdev manager
+ * @return 0 on success, or a negative error code
+ */
+long swap_activate(const char *device);
+
+/**
+ * @brief Register a new user address space to be scanned for pages to swap out
+ */
+void swap_register_mm(MMContext *mmctx);
+
+/**
+ * @brief Unregister an address space that is being destroyed
+ */
+void swap_unregister_mm(MMContext *mmctx);
+
+/**
+ * @brief A swap entry has been copied (when forking)
+ */
+void swap_ref_slot(u64 slot);
+
+/**
+ * @brief A swap entry has been dropped, the slot is freed when there are no more references to it
+ */
+void swap_put_slot(u64 slot);
+
+/**
+ * @brief Map a page that has been swapped out back in, without sleeping
+ *
+ * @param vmap The vmap the fault is in, with its lock held
+ * @param fault_addr The faulting address
+ * @param pml1e The PTE of the faulting address, which holds a swap entry
+ * @param page The content of the slot read by swap_read_page, which is consumed, or NULL
+ * @return true if the page has been mapped, false if it has to be read with swap_read_page first
+ */
+bool swap_in(vmap_t *vmap, ptr_t fault_addr, pml1e_t *pml1e, phyframe_t *page);
+
+/**
+ * @brief Read a copy of a swapped-out page, this sleeps, so no locks may be held
+ * @note The caller holds a reference to the slot, so that it can't be reused meanwhile
+ *
+ * @return A new page with the content of the slot, or NULL if it couldn't be read
+ */
+phyframe_t *swap_read_page(u64 slot);
+
+/**
+ * @brief Whether an allocation for a user page should wait for kswapd first, to keep a reserve for the swap path
+ */
+bool swap_should_throttle(void);
+
+/**
+ * @brief Wake kswapd because free memory is low, and wait for it to reclaim some
+ *
+ * @return false if there's nothing to wait for (swap is not active)
+ */
+bool swap_wait_for_memory(void);
+
+/** @} */
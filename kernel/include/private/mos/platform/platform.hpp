@@ -63,6 +63,11 @@ struct MMContext : mos::NamedType<"MMContext">
     spinlock_t mm_lock = SPINLOCK_INIT; ///< protects [pgd] and the [mmaps] list (the list itself, not the vmap_t objects)
     pgd_t pgd = { 0 };
     list_head mmaps;
+    list_head dma_pins; ///< buffers pinned for DMA, \see dmabuf_pin, protected by [mm_lock]
+
+    as_linked_list;           ///< in the list of user address spaces kswapd scans, \see swap.hpp
+    ptr_t swap_cursor = 0;    ///< where kswapd continues scanning this address space
+    bool swap_exempt = false; ///< never swap out pages of this address space
 };
 
 extern MMContext mos_kernel_mm;
@@ -150,18 +155,44 @@ void platform_dump_stack(const platform_regs_t *regs);
 void platform_dump_current_stack();
 void platform_dump_thread_kernel_stack(const Thread *thread);
 
+/**
+ * @brief Collect the interrupted instruction pointer and the return addresses of its frame-pointer stack
+ *
+ * @details Safe to call from an interrupt handler: it doesn't print, take locks or fault, the walk stops at
+ *          the first frame that isn't mapped.
+ *
+ * @param regs The interrupted context
+ * @param ips Receives the instruction pointer, then the return addresses, innermost first
+ * @param max Size of @p ips
+ * @param user Set to whether the context was in userspace
+ * @return the number of addresses collected
+ */
+size_t platform_unwind_stack(const platform_regs_t *regs, ptr_t *ips, size_t max, bool *user);
+
 // Platform Timer/Clock APIs
 // default implementation does nothing
 void platform_get_time(timeval_t *val);
 void platform_get_unix_timestamp(u64 *timestamp);
 
+/**
+ * @brief Frequency of platform_get_timestamp, in ticks per second
+ */
+u64 platform_get_timestamp_frequency(void);
+
+/**
+ * @brief Program the current CPU's timer interrupt to fire once, at the given platform timestamp
+ *
+ * @param timestamp when to fire, a timestamp in the past fires as soon as possible, 0 disarms the timer
+ */
+void platform_timer_set_deadline(u64 timestamp);
+
 // Platform CPU APIs
 // default implementation loops forever
 [[noreturn]] void platform_halt_cpu(void);
 // default implementation does nothing for 4 functions below
 void platform_invalidate_tlb(ptr_t vaddr);
 u32 platform_current_cpu_id(void);
-void platform_cpu_idle(void);
+void platform_cpu_idle(void); // enable interrupts and wait for one, atomically
 u64 platform_get_timestamp(void);
 
 typedef char datetime_str_t[32];
@@ -172,6 +203,13 @@ datetime_str_t *platform_get_datetime_str(void);
 void platform_interrupt_enable(void);
 void platform_interrupt_disable(void);
 
+// Platform Device Interrupt APIs
+// interrupts routed this way are delivered to interrupt_entry() with the returned irq number
+bool platform_irq_enable(u32 irq);                // route a (legacy) interrupt line, returns false if there is no such line
+void platform_irq_disable(u32 irq);               //
+long platform_msi_alloc(u64 *address, u32 *data); // allocate a message-signalled interrupt, returns the irq number or an error
+void platform_msi_free(u32 irq);                  //
+
 // Platform Page Table APIs
 // no default implementation, platform-specific implementations must be provided
 pfn_t platform_pml1e_get_pfn(const pml1e_t *pml1);           // returns the physical address contained in the pmlx entry,
@@ -179,6 +217,7 @@ void platform_pml1e_set_pfn(pml1e_t *pml1, pfn_t pfn);       // -- which can be
 bool platform_pml1e_get_present(const pml1e_t *pml1);        // returns if an entry in this page table is present
 void platform_pml1e_set_flags(pml1e_t *pml1, VMFlags flags); // set bits in the flags field of the pmlx entry
 VMFlags platform_pml1e_get_flags(const pml1e_t *pml1e);      // get bits in the flags field of the pmlx entry
+bool platform_pml1e_test_and_clear_accessed(pml1e_t *pml1e); // returns if the page was accessed since the last call
 
 #if MOS_PLATFORM_PAGING_LEVELS >= 2
 pml1_t platform_pml2e_get_pml1(const pml2e_t *pml2);
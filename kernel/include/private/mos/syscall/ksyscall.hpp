@@ -5,3 +5,10 @@
 #include <mos/types.hpp>
 
 reg_t ksyscall_enter(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6);
+
+/**
+ * @brief Account a syscall in the per-CPU syscall statistics, and in the current process's
+ *
+ * @param time Time spent in the syscall, in platform timestamp ticks
+ */
+void ksyscall_account(reg_t number, reg_t ret, u64 time);
@@ -41,6 +41,7 @@
     X(signal)       \
     X(slab)         \
     X(spinlock)     \
+    X(swap)         \
     X(syscall)      \
     X(sysfs)        \
     X(thread)       \
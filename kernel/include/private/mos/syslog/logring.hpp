@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/syslog/syslog.hpp"
+
+#include <mos/types.hpp>
+#include <stdarg.h>
+
+/**
+ * @defgroup logring Log rings
+ * @ingroup syslog
+ * @brief Per-CPU lock-free buffers of binary log records
+ *
+ * @details A message is stored as a compact binary record: its timestamp, level, feature, source location,
+ *          the thread that logged it, the format string and the raw arguments. Strings passed as arguments
+ *          are copied into the record, they may not outlive the call. Formatting is deferred to whoever
+ *          drains the rings (klogd), which takes it off the logging CPU.
+ *
+ *          Messages that can't be deferred (e.g. '%pt', which dereferences a live object) are formatted
+ *          immediately and stored as text instead.
+ *
+ *          Space is reserved with a compare-and-swap on the ring's head, so a record can be written from
+ *          any context (including interrupt handlers) without a lock; a record is visible to the consumer
+ *          once it's committed. When a ring is full, the record isn't stored, and is counted.
+ * @{
+ */
+
+#define SYSLOG_RECORD_MAX_ARGS 12
+#define SYSLOG_RECORD_NAME_LEN 16
+
+enum syslog_record_flags : u8
+{
+    SYSLOG_RECORD_PADDING = 1 << 0,      ///< not a record, skips to the end of the ring
+    SYSLOG_RECORD_PREFORMATTED = 1 << 1, ///< the text is the formatted message, there's no format
+    SYSLOG_RECORD_RAW = 1 << 2,          ///< print the text as is, without a prefix (from a SyslogStreamWriter)
+    SYSLOG_RECORD_PRINTED = 1 << 3,      ///< already printed synchronously, only to be forwarded to the sink
+};
+
+typedef struct
+{
+    u32 size;     ///< of the whole record, including the text, always a multiple of 8
+    u8 committed; ///< set by the producer once the record is complete
+    u8 flags;
+    u8 level;
+    u8 nargs;
+
+    u64 timestamp;
+    const debug_info_entry *feat;
+    const char *file, *func, *fmt; ///< all static strings
+    u32 line;
+    u32 cpu_id;
+    tid_t tid;
+    pid_t pid;
+    char thread_name[SYSLOG_RECORD_NAME_LEN];
+    char process_name[SYSLOG_RECORD_NAME_LEN];
+
+    u64 args[SYSLOG_RECORD_MAX_ARGS]; ///< '%s' arguments are offsets into text
+    u32 text_len;
+    char text[];
+} syslog_record_t;
+
+typedef struct
+{
+    u64 records;      ///< records written
+    u64 preformatted; ///< of which had to be formatted by the producer
+    u64 dropped;      ///< records that didn't fit because the ring was full, only debug messages are lost
+    size_t used;      ///< bytes currently in the ring
+} syslog_ring_stat_t;
+
+/**
+ * @brief Fill in the header of a record for the current thread
+ */
+void syslog_record_init(syslog_record_t *record, LogLevel level, const debug_info_entry *feat, u8 flags);
+
+/**
+ * @brief Store a message in the current CPU's ring
+ *
+ * @param flags SYSLOG_RECORD_PRINTED if it has been printed already, 0 otherwise
+ * @return false if the record has been dropped
+ */
+bool syslog_ring_emit(LogLevel level, const char *file, const char *func, int line, const debug_info_entry *feat, u8 flags, const char *fmt, va_list args);
+
+/**
+ * @brief Store some text that is already formatted in the current CPU's ring
+ *
+ * @param flags SYSLOG_RECORD_RAW if the text should be printed without a prefix
+ * @return false if the record has been dropped
+ */
+bool syslog_ring_emit_text(LogLevel level, const debug_info_entry *feat, u8 flags, const char *text, size_t len);
+
+/**
+ * @brief Take the oldest committed record from all the rings, and format it
+ *
+ * @details There must be only one consumer at a time, the caller serialises calls.
+ *
+ * @param record Receives the record's header, its strings are still valid after the call
+ * @param buf Receives the formatted message
+ * @return the length of the message, or -1 if there's no record left
+ */
+ssize_t syslog_ring_pop(syslog_record_t *record, char *buf, size_t size);
+
+void syslog_ring_get_stat(u32 cpu, syslog_ring_stat_t *stat);
+
+/** @} */
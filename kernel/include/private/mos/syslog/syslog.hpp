@@ -163,3 +163,18 @@ DefineLogStream(Cont, UNSET);
 #define fmt(_fmt, ...) mos::Preformatted(formatted_type(_fmt ""), ##__VA_ARGS__)
 
 long do_syslog(LogLevel level, const char *file, const char *func, int line, const debug_info_entry *feat, const char *fmt, ...);
+
+/// receives every kernel message after it has been printed, e.g. to forward it to syslogd
+typedef void (*syslog_sink_t)(const struct _pb_syslog_message *msg);
+
+void syslog_set_sink(syslog_sink_t sink);
+
+/**
+ * @brief Print the messages that klogd hasn't printed yet
+ */
+void syslog_flush(void);
+
+/**
+ * @brief Flush the log rings, and print every message synchronously from now on
+ */
+void syslog_enter_panic(void);
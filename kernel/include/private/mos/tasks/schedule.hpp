@@ -41,6 +41,14 @@ void scheduler_remove_thread(Thread *thread);
  */
 void scheduler_wake_thread(Thread *thread);
 
+/**
+ * @brief Mark the current CPU as idle, unless a thread is waiting to run
+ * @note Called by the idle thread with interrupts disabled, a CPU marked as idle is woken up when a thread becomes ready.
+ *
+ * @return true if the CPU is idle and can go to sleep, false if it should reschedule
+ */
+bool scheduler_idle_enter(void);
+
 /**
  * @brief reschedule.
  * @warning The caller must have the current thread's state_lock acquired.
@@ -54,3 +62,24 @@ void reschedule(void);
 void blocked_reschedule(void);
 
 __nodiscard bool reschedule_for_waitlist(waitlist_t *waitlist);
+
+/**
+ * @brief Account a context switch to both threads, and trace it
+ *
+ * @param prev The thread leaving the CPU, in the state it is left in, may be NULL
+ * @param next The thread about to run
+ * @param voluntary Whether prev gave up the CPU itself, rather than being preempted
+ */
+void sched_account_switch(Thread *prev, Thread *next, bool voluntary);
+
+/**
+ * @brief Record that a thread is ready to run, and trace it if it's been woken up
+ */
+void sched_account_ready(Thread *thread, bool wakeup);
+
+/**
+ * @brief Charge a timer tick to the current thread
+ *
+ * @param user Whether the tick interrupted userspace
+ */
+void sched_account_tick(bool user);
@@ -18,6 +18,7 @@ typedef struct _scheduler_ops
     Thread *(*select_next)(scheduler_t *instance);
     void (*add_thread)(scheduler_t *instance, Thread *thread);    ///< Add a thread to the scheduler
     void (*remove_thread)(scheduler_t *instance, Thread *thread); ///< Remove a thread from the scheduler
+    bool (*has_threads)(scheduler_t *instance);                   ///< Whether any thread is waiting to run
 } scheduler_ops_t;
 
 typedef struct _scheduler
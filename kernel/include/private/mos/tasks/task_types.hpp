@@ -3,6 +3,7 @@
 #pragma once
 
 #include "mos/filesystem/vfs_types.hpp"
+#include "mos/mm/mmstat.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/syslog/syslog.hpp"
 #include "mos/tasks/wait.hpp"
@@ -38,6 +39,23 @@ typedef struct
     waitlist_t sigchild_waitlist;       ///< the parent is waiting for a child to exit, if not empty
 } process_signal_info_t;
 
+typedef struct
+{
+    u64 count;  ///< syscalls made by all the threads of the process
+    u64 errors; ///< of which returned an error
+    u64 time;   ///< total time spent in them, in platform timestamp ticks
+} process_syscall_stat_t;
+
+typedef struct
+{
+    u64 user_ticks, sys_ticks; ///< timer ticks that interrupted the thread in user/kernel mode
+    u64 runtime;               ///< time spent on a CPU, in platform timestamp ticks, up to the last switch
+    u64 nvcsw, nivcsw;         ///< voluntary (blocked, exited) and involuntary (preempted) context switches
+    u64 wait_time, wait_max;   ///< time spent ready but waiting for a CPU
+    u64 last_run;              ///< when it was last switched to
+    u64 ready_since;           ///< when it was last made ready, 0 if it isn't waiting for a CPU
+} thread_sched_stat_t;
+
 struct fd_type
 {
     IO *io;
@@ -77,8 +95,13 @@ struct Process : mos::NamedType<"Process">
 
     platform_process_options_t platform_options; ///< platform per-process flags
 
+    bool privileged; ///< may use the system-wide syscalls (swapon, irq_open...), inherited, until privilege_drop
+
     process_signal_info_t signal_info; ///< signal handling info
 
+    process_syscall_stat_t syscall_stat = {}; ///< updated atomically, threads may be on different CPUs
+    vmfault_stat_t fault_stat = {};           ///< page faults of all the threads, in all the vmaps
+
   public:
     static inline bool IsValid(const Process *process)
     {
@@ -128,6 +151,8 @@ struct Thread : mos::NamedType<"Thread">
 
     thread_signal_info_t signal_info;
 
+    thread_sched_stat_t sched_stat = {}; ///< updated by the CPU the thread is on, or is being scheduled on
+
     ~Thread();
 
     static bool IsValid(const Thread *thread)
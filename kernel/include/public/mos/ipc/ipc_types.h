@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// This file defines the flags and shared-memory layout of IPC connections.
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+typedef enum
+{
+    IPC_CONNECT_NONE = 0,
+    IPC_CONNECT_SHM_RING = 1 << 0, // also create a pair of shared-memory rings for the connection
+} ipc_connect_flags_t;
+
+#define IPC_SHM_MAGIC   MOS_FOURCC('I', 'S', 'H', 'M')
+#define IPC_SHM_VERSION 1
+
+typedef enum
+{
+    IPC_SHM_RING_CLIENT_TO_SERVER = 0,
+    IPC_SHM_RING_SERVER_TO_CLIENT = 1,
+} ipc_shm_ring_id_t;
+
+/**
+ * @brief A single-producer single-consumer byte ring living in the shared area
+ *
+ * @details head and tail are free-running byte counters, the ring is empty when they are
+ *          equal. Each is written by only one party, so no locking is needed.
+ *
+ *          A party that has to sleep raises its *_waiting flag, re-checks the ring and then
+ *          futex-waits on the corresponding doorbell. The other party bumps the doorbell and
+ *          calls futex_wake only if it sees the flag, so the kernel is entered only when
+ *          someone actually sleeps.
+ */
+typedef struct
+{
+    u32 head;                   ///< written by the producer
+    u32 consumer_waiting;       ///< set by the consumer before it sleeps on data_doorbell
+    futex_word_t data_doorbell; ///< bumped by the producer when data becomes available
+    u32 _pad0[13];
+
+    u32 tail;                    ///< written by the consumer
+    u32 producer_waiting;        ///< set by the producer before it sleeps on space_doorbell
+    futex_word_t space_doorbell; ///< bumped by the consumer when space becomes available
+    u32 _pad1[13];
+} ipc_shm_ring_t;
+
+MOS_STATIC_ASSERT(sizeof(ipc_shm_ring_t) == 128, "ipc_shm_ring_t should be two cache lines");
+
+/**
+ * @brief The header page of an IPC shared-memory area
+ *
+ * @details The area is laid out as [header page][client-to-server data][server-to-client data],
+ *          it is initialised by the kernel when the connection is accepted, and can be mapped
+ *          by mmap'ing the connection fd at offset 0 with MMAP_SHARED.
+ */
+typedef struct
+{
+    u32 magic;          ///< IPC_SHM_MAGIC
+    u32 version;        ///< IPC_SHM_VERSION
+    u32 ring_size;      ///< size of each data region in bytes, a power of two
+    u32 closed;         ///< set by the kernel when either end of the connection is closed
+    u64 data_offset[2]; ///< offset of each ring's data region from the start of the area
+    ipc_shm_ring_t rings[2];
+} ipc_shm_header_t;
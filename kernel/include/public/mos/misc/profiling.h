@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// This file defines the layout of /sys/profiling/trace, as decoded by scripts/profile-trace.py.
+
+#pragma once
+
+#include <mos/misc/trace.h>
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+#define PROFILE_TRACE_MAGIC   "MOSPROF1"
+#define PROFILE_TRACE_VERSION 3
+
+#define PROFILE_NAME_OTHER ((u32) -1) ///< events whose name didn't fit in the name table
+
+/**
+ * @brief The header of a trace
+ *
+ * @details It is followed by n_names names (a profile_trace_name_t, then the name itself without a NUL),
+ *          then by the events.
+ */
+typedef struct
+{
+    trace_header_t common; ///< with PROFILE_TRACE_MAGIC
+    u32 n_names;
+    u32 reserved;
+} __packed profile_trace_header_t;
+
+typedef struct
+{
+    u32 id;
+    u32 len;
+} __packed profile_trace_name_t;
+
+typedef struct
+{
+    u64 start, end; ///< timestamps (TSC ticks on x86_64)
+    u32 name;       ///< an id from the name table
+    s32 tid;        ///< 0 if there's no current thread
+    u32 cpu;
+    u32 reserved;
+} __packed profile_event_t;
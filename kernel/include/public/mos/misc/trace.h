@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// This file defines the header shared by the binary traces in sysfs (/sys/sched/trace, /sys/profiling/trace).
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+/**
+ * @brief The header every binary trace starts with
+ *
+ * @details What follows it depends on the magic, the events always come last, CPU after CPU,
+ *          each CPU's events from the oldest to the newest.
+ */
+typedef struct
+{
+    char magic[8];    ///< identifies the trace, without the terminating NUL
+    u32 version;      ///< of the trace identified by the magic
+    u32 n_cpus;
+    u32 n_events;
+    u32 reserved;
+    u64 lost;         ///< events overwritten before they could be read
+    u64 timestamp_hz; ///< timestamp ticks per second
+} __packed trace_header_t;
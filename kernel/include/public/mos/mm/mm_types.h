@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <mos/types.h>
+
 typedef enum
 {
     MEM_PERM_NONE = 0,
@@ -17,3 +19,12 @@ typedef enum
     MMAP_PRIVATE = 1 << 1, // the memory is private, and will be CoWed when forking
     MMAP_SHARED = 1 << 2,  // the memory is shared when forking
 } mmap_flags_t;
+
+/**
+ * @brief A physically contiguous part of a pinned buffer, \see dmabuf_pin
+ */
+typedef struct
+{
+    ptr_t address; // physical address
+    size_t size;   // in bytes
+} dma_segment_t;
@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// This file defines the layout of a swap area, as written by mkswap and checked by swapon.
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+#define SWAP_MAGIC   "MOSSWAP1"
+#define SWAP_VERSION 1
+
+/**
+ * @brief The header of a swap area, at the start of its first page
+ *
+ * @details The area is divided into page-sized slots, slot N starts at byte N * page_size of the device.
+ *          Slot 0 holds this header (the rest of that page is zero), so it never holds a page.
+ */
+typedef struct
+{
+    char magic[8]; ///< SWAP_MAGIC, without the terminating NUL
+    u32 version;   ///< SWAP_VERSION
+    u32 page_size; ///< the page size of the system that created the area
+    u64 n_slots;   ///< number of slots, including the header
+} __packed swap_header_t;
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// This file defines the layout of /sys/sched/trace, as decoded by scripts/sched-trace.py.
+
+#pragma once
+
+#include <mos/misc/trace.h>
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+#define SCHED_TRACE_MAGIC   "MOSSCHD1"
+#define SCHED_TRACE_VERSION 2
+
+// a trace is a trace_header_t with SCHED_TRACE_MAGIC, followed by its n_events events
+
+typedef enum
+{
+    SCHED_TRACE_SWITCH = 1, ///< a CPU switched from prev_tid to next_tid
+    SCHED_TRACE_WAKEUP = 2, ///< prev_tid (0 if from an interrupt handler or kernel code) woke next_tid up
+} sched_trace_type_t;
+
+typedef struct
+{
+    u64 timestamp;   ///< TSC ticks on x86_64
+    u32 cpu;
+    u8 type;         ///< a sched_trace_type_t
+    char prev_state; ///< SCHED_TRACE_SWITCH: the state prev_tid was left in, as printed by thread_state_str
+    u16 reserved;
+    s32 prev_tid;    ///< 0 if there was no thread
+    s32 next_tid;
+} __packed sched_trace_event_t;
@@ -43,3 +43,41 @@ void interrupt_handler_register(u32 irq, irq_serve_t handler, void *data)
     list_node_append(&irq_handlers, &new_handler->list_node);
     spinlock_release(&irq_handlers_lock);
 }
+
+bool interrupt_handler_register_exclusive(u32 irq, irq_serve_t handler, void *data)
+{
+    interrupt_handler_t *new_handler = mos::create<interrupt_handler_t>();
+    new_handler->irq = irq;
+    new_handler->handler = handler;
+    new_handler->data = data;
+
+    spinlock_acquire(&irq_handlers_lock);
+    list_foreach(interrupt_handler_t, h, irq_handlers)
+    {
+        if (h->irq == irq)
+        {
+            spinlock_release(&irq_handlers_lock);
+            delete new_handler;
+            return false;
+        }
+    }
+
+    list_node_append(&irq_handlers, &new_handler->list_node);
+    spinlock_release(&irq_handlers_lock);
+    return true;
+}
+
+void interrupt_handler_unregister(u32 irq, irq_serve_t handler, void *data)
+{
+    spinlock_acquire(&irq_handlers_lock);
+    list_foreach(interrupt_handler_t, h, irq_handlers)
+    {
+        if (h->irq == irq && h->handler == handler && h->data == data)
+        {
+            list_remove(h);
+            delete h;
+            break;
+        }
+    }
+    spinlock_release(&irq_handlers_lock);
+}
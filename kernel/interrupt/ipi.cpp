@@ -17,11 +17,18 @@ static void ipi_handler_halt(ipi_type_t type)
     platform_halt_cpu();
 }
 
+static u64 tlb_flush_gen = 0;            ///< bumped for each synchronous shootdown
+static PER_CPU_DECLARE(u64, tlb_flushed); ///< the generation each CPU has last flushed its TLB for
+static spinlock_t tlb_sync_lock;          ///< one synchronous shootdown at a time
+
 static void ipi_handler_invalidate_tlb(ipi_type_t type)
 {
     MOS_UNUSED(type);
     pr_dinfo2(ipi, "Received invalidate TLB IPI");
+    // read the generation first, so that the flush is known to have happened after it was bumped
+    const u64 gen = __atomic_load_n(&tlb_flush_gen, __ATOMIC_ACQUIRE);
     platform_invalidate_tlb(0);
+    __atomic_store_n(per_cpu(tlb_flushed), gen, __ATOMIC_RELEASE);
 }
 
 static void ipi_handler_reschedule(ipi_type_t type)
@@ -56,6 +63,26 @@ void ipi_send_all(ipi_type_t type)
     platform_ipi_send(TARGET_CPU_ALL, type);
 }
 
+void ipi_invalidate_tlb_sync(void)
+{
+    spinlock_acquire(&tlb_sync_lock);
+    const u64 gen = __atomic_add_fetch(&tlb_flush_gen, 1, __ATOMIC_ACQ_REL);
+
+    // stay on this CPU, the IPI is sent to all the others, this one acks for itself
+    platform_interrupt_disable();
+    ipi_handler_invalidate_tlb(IPI_TYPE_INVALIDATE_TLB);
+    ipi_send_all(IPI_TYPE_INVALIDATE_TLB);
+
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        while (__atomic_load_n(&tlb_flushed.percpu_value[cpu], __ATOMIC_ACQUIRE) < gen)
+            ;
+    }
+
+    platform_interrupt_enable();
+    spinlock_release(&tlb_sync_lock);
+}
+
 void ipi_do_handle(ipi_type_t type)
 {
     pr_dinfo2(ipi, "Handling IPI of type %d", type);
@@ -83,6 +110,10 @@ void ipi_do_handle(ipi_type_t type)
 
 STUB_FUNCTION(ipi_send, u8 __maybe_unused target, ipi_type_t __maybe_unused type)
 STUB_FUNCTION(ipi_send_all, ipi_type_t __maybe_unused type)
+void ipi_invalidate_tlb_sync(void)
+{
+    platform_invalidate_tlb(0);
+}
 STUB_FUNCTION(ipi_init, )
 STUB_FUNCTION_UNREACHABLE(ipi_do_handle, ipi_type_t __maybe_unused type)
 #endif
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// IO wrapper for device interrupts, for drivers in userspace
+
+#include "mos/interrupt/irq_io.hpp"
+
+#include "mos/interrupt/interrupt.hpp"
+#include "mos/platform/platform.hpp"
+#include "mos/tasks/schedule.hpp"
+#include "mos/tasks/signal.hpp"
+
+#include <mos/allocator.hpp>
+#include <mos_stdio.hpp>
+#include <mos_stdlib.hpp>
+#include <mos_string.hpp>
+
+struct IrqIO : IO, mos::NamedType<"IrqIO">
+{
+    IrqIO(u32 irq, bool is_msi) : IO(IO_READABLE, IO_IRQ), irq(irq), is_msi(is_msi) {};
+    virtual ~IrqIO() {};
+
+    mos::string name() const override
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%s:%u", is_msi ? "msi" : "irq", irq);
+        return buf;
+    }
+
+    static bool on_interrupt(u32 irq, void *data);
+
+    size_t on_read(void *buf, size_t size) override;
+    void on_closed() override;
+
+    const u32 irq;
+    const bool is_msi;
+    bool active = false; // the handler is registered and the interrupt is routed to it
+
+  private:
+    u64 pending = 0;          // interrupts that have not been read yet
+    Thread *waiter = nullptr; // the thread blocked in read, if any
+};
+
+bool IrqIO::on_interrupt(u32 irq, void *data)
+{
+    MOS_UNUSED(irq);
+    IrqIO *io = static_cast<IrqIO *>(data);
+
+    __atomic_add_fetch(&io->pending, 1, __ATOMIC_RELEASE);
+    if (Thread *thread = __atomic_load_n(&io->waiter, __ATOMIC_ACQUIRE))
+        scheduler_wake_thread(thread);
+
+    return true;
+}
+
+size_t IrqIO::on_read(void *buf, size_t size)
+{
+    if (size < sizeof(u64))
+        return -EINVAL;
+
+    Thread *expected = nullptr;
+    if (!__atomic_compare_exchange_n(&waiter, &expected, current_thread, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return -EBUSY; // another thread is already waiting
+
+    u64 count;
+    while (!(count = __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE)))
+    {
+        // hold the state lock from the last check until we are switched out, an interrupt arriving
+        // in between then waits for the thread to be blocked before waking it up, instead of being lost
+        spinlock_acquire(&current_thread->state_lock);
+        if (__atomic_load_n(&pending, __ATOMIC_ACQUIRE))
+        {
+            spinlock_release(&current_thread->state_lock);
+            continue;
+        }
+
+        current_thread->state = THREAD_STATE_BLOCKED;
+        reschedule();
+
+        if (signal_has_pending())
+        {
+            __atomic_store_n(&waiter, nullptr, __ATOMIC_RELEASE);
+            return -EINTR;
+        }
+    }
+
+    __atomic_store_n(&waiter, nullptr, __ATOMIC_RELEASE);
+    memcpy(buf, &count, sizeof(count));
+    return sizeof(count);
+}
+
+void IrqIO::on_closed()
+{
+    if (active)
+    {
+        if (!is_msi)
+            platform_irq_disable(irq);
+        interrupt_handler_unregister(irq, on_interrupt, this);
+    }
+
+    if (is_msi)
+        platform_msi_free(irq);
+
+    delete this;
+}
+
+static void irq_io_discard(IrqIO *io)
+{
+    io->ref();
+    io->unref(); // closes it
+}
+
+PtrResult<IO> irq_io_open(u32 irq)
+{
+    auto io = mos::create<IrqIO>(irq, false);
+    if (io == nullptr)
+        return -ENOMEM;
+
+    if (!interrupt_handler_register_exclusive(irq, IrqIO::on_interrupt, io))
+    {
+        irq_io_discard(io);
+        return -EBUSY; // the kernel, or another driver, handles this interrupt
+    }
+
+    if (!platform_irq_enable(irq))
+    {
+        interrupt_handler_unregister(irq, IrqIO::on_interrupt, io);
+        irq_io_discard(io);
+        return -EINVAL;
+    }
+
+    io->active = true;
+    return io;
+}
+
+PtrResult<IO> irq_io_open_msi(u64 *address, u32 *data)
+{
+    const long irq = platform_msi_alloc(address, data);
+    if (irq < 0)
+        return irq;
+
+    auto io = mos::create<IrqIO>(irq, true);
+    if (io == nullptr)
+    {
+        platform_msi_free(irq);
+        return -ENOMEM;
+    }
+
+    // the vector has just been allocated, nothing else can be handling it
+    io->active = interrupt_handler_register_exclusive(irq, IrqIO::on_interrupt, io);
+    MOS_ASSERT(io->active);
+    return io;
+}
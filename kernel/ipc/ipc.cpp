@@ -8,16 +8,21 @@
 #include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
 #include "mos/filesystem/vfs_types.hpp"
 #include "mos/filesystem/vfs_utils.hpp"
+#include "mos/io/io.hpp"
 #include "mos/ipc/pipe.hpp"
 #include "mos/lib/sync/spinlock.hpp"
+#include "mos/locks/futex.hpp"
+#include "mos/mm/mm.hpp"
 #include "mos/tasks/schedule.hpp"
 #include "mos/tasks/signal.hpp"
 #include "mos/tasks/thread.hpp"
 #include "mos/tasks/wait.hpp"
 
+#include <climits>
 #include <mos/allocator.hpp>
 #include <mos/filesystem/fs_types.h>
 #include <mos/hashmap.hpp>
+#include <mos/ipc/ipc_types.h>
 #include <mos/lib/structures/hashmap_common.hpp>
 #include <mos/lib/structures/list.hpp>
 #include <mos/mos_global.h>
@@ -25,13 +30,25 @@
 #include <mos_stdlib.hpp>
 #include <mos_string.hpp>
 
-#define IPC_SERVER_MAGIC MOS_FOURCC('I', 'P', 'C', 'S')
+#define IPC_SERVER_MAGIC      MOS_FOURCC('I', 'P', 'C', 'S')
+#define IPC_MAX_INFLIGHT_IOS 64 // per direction
+
+/**
+ * @brief An IO that has been sent over a connection, but not yet received by the peer
+ */
+struct IpcInflightIO final : mos::NamedType<"IPC.InflightIO">
+{
+    as_linked_list;
+    u32 handle;
+    IO *io; ///< holds a reference
+};
 
 struct IpcDescriptor final : mos::NamedType<"IPC.Descriptor">
 {
     as_linked_list; ///< attached to either pending or established list
     const mos::string server_name;
     size_t buffer_size_npages;
+    const IpcConnectFlags flags;
 
     waitlist_t client_waitlist; ///< client waits here for the server to accept the connection
 
@@ -47,10 +64,38 @@ struct IpcDescriptor final : mos::NamedType<"IPC.Descriptor">
         pipe_t *client_read_pipe;
     };
 
-    IpcDescriptor(mos::string_view name, size_t buffer_size) //
-        : server_name(name),                                 //
-          buffer_size_npages(buffer_size / MOS_PAGE_SIZE)    //
+    phyframe_t *shm_frames = nullptr; ///< the shared-memory ring area, if both ends asked for IPC_CONNECT_SHM_RING
+    size_t shm_npages = 0;
+
+    spinlock_t inflight_lock;
+    list_head inflight[2]; ///< IOs sent but not yet received, indexed by ipc_shm_ring_id_t
+    size_t inflight_n[2] = { 0, 0 };
+    u32 next_handle = 1; ///< 0 is never used as a handle
+
+    IpcDescriptor(mos::string_view name, size_t buffer_size, IpcConnectFlags flags) //
+        : server_name(name),                                                        //
+          buffer_size_npages(buffer_size / MOS_PAGE_SIZE),                          //
+          flags(flags)                                                              //
+    {
+        linked_list_init(&inflight[IPC_SHM_RING_CLIENT_TO_SERVER]);
+        linked_list_init(&inflight[IPC_SHM_RING_SERVER_TO_CLIENT]);
+    }
+
+    ~IpcDescriptor()
     {
+        if (shm_frames)
+            pmm_unref(shm_frames, shm_npages); // the frames are freed once all mappings are gone
+
+        // drop the IOs that were never received
+        for (auto &list : inflight)
+        {
+            list_foreach(IpcInflightIO, entry, list)
+            {
+                list_remove(entry);
+                entry->io->unref();
+                delete entry;
+            }
+        }
     }
 };
 
@@ -66,6 +111,8 @@ struct IPCServer final : public mos::NamedType<"IPCServer">
 
     waitlist_t server_waitlist; ///< wake up the server here when a client connects
 
+    IpcActivation *activation = nullptr; ///< set while the name is registered on demand, but not served yet
+
     IPCServer(mos::string_view name, size_t pending_max) : name(name), pending_max(pending_max)
     {
         linked_list_init(list_node(this));
@@ -78,6 +125,20 @@ struct IPCServer final : public mos::NamedType<"IPCServer">
     }
 };
 
+/**
+ * @brief A server name registered to be served on demand
+ * @note activation->server and server->activation are changed with both ipc_lock and the server lock held
+ */
+struct IpcActivation final : mos::NamedType<"IPC.Activation">
+{
+    IPCServer *server = nullptr; ///< the placeholder server, NULL once a real server has taken it over
+    waitlist_t waitlist;         ///< the registrant waits here, \see ipc_activation_wait
+    bool reported = false;       ///< the registrant has been told about the first connection
+    pid_t server_pid = 0;        ///< the process allowed to take over the name, \see ipc_activation_authorize
+    size_t waiters = 0;          ///< threads in ipc_activation_wait, the last of them frees a closed activation
+    bool closed = false;         ///< ipc_activation_close has been called, protected by ipc_lock
+};
+
 // protects ipc_servers and name_waitlist
 static spinlock_t ipc_lock;
 
@@ -86,10 +147,9 @@ static list_head ipc_servers;
 // waitlist for an IPC server, key = name, value = waitlist_t *
 static mos::HashMap<mos::string, waitlist_t *> name_waitlist;
 
-void ipc_server_close(IPCServer *server)
+// both ipc_lock and the server lock must be held, they are released
+static void ipc_server_close_locked(IPCServer *server)
 {
-    spinlock_acquire(&ipc_lock);
-    spinlock_acquire(&server->lock);
     // remove the server from the list
     list_remove(server);
 
@@ -142,6 +202,13 @@ void ipc_server_close(IPCServer *server)
     }
 }
 
+void ipc_server_close(IPCServer *server)
+{
+    spinlock_acquire(&ipc_lock);
+    spinlock_acquire(&server->lock);
+    ipc_server_close_locked(server);
+}
+
 size_t ipc_client_read(IpcDescriptor *ipc, void *buf, size_t size)
 {
     return pipe_read(ipc->client_read_pipe, buf, size);
@@ -162,8 +229,26 @@ size_t ipc_server_write(IpcDescriptor *ipc, const void *buf, size_t size)
     return pipe_write(ipc->server_write_pipe, buf, size);
 }
 
+static void ipc_shm_mark_closed(IpcDescriptor *ipc)
+{
+    if (!ipc->shm_frames)
+        return;
+
+    // wake up anyone sleeping on the rings, they will see the closed flag and give up
+    ipc_shm_header_t *header = (ipc_shm_header_t *) phyframe_va(ipc->shm_frames);
+    __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+    for (auto &ring : header->rings)
+    {
+        __atomic_add_fetch(&ring.data_doorbell, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&ring.space_doorbell, 1, __ATOMIC_RELEASE);
+        futex_wake(&ring.data_doorbell, INT_MAX);
+        futex_wake(&ring.space_doorbell, INT_MAX);
+    }
+}
+
 void ipc_client_close_channel(IpcDescriptor *ipc)
 {
+    ipc_shm_mark_closed(ipc);
     bool r_fullyclosed = pipe_close_one_end(ipc->client_read_pipe);
     bool w_fullyclosed = pipe_close_one_end(ipc->client_write_pipe);
     MOS_ASSERT(r_fullyclosed == w_fullyclosed); // both ends should have the same return value
@@ -178,6 +263,7 @@ void ipc_client_close_channel(IpcDescriptor *ipc)
 
 void ipc_server_close_channel(IpcDescriptor *ipc)
 {
+    ipc_shm_mark_closed(ipc);
     bool r_fullyclosed = pipe_close_one_end(ipc->server_read_pipe);
     bool w_fullyclosed = pipe_close_one_end(ipc->server_write_pipe);
     MOS_ASSERT(r_fullyclosed == w_fullyclosed); // both ends should have the same return value
@@ -192,21 +278,43 @@ void ipc_server_close_channel(IpcDescriptor *ipc)
 
 static inode_t *ipc_sysfs_create_ino(IPCServer *ipc_server);
 
-PtrResult<IPCServer> ipc_server_create(mos::string_view name, size_t max_pending)
+static PtrResult<IPCServer> ipc_server_do_create(mos::string_view name, size_t max_pending, IpcActivation *activation)
 {
     dInfo<ipc> << "creating ipc server '" << name << "' with max_pending=" << max_pending;
     const auto guard = ipc_lock.lock();
     list_foreach(IPCServer, server, ipc_servers)
     {
-        if (server->name == name)
+        if (server->name != name)
+            continue;
+
+        if (!server->activation || activation)
         {
             dWarn<ipc> << "ipc server '" << name << "' already exists";
             return -EEXIST;
         }
+
+        if (server->activation->server_pid != current_process->pid)
+        {
+            dWarn<ipc> << "ipc server '" << name << "' is served on demand by another process";
+            return -EEXIST;
+        }
+
+        // the name is served on demand, the real server takes over the placeholder along with its pending connections
+        spinlock_acquire(&server->lock);
+        server->activation->server = NULL;
+        waitlist_wake_all(&server->activation->waitlist); // the registrant learns that the name is now served
+        server->activation = NULL;
+        server->pending_max = max_pending;
+        dInfo<ipc> << "ipc server '" << name << "' taken over with " << server->pending_n << " pending connections";
+        spinlock_release(&server->lock);
+        return server;
     }
 
     // we don't need to acquire the lock here because the server is not yet announced
     const auto server = mos::create<IPCServer>(name, max_pending);
+    server->activation = activation;
+    if (activation)
+        activation->server = server;
 
     // now announce the server
     list_node_append(&ipc_servers, list_node(server));
@@ -228,6 +336,119 @@ PtrResult<IPCServer> ipc_server_create(mos::string_view name, size_t max_pending
     return server;
 }
 
+PtrResult<IPCServer> ipc_server_create(mos::string_view name, size_t max_pending)
+{
+    return ipc_server_do_create(name, max_pending, NULL);
+}
+
+PtrResult<IpcActivation> ipc_activation_create(mos::string_view name, size_t max_pending)
+{
+    const auto activation = mos::create<IpcActivation>();
+    if (!activation)
+        return -ENOMEM;
+
+    auto server = ipc_server_do_create(name, max_pending, activation);
+    if (server.isErr())
+    {
+        delete activation;
+        return server.getErr();
+    }
+
+    dInfo<ipc> << "ipc server '" << name << "' is served on demand";
+    return activation;
+}
+
+long ipc_activation_authorize(IpcActivation *activation, pid_t pid)
+{
+    const auto guard = ipc_lock.lock();
+    if (!activation->server)
+        return -EBUSY; // already taken over
+
+    activation->server_pid = pid;
+    return 0;
+}
+
+// drop the reference of a waiter, the last one frees the activation once it's closed
+static long ipc_activation_put_waiter(IpcActivation *activation, long ret)
+{
+    spinlock_acquire(&ipc_lock);
+    const bool last = --activation->waiters == 0 && activation->closed;
+    spinlock_release(&ipc_lock);
+    if (last)
+        delete activation;
+    return ret;
+}
+
+long ipc_activation_wait(IpcActivation *activation)
+{
+    spinlock_acquire(&ipc_lock);
+    activation->waiters++;
+    spinlock_release(&ipc_lock);
+
+retry:
+    spinlock_acquire(&ipc_lock);
+    if (activation->closed)
+    {
+        spinlock_release(&ipc_lock);
+        return ipc_activation_put_waiter(activation, -EBADF); // closed by another thread while we were waiting
+    }
+
+    IPCServer *server = activation->server;
+    if (!server)
+    {
+        spinlock_release(&ipc_lock);
+        return ipc_activation_put_waiter(activation, 0); // a real server has taken over the name
+    }
+
+    spinlock_acquire(&server->lock);
+    spinlock_release(&ipc_lock);
+
+    if (!activation->reported && server->pending_n)
+    {
+        activation->reported = true;
+        const long n = server->pending_n;
+        spinlock_release(&server->lock);
+        return ipc_activation_put_waiter(activation, n);
+    }
+
+    MOS_ASSERT(waitlist_append(&activation->waitlist));
+    spinlock_release(&server->lock);
+    blocked_reschedule();
+
+    if (signal_has_pending())
+    {
+        waitlist_remove_me(&activation->waitlist);
+        return ipc_activation_put_waiter(activation, -EINTR);
+    }
+
+    goto retry;
+}
+
+void ipc_activation_close(IpcActivation *activation)
+{
+    spinlock_acquire(&ipc_lock);
+    activation->closed = true;
+    IPCServer *server = activation->server;
+    if (server)
+    {
+        // ipc_connect_to_server wakes the registrant with only the server lock held, so detach under it
+        spinlock_acquire(&server->lock);
+        server->activation = NULL;
+        activation->server = NULL;
+    }
+
+    waitlist_wake_all(&activation->waitlist); // waiters see 'closed' and bail out
+    const bool unused = activation->waiters == 0;
+
+    if (server)
+        ipc_server_close_locked(server); // no one has taken over the name, refuse the clients queued on it
+    else
+        spinlock_release(&ipc_lock);
+
+    if (unused)
+        delete activation;
+}
+
 PtrResult<IPCServer> ipc_get_server(mos::string_view name)
 {
     const auto guard = ipc_lock.lock();
@@ -240,7 +461,108 @@ PtrResult<IPCServer> ipc_get_server(mos::string_view name)
     return -ENOENT;
 }
 
-PtrResult<IpcDescriptor> ipc_server_accept(IPCServer *ipc_server)
+static bool ipc_shm_setup(IpcDescriptor *desc)
+{
+    // each ring is a power of two in size, so that the free-running counters wrap correctly
+    size_t ring_size = MOS_PAGE_SIZE;
+    while (ring_size < desc->buffer_size_npages * MOS_PAGE_SIZE)
+        ring_size <<= 1;
+
+    const size_t npages = 1 + 2 * (ring_size / MOS_PAGE_SIZE);
+    phyframe_t *frames = mm_get_free_pages(npages);
+    if (!frames)
+        return false;
+
+    pmm_ref(frames, npages); // the descriptor holds a reference, see ~IpcDescriptor
+    for (size_t i = 0; i < npages; i++)
+        memzero((void *) phyframe_va(frames + i), MOS_PAGE_SIZE); // all of it is mapped into userspace
+
+    ipc_shm_header_t *header = (ipc_shm_header_t *) phyframe_va(frames);
+    header->magic = IPC_SHM_MAGIC;
+    header->version = IPC_SHM_VERSION;
+    header->ring_size = ring_size;
+    header->data_offset[IPC_SHM_RING_CLIENT_TO_SERVER] = MOS_PAGE_SIZE;
+    header->data_offset[IPC_SHM_RING_SERVER_TO_CLIENT] = MOS_PAGE_SIZE + ring_size;
+
+    desc->shm_frames = frames;
+    desc->shm_npages = npages;
+    dInfo<ipc> << "created shared-memory rings of " << ring_size << " bytes for '" << desc->server_name << "'";
+    return true;
+}
+
+phyframe_t *ipc_shm_get_page(const IpcDescriptor *ipc, size_t pgoff)
+{
+    if (!ipc->shm_frames || pgoff >= ipc->shm_npages)
+        return nullptr;
+    return ipc->shm_frames + pgoff;
+}
+
+size_t ipc_shm_npages(const IpcDescriptor *ipc)
+{
+    return ipc->shm_npages;
+}
+
+long ipc_attach_io(IpcDescriptor *ipc, bool from_server, IO *io)
+{
+    const int dir = from_server ? IPC_SHM_RING_SERVER_TO_CLIENT : IPC_SHM_RING_CLIENT_TO_SERVER;
+
+    IpcInflightIO *entry = mos::create<IpcInflightIO>();
+    if (!entry)
+        return -ENOMEM;
+
+    linked_list_init(list_node(entry));
+    entry->io = io->ref();
+    if (!entry->io)
+    {
+        delete entry;
+        return -EBADF;
+    }
+
+    spinlock_acquire(&ipc->inflight_lock);
+    if (ipc->inflight_n[dir] >= IPC_MAX_INFLIGHT_IOS)
+    {
+        spinlock_release(&ipc->inflight_lock);
+        io->unref();
+        delete entry;
+        return -EMFILE; // the peer isn't receiving them
+    }
+
+    entry->handle = ipc->next_handle++;
+    if (ipc->next_handle == 0)
+        ipc->next_handle = 1;
+    list_node_append(&ipc->inflight[dir], list_node(entry));
+    ipc->inflight_n[dir]++;
+    const u32 handle = entry->handle;
+    spinlock_release(&ipc->inflight_lock);
+
+    dInfo<ipc> << "attached " << io << " to ipc connection '" << ipc->server_name << "', handle " << handle;
+    return handle;
+}
+
+PtrResult<IO> ipc_detach_io(IpcDescriptor *ipc, bool to_server, u32 handle)
+{
+    const int dir = to_server ? IPC_SHM_RING_CLIENT_TO_SERVER : IPC_SHM_RING_SERVER_TO_CLIENT;
+
+    spinlock_acquire(&ipc->inflight_lock);
+    list_foreach(IpcInflightIO, entry, ipc->inflight[dir])
+    {
+        if (entry->handle != handle)
+            continue;
+
+        list_remove(entry);
+        ipc->inflight_n[dir]--;
+        spinlock_release(&ipc->inflight_lock);
+
+        IO *io = entry->io; // the reference is passed to the caller
+        delete entry;
+        return io;
+    }
+    spinlock_release(&ipc->inflight_lock);
+
+    return -ENOENT;
+}
+
+PtrResult<IpcDescriptor> ipc_server_accept(IPCServer *ipc_server, IpcConnectFlags flags)
 {
     dInfo<ipc> << "accepting connection on ipc server '" << ipc_server->name << "'...";
 
@@ -285,7 +607,7 @@ retry_accept:
     dInfo<ipc> << "accepted a connection on ipc server '" << ipc_server->name << "' with buffer_size_npages=" << desc->buffer_size_npages;
 
     // setup the pipes
-    auto readPipe = pipe_create(desc->buffer_size_npages);
+    auto readPipe = pipe_create(desc->buffer_size_npages * MOS_PAGE_SIZE);
     if (readPipe.isErr())
     {
         dWarn<ipc> << "failed to create read pipe";
@@ -294,7 +616,7 @@ retry_accept:
     }
     desc->server_read_pipe = readPipe.get();
 
-    auto writePipe = pipe_create(desc->buffer_size_npages);
+    auto writePipe = pipe_create(desc->buffer_size_npages * MOS_PAGE_SIZE);
     if (writePipe.isErr())
     {
         dWarn<ipc> << "failed to create write pipe";
@@ -303,13 +625,18 @@ retry_accept:
     }
     desc->server_write_pipe = writePipe.get();
 
+    // only when both ends asked for them, a server that never attaches to the rings would leave the client waiting forever
+    const bool shm_ring = desc->flags.test(IPC_CONNECT_SHM_RING) && flags.test(IPC_CONNECT_SHM_RING);
+    if (shm_ring && !ipc_shm_setup(desc))
+        dWarn<ipc> << "failed to setup shared-memory rings, falling back to stream mode";
+
     // wake up the client
     waitlist_wake_all(&desc->client_waitlist);
 
     return desc;
 }
 
-PtrResult<IpcDescriptor> ipc_connect_to_server(mos::string name, size_t buffer_size)
+PtrResult<IpcDescriptor> ipc_connect_to_server(mos::string name, size_t buffer_size, IpcConnectFlags flags)
 {
     if (buffer_size == 0)
         return -EINVAL; // buffer size must be > 0
@@ -335,7 +662,7 @@ check_server:
     }
 
     // now we have a server, we can create the connection
-    const auto descriptor = mos::create<IpcDescriptor>(name, buffer_size);
+    const auto descriptor = mos::create<IpcDescriptor>(name, buffer_size, flags);
 
     if (!ipc_server)
     {
@@ -383,6 +710,13 @@ check_server:
     list_node_append(&ipc_server->pending, list_node(descriptor)); // add to pending list
     ipc_server->pending_n++;
 
+    if (ipc_server->activation)
+    {
+        // registered but not served yet, the connection stays queued until the real server takes the name over
+        dInfo<ipc> << "ipc server '" << ipc_server->name << "' is served on demand, waking up the registrant";
+        waitlist_wake_all(&ipc_server->activation->waitlist);
+    }
+
     // now wait for the server to accept the connection
     MOS_ASSERT(waitlist_append(&descriptor->client_waitlist));
     waitlist_wake(&ipc_server->server_waitlist, 1);
@@ -415,7 +749,7 @@ static bool ipc_sysfs_servers(sysfs_file_t *f)
     sysfs_printf(f, "%-40s\t%s\n", "Server Name", "Max Pending Connections");
     list_foreach(IPCServer, ipc, ipc_servers)
     {
-        sysfs_printf(f, "%-40s\t%zu\n", ipc->name.c_str(), ipc->pending_max);
+        sysfs_printf(f, "%-40s\t%zu%s\n", ipc->name.c_str(), ipc->pending_max, ipc->activation ? " (on demand)" : "");
     }
 
     return true;
@@ -9,6 +9,7 @@
 
 #include <mos/allocator.hpp>
 #include <mos_stdlib.hpp>
+#include <mos_string.hpp>
 
 struct IPC_ControlIO : IO
 {
@@ -33,9 +34,43 @@ void IPC_ControlIO::on_closed()
     delete server_io;
 }
 
+vmfault_result_t IpcConnectionIO::on_shm_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
+{
+    const IpcConnectionIO *io = static_cast<IpcConnectionIO *>(vmap->io);
+    const size_t pgoff = (vmap->io_offset + ALIGN_DOWN_TO_PAGE(fault_addr) - vmap->vaddr) / MOS_PAGE_SIZE;
+
+    info->backing_page = ipc_shm_get_page(io->descriptor, pgoff);
+    if (!info->backing_page)
+        return VMFAULT_CANNOT_HANDLE;
+
+    vmap_stat_inc(vmap, regular);
+    return VMFAULT_MAP_BACKING_PAGE;
+}
+
+bool IpcConnectionIO::on_mmap(vmap_t *vmap, off_t offset)
+{
+    if (vmap->type != VMAP_TYPE_SHARED)
+    {
+        mWarn << "ipc: the shared-memory rings can only be mapped with MMAP_SHARED";
+        return false;
+    }
+
+    if (offset < 0 || (size_t) offset / MOS_PAGE_SIZE + vmap->npages > ipc_shm_npages(descriptor))
+        return false;
+
+    vmap->on_fault = on_shm_fault;
+    return true;
+}
+
+bool IpcConnectionIO::on_munmap(vmap_t *, bool *unmapped)
+{
+    *unmapped = false; // let the mm subsystem unmap (and unref) the pages
+    return true;
+}
+
 struct IpcServerIO : IpcConnectionIO, mos::NamedType<"IPC.ServerIO">
 {
-    IpcServerIO(IpcDescriptor *desc) : IpcConnectionIO(desc) {};
+    IpcServerIO(IpcDescriptor *desc) : IpcConnectionIO(desc, true) {};
     virtual ~IpcServerIO() {};
 
     size_t on_read(void *buf, size_t size)
@@ -54,7 +89,7 @@ struct IpcServerIO : IpcConnectionIO, mos::NamedType<"IPC.ServerIO">
 
 struct IpcClientIO : IpcConnectionIO, mos::NamedType<"IPC.ClientIO">
 {
-    IpcClientIO(IpcDescriptor *desc) : IpcConnectionIO(desc) {};
+    IpcClientIO(IpcDescriptor *desc) : IpcConnectionIO(desc, false) {};
     virtual ~IpcClientIO() {};
 
     size_t on_read(void *buf, size_t size)
@@ -106,13 +141,68 @@ PtrResult<IO> ipc_create(const char *name, size_t max_pending_connections)
     return &io->control_io;
 }
 
-PtrResult<IO> ipc_accept(IO *server)
+struct IpcActivationIO : IO, mos::NamedType<"IPC.ActivationIO">
+{
+    IpcActivationIO(IpcActivation *activation) : IO(IO_READABLE | IO_WRITABLE, IO_IPC_ACT), activation(activation) {};
+    virtual ~IpcActivationIO() {};
+
+    size_t on_read(void *buf, size_t size) override
+    {
+        if (size < sizeof(u64))
+            return -EINVAL;
+
+        const long ret = ipc_activation_wait(activation);
+        if (ret <= 0)
+            return ret; // the name is now served (EOF), or interrupted
+
+        const u64 pending = ret;
+        memcpy(buf, &pending, sizeof(pending));
+        return sizeof(pending);
+    }
+
+    size_t on_write(const void *buf, size_t size) override
+    {
+        if (size != sizeof(pid_t))
+            return -EINVAL;
+
+        pid_t pid;
+        memcpy(&pid, buf, sizeof(pid));
+        const long ret = ipc_activation_authorize(activation, pid);
+        return ret < 0 ? ret : size;
+    }
+
+    void on_closed() override
+    {
+        ipc_activation_close(activation);
+        delete this;
+    }
+
+    IpcActivation *const activation;
+};
+
+PtrResult<IO> ipc_register(const char *name, size_t max_pending_connections)
+{
+    auto activation = ipc_activation_create(name, max_pending_connections);
+    if (activation.isErr())
+        return activation.getErr();
+
+    const auto io = mos::create<IpcActivationIO>(activation.get());
+    if (io == nullptr)
+    {
+        ipc_activation_close(activation.get());
+        return -ENOMEM;
+    }
+
+    return io;
+}
+
+PtrResult<IO> ipc_accept(IO *server, IpcConnectFlags flags)
 {
     if (server->io_type != IO_IPC)
         return -EBADF; // not an ipc server
 
     ipc_server_io_t *ipc_server = container_of(static_cast<IPC_ControlIO *>(server), ipc_server_io_t, control_io);
-    const auto ipc = ipc_server_accept(ipc_server->server);
+    const auto ipc = ipc_server_accept(ipc_server->server, flags);
     if (ipc.isErr())
         return ipc.getErr();
 
@@ -123,9 +213,9 @@ PtrResult<IO> ipc_accept(IO *server)
     return io;
 }
 
-PtrResult<IO> ipc_connect(const char *name, size_t buffer_size)
+PtrResult<IO> ipc_connect(const char *name, size_t buffer_size, IpcConnectFlags flags)
 {
-    const auto ipc = ipc_connect_to_server(name, buffer_size);
+    const auto ipc = ipc_connect_to_server(name, buffer_size, flags);
     if (ipc.isErr())
         return ipc.getErr();
 
@@ -135,3 +225,32 @@ PtrResult<IO> ipc_connect(const char *name, size_t buffer_size)
 
     return io;
 }
+
+static IpcConnectionIO *ipc_get_connection(IO *io)
+{
+    // the control IO of an IPC server is also IO_IPC, but it is neither readable nor writable
+    if (io->io_type != IO_IPC || !io->io_flags.test(IO_READABLE))
+        return nullptr;
+    return static_cast<IpcConnectionIO *>(io);
+}
+
+long ipc_send_io(IO *conn, IO *io)
+{
+    const auto connection = ipc_get_connection(conn);
+    if (!connection)
+        return -EBADF;
+
+    if (conn == io)
+        return -EINVAL; // the connection would keep itself alive
+
+    return ipc_attach_io(connection->descriptor, connection->is_server_side, io);
+}
+
+PtrResult<IO> ipc_receive_io(IO *conn, u32 handle)
+{
+    const auto connection = ipc_get_connection(conn);
+    if (!connection)
+        return -EBADF;
+
+    return ipc_detach_io(connection->descriptor, connection->is_server_side, handle);
+}
@@ -16,6 +16,7 @@
 #include <mos/ipc/ipc.hpp>
 #include <mos/lib/cmdline.hpp>
 #include <mos/list.hpp>
+#include <mos/misc/boottime.hpp>
 #include <mos/misc/cmdline.hpp>
 #include <mos/misc/setup.hpp>
 #include <mos/platform/platform.hpp>
@@ -129,6 +130,7 @@ static void setup_sane_environment()
 
 void mos_start_kernel(void)
 {
+    const u64 boot_start = platform_get_timestamp();
     setup_sane_environment();
     mInfo << "Welcome to MOS!";
     mInfo << fmt("MOS {}-{} on ({}, {}), compiler {}", MOS_KERNEL_VERSION, MOS_ARCH, MOS_KERNEL_REVISION, __DATE__, __VERSION__);
@@ -195,9 +197,11 @@ void mos_start_kernel(void)
     for (u32 i = 0; i < init_envp.size(); i++)
         mInfo << "    " << init_envp[i].c_str();
 
+    const u64 init_start = platform_get_timestamp();
     const auto init = elf_create_process(init_args[0], NULL, init_args, init_envp, &init_io);
     if (unlikely(!init))
         mos_panic("failed to create init process");
+    boottime_record("kernel", "create_init_process", init_start, platform_get_timestamp());
 
     const auto m = mm_map_user_pages(init->mm, MOS_INITRD_BASE, platform_info->initrd_pfn, platform_info->initrd_npages, VM_USER_RO, VMAP_TYPE_SHARED, VMAP_FILE, true);
     pmm_ref(platform_info->initrd_pfn, platform_info->initrd_npages);
@@ -207,6 +211,7 @@ void mos_start_kernel(void)
 
     kthread_init(); // must be called after creating the first init process
     startup_invoke_autoinit(INIT_TARGET_KTHREAD);
+    boottime_record("kernel", "mos_start_kernel", boot_start, platform_get_timestamp());
 
     unblock_scheduler();
 
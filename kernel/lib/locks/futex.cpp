@@ -5,6 +5,7 @@
 #include <mos/lib/structures/list.hpp>
 #include <mos/lib/sync/spinlock.hpp>
 #include <mos/locks/futex.hpp>
+#include <mos/mm/mm.hpp>
 #include <mos/mm/paging/paging.hpp>
 #include <mos/platform/platform.hpp>
 #include <mos/syslog/printk.hpp>
@@ -29,6 +30,12 @@ static spinlock_t futex_list_lock;
 static futex_key_t futex_get_key(const futex_word_t *futex)
 {
     const ptr_t vaddr = (ptr_t) futex;
+
+    // direct-mapped memory may also be mapped into userspace (e.g. IPC shared-memory rings),
+    // key it by the physical address so that both sides agree on the futex
+    if (vaddr >= platform_info->direct_map_base && vaddr < pfn_va(platform_info->max_pfn))
+        return vaddr - platform_info->direct_map_base;
+
     if (vaddr >= MOS_KERNEL_START_VADDR)
         return vaddr;
     return mm_get_phys_addr(current_process->mm, vaddr);
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <mos/lib/structures/timer_wheel.hpp>
+#include <mos/moslib_global.hpp>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static u32 timer_wheel_level_of(u64 delta)
+{
+    if (delta < TIMER_WHEEL_SLOTS)
+        return 0;
+    return (63 - __builtin_clzll(delta)) / TIMER_WHEEL_BITS;
+}
+
+static void timer_wheel_enqueue(timer_wheel_t *wheel, timer_wheel_entry_t *entry)
+{
+    if (entry->expires < wheel->clk)
+    {
+        // the wheel has already gone past it
+        entry->index = TIMER_WHEEL_DUE;
+        list_node_append(&wheel->due, list_node(entry));
+        return;
+    }
+
+    const u64 delta = std::min<u64>(entry->expires - wheel->clk, TIMER_WHEEL_MAX_DELTA);
+    const u32 level = timer_wheel_level_of(delta);
+    const u32 slot = ((wheel->clk + delta) >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK;
+
+    entry->index = level * TIMER_WHEEL_SLOTS + slot;
+    list_node_append(&wheel->slots[level][slot], list_node(entry));
+    wheel->pending[level] |= 1ull << slot;
+}
+
+/**
+ * @brief The absolute slot number (in units of 64^level) of the first non-empty slot at or after clk
+ *
+ * @details Entries of a level are always within 64 slots from clk, so the slot index is unambiguous.
+ */
+static u64 timer_wheel_level_next(const timer_wheel_t *wheel, u32 level)
+{
+    const u64 pending = wheel->pending[level];
+    if (!pending)
+        return TIMER_WHEEL_NEVER;
+
+    const u32 shift = level * TIMER_WHEEL_BITS;
+    const u64 start = (wheel->clk + (1ull << shift) - 1) >> shift;
+    const u32 pos = start & SLOT_MASK;
+    const u64 rotated = pos ? (pending >> pos) | (pending << (TIMER_WHEEL_SLOTS - pos)) : pending;
+    return start + __builtin_ctzll(rotated);
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, u64 now)
+{
+    wheel->clk = now;
+    wheel->count = 0;
+    linked_list_init(&wheel->due);
+    for (u32 level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        wheel->pending[level] = 0;
+        for (u32 slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+            linked_list_init(&wheel->slots[level][slot]);
+    }
+}
+
+void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_entry_t *entry)
+{
+    timer_wheel_enqueue(wheel, entry);
+    wheel->count++;
+}
+
+void timer_wheel_remove(timer_wheel_t *wheel, timer_wheel_entry_t *entry)
+{
+    wheel->count--;
+    if (entry->index == TIMER_WHEEL_DUE)
+    {
+        list_remove(entry);
+        return;
+    }
+
+    const u32 level = entry->index / TIMER_WHEEL_SLOTS, slot = entry->index % TIMER_WHEEL_SLOTS;
+    list_remove(entry);
+    if (list_is_empty(&wheel->slots[level][slot]))
+        wheel->pending[level] &= ~(1ull << slot);
+}
+
+u64 timer_wheel_next_expiry(const timer_wheel_t *wheel)
+{
+    u64 next = TIMER_WHEEL_NEVER;
+    list_foreach(timer_wheel_entry_t, entry, wheel->due)
+        next = std::min(next, entry->expires);
+
+    for (u32 level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        const u64 index = timer_wheel_level_next(wheel, level);
+        if (index == TIMER_WHEEL_NEVER)
+            continue;
+
+        // only the first non-empty slot of each level can hold the earliest entry, entries parked
+        // beyond TIMER_WHEEL_MAX_DELTA count as expiring at the end of their slot
+        const u32 shift = level * TIMER_WHEEL_BITS;
+        const u64 slot_end = ((index + 1) << shift) - 1;
+        list_foreach(timer_wheel_entry_t, entry, wheel->slots[level][index & SLOT_MASK])
+            next = std::min(next, std::min(entry->expires, slot_end));
+    }
+
+    return next;
+}
+
+size_t timer_wheel_advance(timer_wheel_t *wheel, u64 now, list_head *expired)
+{
+    size_t nexpired = 0;
+    list_foreach(timer_wheel_entry_t, entry, wheel->due)
+    {
+        list_remove(entry);
+        list_node_append(expired, list_node(entry));
+        nexpired++;
+    }
+
+    while (true)
+    {
+        // jump straight to the next slot of any level that needs processing
+        u64 next = TIMER_WHEEL_NEVER;
+        for (u32 level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            const u64 index = timer_wheel_level_next(wheel, level);
+            if (index != TIMER_WHEEL_NEVER)
+                next = std::min(next, index << (level * TIMER_WHEEL_BITS));
+        }
+
+        if (next == TIMER_WHEEL_NEVER || next > now)
+            break;
+
+        wheel->clk = next;
+
+        // cascade the highest level first, so that an entry can fall all the way down to level 0
+        for (u32 level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            const u32 shift = level * TIMER_WHEEL_BITS;
+            if (next & ((1ull << shift) - 1))
+                continue;
+
+            const u32 slot = (next >> shift) & SLOT_MASK;
+            if (!(wheel->pending[level] & (1ull << slot)))
+                continue;
+
+            wheel->pending[level] &= ~(1ull << slot);
+            list_foreach(timer_wheel_entry_t, entry, wheel->slots[level][slot])
+            {
+                list_remove(entry);
+                timer_wheel_enqueue(wheel, entry); // always to a lower level, or to another slot if it's parked
+            }
+        }
+
+        const u32 slot = next & SLOT_MASK;
+        if (wheel->pending[0] & (1ull << slot))
+        {
+            wheel->pending[0] &= ~(1ull << slot);
+            list_foreach(timer_wheel_entry_t, entry, wheel->slots[0][slot])
+            {
+                list_remove(entry);
+                list_node_append(expired, list_node(entry));
+                nexpired++;
+            }
+        }
+
+        wheel->clk = next + 1;
+    }
+
+    // nothing is due until after 'now'
+    if (wheel->clk <= now)
+        wheel->clk = now + 1;
+
+    wheel->count -= nexpired;
+    return nexpired;
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// The boot timeline: how long each init function, cmdline hook and AP bring-up took
+
+#include "mos/misc/boottime.hpp"
+
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/platform/platform.hpp"
+
+#include <algorithm>
+#include <mos/lib/sync/spinlock.hpp>
+
+typedef struct
+{
+    const char *stage;
+    const char *name;
+    u64 start, end;
+    u32 cpu;
+} boottime_record_t;
+
+// the boot happens only once, the records are never freed
+static boottime_record_t boottime_records[BOOTTIME_MAX_RECORDS];
+static size_t boottime_nrecords = 0;
+static size_t boottime_dropped = 0;
+static spinlock_t boottime_lock; // APs are brought up concurrently
+
+void boottime_record(const char *stage, const char *name, u64 start, u64 end)
+{
+    SpinLocker lock(&boottime_lock);
+    if (boottime_nrecords == BOOTTIME_MAX_RECORDS)
+    {
+        boottime_dropped++;
+        return;
+    }
+
+    boottime_records[boottime_nrecords++] = {
+        .stage = stage,
+        .name = name,
+        .start = start,
+        .end = end,
+        .cpu = platform_current_cpu_id(),
+    };
+}
+
+// ! sysfs support
+
+static bool boottime_sysfs_timeline(sysfs_file_t *f)
+{
+    // records are never modified once added, only the count needs the lock
+    size_t nrecords;
+    {
+        SpinLocker lock(&boottime_lock);
+        nrecords = boottime_nrecords;
+    }
+
+    // timestamps are relative to the first recorded stage, in platform timestamp units
+    u64 origin = nrecords ? boottime_records[0].start : 0;
+    for (size_t i = 1; i < nrecords; i++)
+        origin = std::min(origin, boottime_records[i].start);
+
+    sysfs_printf(f, "%-14s %-4s %16s %16s %s\n", "stage", "cpu", "start", "duration", "name");
+    for (size_t i = 0; i < nrecords; i++)
+    {
+        const boottime_record_t *r = &boottime_records[i];
+        sysfs_printf(f, "%-14s %-4u %16llu %16llu %s\n", r->stage, r->cpu, r->start - origin, r->end - r->start, r->name);
+    }
+
+    if (boottime_dropped)
+        sysfs_printf(f, "# %zu stages not recorded, the timeline is full\n", boottime_dropped);
+
+    sysfs_printf(f, "# timestamp_hz %llu\n", platform_get_timestamp_frequency());
+
+    return true;
+}
+
+static sysfs_item_t boottime_sysfs_items[] = {
+    SYSFS_RO_ITEM("timeline", boottime_sysfs_timeline),
+};
+
+SYSFS_AUTOREGISTER(boottime, boottime_sysfs_items);
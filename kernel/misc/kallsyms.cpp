@@ -4,19 +4,18 @@
 
 const kallsyms_t *kallsyms_get_symbol(ptr_t addr)
 {
-    // kallsyms are sorted by address
-    const kallsyms_t *ks = mos_kallsyms;
-    const kallsyms_t *result = NULL;
-
-    while (ks->name)
+    // kallsyms are sorted by address, find the last symbol at or before addr
+    size_t lo = 0, hi = mos_kallsyms_count;
+    while (lo < hi)
     {
-        if (ks->address > addr)
-            break;
-        result = ks;
-        ks++;
+        const size_t mid = lo + (hi - lo) / 2;
+        if (mos_kallsyms[mid].address <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    return result;
+    return lo ? &mos_kallsyms[lo - 1] : NULL;
 }
 
 const char *kallsyms_get_symbol_name(ptr_t addr)
@@ -79,6 +79,7 @@ void try_handle_kernel_panics(ptr_t ip)
 void handle_kernel_panic(const panic_point_t *point)
 {
     platform_interrupt_disable();
+    syslog_enter_panic();
 
     if (!once())
     {
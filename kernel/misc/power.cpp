@@ -38,5 +38,6 @@ void power_register_shutdown_callback(power_callback_t callback, void *data)
     }
 
     pr_info("Bye!");
+    syslog_flush();
     platform_shutdown();
 }
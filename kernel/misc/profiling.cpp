@@ -2,54 +2,175 @@
 #include <mos/mos_global.h>
 
 #if MOS_CONFIG(MOS_PROFILING)
-#include "mos/device/console.hpp"
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/misc/cmdline.hpp"
 #include "mos/misc/profiling.hpp"
 #include "mos/misc/setup.hpp"
-#include "mos/syslog/printk.hpp"
+#include "mos/misc/trace_ring.hpp"
+#include "mos/platform/platform.hpp"
+#include "mos/tasks/task_types.hpp"
 
-#include <mos/lib/structures/hashmap.hpp>
-#include <mos/lib/structures/hashmap_common.hpp>
+#include <algorithm>
+#include <mos/lib/sync/spinlock.hpp>
 #include <mos_stdio.hpp>
 #include <mos_stdlib.hpp>
 #include <mos_string.hpp>
 #endif
 
 #if MOS_CONFIG(MOS_PROFILING)
-#define PROFILER_HEADER "\nname,start_time,end_time,total_time\n"
-#define PROFILER_LINE   "%s,%llu,%llu,%llu"
+#define PROFILE_MAX_NAMES 1024 // one slot is always left empty, lookups stop there
 
-static console *profile_console = NULL;
-static spinlock_t profile_lock static char profile_buffer[MOS_PRINTK_BUFFER_SIZE] = { 0 };
-static char name_buffer[MOS_PRINTK_BUFFER_SIZE] = { 0 };
+typedef struct
+{
+    u32 id; // 0 if the slot is free, set last
+    u32 nargs;
+    const char *fmt;
+    u64 args[PROFILE_NAME_MAX_ARGS];
+    char name[PROFILE_NAME_MAX_LEN];
+} profile_name_t;
+
+typedef TraceRing<profile_event_t, MOS_PROFILING_RING_EVENTS> profile_ring_t;
+
+bool profile_enabled = true;
+
+static profile_name_t profile_names[PROFILE_MAX_NAMES]; // an open-addressing hash table, never shrinks
+static profile_name_t *profile_names_by_id[PROFILE_MAX_NAMES];
+static size_t profile_n_names = 0;
+static spinlock_t profile_names_lock;
+
+static PER_CPU_DECLARE(profile_ring_t, profile_rings);
 
-static bool profile_output_console(const char *console)
+MOS_EARLY_SETUP("profile", profile_setup)
 {
-    profile_console = console_get(console);
-    MOS_ASSERT(profile_console);
-    console_write(profile_console, PROFILER_HEADER, strlen(PROFILER_HEADER));
+    profile_enabled = cmdline_string_truthiness(arg, true);
     return true;
 }
 
-MOS_SETUP("profile_console", profile_output_console);
+// ! name table
+
+static size_t profile_name_hash(const char *fmt, const u64 *args, size_t nargs)
+{
+    u64 hash = (ptr_t) fmt * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < nargs; i++)
+        hash = (hash ^ args[i]) * 0x100000001B3ULL;
+    return (hash ^ (hash >> 32)) % PROFILE_MAX_NAMES;
+}
+
+static bool profile_name_matches(const profile_name_t *entry, const char *fmt, const u64 *args, size_t nargs)
+{
+    return entry->fmt == fmt && entry->nargs == nargs && memcmp(entry->args, args, nargs * sizeof(u64)) == 0;
+}
+
+u32 profile_name_lookup(const char *fmt, const u64 *args, size_t nargs)
+{
+    for (size_t slot = profile_name_hash(fmt, args, nargs);; slot = (slot + 1) % PROFILE_MAX_NAMES)
+    {
+        const profile_name_t *entry = &profile_names[slot];
+        const u32 id = __atomic_load_n(&entry->id, __ATOMIC_ACQUIRE);
+        if (!id)
+            return __atomic_load_n(&profile_n_names, __ATOMIC_RELAXED) == PROFILE_MAX_NAMES - 1 ? PROFILE_NAME_OTHER : 0;
+
+        if (profile_name_matches(entry, fmt, args, nargs))
+            return id;
+    }
+}
 
-void profile_leave(const pf_point_t start, const char *fmt, ...)
+u32 profile_name_intern(const char *fmt, const u64 *args, size_t nargs, const char *name)
 {
-    const u64 end = platform_get_timestamp();
+    SpinLocker lock(&profile_names_lock);
+    if (profile_n_names == PROFILE_MAX_NAMES - 1)
+        return PROFILE_NAME_OTHER;
 
-    if (unlikely(!profile_console))
-        return;
+    size_t slot = profile_name_hash(fmt, args, nargs);
+    for (; profile_names[slot].id; slot = (slot + 1) % PROFILE_MAX_NAMES)
+        if (profile_name_matches(&profile_names[slot], fmt, args, nargs))
+            return profile_names[slot].id; // another CPU was faster
 
-    const u64 total = end - start;
+    profile_name_t *entry = &profile_names[slot];
+    entry->fmt = fmt;
+    entry->nargs = nargs;
+    memcpy(entry->args, args, nargs * sizeof(u64));
+    strncpy(entry->name, name, PROFILE_NAME_MAX_LEN - 1);
 
-    spinlock_acquire(&profile_lock);
-    va_list args;
-    va_start(args, fmt);
-    vsnprintf(name_buffer, sizeof(name_buffer), fmt, args);
-    va_end(args);
+    const u32 id = ++profile_n_names;
+    profile_names_by_id[id] = entry;
+    __atomic_store_n(&entry->id, id, __ATOMIC_RELEASE); // lookups can find it now
+    return id;
+}
+
+// ! event rings
 
-    const size_t len = snprintf(profile_buffer, sizeof(profile_buffer), PROFILER_LINE "\n", name_buffer, start, end, total);
-    console_write(profile_console, profile_buffer, len);
-    spinlock_release(&profile_lock);
+void profile_record(pf_point_t start, pf_point_t end, u32 name)
+{
+    profile_event_t *event = per_cpu(profile_rings)->next();
+    event->start = start;
+    event->end = end;
+    event->name = name;
+    event->tid = current_thread ? current_thread->tid : 0;
+    event->cpu = platform_current_cpu_id();
 }
 
+// ! sysfs support
+
+static bool profile_sysfs_trace(sysfs_file_t *f)
+{
+    u64 heads[MOS_MAX_CPU_COUNT];
+    const trace_header_t common = trace_rings_snapshot(profile_rings.percpu_value, PROFILE_TRACE_MAGIC, PROFILE_TRACE_VERSION, heads);
+
+    spinlock_acquire(&profile_names_lock);
+    const u32 n_names = profile_n_names;
+    spinlock_release(&profile_names_lock);
+
+    const profile_trace_header_t header = {
+        .common = common,
+        .n_names = n_names + 1, // including PROFILE_NAME_OTHER
+    };
+    sysfs_put_data(f, &header, sizeof(header));
+
+    for (u32 id = 1; id <= n_names; id++)
+    {
+        const char *name = profile_names_by_id[id]->name;
+        const profile_trace_name_t entry = { .id = id, .len = (u32) strlen(name) };
+        sysfs_put_data(f, &entry, sizeof(entry));
+        sysfs_put_data(f, name, entry.len);
+    }
+
+    static const char other[] = "<other>";
+    const profile_trace_name_t entry = { .id = PROFILE_NAME_OTHER, .len = sizeof(other) - 1 };
+    sysfs_put_data(f, &entry, sizeof(entry));
+    sysfs_put_data(f, other, entry.len);
+
+    trace_rings_put_events(f, profile_rings.percpu_value, heads);
+    return true;
+}
+
+static bool profile_sysfs_enabled_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%d\n", profile_enabled);
+    return true;
+}
+
+static size_t profile_sysfs_enabled_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+    if (count < 1)
+        return -EINVAL;
+
+    const bool on = buf[0] == '1';
+    if (on && !profile_enabled)
+        trace_rings_reset(profile_rings.percpu_value); // start a new trace, the names stay
+
+    profile_enabled = on;
+    return count;
+}
+
+static sysfs_item_t profile_sysfs_items[] = {
+    SYSFS_RO_ITEM("trace", profile_sysfs_trace),
+    SYSFS_RW_ITEM("enabled", profile_sysfs_enabled_show, profile_sysfs_enabled_store),
+};
+
+SYSFS_AUTOREGISTER(profiling, profile_sysfs_items);
+
 #endif
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/misc/sampler.hpp"
+
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/misc/kallsyms.hpp"
+#include "mos/mm/mm.hpp"
+#include "mos/syslog/printk.hpp"
+#include "mos/tasks/task_types.hpp"
+
+#include <mos/hashmap.hpp>
+#include <mos/lib/sync/spinlock.hpp>
+#include <mos/string.hpp>
+#include <mos_stdio.hpp>
+#include <mos_stdlib.hpp>
+#include <mos_string.hpp>
+
+typedef struct
+{
+    tid_t tid;
+    u8 depth; ///< number of valid entries in ips
+    bool user;
+    char comm[16]; ///< name of the process
+    ptr_t ips[SAMPLER_MAX_DEPTH]; ///< innermost first
+} sampler_sample_t;
+
+typedef struct
+{
+    sampler_sample_t *samples; ///< MOS_SAMPLER_SAMPLES entries, allocated when the sampler is first started
+    size_t head;               ///< number of samples taken
+    u64 ticks;                 ///< timer ticks seen since the sampler was started
+    u64 dropped;               ///< samples not taken because the buffer was full
+} sampler_buffer_t;
+
+static bool sampler_enabled = false;
+static u64 sampler_interval = 1; // in timer ticks
+static spinlock_t sampler_control_lock;
+
+static PER_CPU_DECLARE(sampler_buffer_t, sampler_buffers);
+
+void sampler_tick(const platform_regs_t *regs)
+{
+    if (likely(!__atomic_load_n(&sampler_enabled, __ATOMIC_ACQUIRE)) || !regs)
+        return;
+
+    // interrupts are disabled, nothing else writes to this CPU's buffer
+    sampler_buffer_t *buf = per_cpu(sampler_buffers);
+    if (buf->ticks++ % sampler_interval)
+        return;
+
+    if (buf->head == MOS_SAMPLER_SAMPLES)
+    {
+        buf->dropped++;
+        return;
+    }
+
+    sampler_sample_t *sample = &buf->samples[buf->head];
+    bool user = false;
+    sample->depth = platform_unwind_stack(regs, sample->ips, SAMPLER_MAX_DEPTH, &user);
+    sample->user = user;
+    sample->tid = current_thread ? current_thread->tid : 0;
+    if (current_thread)
+        strncpy(sample->comm, current_thread->owner->name.c_str(), sizeof(sample->comm) - 1);
+    else
+        strcpy(sample->comm, "<none>");
+    sample->comm[sizeof(sample->comm) - 1] = '\0';
+
+    __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE); // the sample is visible to readers now
+}
+
+static bool sampler_start(void)
+{
+    const size_t npages = ALIGN_UP_TO_PAGE(sizeof(sampler_sample_t) * MOS_SAMPLER_SAMPLES) / MOS_PAGE_SIZE;
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        sampler_buffer_t *buf = &sampler_buffers.percpu_value[cpu];
+        if (!buf->samples)
+        {
+            phyframe_t *frames = mm_get_free_pages(npages);
+            if (!frames)
+            {
+                pr_warn("sampler: failed to allocate %zu pages for CPU %u", npages, cpu);
+                return false;
+            }
+
+            buf->samples = (sampler_sample_t *) phyframe_va(frames); // kept for the next start
+        }
+
+        buf->head = 0;
+        buf->ticks = 0;
+        buf->dropped = 0;
+    }
+
+    return true;
+}
+
+// ! sysfs support
+
+static bool sampler_sysfs_folded(sysfs_file_t *f)
+{
+    // identical stacks are merged, as expected by flamegraph.pl: "comm;outer;...;inner count"
+    mos::HashMap<mos::string, size_t> stacks;
+    char frame[128];
+
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const sampler_buffer_t *buf = &sampler_buffers.percpu_value[cpu];
+        const size_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        for (size_t i = 0; i < head; i++)
+        {
+            const sampler_sample_t *sample = &buf->samples[i];
+            mos::string stack = sample->comm;
+            for (size_t depth = sample->depth; depth > 0; depth--)
+            {
+                const ptr_t ip = sample->ips[depth - 1];
+                if (sample->user)
+                    snprintf(frame, sizeof(frame), ";0x%lx", ip); // not symbolised, resolve it against the binary
+                else
+                    snprintf(frame, sizeof(frame), ";%s_[k]", kallsyms_get_symbol_name(ip));
+                stack += frame;
+            }
+
+            stacks[stack]++;
+        }
+    }
+
+    for (const auto &[stack, count] : stacks)
+        sysfs_printf(f, "%s %zu\n", stack.c_str(), count);
+
+    return true;
+}
+
+static bool sampler_sysfs_stat(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-5s %10s %10s %10s\n", "cpu", "ticks", "samples", "dropped");
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const sampler_buffer_t *buf = &sampler_buffers.percpu_value[cpu];
+        sysfs_printf(f, "%-5u %10llu %10zu %10llu\n", cpu, buf->ticks, buf->head, buf->dropped);
+    }
+    return true;
+}
+
+static bool sampler_sysfs_enabled_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%d\n", sampler_enabled);
+    return true;
+}
+
+static size_t sampler_sysfs_enabled_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+    if (count < 1)
+        return -EINVAL;
+
+    SpinLocker lock(&sampler_control_lock);
+    const bool on = buf[0] == '1';
+    if (on && !sampler_enabled)
+    {
+        // start a new profile, the previous samples are discarded
+        if (!sampler_start())
+            return -ENOMEM;
+    }
+
+    __atomic_store_n(&sampler_enabled, on, __ATOMIC_RELEASE);
+    return count;
+}
+
+static bool sampler_sysfs_interval_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%llu\n", sampler_interval);
+    return true;
+}
+
+static size_t sampler_sysfs_interval_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+
+    const s64 interval = strntoll(buf, NULL, 10, count);
+    if (interval <= 0)
+        return -EINVAL;
+
+    SpinLocker lock(&sampler_control_lock);
+    if (sampler_enabled)
+        return -EBUSY;
+
+    sampler_interval = interval;
+    return count;
+}
+
+static sysfs_item_t sampler_sysfs_items[] = {
+    SYSFS_RO_ITEM("folded", sampler_sysfs_folded),
+    SYSFS_RO_ITEM("stat", sampler_sysfs_stat),
+    SYSFS_RW_ITEM("enabled", sampler_sysfs_enabled_show, sampler_sysfs_enabled_store),
+    SYSFS_RW_ITEM("interval", sampler_sysfs_interval_show, sampler_sysfs_interval_store),
+};
+
+SYSFS_AUTOREGISTER(sampler, sampler_sysfs_items);
@@ -2,9 +2,20 @@
 
 #include "mos/misc/setup.hpp"
 
+#include "mos/misc/boottime.hpp"
 #include "mos/misc/cmdline.hpp"
+#include "mos/misc/kallsyms.hpp"
+#include "mos/platform/platform.hpp"
 #include "mos/syslog/printk.hpp"
 
+static const char *const init_target_stages[] = {
+    [INIT_TARGET_POWER] = "init.power",     //
+    [INIT_TARGET_PRE_VFS] = "init.pre_vfs", //
+    [INIT_TARGET_VFS] = "init.vfs",         //
+    [INIT_TARGET_SYSFS] = "init.sysfs",     //
+    [INIT_TARGET_KTHREAD] = "init.kthread", //
+};
+
 void startup_invoke_autoinit(init_target_t target)
 {
     extern const mos_init_t __MOS_INIT_START[];
@@ -12,12 +23,16 @@ void startup_invoke_autoinit(init_target_t target)
 
     for (const mos_init_t *init = __MOS_INIT_START; init < __MOS_INIT_END; init++)
     {
-        if (init->target == target)
-            init->init_fn();
+        if (init->target != target)
+            continue;
+
+        const u64 start = platform_get_timestamp();
+        init->init_fn();
+        boottime_record(init_target_stages[target], kallsyms_get_symbol_name((ptr_t) init->init_fn), start, platform_get_timestamp());
     }
 }
 
-static void do_invoke_setup(const mos_cmdline_hook_t start[], const mos_cmdline_hook_t end[])
+static void do_invoke_setup(const char *stage, const mos_cmdline_hook_t start[], const mos_cmdline_hook_t end[])
 {
     for (const mos_cmdline_hook_t *func = start; func < end; func++)
     {
@@ -36,7 +51,10 @@ static void do_invoke_setup(const mos_cmdline_hook_t start[], const mos_cmdline_
         }
 
         pr_dinfo2(setup, "invoking setup function for '%s'", func->param);
-        if (unlikely(!func->hook(option->arg ?: "")))
+        const u64 hook_start = platform_get_timestamp();
+        const bool ok = func->hook(option->arg ?: "");
+        boottime_record(stage, func->param, hook_start, platform_get_timestamp());
+        if (unlikely(!ok))
         {
             pr_warn("setup function for '%s' failed", func->param);
             continue;
@@ -50,12 +68,12 @@ void startup_invoke_cmdline_hooks(void)
 {
     extern const mos_cmdline_hook_t __MOS_SETUP_START[]; // defined in linker script
     extern const mos_cmdline_hook_t __MOS_SETUP_END[];
-    do_invoke_setup(__MOS_SETUP_START, __MOS_SETUP_END);
+    do_invoke_setup("setup", __MOS_SETUP_START, __MOS_SETUP_END);
 }
 
 void startup_invoke_early_cmdline_hooks(void)
 {
     extern const mos_cmdline_hook_t __MOS_EARLY_SETUP_START[]; // defined in linker script
     extern const mos_cmdline_hook_t __MOS_EARLY_SETUP_END[];
-    do_invoke_setup(__MOS_EARLY_SETUP_START, __MOS_EARLY_SETUP_END);
+    do_invoke_setup("early_setup", __MOS_EARLY_SETUP_START, __MOS_EARLY_SETUP_END);
 }
@@ -37,9 +37,14 @@ static vmfault_result_t cow_zod_fault_handler(vmap_t *vmap, ptr_t fault_addr, pa
 
     if (info->is_present && info->is_write)
     {
-        vmap_stat_dec(vmap, cow); // the faulting page is a CoW page
-        vmap_stat_inc(vmap, regular);
-        return mm_resolve_cow_fault(vmap, fault_addr, info);
+        info->type = VMFAULT_TYPE_COW;
+        const vmfault_result_t result = mm_resolve_cow_fault(vmap, fault_addr, info);
+        if (result == VMFAULT_COMPLETE)
+        {
+            vmap_stat_dec(vmap, cow); // the faulting page is a CoW page
+            vmap_stat_inc(vmap, regular);
+        }
+        return result;
     }
 
     MOS_ASSERT(!info->is_present); // we can't have (present && !write)
@@ -47,12 +52,15 @@ static vmfault_result_t cow_zod_fault_handler(vmap_t *vmap, ptr_t fault_addr, pa
     if (info->is_write)
     {
         // non-present and write, must be a ZoD page
-        info->backing_page = mm_get_free_page();
-        vmap_stat_inc(vmap, regular);
+        info->type = VMFAULT_TYPE_ZOD;
+        info->backing_page = mm_get_free_user_page();
+        if (info->backing_page)
+            vmap_stat_inc(vmap, regular);
         return VMFAULT_MAP_BACKING_PAGE;
     }
     else
     {
+        info->type = VMFAULT_TYPE_ZERO;
         info->backing_page = zero_page();
         vmap_stat_inc(vmap, cow);
         return VMFAULT_MAP_BACKING_PAGE_RO;
@@ -6,12 +6,25 @@
 #include "mos/mm/dma.hpp"
 #include "mos/mm/mm.hpp"
 #include "mos/mm/paging/paging.hpp"
+#include "mos/mm/paging/table_ops.hpp"
 #include "mos/mm/physical/pmm.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/syslog/printk.hpp"
 
+#include <algorithm>
+#include <errno.h>
+#include <mos/lib/structures/list.hpp>
+#include <mos/vector.hpp>
 #include <mos_string.hpp>
 
+struct DmaPin : mos::NamedType<"DmaPin">
+{
+    as_linked_list;
+    ptr_t vaddr;
+    size_t size;
+    mos::vector<pfn_t> pfns;
+};
+
 static pfn_t dmabuf_do_allocate(size_t n_pages, bool do_ref)
 {
     phyframe_t *frames = pmm_allocate_frames(n_pages, PMM_ALLOC_NORMAL);
@@ -68,3 +81,160 @@ bool dmabuf_unshare(ptr_t phys, size_t size, void *buffer)
     pmm_free_frames(pfn_phyframe(pfn), ALIGN_UP_TO_PAGE(size) / MOS_PAGE_SIZE);
     return true;
 }
+
+static void dmabuf_unref_pages(const mos::vector<pfn_t> &pfns)
+{
+    for (size_t i = 0; i < pfns.size(); i++)
+        pmm_unref_one(pfns[i]);
+}
+
+// take a reference on the frame backing a user page, faulting it in first if needed
+static long dmabuf_pin_page(MMContext *mm, ptr_t vaddr, bool device_writes, pfn_t *out_pfn)
+{
+    for (int attempt = 0; attempt < 3; attempt++)
+    {
+        bool present;
+        {
+            SpinLocker lock(&mm->mm_lock);
+            vmap_t *vmap = vmap_obtain(mm, vaddr);
+            if (!vmap)
+                return -EFAULT;
+
+            const bool writable = vmap->vmflags.test(VM_WRITE);
+            spinlock_release(&vmap->lock);
+            if (device_writes && !writable)
+                return -EFAULT;
+
+            const pfn_t pfn = mm_do_get_pfn(mm->pgd, vaddr);
+            present = pfn != 0;
+            if (present && (!device_writes || mm_do_get_flags(mm->pgd, vaddr).test(VM_WRITE)))
+            {
+                // only RAM can be pinned, MMIO and reserved memory is not refcounted
+                if (pfn >= pmm_total_frames || pfn_phyframe(pfn)->state != phyframe::PHYFRAME_ALLOCATED)
+                    return -EINVAL;
+
+                pmm_ref_one(pfn);
+                *out_pfn = pfn;
+                return 0;
+            }
+        }
+
+        // let the fault handler populate the page (or break CoW), as if userspace had touched it
+        pagefault_t info = {
+            .is_present = present,
+            .is_write = device_writes,
+            .is_user = true,
+            .is_exec = false,
+            .ip = 0,
+            .regs = platform_thread_regs(current_thread),
+            .backing_page = nullptr,
+        };
+        mm_handle_fault(vaddr, &info);
+    }
+
+    return -EFAULT;
+}
+
+long dmabuf_pin(void *buffer, size_t size, bool device_writes, dma_segment_t *segments, size_t max_segments)
+{
+    const ptr_t vaddr = (ptr_t) buffer;
+    if (size == 0 || vaddr + size < vaddr || vaddr + size > MOS_USER_END_VADDR)
+        return -EINVAL;
+
+    MMContext *const mm = current_mm;
+    const ptr_t start = ALIGN_DOWN_TO_PAGE(vaddr);
+    const size_t npages = (ALIGN_UP_TO_PAGE(vaddr + size) - start) / MOS_PAGE_SIZE;
+
+    auto pin = mos::create<DmaPin>();
+    pin->vaddr = vaddr;
+    pin->size = size;
+    pin->pfns.reserve(npages);
+
+    size_t n_segments = 0;
+    for (size_t i = 0; i < npages; i++)
+    {
+        pfn_t pfn;
+        if (const long err = dmabuf_pin_page(mm, start + i * MOS_PAGE_SIZE, device_writes, &pfn); err < 0)
+        {
+            dmabuf_unref_pages(pin->pfns);
+            delete pin;
+            return err;
+        }
+
+        if (i == 0 || pfn != pin->pfns[i - 1] + 1)
+            n_segments++;
+        pin->pfns.push_back(pfn);
+    }
+
+    if (n_segments > max_segments)
+    {
+        dmabuf_unref_pages(pin->pfns);
+        delete pin;
+        return n_segments;
+    }
+
+    // the first segment starts at the offset of the buffer in its page, the last one ends with the buffer
+    mos::vector<dma_segment_t> segs;
+    segs.reserve(n_segments);
+    size_t remaining = size, offset = vaddr % MOS_PAGE_SIZE;
+    for (size_t i = 0; i < npages; i++)
+    {
+        const size_t chunk = std::min<size_t>(remaining, MOS_PAGE_SIZE - offset);
+        if (i == 0 || pin->pfns[i] != pin->pfns[i - 1] + 1)
+            segs.push_back(dma_segment_t{ .address = pin->pfns[i] * MOS_PAGE_SIZE + offset, .size = 0 });
+        segs[segs.size() - 1].size += chunk;
+        remaining -= chunk;
+        offset = 0;
+    }
+
+    if (mm_copy_to_user(segments, &segs[0], n_segments * sizeof(dma_segment_t)))
+    {
+        dmabuf_unref_pages(pin->pfns);
+        delete pin;
+        return -EFAULT;
+    }
+
+    pr_dinfo2(dma, "pinned %zu bytes at " PTR_FMT " in %zu segments", size, vaddr, n_segments);
+
+    SpinLocker lock(&mm->mm_lock);
+    linked_list_init(list_node(pin));
+    list_node_append(&mm->dma_pins, list_node(pin));
+    return n_segments;
+}
+
+bool dmabuf_unpin(void *buffer, size_t size)
+{
+    MMContext *const mm = current_mm;
+    DmaPin *found = nullptr;
+
+    {
+        SpinLocker lock(&mm->mm_lock);
+        list_foreach(DmaPin, pin, mm->dma_pins)
+        {
+            if (pin->vaddr == (ptr_t) buffer && pin->size == size)
+            {
+                list_remove(pin);
+                found = pin;
+                break;
+            }
+        }
+    }
+
+    if (!found)
+        return false;
+
+    pr_dinfo2(dma, "unpinned %zu bytes at " PTR_FMT, size, (ptr_t) buffer);
+    dmabuf_unref_pages(found->pfns);
+    delete found;
+    return true;
+}
+
+void dmabuf_release_pins(MMContext *mmctx)
+{
+    list_foreach(DmaPin, pin, mmctx->dma_pins)
+    {
+        list_remove(pin);
+        dmabuf_unref_pages(pin->pfns);
+        delete pin;
+    }
+}
@@ -4,11 +4,15 @@
 
 #include "mos/filesystem/sysfs/sysfs.hpp"
 #include "mos/interrupt/ipi.hpp"
+#include "mos/misc/profiling.hpp"
 #include "mos/misc/setup.hpp"
+#include "mos/mm/dma.hpp"
 #include "mos/mm/paging/paging.hpp"
 #include "mos/mm/paging/pmlx/pml5.hpp"
 #include "mos/mm/paging/table_ops.hpp"
+#include "mos/mm/paging/pmlx/pml1.hpp"
 #include "mos/mm/physical/pmm.hpp"
+#include "mos/mm/swap.hpp"
 #include "mos/platform/platform.hpp"
 #include "mos/platform/platform_defs.hpp"
 #include "mos/tasks/signal.hpp"
@@ -23,6 +27,8 @@
 #include "mos/tasks/process.hpp"
 #endif
 
+#define MM_USER_PAGE_RETRIES 100 // \see swap_wait_for_memory
+
 phyframe_t *mm_get_free_page_raw(void)
 {
     phyframe_t *frame = pmm_allocate_frames(1, PMM_ALLOC_NORMAL);
@@ -44,6 +50,28 @@ phyframe_t *mm_get_free_page(void)
     return frame;
 }
 
+void mm_wait_for_user_pages(void)
+{
+    for (size_t tries = 0; tries < MM_USER_PAGE_RETRIES && swap_should_throttle(); tries++)
+    {
+        if (!swap_wait_for_memory())
+            break;
+    }
+}
+
+phyframe_t *mm_get_free_user_page(void)
+{
+    phyframe_t *frame = pmm_allocate_frames(1, PMM_ALLOC_NORMAL);
+    if (!frame)
+    {
+        mEmerg << "failed to allocate a user page";
+        return NULL;
+    }
+
+    memzero((void *) phyframe_va(frame), MOS_PAGE_SIZE);
+    return frame;
+}
+
 phyframe_t *mm_get_free_pages(size_t npages)
 {
     phyframe_t *frame = pmm_allocate_frames(npages, PMM_ALLOC_NORMAL);
@@ -60,6 +88,7 @@ MMContext *mm_create_context(void)
 {
     MMContext *mmctx = mos::create<MMContext>();
     linked_list_init(&mmctx->mmaps);
+    linked_list_init(&mmctx->dma_pins);
 
     pml4_t pml4 = pml_create_table(pml4);
 
@@ -69,6 +98,7 @@ MMContext *mm_create_context(void)
 
     mmctx->pgd = pgd_create(pml4);
 
+    swap_register_mm(mmctx);
     return mmctx;
 }
 
@@ -76,6 +106,8 @@ void mm_destroy_context(MMContext *mmctx)
 {
     MOS_ASSERT(mmctx != platform_info->kernel_mm); // you can't destroy the kernel mmctx
     MOS_ASSERT(list_is_empty(&mmctx->mmaps));
+    swap_unregister_mm(mmctx);
+    dmabuf_release_pins(mmctx);
 
     ptr_t zero = 0;
     size_t userspace_npages = (MOS_USER_END_VADDR + 1) / MOS_PAGE_SIZE;
@@ -267,13 +299,54 @@ void mm_copy_page(const phyframe_t *src, const phyframe_t *dst)
     memcpy((void *) phyframe_va(dst), (void *) phyframe_va(src), MOS_PAGE_SIZE);
 }
 
+// whether [addr, addr + size) is mapped in the current process, the pages themselves are faulted in on access
+static bool mm_check_user_range(ptr_t addr, size_t size, bool write)
+{
+    if (addr + size < addr || addr + size > MOS_USER_END_VADDR)
+        return false;
+
+    MMContext *const mm = current_mm;
+    SpinLocker lock(&mm->mm_lock);
+    for (ptr_t page = ALIGN_DOWN_TO_PAGE(addr); page < addr + size; page += MOS_PAGE_SIZE)
+    {
+        vmap_t *vmap = vmap_obtain(mm, page);
+        if (!vmap)
+            return false;
+
+        const bool allowed = !write || vmap->vmflags.test(VM_WRITE);
+        spinlock_release(&vmap->lock);
+        if (!allowed)
+            return false;
+    }
+
+    return true;
+}
+
+long mm_copy_to_user(void *user_dst, const void *src, size_t size)
+{
+    if (!mm_check_user_range((ptr_t) user_dst, size, true))
+        return -EFAULT;
+    memcpy(user_dst, src, size);
+    return 0;
+}
+
+long mm_copy_from_user(void *dst, const void *user_src, size_t size)
+{
+    if (!mm_check_user_range((ptr_t) user_src, size, false))
+        return -EFAULT;
+    memcpy(dst, user_src, size);
+    return 0;
+}
+
 vmfault_result_t mm_resolve_cow_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
 {
     MOS_ASSERT(spinlock_is_locked(&vmap->lock));
     MOS_ASSERT(info->is_write && info->is_present);
 
     // fast path to handle CoW
-    phyframe_t *page = mm_get_free_page();
+    phyframe_t *page = mm_get_free_user_page();
+    if (!page)
+        return VMFAULT_CANNOT_HANDLE;
     mm_copy_page(info->faulting_page, page);
     mm_replace_page_locked(vmap->mmctx, fault_addr, phyframe_pfn(page), vmap->vmflags);
 
@@ -363,6 +436,8 @@ static void invalid_page_fault(ptr_t fault_addr, vmap_t *faulting_vmap, vmap_t *
 void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
 {
     const char *unhandled_reason = NULL;
+    const u64 start = platform_get_timestamp();
+    const pf_point_t ev = profile_enter();
 
     dEmph<pagefault> << (info->is_user ? "user" : "kernel") << " #PF: "  //
                      << (current_thread ? current_thread : NULL) << ", " //
@@ -377,10 +452,36 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
     vmap_t *fault_vmap = NULL;
     vmap_t *ip_vmap = NULL;
 
+    // the vmap's lock must be held, if there's one
+    const auto AccountFault = [&](vmap_t *vmap, bool tlb_shootdown)
+    {
+        const u64 time = platform_get_timestamp() - start;
+        if (vmap)
+            vmfault_stat_add(&vmap->fault_stat, info->type, time, tlb_shootdown);
+        if (current_thread)
+            vmfault_stat_add(&current_process->fault_stat, info->type, time, tlb_shootdown);
+        profile_leave(ev, "mm.fault.%s", vmfault_type_names[info->type]);
+    };
+
+    // a swapped-out page is read with no locks held, and the fault is then retried with it
+    phyframe_t *swap_page = NULL;
+    u64 swap_slot = 0; // the slot swap_page was read from, we hold a reference to it
+
+    const auto ReleaseSwapPage = [&]()
+    {
+        if (swap_page)
+            mm_free_page(swap_page), swap_page = NULL;
+        if (swap_slot)
+            swap_put_slot(swap_slot), swap_slot = 0;
+    };
+
     const auto DoUnhandledPageFault = [&]()
     {
         // if we get here, the fault was not handled
         MOS_ASSERT_X(unhandled_reason, "unhandled fault with no reason");
+        ReleaseSwapPage();
+        info->type = VMFAULT_TYPE_INVALID;
+        AccountFault(NULL, false);
         invalid_page_fault(fault_addr, fault_vmap, ip_vmap, info, unhandled_reason);
     };
 
@@ -391,6 +492,9 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
     }
 
     MMContext *const mm = current_mm;
+    mm_wait_for_user_pages(); // the handlers allocate with the locks held, where they can't sleep
+
+retry:
     mm_lock_context_pair(mm);
 
     fault_vmap = vmap_obtain(mm, fault_addr, &offset);
@@ -417,10 +521,13 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
         // vmprotect has been called on this vmap to enable execution
         // we need to make sure that the page is executable
         mm_do_flag(fault_vmap->mmctx->pgd, fault_addr, 1, page_flags | VM_EXEC);
+        info->type = VMFAULT_TYPE_EXEC;
+        AccountFault(fault_vmap, false);
         mm_unlock_context_pair(mm, NULL);
         spinlock_release(&fault_vmap->lock);
         if (ip_vmap != fault_vmap && ip_vmap)
             spinlock_release(&ip_vmap->lock);
+        ReleaseSwapPage();
         return;
     }
 
@@ -447,8 +554,61 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
         };
     };
 
-    dCont<pagefault> << ", handler " << (void *) (ptr_t) fault_vmap->on_fault;
-    vmfault_result_t fault_result = fault_vmap->on_fault(fault_vmap, fault_addr, info);
+    // a page that has been swapped out, whatever the vmap would otherwise do
+    pml1e_t *swap_pml1e = info->is_present ? NULL : mm_do_get_pml1e(fault_vmap->mmctx->pgd, fault_addr);
+    const bool swapped_in_meanwhile = swap_slot && swap_pml1e && platform_pml1e_get_present(swap_pml1e);
+    if (swap_pml1e && !pml1e_is_swap(swap_pml1e))
+        swap_pml1e = NULL;
+
+    vmfault_result_t fault_result;
+    bool replaced_present = false; // a present mapping was changed, other CPUs may still have it in their TLBs
+    if (swapped_in_meanwhile)
+    {
+        dCont<pagefault> << ", swapped in by another thread";
+        info->type = VMFAULT_TYPE_SWAP;
+        fault_result = VMFAULT_COMPLETE;
+    }
+    else if (swap_pml1e)
+    {
+        dCont<pagefault> << ", swapped out";
+        info->type = VMFAULT_TYPE_SWAP;
+
+        const u64 slot = pml1e_get_swap(swap_pml1e);
+        if (swap_slot != slot)
+            ReleaseSwapPage(); // the PTE has changed while we were reading, read again
+
+        if (swap_in(fault_vmap, fault_addr, swap_pml1e, swap_page))
+        {
+            swap_page = NULL; // consumed
+            fault_result = VMFAULT_COMPLETE;
+        }
+        else
+        {
+            // the read sleeps, the slot reference keeps it from being reused until the PTE is checked again
+            swap_ref_slot(slot);
+            if (ip_vmap)
+                spinlock_release(&ip_vmap->lock);
+            if (fault_vmap != ip_vmap)
+                spinlock_release(&fault_vmap->lock);
+            mm_unlock_context_pair(mm, NULL);
+
+            swap_slot = slot;
+            swap_page = swap_read_page(slot);
+            if (!swap_page)
+            {
+                unhandled_reason = "failed to read a swapped-out page";
+                return DoUnhandledPageFault();
+            }
+
+            goto retry;
+        }
+    }
+    else
+    {
+        dCont<pagefault> << ", handler " << (void *) (ptr_t) fault_vmap->on_fault;
+        fault_result = fault_vmap->on_fault(fault_vmap, fault_addr, info);
+        replaced_present = fault_result == VMFAULT_COMPLETE && info->is_present; // e.g. mm_resolve_cow_fault
+    }
     dCont<pagefault> << " -> " << get_fault_result(fault_result);
 
     VMFlags map_flags = fault_vmap->vmflags;
@@ -463,8 +623,9 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
         case VMFAULT_COPY_BACKING_PAGE:
         {
             MOS_ASSERT(info->backing_page);
-            const phyframe_t *page = mm_get_free_page(); // will be ref'd by mm_replace_page_locked()
-            mm_copy_page(info->backing_page, page);
+            const phyframe_t *page = mm_get_free_user_page(); // will be ref'd by mm_replace_page_locked()
+            if (page)
+                mm_copy_page(info->backing_page, page);
             info->backing_page = page;
             goto map_backing_page;
         }
@@ -484,6 +645,8 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
             }
 
             dCont<pagefault> << " (backing page: " << phyframe_pfn(info->backing_page) << ")";
+            const pml1e_t *pml1e = mm_do_get_pml1e(fault_vmap->mmctx->pgd, fault_addr);
+            replaced_present = pml1e && pml1e_is_present(pml1e);
             mm_replace_page_locked(fault_vmap->mmctx, fault_addr, phyframe_pfn(info->backing_page), map_flags);
             fault_result = VMFAULT_COMPLETE;
             break;
@@ -491,12 +654,16 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
     }
 
     MOS_ASSERT_X(fault_result == VMFAULT_COMPLETE || fault_result == VMFAULT_CANNOT_HANDLE, "invalid fault result %d", fault_result);
+    if (fault_result == VMFAULT_COMPLETE)
+        AccountFault(fault_vmap, replaced_present); // the IPI is sent below
     if (ip_vmap)
         spinlock_release(&ip_vmap->lock);
     if (fault_vmap != ip_vmap)
         spinlock_release(&fault_vmap->lock);
     mm_unlock_context_pair(mm, NULL);
-    ipi_send_all(IPI_TYPE_INVALIDATE_TLB);
+    ReleaseSwapPage(); // the page was swapped in by someone else meanwhile, or is no longer needed
+    if (replaced_present)
+        ipi_send_all(IPI_TYPE_INVALIDATE_TLB); // a page that wasn't present can't be cached anywhere
     if (fault_result == VMFAULT_COMPLETE)
         return;
 
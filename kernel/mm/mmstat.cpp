@@ -29,6 +29,29 @@ const char *mem_type_names[_MEM_MAX_TYPES] = {
     [MEM_USER] = "User",           //
 };
 
+const char *vmfault_type_names[_VMFAULT_TYPE_MAX] = {
+    [VMFAULT_TYPE_OTHER] = "other",     //
+    [VMFAULT_TYPE_ZERO] = "zero",       //
+    [VMFAULT_TYPE_ZOD] = "zod",         //
+    [VMFAULT_TYPE_COW] = "cow",         //
+    [VMFAULT_TYPE_FILE] = "file",       //
+    [VMFAULT_TYPE_SWAP] = "swap",       //
+    [VMFAULT_TYPE_EXEC] = "exec",       //
+    [VMFAULT_TYPE_INVALID] = "invalid", //
+};
+
+void vmfault_stat_add(vmfault_stat_t *stat, vmfault_type_t type, u64 time, bool tlb_shootdown)
+{
+    MOS_ASSERT(type < _VMFAULT_TYPE_MAX);
+    __atomic_fetch_add(&stat->count[type], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->time, time, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->tlb_shootdowns, tlb_shootdown, __ATOMIC_RELAXED);
+
+    u64 max = __atomic_load_n(&stat->time_max, __ATOMIC_RELAXED);
+    while (time > max && !__atomic_compare_exchange_n(&stat->time_max, &max, time, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
 void mmstat_inc(mmstat_type_t type, size_t size)
 {
     MOS_ASSERT(type < _MEM_MAX_TYPES);
@@ -181,11 +204,58 @@ static size_t mmstat_sysfs_store_pid(sysfs_file_t *f, const char *buf, size_t co
     return count;
 }
 
+static void mmstat_print_fault_stat(sysfs_file_t *f, const vmfault_stat_t *stat)
+{
+    u64 total = 0;
+    for (u32 i = 0; i < _VMFAULT_TYPE_MAX; i++)
+    {
+        total += stat->count[i];
+        if (stat->count[i])
+            sysfs_printf(f, " %s=%llu", vmfault_type_names[i], stat->count[i]);
+    }
+
+    sysfs_printf(f, " total=%llu", total);
+    if (total)
+        sysfs_printf(f, " avg=%llu max=%llu ipis=%llu", stat->time / total, stat->time_max, stat->tlb_shootdowns);
+}
+
+static bool mmstat_sysfs_faults(sysfs_file_t *f)
+{
+    // every process, then each of its vmaps, with the faults taken in it (times in platform timestamp ticks)
+    for (const auto &[pid, proc] : ProcessTable)
+    {
+        MMContext *const mm = proc->mm;
+        if (!mm || mm == platform_info->kernel_mm)
+            continue;
+
+        sysfs_printf(f, "%pp faults:", proc);
+        mmstat_print_fault_stat(f, &proc->fault_stat);
+        sysfs_printf(f, "
+");
+
+        // faults take the mm lock, the vmaps' stats can't change while it's held
+        spinlock_acquire(&mm->mm_lock);
+        list_foreach(vmap_t, vmap, mm->mmaps)
+        {
+            sysfs_printf(f, "  %pvm
+", (void *) vmap);
+            sysfs_printf(f, "    rss=%zu swap=%zu faults:", vmap->stat.regular + vmap->stat.cow, vmap->stat.swap);
+            mmstat_print_fault_stat(f, &vmap->fault_stat);
+            sysfs_printf(f, "
+");
+        }
+        spinlock_release(&mm->mm_lock);
+    }
+
+    return true;
+}
+
 static sysfs_item_t mmstat_sysfs_items[] = {
     SYSFS_RO_ITEM("stat", mmstat_sysfs_stat),
     SYSFS_RW_ITEM("phyframe_stat", mmstat_sysfs_phyframe_stat_show, mmstat_sysfs_phyframe_stat_store),
     SYSFS_RW_ITEM("pagetable", mmstat_sysfs_pagetable_show, mmstat_sysfs_store_pid),
     SYSFS_RW_ITEM("vmaps", mmstat_sysfs_vmaps_show, mmstat_sysfs_store_pid),
+    SYSFS_RO_ITEM("faults", mmstat_sysfs_faults),
 };
 
 SYSFS_AUTOREGISTER(mmstat, mmstat_sysfs_items);
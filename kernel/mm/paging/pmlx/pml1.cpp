@@ -13,6 +13,11 @@
 #error "Give up your mind"
 #endif
 
+// the hardware ignores everything else in an entry once the present bit (bit 0 on all platforms) is clear
+#define PML1E_SWAP_MARKER BIT(1)
+#define PML1E_SWAP_SHIFT  12
+#define PML1E_SWAP_BITS   40
+
 void pml1_traverse(pml1_t pml1, ptr_t *vaddr, size_t *n_pages, pagetable_walk_options_t callback, void *data)
 {
     for (size_t pml1_i = pml1_index(*vaddr); pml1_i < PML1_ENTRIES && *n_pages; pml1_i++)
@@ -58,3 +63,20 @@ pfn_t pml1e_get_pfn(const pml1e_t *pml1e)
 {
     return platform_pml1e_get_pfn(pml1e);
 }
+
+bool pml1e_is_swap(const pml1e_t *pml1e)
+{
+    return !platform_pml1e_get_present(pml1e) && (pml1e->content & PML1E_SWAP_MARKER);
+}
+
+u64 pml1e_get_swap(const pml1e_t *pml1e)
+{
+    MOS_ASSERT(pml1e_is_swap(pml1e));
+    return ((u64) pml1e->content >> PML1E_SWAP_SHIFT) & (BIT(PML1E_SWAP_BITS) - 1);
+}
+
+void pml1e_set_swap(pml1e_t *pml1e, u64 slot)
+{
+    MOS_ASSERT(slot && slot < BIT(PML1E_SWAP_BITS));
+    pml1e->content = (pte_content_t) ((slot << PML1E_SWAP_SHIFT) | PML1E_SWAP_MARKER);
+}
@@ -7,6 +7,7 @@
 #include "mos/mm/paging/pmlx/pml2.hpp"
 #include "mos/mm/paging/pmlx/pml3.hpp"
 #include "mos/mm/paging/pmlx/pml4.hpp"
+#include "mos/mm/swap.hpp"
 #include "mos/platform/platform.hpp"
 
 #include <mos/mos_global.h>
@@ -25,6 +26,11 @@ static void pml1e_do_copy_callback(pml1_t pml1, pml1e_t *src_e, ptr_t vaddr, voi
         pmm_ref_one(platform_pml1e_get_pfn(src_e));
         copy_data->dest_pml1e->content = src_e->content;
     }
+    else if (pml1e_is_swap(src_e))
+    {
+        swap_ref_slot(pml1e_get_swap(src_e)); // both now read the page back from the same slot
+        copy_data->dest_pml1e->content = src_e->content;
+    }
     else
     {
         pmlxe_destroy(copy_data->dest_pml1e);
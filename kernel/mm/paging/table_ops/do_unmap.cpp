@@ -2,6 +2,8 @@
 
 #include "mos/mm/paging/table_ops/do_unmap.hpp"
 
+#include "mos/mm/paging/pmlx/pml1.hpp"
+#include "mos/mm/swap.hpp"
 #include "mos/platform/platform.hpp"
 
 static void pml1e_do_unmap_callback(pml1_t pml1, pml1e_t *e, ptr_t vaddr, void *data)
@@ -10,6 +12,14 @@ static void pml1e_do_unmap_callback(pml1_t pml1, pml1e_t *e, ptr_t vaddr, void *
     MOS_UNUSED(vaddr);
 
     struct pagetable_do_unmap_data *unmap_data = (pagetable_do_unmap_data *) data;
+    if (pml1e_is_swap(e))
+    {
+        if (unmap_data->do_unref)
+            swap_put_slot(pml1e_get_swap(e));
+        pmlxe_destroy(e);
+        return;
+    }
+
     if (!platform_pml1e_get_present(e))
         return; // nothing to do (page isn't mapped)
 
@@ -0,0 +1,653 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/mm/swap.hpp"
+
+#include "mos/device/timer.hpp"
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/interrupt/ipi.hpp"
+#include "mos/mm/paging/paging.hpp"
+#include "mos/mm/paging/pmlx/pml1.hpp"
+#include "mos/mm/paging/table_ops.hpp"
+#include "mos/mm/physical/pmm.hpp"
+#include "mos/platform/platform.hpp"
+#include "mos/tasks/kthread.hpp"
+#include "proto/blockdev.pb.h"
+#include "proto/blockdev.service.h"
+
+#include <algorithm>
+#include <librpc/macro_magic.h>
+#include <librpc/rpc.h>
+#include <librpc/rpc_client.h>
+#include <mos/hashmap.hpp>
+#include <mos/lib/structures/list.hpp>
+#include <mos/lib/sync/mutex.hpp>
+#include <mos/lib/sync/spinlock.hpp>
+#include <mos/string.hpp>
+#include <mos_stdlib.hpp>
+#include <mos_string.hpp>
+#include <pb.h>
+
+#define BLOCKDEV_MANAGER_RPC_SERVER_NAME "mos.blockdev-manager" // \see userspace/services/blockdev-manager/include/blockdev.h
+
+#define SWAP_BATCH_PAGES      32   // pages evicted, and written, at once
+#define SWAP_SCAN_BUDGET      4096 // PTEs looked at for one batch at most
+#define SWAP_MAX_IDLE_BATCHES 64   // give up reclaiming after this many batches that found nothing
+#define SWAP_SLOT_MAX_REF     0xff // a slot referenced this many times is never freed
+#define KSWAPD_INTERVAL_MS    50
+#define SWAP_THROTTLE_MS      10
+
+MOS_RPC_BLOCKDEVMANAGER_CLIENT(blockdev_manager)
+
+struct SwapCacheEntry
+{
+    phyframe_t *frame; ///< the swap cache holds a reference to it
+    bool writing;      ///< false once the write has failed, the page then stays here until it's faulted back in
+};
+
+// the device, set up once by swap_activate()
+static bool swap_active = false;
+static rpc_server_stub_t *swap_rpc = NULL;
+static mosrpc_blockdev_blockdev swap_device = {};
+static mos::string swap_device_name;
+static u32 swap_blocks_per_page = 0;
+static mutex_t swap_io_lock; ///< one request to the blockdev manager at a time
+static pb_bytes_array_t *swap_write_buffer = NULL; ///< SWAP_BATCH_PAGES pages, only kswapd writes
+
+// watermarks, in free frames
+static size_t swap_min_frames = 0;  ///< below this, only swap-exempt processes may allocate right away
+static size_t swap_low_frames = 0;  ///< below this, kswapd starts reclaiming
+static size_t swap_high_frames = 0; ///< and stops again above this
+
+static spinlock_t swap_lock; ///< protects everything below
+static u8 *swap_slot_refs = NULL;
+static u64 swap_n_slots = 0, swap_used_slots = 0, swap_next_slot = 1;
+static mos::HashMap<u64, SwapCacheEntry> swap_cache; ///< pages being written out (or that failed to)
+
+static struct
+{
+    size_t swapped_out, swapped_in;
+    size_t cache_hits;
+    size_t write_errors, read_errors;
+} swap_stats;
+
+static list_head swap_mm_list; ///< user address spaces, in the order kswapd visits them
+static spinlock_t swap_mm_list_lock;
+static size_t swap_mm_count = 0;
+
+static bool kswapd_wakeup = false;
+
+static size_t swap_free_frames(void)
+{
+    return pmm_total_frames - pmm_allocated_frames - pmm_reserved_frames;
+}
+
+// ! slots
+
+static u64 swap_alloc_slot_locked(void)
+{
+    MOS_ASSERT(spinlock_is_locked(&swap_lock));
+    if (swap_used_slots + 1 >= swap_n_slots)
+        return 0;
+
+    // next-fit, so that pages evicted together end up next to each other
+    for (u64 i = 1; i < swap_n_slots; i++)
+    {
+        const u64 slot = swap_next_slot;
+        swap_next_slot = swap_next_slot + 1 == swap_n_slots ? 1 : swap_next_slot + 1;
+
+        // a freed slot may still be being written to, don't reuse it until that's done
+        if (swap_slot_refs[slot] == 0 && !swap_cache.contains(slot))
+        {
+            swap_slot_refs[slot] = 1;
+            swap_used_slots++;
+            return slot;
+        }
+    }
+
+    return 0;
+}
+
+static void swap_put_slot_locked(u64 slot)
+{
+    MOS_ASSERT(spinlock_is_locked(&swap_lock));
+    MOS_ASSERT_X(slot && slot < swap_n_slots && swap_slot_refs[slot], "invalid swap slot %llu", slot);
+
+    if (swap_slot_refs[slot] == SWAP_SLOT_MAX_REF)
+        return; // it has lost count
+
+    if (--swap_slot_refs[slot])
+        return;
+
+    swap_used_slots--;
+
+    // nobody needs the page anymore, unless the write is still reading from it, it then drops the page itself
+    const auto cached = swap_cache.get(slot);
+    if (cached && !cached->writing)
+    {
+        swap_cache.remove(slot);
+        pmm_unref_one(cached->frame);
+    }
+}
+
+void swap_ref_slot(u64 slot)
+{
+    SpinLocker locker(&swap_lock);
+    MOS_ASSERT_X(slot && slot < swap_n_slots && swap_slot_refs[slot], "invalid swap slot %llu", slot);
+    if (swap_slot_refs[slot] < SWAP_SLOT_MAX_REF)
+        swap_slot_refs[slot]++;
+}
+
+void swap_put_slot(u64 slot)
+{
+    SpinLocker locker(&swap_lock);
+    swap_put_slot_locked(slot);
+}
+
+// ! I/O
+
+static bool swap_read_slot(u64 slot, phyframe_t *page)
+{
+    mosrpc_blockdev_read_block_request req = {};
+    req.device = swap_device;
+    req.n_boffset = slot * swap_blocks_per_page;
+    req.n_blocks = swap_blocks_per_page;
+
+    mosrpc_blockdev_read_block_response resp = {};
+
+    mutex_acquire(&swap_io_lock);
+    const int result = blockdev_manager_read_block(swap_rpc, &req, &resp);
+    mutex_release(&swap_io_lock);
+
+    const bool ok = result == RPC_RESULT_OK && resp.result.success && resp.data && resp.data->size == MOS_PAGE_SIZE;
+    if (ok)
+        memcpy((void *) phyframe_va(page), resp.data->bytes, MOS_PAGE_SIZE);
+    else
+        mWarn << "swap: failed to read slot " << slot << " (" << result << ")";
+
+    pb_release(mosrpc_blockdev_read_block_response_fields, &resp);
+    return ok;
+}
+
+// write pages to consecutive slots with one request
+static bool swap_write_slots(u64 first, phyframe_t *const *pages, size_t n_pages)
+{
+    mosrpc_blockdev_write_block_request req = {};
+    req.device = swap_device;
+    req.n_boffset = first * swap_blocks_per_page;
+    req.n_blocks = n_pages * swap_blocks_per_page;
+    req.data = swap_write_buffer;
+    req.data->size = n_pages * MOS_PAGE_SIZE;
+    for (size_t i = 0; i < n_pages; i++)
+        memcpy(req.data->bytes + i * MOS_PAGE_SIZE, (void *) phyframe_va(pages[i]), MOS_PAGE_SIZE);
+
+    mosrpc_blockdev_write_block_response resp = {};
+
+    mutex_acquire(&swap_io_lock);
+    const int result = blockdev_manager_write_block(swap_rpc, &req, &resp);
+    mutex_release(&swap_io_lock);
+
+    const bool ok = result == RPC_RESULT_OK && resp.result.success;
+    if (!ok)
+        mWarn << "swap: failed to write " << n_pages << " pages at slot " << first << " (" << result << ")";
+
+    pb_release(mosrpc_blockdev_write_block_response_fields, &resp); // the request owns nothing, the buffer is reused
+    return ok;
+}
+
+static void swap_complete_write(u64 slot, bool ok)
+{
+    SpinLocker locker(&swap_lock);
+    const auto cached = swap_cache.get(slot);
+    MOS_ASSERT(cached);
+
+    if (ok || swap_slot_refs[slot] == 0)
+    {
+        swap_cache.remove(slot);
+        pmm_unref_one(cached->frame);
+    }
+    else
+    {
+        swap_cache[slot].writing = false; // it's the only copy of the page
+        swap_stats.write_errors++;
+    }
+}
+
+// ! swap-out
+
+struct SwapOutBatch
+{
+    u64 slots[SWAP_BATCH_PAGES];
+    phyframe_t *frames[SWAP_BATCH_PAGES];
+    size_t n = 0;
+    size_t scanned = 0;
+    bool slots_exhausted = false;
+};
+
+static bool swap_vmap_eligible(const vmap_t *vmap)
+{
+    // only private anonymous memory, everything else is either shared or can be read back from its file
+    return !vmap->io && vmap->type == VMAP_TYPE_PRIVATE && (vmap->content == VMAP_STACK || vmap->content == VMAP_MMAP);
+}
+
+// evict the pages of a vmap that haven't been accessed since the last visit, returns false if the batch is full
+static bool swap_scan_vmap(vmap_t *vmap, SwapOutBatch *batch)
+{
+    MMContext *const mm = vmap->mmctx;
+    const ptr_t end = vmap->vaddr + vmap->npages * MOS_PAGE_SIZE;
+
+    for (ptr_t vaddr = std::max(mm->swap_cursor, vmap->vaddr); vaddr < end; vaddr += MOS_PAGE_SIZE)
+    {
+        if (batch->n == SWAP_BATCH_PAGES || batch->scanned == SWAP_SCAN_BUDGET || batch->slots_exhausted)
+            return false;
+
+        mm->swap_cursor = vaddr + MOS_PAGE_SIZE;
+        batch->scanned++;
+
+        pml1e_t *pml1e = mm_do_get_pml1e(mm->pgd, vaddr);
+        if (!pml1e || !platform_pml1e_get_present(pml1e))
+            continue;
+
+        // read-only pages are the zero page, or still shared with a parent or child
+        if (!platform_pml1e_get_flags(pml1e).test(VM_WRITE))
+            continue;
+
+        const pfn_t pfn = platform_pml1e_get_pfn(pml1e);
+        if (pfn >= pmm_total_frames)
+            continue;
+
+        // a page mapped elsewhere too, or pinned for DMA, has to stay
+        phyframe_t *frame = pfn_phyframe(pfn);
+        if (frame->state != phyframe::PHYFRAME_ALLOCATED || frame->alloc.refcount != 1)
+            continue;
+
+        if (platform_pml1e_test_and_clear_accessed(pml1e))
+            continue; // second chance
+
+        SpinLocker locker(&swap_lock);
+        const u64 slot = swap_alloc_slot_locked();
+        if (!slot)
+        {
+            batch->slots_exhausted = true;
+            return false;
+        }
+
+        // the reference the mapping had now belongs to the swap cache
+        pml1e_set_swap(pml1e, slot);
+        platform_invalidate_tlb(vaddr);
+        swap_cache.insert(slot, SwapCacheEntry{ .frame = frame, .writing = true });
+        vmap_stat_dec(vmap, regular);
+        vmap_stat_inc(vmap, swap);
+        swap_stats.swapped_out++;
+
+        batch->slots[batch->n] = slot;
+        batch->frames[batch->n] = frame;
+        batch->n++;
+    }
+
+    return true;
+}
+
+// scan an address space from where the last visit stopped, returns false if it wasn't scanned to its end
+static bool swap_scan_mm(MMContext *mm, SwapOutBatch *batch)
+{
+    // whoever holds the locks is using the address space right now (or is faulting, possibly waiting for us)
+    if (mm->swap_exempt || !spinlock_try_acquire(&mm->mm_lock))
+        return true;
+
+    list_foreach(vmap_t, vmap, mm->mmaps)
+    {
+        if (vmap->vaddr + vmap->npages * MOS_PAGE_SIZE <= mm->swap_cursor || !swap_vmap_eligible(vmap))
+            continue;
+
+        if (!spinlock_try_acquire(&vmap->lock))
+            continue;
+
+        const bool completed = swap_scan_vmap(vmap, batch);
+        spinlock_release(&vmap->lock);
+
+        if (!completed)
+        {
+            spinlock_release(&mm->mm_lock);
+            return false;
+        }
+    }
+
+    mm->swap_cursor = 0;
+    spinlock_release(&mm->mm_lock);
+    return true;
+}
+
+// evict a batch of pages and write them out, returns the number of pages evicted
+static size_t swap_out_batch(void)
+{
+    SwapOutBatch batch;
+
+    spinlock_acquire(&swap_mm_list_lock);
+    for (size_t visited = 0; visited < swap_mm_count; visited++)
+    {
+        MMContext *mm = list_entry(swap_mm_list.next, MMContext);
+        if (!swap_scan_mm(mm, &batch))
+            break; // continue with this one next time
+
+        // round-robin over the address spaces
+        list_remove(mm);
+        list_node_append(&swap_mm_list, list_node(mm));
+    }
+    spinlock_release(&swap_mm_list_lock);
+
+    if (batch.slots_exhausted && !batch.n)
+        dInfo2<swap> << "swap area is full";
+
+    if (!batch.n)
+        return 0;
+
+    // other CPUs may still write through stale TLB entries, they have to be gone before the data is read
+    ipi_invalidate_tlb_sync();
+
+    // slots are handed out in order, so runs of consecutive ones are written together
+    for (size_t i = 0; i < batch.n;)
+    {
+        size_t run = 1;
+        while (i + run < batch.n && batch.slots[i + run] == batch.slots[i] + run)
+            run++;
+
+        const bool ok = swap_write_slots(batch.slots[i], &batch.frames[i], run);
+        for (size_t j = i; j < i + run; j++)
+            swap_complete_write(batch.slots[j], ok);
+
+        i += run;
+    }
+
+    dInfo2<swap> << "swapped out " << batch.n << " pages, " << swap_free_frames() << " frames free";
+    return batch.n;
+}
+
+static void swap_reclaim(void)
+{
+    size_t idle_batches = 0;
+    while (swap_free_frames() < swap_high_frames && idle_batches < SWAP_MAX_IDLE_BATCHES)
+        idle_batches = swap_out_batch() ? 0 : idle_batches + 1;
+}
+
+static void kswapd_entry(void *arg)
+{
+    MOS_UNUSED(arg);
+    while (true)
+    {
+        if (kswapd_wakeup || swap_free_frames() < swap_low_frames)
+        {
+            kswapd_wakeup = false;
+            swap_reclaim();
+        }
+
+        timer_msleep(KSWAPD_INTERVAL_MS);
+    }
+}
+
+// ! swap-in
+
+static void swap_map_page_locked(vmap_t *vmap, ptr_t vaddr, pml1e_t *pml1e, phyframe_t *page, u64 slot)
+{
+    MOS_ASSERT(spinlock_is_locked(&swap_lock));
+    pmlxe_destroy(pml1e);
+    mm_replace_page_locked(vmap->mmctx, vaddr, phyframe_pfn(page), vmap->vmflags);
+    swap_put_slot_locked(slot);
+
+    vmap_stat_dec(vmap, swap);
+    vmap_stat_inc(vmap, regular);
+    swap_stats.swapped_in++;
+}
+
+bool swap_in(vmap_t *vmap, ptr_t fault_addr, pml1e_t *pml1e, phyframe_t *page)
+{
+    MOS_ASSERT(spinlock_is_locked(&vmap->lock));
+    const u64 slot = pml1e_get_swap(pml1e);
+
+    SpinLocker locker(&swap_lock);
+    if (page)
+    {
+        swap_map_page_locked(vmap, fault_addr, pml1e, page, slot);
+        dInfo2<swap> << "swap-in of slot " << slot;
+        return true;
+    }
+
+    const auto cached = swap_cache.get(slot);
+    if (!cached || swap_slot_refs[slot] != 1)
+        return false; // it has to be read, or copied, which may sleep
+
+    // nobody else uses the slot, take the page back as it is
+    swap_stats.cache_hits++;
+    swap_map_page_locked(vmap, fault_addr, pml1e, cached->frame, slot);
+    dInfo2<swap> << "swap-in of slot " << slot << " from the swap cache";
+    return true;
+}
+
+phyframe_t *swap_read_page(u64 slot)
+{
+    phyframe_t *source = NULL; // the page is still in the swap cache, but shared with others
+
+    spinlock_acquire(&swap_lock);
+    if (const auto cached = swap_cache.get(slot))
+    {
+        swap_stats.cache_hits++;
+        source = pmm_ref_one(cached->frame);
+    }
+    spinlock_release(&swap_lock);
+
+    phyframe_t *page = mm_get_free_user_page();
+    if (!page)
+    {
+        if (source)
+            pmm_unref_one(source);
+        return NULL;
+    }
+
+    if (source)
+    {
+        memcpy((void *) phyframe_va(page), (void *) phyframe_va(source), MOS_PAGE_SIZE);
+        pmm_unref_one(source);
+    }
+    else if (!swap_read_slot(slot, page))
+    {
+        spinlock_acquire(&swap_lock);
+        swap_stats.read_errors++;
+        spinlock_release(&swap_lock);
+        mm_free_page(page);
+        return NULL;
+    }
+
+    return page;
+}
+
+// ! memory pressure
+
+bool swap_should_throttle(void)
+{
+    if (!swap_active || swap_free_frames() >= swap_min_frames)
+        return false;
+
+    // processes that swap I/O may depend on (the blockdev manager, drivers) get to use the reserve
+    return !current_mm->swap_exempt;
+}
+
+bool swap_wait_for_memory(void)
+{
+    if (!swap_active)
+        return false;
+
+    kswapd_wakeup = true;
+    timer_msleep(SWAP_THROTTLE_MS);
+    return true;
+}
+
+void swap_register_mm(MMContext *mmctx)
+{
+    SpinLocker locker(&swap_mm_list_lock);
+    list_node_append(&swap_mm_list, list_node(mmctx));
+    swap_mm_count++;
+}
+
+void swap_unregister_mm(MMContext *mmctx)
+{
+    SpinLocker locker(&swap_mm_list_lock);
+    list_remove(mmctx);
+    swap_mm_count--;
+}
+
+// ! activation
+
+long swap_activate(const char *device)
+{
+    if (swap_active)
+        return -EBUSY;
+
+    rpc_server_stub_t *rpc = rpc_client_create(BLOCKDEV_MANAGER_RPC_SERVER_NAME);
+    if (!rpc)
+    {
+        mWarn << "swap: failed to connect to " << BLOCKDEV_MANAGER_RPC_SERVER_NAME;
+        return -ENODEV;
+    }
+
+    // the kernel can't receive a direct channel, all I/O goes through the manager
+    mosrpc_blockdev_open_device_request open_req = {};
+    open_req.device_name = (char *) device;
+    open_req.manager_only = true;
+    mosrpc_blockdev_open_device_response open_resp = {};
+    const int result = blockdev_manager_open_device(rpc, &open_req, &open_resp);
+    const bool opened = result == RPC_RESULT_OK && open_resp.result.success;
+    const auto handle = open_resp.device;
+    const u32 block_size = open_resp.block_size;
+    const u64 device_size = open_resp.n_blocks * block_size;
+    pb_release(mosrpc_blockdev_open_device_response_fields, &open_resp);
+
+    if (!opened)
+    {
+        mWarn << "swap: failed to open block device '" << device << "'";
+        rpc_client_destroy(rpc);
+        return -ENOENT;
+    }
+
+    if (!block_size || MOS_PAGE_SIZE % block_size)
+    {
+        mWarn << "swap: unsupported block size " << block_size << " of '" << device << "'";
+        rpc_client_destroy(rpc);
+        return -EINVAL;
+    }
+
+    swap_rpc = rpc;
+    swap_device = handle;
+    swap_blocks_per_page = MOS_PAGE_SIZE / block_size;
+
+    phyframe_t *header_page = mm_get_free_page();
+    if (!header_page)
+    {
+        rpc_client_destroy(rpc);
+        return -ENOMEM;
+    }
+
+    const bool header_read = swap_read_slot(0, header_page);
+    const swap_header_t header = *(const swap_header_t *) phyframe_va(header_page);
+    mm_free_page(header_page);
+
+    if (!header_read || memcmp(header.magic, SWAP_MAGIC, sizeof(header.magic)) != 0 || header.version != SWAP_VERSION)
+    {
+        mWarn << "swap: '" << device << "' is not a swap area, run mkswap on it first";
+        rpc_client_destroy(rpc);
+        return -EINVAL;
+    }
+
+    if (header.page_size != MOS_PAGE_SIZE)
+    {
+        mWarn << "swap: '" << device << "' was made for " << header.page_size << "-byte pages";
+        rpc_client_destroy(rpc);
+        return -EINVAL;
+    }
+
+    const u64 n_slots = std::min<u64>(header.n_slots, device_size / MOS_PAGE_SIZE);
+    if (n_slots < 2)
+    {
+        mWarn << "swap: '" << device << "' is too small";
+        rpc_client_destroy(rpc);
+        return -EINVAL;
+    }
+
+    // allocated up front, kswapd can't fail to write because memory is short, that's when it runs
+    swap_write_buffer = (pb_bytes_array_t *) kcalloc<char>(PB_BYTES_ARRAY_T_ALLOCSIZE(SWAP_BATCH_PAGES * MOS_PAGE_SIZE));
+    if (!swap_write_buffer)
+    {
+        rpc_client_destroy(rpc);
+        return -ENOMEM;
+    }
+
+    const size_t map_npages = ALIGN_UP_TO_PAGE(n_slots) / MOS_PAGE_SIZE;
+    phyframe_t *refs_frames = mm_get_free_pages(map_npages);
+    if (!refs_frames)
+    {
+        kfree(swap_write_buffer);
+        swap_write_buffer = NULL;
+        rpc_client_destroy(rpc);
+        return -ENOMEM;
+    }
+    pmm_ref(refs_frames, map_npages);
+    memzero((void *) phyframe_va(refs_frames), map_npages * MOS_PAGE_SIZE);
+
+    spinlock_acquire(&swap_lock);
+    swap_slot_refs = (u8 *) phyframe_va(refs_frames);
+    swap_slot_refs[0] = SWAP_SLOT_MAX_REF; // the header
+    swap_n_slots = n_slots;
+    swap_used_slots = 0;
+    swap_next_slot = 1;
+    spinlock_release(&swap_lock);
+
+    swap_device_name = device;
+    swap_min_frames = std::max<size_t>(pmm_total_frames / 128, SWAP_BATCH_PAGES);
+    swap_low_frames = std::max<size_t>(pmm_total_frames / 32, 2 * swap_min_frames);
+    swap_high_frames = std::max<size_t>(pmm_total_frames / 16, 2 * swap_low_frames);
+    swap_active = true;
+
+    kthread_create(kswapd_entry, NULL, "kswapd");
+    mInfo << "swap: using '" << device << "', " << (n_slots - 1) << " slots";
+    return 0;
+}
+
+// ! sysfs support
+
+static bool swap_sysfs_stat(sysfs_file_t *f)
+{
+    if (!swap_active)
+    {
+        sysfs_printf(f, "%-20s: %s\n", "Device", "(none)");
+        return true;
+    }
+
+    spinlock_acquire(&swap_lock);
+    const u64 total = swap_n_slots - 1, used = swap_used_slots;
+    const size_t cached = swap_cache.size();
+    const auto stats = swap_stats;
+    spinlock_release(&swap_lock);
+
+    char size_buf[32];
+    sysfs_printf(f, "%-20s: %s\n", "Device", swap_device_name.c_str());
+
+    format_size(size_buf, sizeof(size_buf), total * MOS_PAGE_SIZE);
+    sysfs_printf(f, "%-20s: %s, %llu pages\n", "Total", size_buf, total);
+
+    format_size(size_buf, sizeof(size_buf), used * MOS_PAGE_SIZE);
+    sysfs_printf(f, "%-20s: %s, %llu pages\n", "Used", size_buf, used);
+
+    sysfs_printf(f, "%-20s: %zu pages\n", "SwapCache", cached);
+    sysfs_printf(f, "%-20s: %zu pages\n", "SwappedOut", stats.swapped_out);
+    sysfs_printf(f, "%-20s: %zu pages\n", "SwappedIn", stats.swapped_in);
+    sysfs_printf(f, "%-20s: %zu\n", "CacheHits", stats.cache_hits);
+    sysfs_printf(f, "%-20s: %zu\n", "WriteErrors", stats.write_errors);
+    sysfs_printf(f, "%-20s: %zu\n", "ReadErrors", stats.read_errors);
+    sysfs_printf(f, "%-20s: %zu / %zu / %zu frames\n", "Watermarks", swap_min_frames, swap_low_frames, swap_high_frames);
+    return true;
+}
+
+static sysfs_item_t swap_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", swap_sysfs_stat),
+};
+
+SYSFS_AUTOREGISTER(swap, swap_sysfs_items);
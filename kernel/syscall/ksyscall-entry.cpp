@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mos/device/timer.hpp"
+#include "mos/interrupt/irq_io.hpp"
 #include "mos/ipc/ipc_io.hpp"
 #include "mos/ipc/memfd.hpp"
 #include "mos/ipc/pipe.hpp"
@@ -8,6 +9,8 @@
 #include "mos/misc/kutils.hpp"
 #include "mos/misc/power.hpp"
 #include "mos/mm/dma.hpp"
+#include "mos/mm/mm.hpp"
+#include "mos/mm/swap.hpp"
 #include "mos/tasks/signal.hpp"
 
 #include <bits/posix/iovec.h>
@@ -207,9 +210,22 @@ DEFINE_SYSCALL(fd_t, ipc_create)(const char *name, size_t max_pending_connection
     auto io = ipc_create(name, max_pending_connections);
     if (io.isErr())
         return io.getErr();
+
+    // servers are never swapped out, swap I/O may well go through them (the blockdev manager, the drivers)
+    current_process->mm->swap_exempt = true;
     return process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
 }
 
+DEFINE_SYSCALL(fd_t, ipc_register)(const char *name, size_t max_pending_connections)
+{
+    auto io = ipc_register(name, max_pending_connections);
+    if (io.isErr())
+        return io.getErr();
+
+    // the registrant starts the server, which mustn't inherit the registration
+    return process_attach_ref_fd(current_process, io.get(), FD_FLAGS_CLOEXEC);
+}
+
 DEFINE_SYSCALL(fd_t, ipc_accept)(fd_t listen_fd)
 {
     IO *server = process_get_fd(current_process, listen_fd);
@@ -223,6 +239,22 @@ DEFINE_SYSCALL(fd_t, ipc_accept)(fd_t listen_fd)
     return process_attach_ref_fd(current_process, client_io.get(), FD_FLAGS_NONE);
 }
 
+DEFINE_SYSCALL(fd_t, ipc_accept_ex)(fd_t listen_fd, u64 flags)
+{
+    if (flags & ~(u64) IPC_CONNECT_SHM_RING)
+        return -EINVAL;
+
+    IO *server = process_get_fd(current_process, listen_fd);
+    if (server == NULL)
+        return -EBADF;
+
+    auto client_io = ipc_accept(server, (ipc_connect_flags_t) flags);
+    if (client_io.isErr())
+        return client_io.getErr();
+
+    return process_attach_ref_fd(current_process, client_io.get(), FD_FLAGS_NONE);
+}
+
 DEFINE_SYSCALL(fd_t, ipc_connect)(const char *server, size_t buffer_size)
 {
     auto io = ipc_connect(server, buffer_size);
@@ -231,6 +263,80 @@ DEFINE_SYSCALL(fd_t, ipc_connect)(const char *server, size_t buffer_size)
     return process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
 }
 
+DEFINE_SYSCALL(fd_t, ipc_connect_ex)(const char *server, size_t buffer_size, u64 flags)
+{
+    if (flags & ~(u64) IPC_CONNECT_SHM_RING)
+        return -EINVAL;
+
+    auto io = ipc_connect(server, buffer_size, (ipc_connect_flags_t) flags);
+    if (io.isErr())
+        return io.getErr();
+    return process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
+}
+
+DEFINE_SYSCALL(long, ipc_send_fd)(fd_t conn, fd_t fd)
+{
+    IO *conn_io = process_get_fd(current_process, conn);
+    IO *io = process_get_fd(current_process, fd);
+    if (conn_io == NULL || io == NULL)
+        return -EBADF;
+
+    return ipc_send_io(conn_io, io);
+}
+
+DEFINE_SYSCALL(fd_t, ipc_recv_fd)(fd_t conn, u64 handle)
+{
+    IO *conn_io = process_get_fd(current_process, conn);
+    if (conn_io == NULL)
+        return -EBADF;
+
+    if (handle == 0 || handle > (u32) -1)
+        return -ENOENT;
+
+    auto io = ipc_receive_io(conn_io, handle);
+    if (io.isErr())
+        return io.getErr();
+
+    const fd_t fd = process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
+    io.get()->unref(); // drop the reference held while the IO was in flight
+    return fd;
+}
+
+DEFINE_SYSCALL(fd_t, irq_open)(u32 irq)
+{
+    if (!current_process->privileged)
+        return -EPERM;
+
+    auto io = irq_io_open(irq);
+    if (io.isErr())
+        return io.getErr();
+    return process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
+}
+
+DEFINE_SYSCALL(fd_t, irq_open_msi)(u64 *address, u32 *data)
+{
+    if (!current_process->privileged)
+        return -EPERM;
+
+    u64 msi_address;
+    u32 msi_data;
+    auto io = irq_io_open_msi(&msi_address, &msi_data);
+    if (io.isErr())
+        return io.getErr();
+
+    const fd_t fd = process_attach_ref_fd(current_process, io.get(), FD_FLAGS_NONE);
+    if (IS_ERR_VALUE(fd))
+        return fd;
+
+    if (mm_copy_to_user(address, &msi_address, sizeof(msi_address)) || mm_copy_to_user(data, &msi_data, sizeof(msi_data)))
+    {
+        process_detach_fd(current_process, fd); // the vector is freed with the IO
+        return -EFAULT;
+    }
+
+    return fd;
+}
+
 DEFINE_SYSCALL(u64, arch_syscall)(u64 syscall, u64 arg1, u64 arg2, u64 arg3, u64 arg4)
 {
     return platform_arch_syscall(syscall, arg1, arg2, arg3, arg4);
@@ -489,6 +595,11 @@ DEFINE_SYSCALL(long, clock_msleep)(u64 ms)
     return 0;
 }
 
+DEFINE_SYSCALL(long, clock_nsleep)(u64 ns)
+{
+    return timer_nsleep(ns);
+}
+
 DEFINE_SYSCALL(fd_t, io_dup)(fd_t fd)
 {
     IO *io = process_get_fd(current_process, fd);
@@ -541,6 +652,36 @@ DEFINE_SYSCALL(bool, dmabuf_unshare)(ptr_t phys, size_t size, void *buf)
     return dmabuf_unshare(phys, size, buf);
 }
 
+DEFINE_SYSCALL(long, dmabuf_pin)(void *buffer, size_t size, bool device_writes, dma_segment_t *segments, size_t max_segments)
+{
+    if (!current_process->privileged)
+        return -EPERM;
+
+    if (max_segments && !segments)
+        return -EFAULT;
+
+    return dmabuf_pin(buffer, size, device_writes, segments, max_segments);
+}
+
+DEFINE_SYSCALL(bool, dmabuf_unpin)(void *buffer, size_t size)
+{
+    return dmabuf_unpin(buffer, size);
+}
+
+DEFINE_SYSCALL(long, swapon)(const char *device)
+{
+    if (!current_process->privileged)
+        return -EPERM;
+
+    return swap_activate(device);
+}
+
+DEFINE_SYSCALL(long, privilege_drop)(void)
+{
+    current_process->privileged = false;
+    return 0;
+}
+
 DEFINE_SYSCALL(long, pipe)(fd_t *reader, fd_t *writer, u64 flags)
 {
     auto pipe = pipe_create(MOS_PAGE_SIZE * 4);
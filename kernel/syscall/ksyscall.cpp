@@ -3,6 +3,7 @@
 #include "mos/syscall/ksyscall.hpp"
 
 #include "mos/misc/profiling.hpp"
+#include "mos/platform/platform.hpp"
 #include "mos/tasks/signal.hpp"
 
 #include <mos/syscall/dispatcher.h>
@@ -12,9 +13,11 @@
 
 reg_t ksyscall_enter(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
 {
+    const u64 start = platform_get_timestamp();
     const pf_point_t ev = profile_enter();
     const reg_t ret = dispatch_syscall(number, arg1, arg2, arg3, arg4, arg5, arg6);
     profile_leave(ev, "syscall.%lu.%s", number, get_syscall_names(number));
+    ksyscall_account(number, ret, platform_get_timestamp() - start);
 
     if (IS_ERR_VALUE(ret))
     {
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/platform/platform.hpp"
+#include "mos/syscall/ksyscall.hpp"
+#include "mos/tasks/process.hpp"
+#include "mos/tasks/task_types.hpp"
+
+#include <algorithm>
+#include <mos/syscall/number.h>
+#include <mos/syscall/table.h>
+#include <mos/types.hpp>
+
+#define SYSCALL_STAT_NR      (SYSCALL_MAX_NR + 2) // the last slot counts invalid syscall numbers
+#define SYSCALL_STAT_BUCKETS 32                   // log2 of the latency, the last bucket takes everything above
+
+typedef struct
+{
+    u64 count;
+    u64 errors;
+    u64 time;
+    u64 max;
+    u64 buckets[SYSCALL_STAT_BUCKETS]; ///< bucket n counts latencies in [2^n, 2^(n+1)), bucket 0 also has 0
+} syscall_stat_t;
+
+typedef struct
+{
+    syscall_stat_t syscalls[SYSCALL_STAT_NR];
+} syscall_stat_table_t;
+
+// updated with relaxed atomics, a thread can be preempted by another one on the same CPU, or migrate, in the middle
+static PER_CPU_DECLARE(syscall_stat_table_t, syscall_stats);
+
+should_inline size_t syscall_stat_bucket(u64 time)
+{
+    const size_t bucket = time ? 63 - __builtin_clzll(time) : 0;
+    return bucket < SYSCALL_STAT_BUCKETS ? bucket : SYSCALL_STAT_BUCKETS - 1;
+}
+
+void ksyscall_account(reg_t number, reg_t ret, u64 time)
+{
+    const bool error = IS_ERR_VALUE(ret);
+    syscall_stat_t *stat = &per_cpu(syscall_stats)->syscalls[number <= SYSCALL_MAX_NR ? number : SYSCALL_STAT_NR - 1];
+    __atomic_fetch_add(&stat->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->errors, error, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->time, time, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->buckets[syscall_stat_bucket(time)], 1, __ATOMIC_RELAXED);
+
+    u64 max = __atomic_load_n(&stat->max, __ATOMIC_RELAXED);
+    while (time > max && !__atomic_compare_exchange_n(&stat->max, &max, time, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    process_syscall_stat_t *pstat = &current_process->syscall_stat;
+    __atomic_fetch_add(&pstat->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pstat->errors, error, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pstat->time, time, __ATOMIC_RELAXED);
+}
+
+static void syscall_stat_merge(size_t nr, syscall_stat_t *out)
+{
+    *out = {};
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const syscall_stat_t *stat = &syscall_stats.percpu_value[cpu].syscalls[nr];
+        out->count += __atomic_load_n(&stat->count, __ATOMIC_RELAXED);
+        out->errors += __atomic_load_n(&stat->errors, __ATOMIC_RELAXED);
+        out->time += __atomic_load_n(&stat->time, __ATOMIC_RELAXED);
+        out->max = std::max(out->max, __atomic_load_n(&stat->max, __ATOMIC_RELAXED));
+        for (size_t i = 0; i < SYSCALL_STAT_BUCKETS; i++)
+            out->buckets[i] += __atomic_load_n(&stat->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+should_inline const char *syscall_stat_name(size_t nr)
+{
+    return nr <= SYSCALL_MAX_NR ? get_syscall_names(nr) : "<invalid>";
+}
+
+// ! sysfs support
+
+static bool syscall_sysfs_stat(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-4s %-28s %12s %10s %14s %14s\n", "nr", "name", "count", "errors", "avg", "max");
+    for (size_t nr = 0; nr < SYSCALL_STAT_NR; nr++)
+    {
+        syscall_stat_t stat;
+        syscall_stat_merge(nr, &stat);
+        if (!stat.count)
+            continue;
+
+        sysfs_printf(f, "%-4zu %-28s %12llu %10llu %14llu %14llu\n", nr, syscall_stat_name(nr), stat.count, stat.errors, stat.time / stat.count,
+                     stat.max);
+    }
+    return true;
+}
+
+static bool syscall_sysfs_latency(sysfs_file_t *f)
+{
+    // one line per syscall: the name, then "<bucket>:<count>" for the non-empty buckets
+    for (size_t nr = 0; nr < SYSCALL_STAT_NR; nr++)
+    {
+        syscall_stat_t stat;
+        syscall_stat_merge(nr, &stat);
+        if (!stat.count)
+            continue;
+
+        sysfs_printf(f, "%s", syscall_stat_name(nr));
+        for (size_t i = 0; i < SYSCALL_STAT_BUCKETS; i++)
+            if (stat.buckets[i])
+                sysfs_printf(f, " %zu:%llu", i, stat.buckets[i]);
+        sysfs_printf(f, "\n");
+    }
+    return true;
+}
+
+static bool syscall_sysfs_processes(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-6s %-24s %12s %10s %16s\n", "pid", "name", "count", "errors", "time");
+    for (const auto &[pid, proc] : ProcessTable)
+    {
+        const process_syscall_stat_t *stat = &proc->syscall_stat;
+        sysfs_printf(f, "%-6d %-24s %12llu %10llu %16llu\n", pid, proc->name.c_str(), __atomic_load_n(&stat->count, __ATOMIC_RELAXED),
+                     __atomic_load_n(&stat->errors, __ATOMIC_RELAXED), __atomic_load_n(&stat->time, __ATOMIC_RELAXED));
+    }
+    return true;
+}
+
+static sysfs_item_t syscall_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", syscall_sysfs_stat),
+    SYSFS_RO_ITEM("latency", syscall_sysfs_latency),
+    SYSFS_RO_ITEM("processes", syscall_sysfs_processes),
+};
+
+SYSFS_AUTOREGISTER(syscall, syscall_sysfs_items);
@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/syslog/logring.hpp"
+
+#include "mos/platform/platform.hpp"
+#include "mos/tasks/task_types.hpp"
+
+#include <algorithm>
+#include <mos/mos_global.h>
+#include <mos_stdio.hpp>
+#include <mos_string.hpp>
+
+#define SYSLOG_RECORD_MAX_TEXT MOS_PRINTK_BUFFER_SIZE
+#define SYSLOG_SPEC_MAX_LEN    32 // a longer conversion specification isn't worth deferring
+
+static_assert((MOS_SYSLOG_RING_SIZE & (MOS_SYSLOG_RING_SIZE - 1)) == 0, "the log ring size must be a power of 2");
+static_assert(MOS_SYSLOG_RING_SIZE >= 4 * (sizeof(syslog_record_t) + SYSLOG_RECORD_MAX_TEXT), "the log ring is too small");
+
+struct syslog_ring_t
+{
+    u64 head; // reserved up to, moved by the producers
+    u64 tail; // consumed up to, moved by the consumer
+    u64 records, preformatted, dropped;
+    alignas(8) u8 data[MOS_SYSLOG_RING_SIZE];
+};
+
+static PER_CPU_DECLARE(syslog_ring_t, syslog_rings);
+
+// ! the ring itself
+
+static syslog_record_t *ring_reserve(syslog_ring_t *ring, size_t size)
+{
+    size = ALIGN_UP(size, 8);
+
+    u64 head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    size_t pad;
+    do
+    {
+        // a record never wraps around, the space left at the end of the ring is skipped with a padding record
+        const size_t off = head & (MOS_SYSLOG_RING_SIZE - 1);
+        pad = off + size > MOS_SYSLOG_RING_SIZE ? MOS_SYSLOG_RING_SIZE - off : 0;
+        if (head + pad + size - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > MOS_SYSLOG_RING_SIZE)
+        {
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->head, &head, head + pad + size, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (pad)
+    {
+        syslog_record_t *padding = (syslog_record_t *) &ring->data[head & (MOS_SYSLOG_RING_SIZE - 1)];
+        padding->size = pad;
+        padding->flags = SYSLOG_RECORD_PADDING;
+        __atomic_store_n(&padding->committed, 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_add(&ring->records, 1, __ATOMIC_RELAXED);
+    syslog_record_t *record = (syslog_record_t *) &ring->data[(head + pad) & (MOS_SYSLOG_RING_SIZE - 1)];
+    record->size = size;
+    return record;
+}
+
+static void ring_commit(syslog_record_t *record)
+{
+    __atomic_store_n(&record->committed, 1, __ATOMIC_RELEASE);
+}
+
+/// the oldest record of a ring, if it has been committed
+static syslog_record_t *ring_peek(syslog_ring_t *ring)
+{
+    while (true)
+    {
+        const u64 tail = ring->tail;
+        if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+            return NULL;
+
+        syslog_record_t *record = (syslog_record_t *) &ring->data[tail & (MOS_SYSLOG_RING_SIZE - 1)];
+        if (!__atomic_load_n(&record->committed, __ATOMIC_ACQUIRE))
+            return NULL; // a producer is still writing it, later records have to wait
+
+        if (!(record->flags & SYSLOG_RECORD_PADDING))
+            return record;
+
+        // skip the padding
+        const size_t size = record->size;
+        memzero(record, size);
+        __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+    }
+}
+
+static void ring_release(syslog_ring_t *ring, syslog_record_t *record)
+{
+    // the producers rely on the ring being zeroed, a header that isn't committed yet reads as such
+    const size_t size = record->size;
+    memzero(record, size);
+    __atomic_store_n(&ring->tail, ring->tail + size, __ATOMIC_RELEASE);
+}
+
+// ! format strings
+
+typedef struct
+{
+    const char *end; // one past the conversion specifier
+    char conversion;
+    bool wide; // takes a 64-bit argument
+    bool star_width, star_precision;
+    s32 precision; // a literal precision, -1 if none
+} fmt_spec_t;
+
+/// parse a conversion specification, following vsnprintf, @p p points after the '%'
+static bool parse_spec(const char *p, fmt_spec_t *spec)
+{
+    *spec = { .precision = -1 };
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+        p++;
+
+    if (*p == '*')
+        spec->star_width = true, p++;
+    else
+        while ('0' <= *p && *p <= '9')
+            p++;
+
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+            spec->star_precision = true, p++;
+        else
+            for (spec->precision = 0; '0' <= *p && *p <= '9'; p++)
+                spec->precision = spec->precision * 10 + (*p - '0');
+    }
+
+    switch (*p)
+    {
+        case 'h': p += p[1] == 'h' ? 2 : 1; break;
+        case 'l': p += p[1] == 'l' ? 2 : 1, spec->wide = true; break;
+        case 'j':
+        case 'z':
+        case 't': p++, spec->wide = true; break;
+        default: break;
+    }
+
+    spec->conversion = *p;
+    switch (*p)
+    {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c':
+        case 's': break;
+        case 'p':
+            // '%ps' only needs the address, but the other kernel extensions dereference an object that may be gone
+            // by the time the record is formatted
+            if (p[1] == 't' || p[1] == 'p' || p[1] == 'v' || p[1] == 'i')
+                return false;
+            if (p[1] == 's')
+                p++;
+            break;
+        default: return false; // floating point, '%n', or something we don't know
+    }
+
+    spec->end = p + 1;
+    return true;
+}
+
+/// copy the arguments of @p fmt into the record, strings are only remembered and have to be copied afterwards
+static bool capture_args(syslog_record_t *record, const char **strings, size_t *string_lens, const char *fmt, va_list args)
+{
+    size_t n = 0;
+    for (const char *p = fmt; *p; p++)
+    {
+        if (*p != '%')
+            continue;
+
+        if (*++p == '%')
+            continue;
+
+        fmt_spec_t spec;
+        if (!parse_spec(p, &spec) || spec.end - p + 2 > SYSLOG_SPEC_MAX_LEN)
+            return false;
+
+        if (n + spec.star_width + spec.star_precision + 1 > SYSLOG_RECORD_MAX_ARGS)
+            return false;
+
+        s32 precision = spec.precision;
+        if (spec.star_width)
+            record->args[n++] = va_arg(args, s32);
+        if (spec.star_precision)
+            record->args[n++] = precision = va_arg(args, s32);
+
+        switch (spec.conversion)
+        {
+            case 'd':
+            case 'i': record->args[n++] = spec.wide ? va_arg(args, s64) : va_arg(args, s32); break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X': record->args[n++] = spec.wide ? va_arg(args, u64) : va_arg(args, u32); break;
+            case 'c': record->args[n++] = va_arg(args, s32); break;
+            case 'p': record->args[n++] = (ptr_t) va_arg(args, void *); break;
+            case 's':
+            {
+                const char *str = va_arg(args, const char *);
+                if (!str)
+                    str = "(null)";
+                strings[n] = str;
+                string_lens[n] = precision >= 0 ? strnlen(str, precision) : strlen(str);
+                record->args[n++] = 0;
+                break;
+            }
+        }
+
+        p = spec.end - 1;
+    }
+
+    record->nargs = n;
+    return true;
+}
+
+template<typename T>
+static size_t render_one(char *buf, size_t size, const char *spec, const int *stars, size_t nstars, T value)
+{
+    switch (nstars)
+    {
+        case 0: snprintf(buf, size, spec, value); break;
+        case 1: snprintf(buf, size, spec, stars[0], value); break;
+        default: snprintf(buf, size, spec, stars[0], stars[1], value); break;
+    }
+    return strlen(buf);
+}
+
+/// format a record, the same way vsnprintf would have at the time it was written
+static size_t render(const syslog_record_t *record, char *buf, size_t size)
+{
+    size_t pos = 0, n = 0;
+    buf[0] = '\0';
+
+    for (const char *p = record->fmt; *p && pos + 1 < size;)
+    {
+        if (*p != '%')
+        {
+            buf[pos++] = *p++;
+            continue;
+        }
+
+        if (p[1] == '%')
+        {
+            buf[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        fmt_spec_t spec;
+        if (unlikely(!parse_spec(p + 1, &spec)))
+            break; // can't happen, the producer has checked it
+
+        char specstr[SYSLOG_SPEC_MAX_LEN];
+        memcpy(specstr, p, spec.end - p);
+        specstr[spec.end - p] = '\0';
+        p = spec.end;
+
+        int stars[2];
+        size_t nstars = 0;
+        if (spec.star_width)
+            stars[nstars++] = (int) record->args[n++];
+        if (spec.star_precision)
+            stars[nstars++] = (int) record->args[n++];
+
+        const u64 value = record->args[n++];
+        char *const out = buf + pos;
+        const size_t avail = size - pos;
+        switch (spec.conversion)
+        {
+            case 'd':
+            case 'i': pos += spec.wide ? render_one(out, avail, specstr, stars, nstars, (s64) value) : render_one(out, avail, specstr, stars, nstars, (s32) value); break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X': pos += spec.wide ? render_one(out, avail, specstr, stars, nstars, (u64) value) : render_one(out, avail, specstr, stars, nstars, (u32) value); break;
+            case 'c': pos += render_one(out, avail, specstr, stars, nstars, (s32) value); break;
+            case 'p': pos += render_one(out, avail, specstr, stars, nstars, (void *) value); break;
+            case 's': pos += render_one(out, avail, specstr, stars, nstars, record->text + value); break;
+        }
+    }
+
+    buf[pos] = '\0';
+    return pos;
+}
+
+// ! producers
+
+void syslog_record_init(syslog_record_t *record, LogLevel level, const debug_info_entry *feat, u8 flags)
+{
+    *record = {
+        .flags = flags,
+        .level = (u8) level,
+        .timestamp = platform_get_timestamp(),
+        .feat = feat,
+        .cpu_id = platform_current_cpu_id(),
+    };
+
+    if (const auto thread = current_thread)
+    {
+        record->tid = thread->tid;
+        record->pid = thread->owner->pid;
+        strncpy(record->thread_name, thread->name.c_str(), SYSLOG_RECORD_NAME_LEN - 1);
+        strncpy(record->process_name, thread->owner->name.c_str(), SYSLOG_RECORD_NAME_LEN - 1);
+    }
+}
+
+static bool emit_text(syslog_record_t *header, const char *text, size_t len)
+{
+    len = std::min<size_t>(len, SYSLOG_RECORD_MAX_TEXT - 1);
+    syslog_ring_t *ring = per_cpu(syslog_rings);
+    syslog_record_t *record = ring_reserve(ring, sizeof(syslog_record_t) + len + 1);
+    if (!record)
+        return false;
+
+    const u32 size = record->size;
+    *record = *header;
+    record->size = size;
+    record->committed = 0;
+    record->text_len = len;
+    memcpy(record->text, text, len);
+    record->text[len] = '\0';
+    ring_commit(record);
+    return true;
+}
+
+bool syslog_ring_emit(LogLevel level, const char *file, const char *func, int line, const debug_info_entry *feat, u8 flags, const char *fmt, va_list args)
+{
+    syslog_record_t header;
+    syslog_record_init(&header, level, feat, flags);
+    header.file = file;
+    header.func = func;
+    header.line = line;
+
+    const char *strings[SYSLOG_RECORD_MAX_ARGS] = {};
+    size_t string_lens[SYSLOG_RECORD_MAX_ARGS] = {};
+
+    va_list captured;
+    va_copy(captured, args);
+    bool deferrable = capture_args(&header, strings, string_lens, fmt, captured);
+    va_end(captured);
+
+    size_t text_len = 0;
+    for (size_t i = 0; deferrable && i < header.nargs; i++)
+        if (strings[i])
+            text_len += string_lens[i] + 1;
+
+    if (!deferrable || text_len > SYSLOG_RECORD_MAX_TEXT)
+    {
+        // format it now, and keep the text
+        char buf[MOS_PRINTK_BUFFER_SIZE];
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        __atomic_fetch_add(&per_cpu(syslog_rings)->preformatted, 1, __ATOMIC_RELAXED);
+        header.flags |= SYSLOG_RECORD_PREFORMATTED;
+        header.nargs = 0;
+        return emit_text(&header, buf, strlen(buf));
+    }
+
+    syslog_ring_t *ring = per_cpu(syslog_rings);
+    syslog_record_t *record = ring_reserve(ring, sizeof(syslog_record_t) + text_len);
+    if (!record)
+        return false;
+
+    const u32 size = record->size;
+    *record = header;
+    record->size = size;
+    record->committed = 0;
+    record->fmt = fmt;
+    record->text_len = text_len;
+
+    size_t off = 0;
+    for (size_t i = 0; i < header.nargs; i++)
+    {
+        if (!strings[i])
+            continue;
+        memcpy(record->text + off, strings[i], string_lens[i]);
+        record->text[off + string_lens[i]] = '\0';
+        record->args[i] = off;
+        off += string_lens[i] + 1;
+    }
+
+    ring_commit(record);
+    return true;
+}
+
+bool syslog_ring_emit_text(LogLevel level, const debug_info_entry *feat, u8 flags, const char *text, size_t len)
+{
+    syslog_record_t header;
+    syslog_record_init(&header, level, feat, flags | SYSLOG_RECORD_PREFORMATTED);
+    return emit_text(&header, text, len);
+}
+
+// ! the consumer
+
+ssize_t syslog_ring_pop(syslog_record_t *record, char *buf, size_t size)
+{
+    // the rings are merged by timestamp, so that messages from different CPUs come out in order
+    syslog_ring_t *oldest_ring = NULL;
+    syslog_record_t *oldest = NULL;
+    for (auto &ring : syslog_rings.percpu_value)
+    {
+        syslog_record_t *r = ring_peek(&ring);
+        if (r && (!oldest || r->timestamp < oldest->timestamp))
+            oldest_ring = &ring, oldest = r;
+    }
+
+    if (!oldest)
+        return -1;
+
+    *record = *oldest;
+
+    size_t len;
+    if (oldest->flags & SYSLOG_RECORD_PREFORMATTED)
+    {
+        len = std::min<size_t>(oldest->text_len, size - 1);
+        memcpy(buf, oldest->text, len);
+        buf[len] = '\0';
+    }
+    else
+    {
+        len = render(oldest, buf, size);
+    }
+
+    ring_release(oldest_ring, oldest);
+    return len;
+}
+
+void syslog_ring_get_stat(u32 cpu, syslog_ring_stat_t *stat)
+{
+    const syslog_ring_t *ring = &syslog_rings.percpu_value[cpu];
+    stat->records = __atomic_load_n(&ring->records, __ATOMIC_RELAXED);
+    stat->preformatted = __atomic_load_n(&ring->preformatted, __ATOMIC_RELAXED);
+    stat->dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    stat->used = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
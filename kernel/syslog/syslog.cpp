@@ -3,7 +3,13 @@
 #include "mos/syslog/syslog.hpp"
 
 #include "mos/device/console.hpp"
+#include "mos/device/timer.hpp"
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/misc/setup.hpp"
 #include "mos/platform/platform.hpp"
+#include "mos/syslog/logring.hpp"
+#include "mos/tasks/kthread.hpp"
 #include "mos/tasks/task_types.hpp"
 #include "proto/syslog.pb.h"
 
@@ -11,9 +17,16 @@
 #include <mos/compiler.h>
 #include <mos/mos_global.h>
 #include <mos_stdio.hpp>
+#include <mos_string.hpp>
 #include <pb_encode.h>
 
-static spinlock_t global_syslog_lock;
+#define KLOGD_INTERVAL_MS       10
+#define SYSLOG_PANIC_LOCK_SPINS 10000000 // the CPU holding the console lock may never release it
+
+static spinlock_t syslog_console_lock; // serialises the console output, and draining the log rings
+static bool klogd_running = false;     // before klogd starts, messages are printed synchronously
+static bool syslog_panicking = false;
+static syslog_sink_t syslog_sink = NULL;
 
 #define DefineLogStream(name, level) const mos::LoggingDescriptor<_none, LogLevel::level> m##name;
 DefineLogStream(Info2, INFO2);
@@ -25,19 +38,53 @@ DefineLogStream(Fatal, FATAL);
 DefineLogStream(Cont, UNSET);
 #undef DefineLogStream
 
-static void do_print_syslog(const pb_syslog_message *msg, const debug_info_entry *feat)
+static bool syslog_should_defer(LogLevel level)
 {
-    const LogLevel level = (LogLevel) msg->info.level;
-    spinlock_acquire(&global_syslog_lock);
+    // emergencies are printed right away, a panic may follow
+    return likely(klogd_running && !syslog_panicking) && level < LogLevel::EMERG;
+}
+
+static bool syslog_may_drop(LogLevel level, const debug_info_entry *feat)
+{
+    // only debug messages are dropped (and counted) when the ring is full, anything else is printed synchronously
+    return feat && level < LogLevel::WARN;
+}
+
+static bool syslog_lock_console(void)
+{
+    if (likely(!syslog_panicking))
+    {
+        spinlock_acquire(&syslog_console_lock);
+        return true;
+    }
+
+    for (size_t i = 0; i < SYSLOG_PANIC_LOCK_SPINS; i++)
+        if (spinlock_try_acquire(&syslog_console_lock))
+            return true;
+
+    return false; // print anyway
+}
+
+static void do_print_syslog(const syslog_record_t *record, const char *message, size_t len)
+{
+    const LogLevel level = (LogLevel) record->level;
+
+    if (record->flags & SYSLOG_RECORD_RAW)
+    {
+        if (unlikely(!printk_console))
+            printk_console = consoles.front();
+        print_to_console(printk_console, level, message, len);
+        return;
+    }
 
     if (level != LogLevel::UNSET)
     {
         lprintk(level, "\r\n");
-        if (feat)
-            lprintk(level, "%-10s | ", feat->name);
+        if (record->feat)
+            lprintk(level, "%-10s | ", record->feat->name);
 
 #if MOS_CONFIG(MOS_PRINTK_WITH_TIMESTAMP)
-        lprintk(level, "%-16lu | ", msg->timestamp);
+        lprintk(level, "%-16lu | ", record->timestamp);
 #endif
 
 #if MOS_CONFIG(MOS_PRINTK_WITH_DATETIME)
@@ -45,67 +92,153 @@ static void do_print_syslog(const pb_syslog_message *msg, const debug_info_entry
 #endif
 
 #if MOS_CONFIG(MOS_PRINTK_WITH_CPU_ID)
-        lprintk(level, "cpu %2d | ", msg->cpu_id);
+        lprintk(level, "cpu %2d | ", record->cpu_id);
 #endif
 
 #if MOS_CONFIG(MOS_PRINTK_WITH_FILENAME)
-        lprintk(level, "%-15s | ", msg->info.source_location.filename);
+        lprintk(level, "%-15s | ", record->file ? record->file : "");
 #endif
 
 #if MOS_CONFIG(MOS_PRINTK_WITH_THREAD_ID)
-        lprintk(level, "[t%d:%s]\t| ", msg->thread.tid, msg->thread.name);
+        lprintk(level, "[t%d:%s]\t| ", record->tid, record->thread_name);
 #endif
     }
 
-    lprintk(level, "%s", msg->message);
+    lprintk(level, "%s", message);
+}
 
-    spinlock_release(&global_syslog_lock);
+/// print everything left in the log rings, with the console lock held
+static void syslog_flush_locked(void)
+{
+    static char message[MOS_PRINTK_BUFFER_SIZE];
+    syslog_record_t record;
+    ssize_t len;
+    while ((len = syslog_ring_pop(&record, message, sizeof(message))) >= 0)
+        if (!(record.flags & SYSLOG_RECORD_PRINTED))
+            do_print_syslog(&record, message, len);
 }
 
-long do_syslog(LogLevel level, const char *file, const char *func, int line, const debug_info_entry *feat, const char *fmt, ...)
+static void syslog_forward(syslog_sink_t sink, const syslog_record_t *record, char *message)
 {
-    auto const thread = current_thread;
     pb_syslog_message msg = {
-        .timestamp = platform_get_timestamp(),
-        .cpu_id = platform_current_cpu_id(),
+        .timestamp = record->timestamp,
+        .message = message,
+        .cpu_id = record->cpu_id,
     };
 
-    msg.info.level = (syslog_level) level;
-    msg.info.featid = feat ? feat->id : 0;
-    msg.info.source_location.line = line;
-    msg.info.source_location.filename = kmalloc<char>(strlen(file) + 1);
-    msg.info.source_location.function = kmalloc<char>(strlen(func) + 1);
-    strcpy(msg.info.source_location.filename, file);
-    strcpy(msg.info.source_location.function, func);
+    msg.info.level = (syslog_level) record->level;
+    msg.info.featid = record->feat ? record->feat->id : 0;
+    msg.info.source_location.line = record->line;
+    msg.info.source_location.filename = const_cast<char *>(record->file ? record->file : "");
+    msg.info.source_location.function = const_cast<char *>(record->func ? record->func : "");
+    msg.thread.tid = record->tid;
+    msg.thread.name = const_cast<char *>(record->thread_name);
+    msg.process.pid = record->pid;
+    msg.process.name = const_cast<char *>(record->process_name);
+    sink(&msg);
+}
 
-    if (thread)
-    {
-        msg.thread.tid = thread->tid;
-        msg.process.pid = thread->owner->pid;
+static bool klogd_print_one(void)
+{
+    static char message[MOS_PRINTK_BUFFER_SIZE];
+    syslog_record_t record;
 
-        msg.thread.name = kmalloc<char>(thread->name.size() + 1);
-        msg.process.name = kmalloc<char>(thread->owner->name.size() + 1);
-        strcpy(msg.thread.name, thread->name.c_str());
-        strcpy(msg.process.name, thread->owner->name.c_str());
+    spinlock_acquire(&syslog_console_lock);
+    const ssize_t len = syslog_ring_pop(&record, message, sizeof(message));
+    if (len >= 0 && !(record.flags & SYSLOG_RECORD_PRINTED))
+        do_print_syslog(&record, message, len);
+    spinlock_release(&syslog_console_lock);
+
+    if (len < 0)
+        return false;
+
+    // the sink may block, it's called without the lock
+    const auto sink = syslog_sink;
+    if (sink && !(record.flags & SYSLOG_RECORD_RAW))
+        syslog_forward(sink, &record, message);
+    return true;
+}
+
+static void klogd_entry(void *arg)
+{
+    MOS_UNUSED(arg);
+    while (true)
+    {
+        while (klogd_print_one())
+            ;
+        timer_msleep(KLOGD_INTERVAL_MS);
     }
+}
 
-    msg.message = kmalloc<char>(MOS_PRINTK_BUFFER_SIZE);
+static void klogd_init(void)
+{
+    if (kthread_create(klogd_entry, NULL, "klogd"))
+        klogd_running = true;
+}
+MOS_INIT(KTHREAD, klogd_init);
+
+void syslog_flush(void)
+{
+    const bool locked = syslog_lock_console();
+    syslog_flush_locked();
+    if (locked)
+        spinlock_release(&syslog_console_lock);
+}
+
+void syslog_enter_panic(void)
+{
+    syslog_panicking = true;
+    syslog_flush();
+}
+
+void syslog_set_sink(syslog_sink_t sink)
+{
+    syslog_sink = sink;
+}
 
+long do_syslog(LogLevel level, const char *file, const char *func, int line, const debug_info_entry *feat, const char *fmt, ...)
+{
     va_list args;
     va_start(args, fmt);
-    vsnprintf(msg.message, MOS_PRINTK_BUFFER_SIZE, fmt, args);
-    va_end(args);
-
-    do_print_syslog(&msg, feat);
 
-    kfree(msg.info.source_location.filename);
-    kfree(msg.info.source_location.function);
-    if (thread)
+    if (syslog_should_defer(level))
     {
-        kfree(msg.thread.name);
-        kfree(msg.process.name);
+        va_list ringargs;
+        va_copy(ringargs, args);
+        const bool stored = syslog_ring_emit(level, file, func, line, feat, 0, fmt, ringargs);
+        va_end(ringargs);
+
+        if (stored || syslog_may_drop(level, feat))
+        {
+            va_end(args);
+            return 0;
+        }
     }
-    kfree(msg.message);
+
+    syslog_record_t record;
+    syslog_record_init(&record, level, feat, 0);
+    record.file = file;
+    record.func = func;
+    record.line = line;
+
+    char message[MOS_PRINTK_BUFFER_SIZE];
+    va_list fmtargs;
+    va_copy(fmtargs, args);
+    vsnprintf(message, sizeof(message), fmt, fmtargs);
+    va_end(fmtargs);
+
+    // older messages that are still in the rings come first
+    const bool locked = syslog_lock_console();
+    syslog_flush_locked();
+    do_print_syslog(&record, message, strlen(message));
+    if (locked)
+        spinlock_release(&syslog_console_lock);
+
+    // still hand it to the sink, through klogd
+    if (syslog_should_defer(LogLevel::INFO))
+        syslog_ring_emit(level, file, func, line, feat, SYSLOG_RECORD_PRINTED, fmt, args);
+
+    va_end(args);
     return 0;
 }
 
@@ -136,9 +269,41 @@ mos::SyslogStreamWriter::~SyslogStreamWriter()
         if (!should_print)
             return;
 
-        if (unlikely(!printk_console))
-            printk_console = consoles.front();
+        const auto feat = mos_debug_info_map[feature];
+        if (syslog_should_defer(level))
+        {
+            if (syslog_ring_emit_text(level, feat, SYSLOG_RECORD_RAW, fmtbuffer.data(), pos) || syslog_may_drop(level, feat))
+                return;
+        }
+
+        syslog_record_t record;
+        syslog_record_init(&record, level, feat, SYSLOG_RECORD_RAW);
 
-        print_to_console(printk_console, level, fmtbuffer.data(), pos);
+        const bool locked = syslog_lock_console();
+        syslog_flush_locked();
+        do_print_syslog(&record, fmtbuffer.data(), pos);
+        if (locked)
+            spinlock_release(&syslog_console_lock);
     }
 }
+
+// ! sysfs support
+
+static bool syslog_sysfs_stat(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%-10s: %s\n", "klogd", klogd_running ? "running" : "not running");
+    sysfs_printf(f, "%-5s %-12s %-12s %-12s %-10s\n", "CPU", "Records", "Formatted", "Dropped", "Used");
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        syslog_ring_stat_t stat;
+        syslog_ring_get_stat(cpu, &stat);
+        sysfs_printf(f, "%-5u %-12llu %-12llu %-12llu %-10zu\n", cpu, stat.records, stat.preformatted, stat.dropped, stat.used);
+    }
+    return true;
+}
+
+static sysfs_item_t syslog_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", syslog_sysfs_stat),
+};
+
+SYSFS_AUTOREGISTER(syslog, syslog_sysfs_items);
@@ -1,17 +1,30 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <mos/device/timer.hpp>
 #include <mos/misc/setup.hpp>
 #include <mos/platform/platform.hpp>
 #include <mos/syslog/printk.hpp>
 #include <mos/tasks/kthread.hpp>
+#include <mos/tasks/schedule.hpp>
 #include <mos_stdio.hpp>
 
 static void idle_task(void *arg)
 {
     MOS_UNUSED(arg);
-    platform_interrupt_enable();
     while (true)
-        platform_cpu_idle();
+    {
+        // with interrupts disabled, a thread that becomes ready from now on kicks us out of platform_cpu_idle
+        platform_interrupt_disable();
+        if (scheduler_idle_enter())
+        {
+            timer_tick_stop(); // nothing to preempt, sleep until a timer expires or we are kicked
+            platform_cpu_idle();
+            continue;
+        }
+
+        spinlock_acquire(&current_thread->state_lock);
+        reschedule();
+    }
 }
 
 static void create_idle_task()
@@ -70,6 +70,8 @@ Process::Process(Private, Process *parent_, mos::string_view name_) : magic(PROC
     linked_list_init(&children);
     this->name = name_.empty() ? "<unknown>" : name_;
 
+    privileged = parent_ ? parent_->privileged : true; // init and kthreadd are privileged
+
     if (unlikely(pid == 1) || unlikely(pid == 2))
     {
         this->parent = nullptr;
@@ -443,6 +445,7 @@ static bool process_sysfs_vmap_stat(sysfs_file_t *f)
         sysfs_printf(f, stat_line("%zu pages"), "Regular", vmap->stat.regular);
         sysfs_printf(f, stat_line("%zu pages"), "PageCache", vmap->stat.pagecache);
         sysfs_printf(f, stat_line("%zu pages"), "CoW", vmap->stat.cow);
+        sysfs_printf(f, stat_line("%zu pages"), "Swapped", vmap->stat.swap);
 #undef stat_line
         sysfs_printf(f, "\n");
     }
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Per-thread CPU time accounting, and the scheduler trace
+
+#include "mos/device/timer.hpp"
+#include "mos/filesystem/sysfs/sysfs.hpp"
+#include "mos/filesystem/sysfs/sysfs_autoinit.hpp"
+#include "mos/misc/trace_ring.hpp"
+#include "mos/platform/platform.hpp"
+#include "mos/tasks/schedule.hpp"
+#include "mos/tasks/task_types.hpp"
+#include "mos/tasks/thread.hpp"
+
+#include <algorithm>
+#include <mos/tasks/sched_trace.h>
+#include <mos_string.hpp>
+
+typedef struct
+{
+    u64 ticks;    ///< timer ticks on this CPU
+    u64 switches; ///< context switches on this CPU
+} sched_cpu_stat_t;
+
+typedef TraceRing<sched_trace_event_t, MOS_SCHED_TRACE_EVENTS> sched_trace_ring_t;
+
+static bool sched_trace_enabled = false;
+
+static PER_CPU_DECLARE(sched_cpu_stat_t, sched_cpu_stats);
+static PER_CPU_DECLARE(sched_trace_ring_t, sched_trace_rings);
+
+static void sched_trace(sched_trace_type_t type, const Thread *prev, const Thread *next, char prev_state)
+{
+    if (likely(!__atomic_load_n(&sched_trace_enabled, __ATOMIC_RELAXED)))
+        return;
+
+    sched_trace_event_t *event = per_cpu(sched_trace_rings)->next();
+    event->timestamp = platform_get_timestamp();
+    event->cpu = platform_current_cpu_id();
+    event->type = type;
+    event->prev_state = prev_state;
+    event->prev_tid = prev ? prev->tid : 0;
+    event->next_tid = next->tid;
+}
+
+void sched_account_switch(Thread *prev, Thread *next, bool voluntary)
+{
+    const u64 now = platform_get_timestamp();
+    per_cpu(sched_cpu_stats)->switches++;
+
+    if (prev)
+    {
+        thread_sched_stat_t *stat = &prev->sched_stat;
+        stat->runtime += now - stat->last_run;
+        if (voluntary)
+            stat->nvcsw++;
+        else
+            stat->nivcsw++;
+    }
+
+    thread_sched_stat_t *stat = &next->sched_stat;
+    if (stat->ready_since)
+    {
+        const u64 wait = now - stat->ready_since;
+        stat->wait_time += wait;
+        stat->wait_max = std::max(stat->wait_max, wait);
+        stat->ready_since = 0;
+    }
+    stat->last_run = now;
+
+    // a preempted thread is put back to READY right after this
+    sched_trace(SCHED_TRACE_SWITCH, prev, next, prev ? (voluntary ? thread_state_str(prev->state) : 'R') : '-');
+}
+
+void sched_account_ready(Thread *thread, bool wakeup)
+{
+    thread->sched_stat.ready_since = platform_get_timestamp() ?: 1; // 0 means "not waiting"
+    if (wakeup)
+        sched_trace(SCHED_TRACE_WAKEUP, current_thread, thread, '-');
+}
+
+void sched_account_tick(bool user)
+{
+    per_cpu(sched_cpu_stats)->ticks++;
+    if (!current_thread)
+        return;
+
+    if (user)
+        current_thread->sched_stat.user_ticks++;
+    else
+        current_thread->sched_stat.sys_ticks++;
+}
+
+// ! sysfs support
+
+static bool sched_sysfs_stat(sysfs_file_t *f)
+{
+    // an idle CPU may not be ticking, the elapsed time is what a CPU could have been busy for
+    sysfs_printf(f, "tick_hz %u\n", MOS_SCHED_TICK_HZ);
+    sysfs_printf(f, "time_ns %llu\n", timer_now_ns());
+    sysfs_printf(f, "%-5s %12s %12s\n", "cpu", "ticks", "switches");
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const sched_cpu_stat_t *stat = &sched_cpu_stats.percpu_value[cpu];
+        sysfs_printf(f, "%-5u %12llu %12llu\n", cpu, stat->ticks, stat->switches);
+    }
+    return true;
+}
+
+static bool sched_sysfs_threads(sysfs_file_t *f)
+{
+    // the name comes last, it may contain spaces
+    sysfs_printf(f, "%-6s %-6s %-5s %10s %10s %16s %10s %10s %14s %14s %s\n", "tid", "pid", "state", "user", "sys", "runtime", "nvcsw", "nivcsw",
+                 "wait_avg", "wait_max", "name");
+    for (const auto &[tid, thread] : thread_table)
+    {
+        const thread_sched_stat_t *stat = &thread->sched_stat;
+        const u64 nswitches = stat->nvcsw + stat->nivcsw;
+        sysfs_printf(f, "%-6d %-6d %-5c %10llu %10llu %16llu %10llu %10llu %14llu %14llu %s\n", tid, thread->owner->pid, thread_state_str(thread->state),
+                     stat->user_ticks, stat->sys_ticks, stat->runtime, stat->nvcsw, stat->nivcsw, nswitches ? stat->wait_time / nswitches : 0,
+                     stat->wait_max, thread->name.c_str());
+    }
+    return true;
+}
+
+static bool sched_sysfs_trace(sysfs_file_t *f)
+{
+    u64 heads[MOS_MAX_CPU_COUNT];
+    const trace_header_t header = trace_rings_snapshot(sched_trace_rings.percpu_value, SCHED_TRACE_MAGIC, SCHED_TRACE_VERSION, heads);
+    sysfs_put_data(f, &header, sizeof(header));
+    trace_rings_put_events(f, sched_trace_rings.percpu_value, heads);
+    return true;
+}
+
+static bool sched_sysfs_trace_enabled_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%d\n", sched_trace_enabled);
+    return true;
+}
+
+static size_t sched_sysfs_trace_enabled_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+    if (count < 1)
+        return -EINVAL;
+
+    const bool on = buf[0] == '1';
+    if (on && !sched_trace_enabled)
+        trace_rings_reset(sched_trace_rings.percpu_value); // start a new trace
+
+    __atomic_store_n(&sched_trace_enabled, on, __ATOMIC_RELEASE);
+    return count;
+}
+
+static sysfs_item_t sched_sysfs_items[] = {
+    SYSFS_RO_ITEM("stat", sched_sysfs_stat),
+    SYSFS_RO_ITEM("threads", sched_sysfs_threads),
+    SYSFS_RO_ITEM("trace", sched_sysfs_trace),
+    SYSFS_RW_ITEM("trace_enabled", sched_sysfs_trace_enabled_show, sched_sysfs_trace_enabled_store),
+};
+
+SYSFS_AUTOREGISTER(sched, sched_sysfs_items);
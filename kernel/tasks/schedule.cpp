@@ -3,6 +3,8 @@
 #include "mos/tasks/schedule.hpp"
 
 #include "mos/assert.hpp"
+#include "mos/device/timer.hpp"
+#include "mos/interrupt/ipi.hpp"
 #include "mos/lib/sync/spinlock.hpp"
 #include "mos/misc/setup.hpp"
 #include "mos/platform/platform.hpp"
@@ -29,6 +31,8 @@ static bool scheduler_ready = false;
 static scheduler_t *active_scheduler = NULL;
 extern const scheduler_info_t __MOS_SCHEDULERS_START[], __MOS_SCHEDULERS_END[];
 
+static PER_CPU_DECLARE(bool, cpu_idle); ///< the CPU has nothing to run, it may be asleep with its tick stopped
+
 MOS_SETUP("scheduler", scheduler_cmdline_selector)
 {
     for (const scheduler_info_t *info = __MOS_SCHEDULERS_START; info < __MOS_SCHEDULERS_END; info++)
@@ -74,11 +78,41 @@ void unblock_scheduler(void)
     MOS_UNREACHABLE();
 }
 
+// wake up an idle CPU to run a thread that has just become ready
+static void scheduler_kick_idle_cpu(void)
+{
+    if (__atomic_load_n(per_cpu(cpu_idle), __ATOMIC_SEQ_CST))
+        return; // we are the idle one, the idle loop picks the thread up
+
+    for (u32 i = 0; i < platform_info->num_cpus; i++)
+    {
+        // claim the CPU, so that it's not kicked twice
+        if (__atomic_exchange_n(&cpu_idle.percpu_value[i], false, __ATOMIC_SEQ_CST))
+        {
+            ipi_send(platform_info->cpu.percpu_value[i].id, IPI_TYPE_RESCHEDULE);
+            return;
+        }
+    }
+}
+
+bool scheduler_idle_enter(void)
+{
+    // pairs with scheduler_kick_idle_cpu: either we see the new thread, or the waker sees us idle
+    __atomic_store_n(per_cpu(cpu_idle), true, __ATOMIC_SEQ_CST);
+    if (!active_scheduler->ops->has_threads(active_scheduler))
+        return true;
+
+    __atomic_store_n(per_cpu(cpu_idle), false, __ATOMIC_SEQ_CST);
+    return false;
+}
+
 void scheduler_add_thread(Thread *thread)
 {
     MOS_ASSERT(Thread::IsValid(thread));
     MOS_ASSERT_X(thread->state == THREAD_STATE_CREATED || thread->state == THREAD_STATE_READY, "thread %pt is not in a valid state", thread);
+    sched_account_ready(thread, false);
     active_scheduler->ops->add_thread(active_scheduler, thread);
+    scheduler_kick_idle_cpu();
 }
 
 void scheduler_remove_thread(Thread *thread)
@@ -100,7 +134,9 @@ void scheduler_wake_thread(Thread *thread)
     thread->state = THREAD_STATE_READY;
     spinlock_release(&thread->state_lock);
     pr_dinfo2(scheduler, "waking up %pt", thread);
+    sched_account_ready(thread, true);
     active_scheduler->ops->add_thread(active_scheduler, thread);
+    scheduler_kick_idle_cpu();
 }
 
 void reschedule(void)
@@ -130,6 +166,13 @@ void reschedule(void)
         next = cpu->idle_thread;
     }
 
+    if (current_thread == cpu->idle_thread && next != cpu->idle_thread)
+    {
+        // leaving idle, the CPU may have stopped its tick
+        __atomic_store_n(per_cpu(cpu_idle), false, __ATOMIC_SEQ_CST);
+        timer_tick_restart();
+    }
+
     const bool should_switch_mm = cpu->mm_context != next->owner->mm;
     if (should_switch_mm)
     {
@@ -143,6 +186,8 @@ void reschedule(void)
             retval |= next->mode == THREAD_MODE_KERNEL ? SWITCH_TO_NEW_KERNEL_THREAD : SWITCH_TO_NEW_USER_THREAD;
     });
 
+    sched_account_switch(current_thread, next, current_thread && current_thread->state != THREAD_STATE_RUNNING);
+
     if (likely(current_thread))
     {
         if (current_thread->state == THREAD_STATE_RUNNING)
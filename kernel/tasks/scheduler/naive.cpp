@@ -88,11 +88,21 @@ static void naive_sched_remove_thread(scheduler_t *instance, Thread *thread)
     spinlock_release(&scheduler->lock);
 }
 
+static bool naive_sched_has_threads(scheduler_t *instance)
+{
+    naive_sched_t *scheduler = container_of(instance, naive_sched_t, base);
+    spinlock_acquire(&scheduler->lock);
+    const bool has_threads = !list_is_empty(&scheduler->threads);
+    spinlock_release(&scheduler->lock);
+    return has_threads;
+}
+
 static const scheduler_ops_t naive_sched_ops = {
     .init = naive_sched_init,
     .select_next = naive_sched_select_next,
     .add_thread = naive_sched_add_thread,
     .remove_thread = naive_sched_remove_thread,
+    .has_threads = naive_sched_has_threads,
 };
 
 static naive_sched_t naive_schedr = {
@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/lib/structures/timer_wheel.hpp>
+
+static timer_wheel_t wheel; // too large for the stack
+
+static size_t advance_and_count(u64 now)
+{
+    list_head expired;
+    const size_t n = timer_wheel_advance(&wheel, now, &expired);
+    list_foreach(timer_wheel_entry_t, entry, expired)
+        list_remove(entry);
+    return n;
+}
+
+MOS_TEST_CASE(test_timer_wheel_empty)
+{
+    timer_wheel_init(&wheel, 1000);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), TIMER_WHEEL_NEVER);
+    MOS_TEST_CHECK(advance_and_count(1 << 30), 0);
+    MOS_TEST_CHECK(wheel.count, 0);
+}
+
+MOS_TEST_CASE(test_timer_wheel_expires_exactly)
+{
+    timer_wheel_init(&wheel, 1000);
+
+    // one entry on each level
+    static timer_wheel_entry_t entries[TIMER_WHEEL_LEVELS];
+    const u64 deltas[TIMER_WHEEL_LEVELS] = { 5, 100, 5000, 300000, 20000000, 1000000000 };
+    for (u32 i = 0; i < TIMER_WHEEL_LEVELS; i++)
+    {
+        entries[i].expires = 1000 + deltas[i];
+        timer_wheel_add(&wheel, &entries[i]);
+    }
+    MOS_TEST_CHECK(wheel.count, TIMER_WHEEL_LEVELS);
+
+    for (u32 i = 0; i < TIMER_WHEEL_LEVELS; i++)
+    {
+        MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), 1000 + deltas[i]);
+        MOS_TEST_CHECK(advance_and_count(1000 + deltas[i] - 1), 0);
+        MOS_TEST_CHECK(advance_and_count(1000 + deltas[i]), 1);
+    }
+
+    MOS_TEST_CHECK(wheel.count, 0);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), TIMER_WHEEL_NEVER);
+}
+
+MOS_TEST_CASE(test_timer_wheel_remove)
+{
+    timer_wheel_init(&wheel, 0);
+
+    static timer_wheel_entry_t a, b;
+    a.expires = 10;
+    b.expires = 4096;
+    timer_wheel_add(&wheel, &a);
+    timer_wheel_add(&wheel, &b);
+
+    timer_wheel_remove(&wheel, &a);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), 4096);
+    MOS_TEST_CHECK(advance_and_count(100), 0);
+
+    timer_wheel_remove(&wheel, &b);
+    MOS_TEST_CHECK(wheel.count, 0);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), TIMER_WHEEL_NEVER);
+    MOS_TEST_CHECK(advance_and_count(10000), 0);
+}
+
+MOS_TEST_CASE(test_timer_wheel_late_and_far)
+{
+    timer_wheel_init(&wheel, 0);
+    MOS_TEST_CHECK(advance_and_count(500), 0);
+
+    // already expired when added
+    static timer_wheel_entry_t late;
+    late.expires = 100;
+    timer_wheel_add(&wheel, &late);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel), 100);
+    MOS_TEST_CHECK(advance_and_count(500), 1);
+
+    // beyond the range of the wheel, it's parked and cascaded until it's due
+    static timer_wheel_entry_t far;
+    far.expires = TIMER_WHEEL_MAX_DELTA * 3;
+    timer_wheel_add(&wheel, &far);
+    MOS_TEST_CHECK(advance_and_count(TIMER_WHEEL_MAX_DELTA * 3 - 1), 0);
+    MOS_TEST_CHECK(timer_wheel_next_expiry(&wheel) <= TIMER_WHEEL_MAX_DELTA * 3, true);
+    MOS_TEST_CHECK(advance_and_count(TIMER_WHEEL_MAX_DELTA * 3), 1);
+}
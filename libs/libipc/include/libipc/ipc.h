@@ -44,6 +44,17 @@ MOSAPI void ipc_msg_destroy(ipc_msg_t *buffer);
  */
 MOSAPI ipc_msg_t *ipc_read_msg(ipcfd_t fd);
 
+/**
+ * @brief Read an IPC message into a reusable buffer.
+ *
+ * @param fd The file descriptor.
+ * @param buffer Pointer to the message buffer, it may point to NULL and is reallocated if it's too small.
+ * @param capacity Pointer to the capacity of the buffer, in bytes of message data.
+ * @return true A message was read into *buffer.
+ * @return false EOF or error, *buffer is kept and should still be destroyed by the caller.
+ */
+MOSAPI bool ipc_read_msg_reuse(ipcfd_t fd, ipc_msg_t **buffer, size_t *capacity);
+
 /**
  * @brief Write an IPC message.
  *
@@ -56,3 +67,26 @@ MOSAPI ipc_msg_t *ipc_read_msg(ipcfd_t fd);
 MOSAPI bool ipc_write_msg(ipcfd_t fd, ipc_msg_t *buffer);
 MOSAPI size_t ipc_read_as_msg(ipcfd_t fd, void *buffer, size_t buffer_size);
 MOSAPI bool ipc_write_as_msg(ipcfd_t fd, const void *data, size_t size);
+
+#ifndef __MOS_KERNEL__
+/**
+ * @brief Attach to the shared-memory rings of an IPC connection.
+ *
+ * @details Once attached, all libipc reads and writes on the fd go through the rings
+ *          instead of the kernel stream. Connections that were not created with
+ *          IPC_CONNECT_SHM_RING are left in stream mode.
+ *
+ * @param fd The connection file descriptor.
+ * @param is_server Whether the caller is the server end of the connection.
+ * @return true The rings are in use.
+ * @return false The connection stays in stream mode.
+ */
+MOSAPI bool ipc_shm_attach(ipcfd_t fd, bool is_server);
+
+/**
+ * @brief Detach from the shared-memory rings of an IPC connection, if any.
+ *
+ * @param fd The connection file descriptor, it should be detached before being closed.
+ */
+MOSAPI void ipc_shm_detach(ipcfd_t fd);
+#endif
@@ -16,10 +16,190 @@
 #define do_write(fd, buffer, size) fd->write(buffer, size)
 #define do_warn(fmt, ...)          mos_warn(fmt, ##__VA_ARGS__)
 #else
+#include <algorithm>
+#include <mos/ipc/ipc_types.h>
+#include <mos/mm/mm_types.h>
+#include <mos/syscall/usermode.h>
 #include <unistd.h>
-#define do_read(fd, buffer, size)  read(fd, buffer, size)
-#define do_write(fd, buffer, size) write(fd, buffer, size)
+#define do_read(fd, buffer, size)  ipc_do_read(fd, buffer, size)
+#define do_write(fd, buffer, size) ipc_do_write(fd, buffer, size)
 #define do_warn(fmt, ...)          fprintf(stderr, fmt __VA_OPT__(, ) __VA_ARGS__)
+
+#define IPC_SHM_MAX_CHANNELS 1024
+
+typedef struct
+{
+    ipc_shm_header_t *header;
+    size_t map_size;
+    ipc_shm_ring_t *tx, *rx;
+    char *tx_data, *rx_data;
+} ipc_shm_channel_t;
+
+static ipc_shm_channel_t *shm_channels[IPC_SHM_MAX_CHANNELS];
+
+static ipc_shm_channel_t *ipc_shm_get(ipcfd_t fd)
+{
+    if (fd < 0 || fd >= IPC_SHM_MAX_CHANNELS)
+        return NULL;
+    return __atomic_load_n(&shm_channels[fd], __ATOMIC_ACQUIRE);
+}
+
+static bool ipc_shm_closed(const ipc_shm_channel_t *ch)
+{
+    return __atomic_load_n(&ch->header->closed, __ATOMIC_ACQUIRE);
+}
+
+// ring the doorbell, but only enter the kernel if the other party is actually sleeping on it
+static void ipc_shm_notify(u32 *waiting, futex_word_t *doorbell)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+        return;
+    __atomic_fetch_add(doorbell, 1, __ATOMIC_SEQ_CST);
+    syscall_futex_wake(doorbell, 1);
+}
+
+// wait until cond() becomes true or the connection is closed, returns false in the latter case
+template<typename TCond>
+static bool ipc_shm_wait(const ipc_shm_channel_t *ch, u32 *waiting, futex_word_t *doorbell, TCond cond)
+{
+    while (!cond())
+    {
+        if (ipc_shm_closed(ch))
+            return cond();
+
+        const futex_word_t bell = __atomic_load_n(doorbell, __ATOMIC_SEQ_CST);
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (!cond() && !ipc_shm_closed(ch))
+            syscall_futex_wait(doorbell, bell);
+        __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+    }
+
+    return true;
+}
+
+static size_t ipc_shm_read(ipc_shm_channel_t *ch, void *buffer, size_t size)
+{
+    ipc_shm_ring_t *ring = ch->rx;
+    const u32 mask = ch->header->ring_size - 1;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        const u32 tail = ring->tail; // only written by us
+        const auto has_data = [&]() { return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != tail; };
+        if (!ipc_shm_wait(ch, &ring->consumer_waiting, &ring->data_doorbell, has_data))
+            break; // closed, and there's nothing left to read
+
+        const u32 avail = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+        const u32 offset = tail & mask;
+        const size_t n = std::min({ (size_t) avail, size - done, (size_t) (mask + 1 - offset) });
+        memcpy((char *) buffer + done, ch->rx_data + offset, n);
+        __atomic_store_n(&ring->tail, tail + (u32) n, __ATOMIC_RELEASE);
+        done += n;
+
+        ipc_shm_notify(&ring->producer_waiting, &ring->space_doorbell);
+    }
+
+    return done;
+}
+
+static size_t ipc_shm_write(ipc_shm_channel_t *ch, const void *buffer, size_t size)
+{
+    ipc_shm_ring_t *ring = ch->tx;
+    const u32 ring_size = ch->header->ring_size;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        if (ipc_shm_closed(ch))
+            break; // nobody will ever read it
+
+        const u32 head = ring->head; // only written by us
+        const auto has_space = [&]() { return head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != ring_size; };
+        if (!ipc_shm_wait(ch, &ring->producer_waiting, &ring->space_doorbell, has_space))
+            break;
+
+        const u32 space = ring_size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+        const u32 offset = head & (ring_size - 1);
+        const size_t n = std::min({ (size_t) space, size - done, (size_t) (ring_size - offset) });
+        memcpy(ch->tx_data + offset, (const char *) buffer + done, n);
+        __atomic_store_n(&ring->head, head + (u32) n, __ATOMIC_RELEASE);
+        done += n;
+
+        ipc_shm_notify(&ring->consumer_waiting, &ring->data_doorbell);
+    }
+
+    return done;
+}
+
+static size_t ipc_do_read(ipcfd_t fd, void *buffer, size_t size)
+{
+    ipc_shm_channel_t *ch = ipc_shm_get(fd);
+    if (ch)
+        return ipc_shm_read(ch, buffer, size);
+    return read(fd, buffer, size);
+}
+
+static size_t ipc_do_write(ipcfd_t fd, const void *buffer, size_t size)
+{
+    ipc_shm_channel_t *ch = ipc_shm_get(fd);
+    if (ch)
+        return ipc_shm_write(ch, buffer, size);
+    return write(fd, buffer, size);
+}
+
+bool ipc_shm_attach(ipcfd_t fd, bool is_server)
+{
+    if (fd < 0 || fd >= IPC_SHM_MAX_CHANNELS)
+        return false;
+
+    // map the header page first to learn the size of the rings
+    const mem_perm_t perm = (mem_perm_t) (MEM_PERM_READ | MEM_PERM_WRITE);
+    ipc_shm_header_t *header = (ipc_shm_header_t *) syscall_mmap_file(0, MOS_PAGE_SIZE, perm, MMAP_SHARED, fd, 0);
+    if (header == NULL || IS_ERR_VALUE(header))
+        return false; // not a shared-memory connection
+
+    if (header->magic != IPC_SHM_MAGIC || header->version != IPC_SHM_VERSION)
+    {
+        do_warn("ipc: unsupported shared-memory header on fd %d\n", fd);
+        syscall_munmap(header, MOS_PAGE_SIZE);
+        return false;
+    }
+
+    const size_t map_size = header->data_offset[IPC_SHM_RING_SERVER_TO_CLIENT] + header->ring_size;
+    syscall_munmap(header, MOS_PAGE_SIZE);
+
+    header = (ipc_shm_header_t *) syscall_mmap_file(0, map_size, perm, MMAP_SHARED, fd, 0);
+    if (header == NULL || IS_ERR_VALUE(header))
+        return false;
+
+    const int tx_id = is_server ? IPC_SHM_RING_SERVER_TO_CLIENT : IPC_SHM_RING_CLIENT_TO_SERVER;
+    const int rx_id = is_server ? IPC_SHM_RING_CLIENT_TO_SERVER : IPC_SHM_RING_SERVER_TO_CLIENT;
+
+    ipc_shm_channel_t *ch = (ipc_shm_channel_t *) malloc(sizeof(ipc_shm_channel_t));
+    ch->header = header;
+    ch->map_size = map_size;
+    ch->tx = &header->rings[tx_id];
+    ch->rx = &header->rings[rx_id];
+    ch->tx_data = (char *) header + header->data_offset[tx_id];
+    ch->rx_data = (char *) header + header->data_offset[rx_id];
+    __atomic_store_n(&shm_channels[fd], ch, __ATOMIC_RELEASE);
+    return true;
+}
+
+void ipc_shm_detach(ipcfd_t fd)
+{
+    if (fd < 0 || fd >= IPC_SHM_MAX_CHANNELS)
+        return;
+
+    ipc_shm_channel_t *ch = __atomic_exchange_n(&shm_channels[fd], (ipc_shm_channel_t *) NULL, __ATOMIC_ACQ_REL);
+    if (!ch)
+        return;
+
+    syscall_munmap(ch->header, ch->map_size);
+    free(ch);
+}
 #endif
 
 MOS_STATIC_ASSERT(sizeof(size_t) == sizeof(uint64_t), "size_t must be 64 bits");
@@ -65,6 +245,40 @@ ipc_msg_t *ipc_read_msg(ipcfd_t fd)
     return buffer;
 }
 
+bool ipc_read_msg_reuse(ipcfd_t fd, ipc_msg_t **buffer, size_t *capacity)
+{
+    size_t size = 0;
+    size_t read_size = do_read(fd, &size, sizeof(size));
+
+    if (read_size == 0)
+        return false; // EOF
+
+    if (read_size != sizeof(size))
+    {
+        do_warn("failed to read size from ipc channel");
+        return false;
+    }
+
+    if (*buffer == NULL || *capacity < size)
+    {
+        ipc_msg_t *new_buffer = (ipc_msg_t *) realloc(*buffer, sizeof(ipc_msg_t) + size);
+        if (!new_buffer)
+            return false;
+        *buffer = new_buffer;
+        *capacity = size;
+    }
+
+    (*buffer)->size = size;
+    read_size = do_read(fd, (*buffer)->data, size);
+    if (read_size != size)
+    {
+        do_warn("failed to read data from ipc channel");
+        return false;
+    }
+
+    return true;
+}
+
 bool ipc_write_msg(ipcfd_t fd, ipc_msg_t *buffer)
 {
     size_t written = do_write(fd, &buffer->size, sizeof(buffer->size));
@@ -120,7 +334,7 @@ size_t ipc_read_as_msg(ipcfd_t fd, void *buffer, size_t buffer_size)
         return 0;
     }
 
-    size = do_read(fd, buffer, buffer_size);
+    size = do_read(fd, buffer, data_size);
     if (unlikely(size != data_size))
     {
         do_warn("failed to read data from ipc channel");
@@ -9,6 +9,20 @@
 
 typedef struct rpc_server_stub rpc_server_stub_t;
 typedef struct rpc_call rpc_call_t;
+typedef struct rpc_pending_call rpc_pending_call_t;
+
+/**
+ * @brief Callback invoked when an asynchronous call completes
+ *
+ * @param result The result code of the call
+ * @param data The result data, only valid during the callback
+ * @param size The size of the result data
+ * @param arg The user argument passed to rpc_call_submit_cb
+ *
+ * @note The callback runs on whichever thread is reading responses from the server,
+ *       it should not block and must not wait for other calls on the same stub.
+ */
+typedef void (*rpc_call_callback_t)(rpc_result_code_t result, const void *data, size_t size, void *arg);
 
 typedef struct
 {
@@ -24,13 +38,49 @@ typedef struct
  */
 MOSAPI rpc_server_stub_t *rpc_client_create(const char *server_name);
 
+#ifndef __MOS_KERNEL__
+/**
+ * @brief Create a server stub for an already established connection
+ *
+ * @param server_name The name of the server, for diagnostics only
+ * @param fd The connection, e.g. one received with rpc_client_receive_fd, the stub takes ownership of it
+ * @return rpc_server_stub_t* A pointer to the new server stub
+ */
+MOSAPI rpc_server_stub_t *rpc_client_create_fd(const char *server_name, fd_t fd);
+#endif
+
 /**
  * @brief Destroy a server stub
  *
  * @param server The server stub to destroy
+ *
+ * @note Outstanding calls are waited for before the connection is closed.
  */
 MOSAPI void rpc_client_destroy(rpc_server_stub_t *server);
 
+#ifndef __MOS_KERNEL__
+/**
+ * @brief Send a file descriptor to the server
+ *
+ * @param server The server stub
+ * @param fd The file descriptor to send, it stays open in the caller
+ * @return u64 A handle to be sent to the server as part of a call, or 0 on error
+ *
+ * @note The server receives the file descriptor with rpc_context_receive_fd, a file descriptor
+ *       that is never received is closed together with the connection.
+ */
+MOSAPI u64 rpc_client_send_fd(rpc_server_stub_t *server, fd_t fd);
+
+/**
+ * @brief Receive a file descriptor that the server has sent with rpc_context_send_fd
+ *
+ * @param server The server stub
+ * @param handle The handle returned by the server
+ * @return fd_t The new file descriptor, or a negative error code
+ */
+MOSAPI fd_t rpc_client_receive_fd(rpc_server_stub_t *server, u64 handle);
+#endif
+
 /**
  * @brief Call a function on the server
  *
@@ -100,6 +150,49 @@ MOSAPI void rpc_call_arg_string(rpc_call_t *call, const char *arg);
  */
 MOSAPI rpc_result_code_t rpc_call_exec(rpc_call_t *call, void **result_data, size_t *result_size);
 
+/**
+ * @brief Submit a call without waiting for its result
+ *
+ * @details Any number of calls may be outstanding on one server stub, responses are matched
+ *          to their calls by call ID and may arrive in any order. There's no dedicated reader
+ *          thread: whichever thread waits first reads responses on behalf of the others.
+ *
+ * @param call The call to submit, it may be destroyed or reused once this function returns
+ * @return rpc_pending_call_t* A handle to be passed to rpc_call_wait, or NULL if the stub is broken
+ */
+MOSAPI rpc_pending_call_t *rpc_call_submit(rpc_call_t *call);
+
+/**
+ * @brief Submit a call, and have a callback invoked when it completes
+ *
+ * @param call The call to submit, it may be destroyed or reused once this function returns
+ * @param callback The callback to invoke, exactly once
+ * @param arg A user argument passed to the callback
+ * @return rpc_result_code_t RPC_RESULT_OK if the call has been submitted, the callback is only invoked then
+ *
+ * @note Callbacks are only invoked while some thread is waiting on the stub, see rpc_client_wait_all.
+ */
+MOSAPI rpc_result_code_t rpc_call_submit_cb(rpc_call_t *call, rpc_call_callback_t callback, void *arg);
+
+/**
+ * @brief Wait for a submitted call to complete
+ *
+ * @param pending The handle returned by rpc_call_submit, it's freed by this function
+ * @param result_data A pointer to a pointer to the result data, or NULL if no result is expected
+ * @param result_size A pointer to the size of the result data, or NULL if no result is expected
+ * @return rpc_result_code_t The result code of the call
+ *
+ * @note The result data will be malloc'd and must be freed by the caller.
+ */
+MOSAPI rpc_result_code_t rpc_call_wait(rpc_pending_call_t *pending, void **result_data, size_t *result_size);
+
+/**
+ * @brief Wait until all outstanding calls on a server stub have completed
+ *
+ * @param server The server stub
+ */
+MOSAPI void rpc_client_wait_all(rpc_server_stub_t *server);
+
 /**
  * @brief Destroy a call
  *
@@ -122,4 +215,13 @@ typedef struct pb_msgdesc_s pb_msgdesc_t;
  */
 MOSAPI rpc_result_code_t rpc_do_pb_call(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp);
 
+/**
+ * @brief Submit a protobuf (nanopb) call without waiting for its result
+ *
+ * @return rpc_pending_call_t* A handle to be passed to rpc_call_wait, which decodes the response into resp
+ *
+ * @note resp must stay valid until rpc_call_wait returns.
+ */
+MOSAPI rpc_pending_call_t *rpc_do_pb_call_async(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp);
+
 #define rpc_pb_call(stub, funcid, reqt, req, respt, resp) rpc_do_pb_call(stub, funcid, reqt##_fields, req, respt##_fields, resp)
@@ -81,6 +81,10 @@
     should_inline rpc_result_code_t prefix##name(rpc_server_stub_t *server_stub, const reqtype *request, resptype *response)                                             \
     {                                                                                                                                                                    \
         return rpc_do_pb_call(server_stub, id, reqtype##_fields, request, resptype##_fields, response);                                                                  \
+    }                                                                                                                                                                    \
+    should_inline rpc_pending_call_t *prefix##name##_async(rpc_server_stub_t *server_stub, const reqtype *request, resptype *response)                                   \
+    {                                                                                                                                                                    \
+        return rpc_do_pb_call_async(server_stub, id, reqtype##_fields, request, resptype##_fields, response);                                                            \
     }
 
 // generate the simplecall implementation
@@ -103,6 +107,10 @@
     rpc_result_code_t prefix##name(const reqtype *request, resptype *response)                                                                                           \
     {                                                                                                                                                                    \
         return rpc_do_pb_call(this->server_stub, id, reqtype##_fields, request, resptype##_fields, response);                                                            \
+    }                                                                                                                                                                    \
+    rpc_pending_call_t *prefix##name##_async(const reqtype *request, resptype *response)                                                                                 \
+    {                                                                                                                                                                    \
+        return rpc_do_pb_call_async(this->server_stub, id, reqtype##_fields, request, resptype##_fields, response);                                                      \
     }
 
 #define RPC_CLIENT_DEFINE_STUB_CLASS(_class_name, X_MACRO)                                                                                                               \
@@ -110,6 +118,7 @@
     {                                                                                                                                                                    \
       public:                                                                                                                                                            \
         explicit _class_name(const std::string &servername) : server_stub(rpc_client_create(servername.c_str())) {};                                                     \
+        explicit _class_name(rpc_server_stub_t *stub) : server_stub(stub) {};                                                                                            \
         X_MACRO(X_GENERATE_FUNCTION_STUB_IMPL_CLASS_ARGS, X_GENERATE_FUNCTION_STUB_IMPL_CLASS_PB, );                                                                     \
         ~_class_name()                                                                                                                                                   \
         {                                                                                                                                                                \
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Shared-memory buffers that are passed by handle instead of being copied into RPC messages
+
+#pragma once
+
+#if defined(__MOS_KERNEL__)
+#error "rpc_buffer.h is only for use in userspace code"
+#endif
+
+#include <mos/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief A memfd-backed buffer, mapped into the caller
+ *
+ * @details The creator sends buf.fd with rpc_client_send_fd (or rpc_context_send_fd), and puts the
+ *          returned handle together with the size in a mosrpc.buffer_handle field. The peer receives
+ *          the fd and maps it with rpc_buffer_map, both ends then see the same pages.
+ */
+typedef struct
+{
+    fd_t fd;
+    void *data;
+    size_t size;
+} rpc_buffer_t;
+
+/**
+ * @brief Map a buffer from a file descriptor, which the buffer then owns
+ *
+ * @details The size comes from the peer, it's checked against the file so that touching the mapping
+ *          past the end of a short file can't fault.
+ *
+ * @return true on success, on failure the fd is left open
+ */
+static inline bool rpc_buffer_map(rpc_buffer_t *buf, fd_t fd, size_t size)
+{
+    struct stat st;
+    if (size == 0 || fstat(fd, &st) < 0 || st.st_size < 0 || (size_t) st.st_size < size)
+        return false;
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    buf->fd = fd;
+    buf->data = data;
+    buf->size = size;
+    return true;
+}
+
+/**
+ * @brief Create a new zero-filled buffer of the given size
+ */
+static inline bool rpc_buffer_create(rpc_buffer_t *buf, const char *name, size_t size)
+{
+    const fd_t fd = memfd_create(name, 0);
+    if (fd < 0)
+        return false;
+
+    // extend the file to the full size, there's no ftruncate for memfd
+    const char zero = 0;
+    if (lseek(fd, size - 1, SEEK_SET) < 0 || write(fd, &zero, 1) != 1 || !rpc_buffer_map(buf, fd, size))
+    {
+        close(fd);
+        return false;
+    }
+
+    return true;
+}
+
+static inline void rpc_buffer_destroy(rpc_buffer_t *buf)
+{
+    if (buf->data)
+        munmap(buf->data, buf->size);
+    if (buf->fd >= 0)
+        close(buf->fd);
+    buf->fd = -1;
+    buf->data = NULL;
+    buf->size = 0;
+}
@@ -69,6 +69,16 @@ class RPCServer
         return server_name;
     }
 
+    void set_concurrent(bool concurrent)
+    {
+        rpc_server_set_concurrent(server, concurrent);
+    }
+
+    void set_worker_pool(size_t nworkers)
+    {
+        rpc_server_set_worker_pool(server, nworkers);
+    }
+
   protected:
     virtual rpc_result_code_t dispatcher(rpc_context_t *context, u32 funcid) = 0;
 
@@ -57,6 +57,30 @@ MOSAPI void rpc_server_set_on_disconnect(rpc_server_t *server, rpc_server_on_dis
  */
 MOSAPI void rpc_server_set_data(rpc_server_t *server, void *data);
 
+/**
+ * @brief Allow requests from the same connection to be handled concurrently
+ *
+ * @param server The server
+ * @param concurrent Whether to handle requests concurrently, the default is false
+ *
+ * @note When enabled, the next request is read without waiting for the reply to the previous one, so requests
+ *       of the same connection may run on several workers at once and replies may be sent out of order.
+ *       Functions must then be thread-safe, also with respect to the per-connection data.
+ */
+MOSAPI void rpc_server_set_concurrent(rpc_server_t *server, bool concurrent);
+
+/**
+ * @brief Handle requests on a pool of worker threads
+ *
+ * @param server The server
+ * @param nworkers The number of idle workers to keep around, 0 (the default) starts a new thread for every request
+ *
+ * @note Each connection has a reader thread which queues its requests as jobs for the workers, a worker runs one
+ *       request at a time. More workers are started when all of them are busy, and the ones exceeding nworkers
+ *       exit once they become idle.
+ */
+MOSAPI void rpc_server_set_worker_pool(rpc_server_t *server, size_t nworkers);
+
 /**
  * @brief Get the user data for the server
  *
@@ -94,6 +118,9 @@ MOSAPI void rpc_server_close(rpc_server_t *server);
 /**
  * @brief Destroy the RPC server
  *
+ * @details Closes every connection that is still open, then waits for the requests that are still running
+ *          to finish and for the workers to exit.
+ *
  * @param server The server to destroy
  */
 MOSAPI void rpc_server_destroy(rpc_server_t *server);
@@ -173,6 +200,26 @@ MOSAPI s32 rpc_arg_s32(const rpc_context_t *context, size_t iarg);
 MOSAPI s64 rpc_arg_s64(const rpc_context_t *context, size_t iarg);
 MOSAPI const char *rpc_arg_string(const rpc_context_t *context, size_t iarg);
 
+#ifndef __MOS_KERNEL__
+/**
+ * @brief Receive a file descriptor that the client has sent with rpc_client_send_fd
+ *
+ * @param context The RPC call context
+ * @param handle The handle that came with the call
+ * @return fd_t The new file descriptor, or a negative error code
+ */
+MOSAPI fd_t rpc_context_receive_fd(rpc_context_t *context, u64 handle);
+
+/**
+ * @brief Send a file descriptor to the client
+ *
+ * @param context The RPC call context
+ * @param fd The file descriptor to send, it stays open in the server
+ * @return u64 A handle to be returned to the client as part of the reply, or 0 on error
+ */
+MOSAPI u64 rpc_context_send_fd(rpc_context_t *context, fd_t fd);
+#endif
+
 /**
  * @brief Write a result to the reply
  *
@@ -26,12 +26,16 @@
 #ifdef __MOS_KERNEL__
 #include "mos/assert.hpp"
 #include "mos/ipc/ipc_io.hpp"
+#include "mos/locks/futex.hpp"
 
 #include <mos/platform/platform.hpp>
 #include <mos/syscall/decl.h>
 #define syscall_ipc_connect(n, s) ipc_connect(n, s).get()
 #define syscall_io_close(fd)      fd->unref()
+#define syscall_futex_wait(f, v)  futex_wait(f, v)
+#define syscall_futex_wake(f, n)  futex_wake(f, n)
 #else
+#include <mos/ipc/ipc_types.h>
 #include <mos/syscall/usermode.h>
 #endif
 
@@ -47,11 +51,31 @@ typedef pthread_mutex_t mutex_t;
 
 #define RPC_CLIENT_SMH_SIZE MOS_PAGE_SIZE
 
+typedef struct rpc_pending_call
+{
+    rpc_server_stub_t *server;
+    id_t call_id;
+    bool done;
+    rpc_result_code_t result_code;
+    void *data; // response data, malloc'd
+    size_t data_size;
+    rpc_call_callback_t callback; // if set, the call is completed by invoking it instead of rpc_call_wait
+    void *callback_arg;
+    const pb_msgdesc_t *respm; // if set, the response is decoded into resp by rpc_call_wait
+    void *resp;
+    struct rpc_pending_call *next;
+} rpc_pending_call_t;
+
 typedef struct rpc_server_stub
 {
     const char *server_name;
     ipcfd_t fd;
-    mutex_t mutex; // only one call at a time
+    mutex_t write_mutex; // serialises writes of requests
+    mutex_t lock;        // protects the fields below
+    rpc_pending_call_t *pending;
+    bool reading;          // whether a thread is currently reading responses
+    bool broken;           // the connection has failed, no more responses will arrive
+    futex_word_t progress; // bumped whenever a response is dispatched or the reader steps down
     std::atomic_size_t callid;
 } rpc_server_stub_t;
 
@@ -67,7 +91,11 @@ rpc_server_stub_t *rpc_client_create(const char *server_name)
 {
     rpc_server_stub_t *client = (rpc_server_stub_t *) calloc(1, sizeof(rpc_server_stub_t));
     client->server_name = server_name;
+#ifdef __MOS_KERNEL__
     client->fd = syscall_ipc_connect(server_name, RPC_CLIENT_SMH_SIZE);
+#else
+    client->fd = syscall_ipc_connect_ex(server_name, RPC_CLIENT_SMH_SIZE, IPC_CONNECT_SHM_RING);
+#endif
 
     if (IS_ERR_VALUE(client->fd))
     {
@@ -75,16 +103,48 @@ rpc_server_stub_t *rpc_client_create(const char *server_name)
         return NULL;
     }
 
+#ifndef __MOS_KERNEL__
+    ipc_shm_attach(client->fd, false); // falls back to the stream if the server side didn't get the rings
+#endif
+
+    return client;
+}
+
+#ifndef __MOS_KERNEL__
+rpc_server_stub_t *rpc_client_create_fd(const char *server_name, fd_t fd)
+{
+    rpc_server_stub_t *client = (rpc_server_stub_t *) calloc(1, sizeof(rpc_server_stub_t));
+    client->server_name = server_name;
+    client->fd = fd;
+    ipc_shm_attach(client->fd, false); // the connection may or may not have the rings, see rpc_client_create
     return client;
 }
+#endif
 
 void rpc_client_destroy(rpc_server_stub_t *server)
 {
-    mutex_acquire(&server->mutex);
+    rpc_client_wait_all(server);
+    mutex_acquire(&server->write_mutex);
+#ifndef __MOS_KERNEL__
+    ipc_shm_detach(server->fd);
+#endif
     syscall_io_close(server->fd);
     free(server);
 }
 
+#ifndef __MOS_KERNEL__
+u64 rpc_client_send_fd(rpc_server_stub_t *server, fd_t fd)
+{
+    const long handle = syscall_ipc_send_fd(server->fd, fd);
+    return IS_ERR_VALUE(handle) ? 0 : handle;
+}
+
+fd_t rpc_client_receive_fd(rpc_server_stub_t *server, u64 handle)
+{
+    return syscall_ipc_recv_fd(server->fd, handle);
+}
+#endif
+
 rpc_call_t *rpc_call_create(rpc_server_stub_t *server, u32 function_id)
 {
     rpc_call_t *call = (rpc_call_t *) calloc(1, sizeof(rpc_call_t));
@@ -138,82 +198,233 @@ void rpc_call_arg_string(rpc_call_t *call, const char *arg)
     rpc_call_arg(call, RPC_ARGTYPE_STRING, arg, strlen(arg) + 1); // also send the null terminator
 }
 
-rpc_result_code_t rpc_call_exec(rpc_call_t *call, void **result_data, size_t *data_size)
+// complete a pending call, returns true if the caller should invoke the callback and free it
+static bool rpc_pending_complete_locked(rpc_pending_call_t *pending, rpc_result_code_t result_code, const void *data, size_t size)
 {
-    if (result_data && data_size)
+    rpc_pending_call_t **pp = &pending->server->pending;
+    while (*pp != pending)
+        pp = &(*pp)->next;
+    *pp = pending->next;
+
+    pending->result_code = result_code;
+    if (size)
     {
-        *data_size = 0;
-        *result_data = NULL;
+        pending->data = malloc(size);
+        pending->data_size = size;
+        memcpy(pending->data, data, size);
     }
 
-    mutex_acquire(&call->mutex);
-    mutex_acquire(&call->server->mutex);
-    call->request->call_id = ++call->server->callid;
+    pending->done = true;
+    return pending->callback != NULL;
+}
 
-    bool written = ipc_write_as_msg(call->server->fd, (char *) call->request, call->size);
-    if (!written)
-    {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return RPC_RESULT_CLIENT_WRITE_FAILED;
-    }
+static void rpc_pending_run_callback(rpc_pending_call_t *pending)
+{
+    pending->callback(pending->result_code, pending->data, pending->data_size, pending->callback_arg);
+    free(pending->data);
+    free(pending);
+}
 
-    ipc_msg_t *msg = ipc_read_msg(call->server->fd);
-    if (!msg)
+// wait until cond() holds, reading and dispatching responses if no other thread is doing so
+// must be called with server->lock held, the lock is held again when this function returns
+template<typename TCond>
+static void rpc_client_wait_locked(rpc_server_stub_t *server, TCond cond)
+{
+    while (!cond())
     {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return RPC_RESULT_CLIENT_READ_FAILED;
+        if (server->reading)
+        {
+            // another thread is reading, wait for it to make progress
+            const futex_word_t progress = __atomic_load_n(&server->progress, __ATOMIC_ACQUIRE);
+            mutex_release(&server->lock);
+            syscall_futex_wait(&server->progress, progress);
+            mutex_acquire(&server->lock);
+            continue;
+        }
+
+        server->reading = true;
+        mutex_release(&server->lock);
+        ipc_msg_t *msg = ipc_read_msg(server->fd);
+        mutex_acquire(&server->lock);
+        server->reading = false;
+
+        const rpc_response_t *response = msg ? (const rpc_response_t *) msg->data : NULL;
+        if (!msg || msg->size < sizeof(rpc_response_t) || response->magic != RPC_RESPONSE_MAGIC || msg->size < sizeof(rpc_response_t) + response->data_size)
+        {
+            // the connection is no longer usable, fail every outstanding call
+            if (msg)
+                mos_warn("invalid response from rpc server '%s'", server->server_name);
+            server->broken = true;
+            while (server->pending)
+            {
+                rpc_pending_call_t *pending = server->pending;
+                if (rpc_pending_complete_locked(pending, RPC_RESULT_CLIENT_READ_FAILED, NULL, 0))
+                {
+                    mutex_release(&server->lock);
+                    rpc_pending_run_callback(pending);
+                    mutex_acquire(&server->lock);
+                }
+            }
+        }
+        else
+        {
+            rpc_pending_call_t *pending = server->pending;
+            while (pending && pending->call_id != response->call_id)
+                pending = pending->next;
+
+            if (!pending)
+                mos_warn("rpc server '%s' replied to unknown call %d", server->server_name, response->call_id);
+            else if (rpc_pending_complete_locked(pending, response->result_code, response->data, response->data_size))
+            {
+                mutex_release(&server->lock);
+                rpc_pending_run_callback(pending);
+                mutex_acquire(&server->lock);
+            }
+        }
+
+        if (msg)
+            ipc_msg_destroy(msg);
+
+        // let the other waiters check their calls, one of them may take over reading
+        __atomic_fetch_add(&server->progress, 1, __ATOMIC_RELEASE);
+        syscall_futex_wake(&server->progress, (size_t) -1);
+
+        if (server->broken)
+            break;
     }
+}
+
+// on success, *out is the pending call for calls without a callback, NULL otherwise
+static rpc_result_code_t rpc_call_do_submit(rpc_call_t *call, rpc_call_callback_t callback, void *arg, const pb_msgdesc_t *respm, void *resp, rpc_pending_call_t **out)
+{
+    *out = NULL;
+    rpc_server_stub_t *server = call->server;
+    rpc_pending_call_t *pending = (rpc_pending_call_t *) calloc(1, sizeof(rpc_pending_call_t));
+    pending->server = server;
+    pending->callback = callback;
+    pending->callback_arg = arg;
+    pending->respm = respm;
+    pending->resp = resp;
 
-    if (msg->size < sizeof(rpc_response_t))
+    mutex_acquire(&call->mutex);
+    mutex_acquire(&server->write_mutex);
+    call->request->call_id = pending->call_id = ++server->callid;
+
+    // register the call before writing it, the response may arrive before we return
+    mutex_acquire(&server->lock);
+    if (server->broken)
     {
-        mutex_release(&call->server->mutex);
+        mutex_release(&server->lock);
+        mutex_release(&server->write_mutex);
         mutex_release(&call->mutex);
-        return RPC_RESULT_CLIENT_READ_FAILED;
+        free(pending);
+        return RPC_RESULT_CLIENT_WRITE_FAILED;
     }
+    pending->next = server->pending;
+    server->pending = pending;
+    mutex_release(&server->lock);
+
+    const bool written = ipc_write_as_msg(server->fd, (char *) call->request, call->size);
+    mutex_release(&server->write_mutex);
+    mutex_release(&call->mutex);
 
-    rpc_response_t *response = (rpc_response_t *) msg->data;
-    if (response->magic != RPC_RESPONSE_MAGIC)
+    if (!written)
     {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return RPC_RESULT_CLIENT_READ_FAILED;
+        // a partially written request leaves the stream unusable
+        mutex_acquire(&server->lock);
+        server->broken = true;
+
+        // a reader may have failed the call already, and freed it if it had a callback
+        bool queued = false;
+        for (rpc_pending_call_t *p = server->pending; p && !queued; p = p->next)
+            queued = p == pending;
+        if (queued)
+            rpc_pending_complete_locked(pending, RPC_RESULT_CLIENT_WRITE_FAILED, NULL, 0);
+        mutex_release(&server->lock);
+
+        // a callback that has already run has reported the failure, otherwise it's returned here
+        if (!queued && callback)
+            return RPC_RESULT_OK;
+
+        free(pending->data);
+        free(pending);
+        return RPC_RESULT_CLIENT_WRITE_FAILED;
     }
 
-    if (response->call_id != call->request->call_id)
+    if (!callback)
+        *out = pending; // a callback call may have been completed and freed already
+    return RPC_RESULT_OK;
+}
+
+rpc_pending_call_t *rpc_call_submit(rpc_call_t *call)
+{
+    rpc_pending_call_t *pending;
+    rpc_call_do_submit(call, NULL, NULL, NULL, NULL, &pending);
+    return pending;
+}
+
+rpc_result_code_t rpc_call_submit_cb(rpc_call_t *call, rpc_call_callback_t callback, void *arg)
+{
+    if (!callback)
+        return RPC_RESULT_INVALID_ARGUMENT;
+
+    rpc_pending_call_t *pending;
+    return rpc_call_do_submit(call, callback, arg, NULL, NULL, &pending);
+}
+
+rpc_result_code_t rpc_call_wait(rpc_pending_call_t *pending, void **result_data, size_t *data_size)
+{
+    if (result_data && data_size)
     {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return RPC_RESULT_CALLID_MISMATCH;
+        *data_size = 0;
+        *result_data = NULL;
     }
 
-    if (response->result_code != RPC_RESULT_OK)
+    rpc_server_stub_t *server = pending->server;
+    mutex_acquire(&server->lock);
+    rpc_client_wait_locked(server, [&]() { return pending->done; });
+    mutex_release(&server->lock);
+
+    rpc_result_code_t result = pending->result_code;
+    if (result == RPC_RESULT_OK && pending->respm && pending->resp)
     {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return response->result_code;
+        pb_istream_t stream = pb_istream_from_buffer((const pb_byte_t *) pending->data, pending->data_size);
+        if (!pb_decode(&stream, pending->respm, pending->resp))
+            result = RPC_RESULT_CLIENT_READ_FAILED;
     }
 
-    if (msg->size < sizeof(rpc_response_t))
+    if (result == RPC_RESULT_OK && result_data && data_size && pending->data_size)
     {
-        mutex_release(&call->server->mutex);
-        mutex_release(&call->mutex);
-        return RPC_RESULT_CLIENT_READ_FAILED;
+        *data_size = pending->data_size;
+        *result_data = pending->data; // ownership is passed to the caller
+        pending->data = NULL;
     }
 
-    if (result_data && data_size && response->data_size)
+    free(pending->data);
+    free(pending);
+    return result;
+}
+
+void rpc_client_wait_all(rpc_server_stub_t *server)
+{
+    mutex_acquire(&server->lock);
+    rpc_client_wait_locked(server, [&]() { return server->pending == NULL; });
+    mutex_release(&server->lock);
+}
+
+rpc_result_code_t rpc_call_exec(rpc_call_t *call, void **result_data, size_t *data_size)
+{
+    if (result_data && data_size)
     {
-        *data_size = response->data_size;
-        *result_data = malloc(response->data_size);
-        memcpy(*result_data, response->data, response->data_size);
+        *data_size = 0;
+        *result_data = NULL;
     }
 
-    rpc_result_code_t result = response->result_code;
-    ipc_msg_destroy(msg);
-    mutex_release(&call->server->mutex);
-    mutex_release(&call->mutex);
-    return result;
+    rpc_pending_call_t *pending = rpc_call_submit(call);
+    if (!pending)
+        return RPC_RESULT_CLIENT_WRITE_FAILED;
+
+    return rpc_call_wait(pending, result_data, data_size);
 }
 
 rpc_result_code_t rpc_simple_call(rpc_server_stub_t *stub, u32 funcid, rpc_result_t *result, const char *argspec, ...)
@@ -292,7 +503,8 @@ exec:
     return RPC_RESULT_OK;
 }
 
-rpc_result_code_t rpc_do_pb_call(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp)
+static rpc_result_code_t rpc_pb_call_submit(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp,
+                                            rpc_pending_call_t **pending)
 {
     size_t bufsize;
     pb_get_encoded_size(&bufsize, reqm, req);
@@ -303,22 +515,24 @@ rpc_result_code_t rpc_do_pb_call(rpc_server_stub_t *stub, u32 funcid, const pb_m
 
     rpc_call_t *call = rpc_call_create(stub, funcid);
     rpc_call_arg(call, RPC_ARGTYPE_BUFFER, buf, wstream.bytes_written);
-
-    void *result = NULL;
-    size_t result_size = 0;
-    rpc_result_code_t result_code = rpc_call_exec(call, &result, &result_size);
+    const rpc_result_code_t result = rpc_call_do_submit(call, NULL, NULL, respm, resp, pending);
     rpc_call_destroy(call);
+    return result;
+}
 
-    if (!respm || !resp)
-        return result_code; // no response expected
-
-    if (result_code != RPC_RESULT_OK)
-        return result_code;
+rpc_pending_call_t *rpc_do_pb_call_async(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp)
+{
+    rpc_pending_call_t *pending = NULL;
+    rpc_pb_call_submit(stub, funcid, reqm, req, respm, resp, &pending);
+    return pending;
+}
 
-    pb_istream_t stream = pb_istream_from_buffer((const pb_byte_t *) result, result_size);
-    if (!pb_decode(&stream, respm, resp))
-        return RPC_RESULT_CLIENT_READ_FAILED;
+rpc_result_code_t rpc_do_pb_call(rpc_server_stub_t *stub, u32 funcid, const pb_msgdesc_t *reqm, const void *req, const pb_msgdesc_t *respm, void *resp)
+{
+    rpc_pending_call_t *pending = NULL;
+    const rpc_result_code_t result = rpc_pb_call_submit(stub, funcid, reqm, req, respm, resp, &pending);
+    if (result != RPC_RESULT_OK)
+        return result;
 
-    free(result);
-    return RPC_RESULT_OK;
+    return rpc_call_wait(pending, NULL, NULL);
 }
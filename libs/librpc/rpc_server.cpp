@@ -29,6 +29,7 @@
 #ifdef __MOS_KERNEL__
 #include "mos/io/io.hpp"
 #include "mos/ipc/ipc_io.hpp"
+#include "mos/locks/futex.hpp"
 #include "mos/tasks/kthread.hpp"
 
 #include <mos/syscall/decl.h>
@@ -37,7 +38,10 @@
 #define syscall_ipc_connect(server_name, smh_size)   ipc_connect(server_name, smh_size)
 #define start_thread(name, func, arg)                kthread_create(func, arg, name)
 #define syscall_io_close(fd)                         fd->unref()
+#define syscall_futex_wait(futex, val)               futex_wait(futex, val)
+#define syscall_futex_wake(futex, count)             futex_wake(futex, count)
 #else
+#include <mos/ipc/ipc_types.h>
 #include <mos/syscall/usermode.h>
 #endif
 
@@ -63,7 +67,8 @@ static void start_thread(const char *name, thread_entry_t entry, void *arg)
 }
 #endif
 
-#define RPC_SERVER_MAX_PENDING_CALLS 32
+#define RPC_SERVER_MAX_PENDING_CALLS      32
+#define RPC_SERVER_MAX_DIRECT_FUNCTION_ID 1024 // larger function IDs fall back to a linear scan
 
 typedef struct _rpc_server
 {
@@ -72,8 +77,24 @@ typedef struct _rpc_server
     ipcfd_t server_fd;
     size_t functions_count;
     rpc_function_info_t *functions;
+    rpc_function_info_t **dispatch_table; // indexed by function ID
+    size_t dispatch_table_size;
     rpc_server_on_connect_t on_connect;
     rpc_server_on_disconnect_t on_disconnect;
+    bool concurrent; // handle requests from the same connection concurrently
+
+    // worker pool, every request is queued as a job for the workers
+    size_t pool_size; // max number of idle workers kept around, 0 to start a thread for every job
+    mutex_t pool_lock;
+    rpc_context_t *queue_head, *queue_tail;
+    size_t queued_jobs;
+    size_t idle_workers;
+    size_t nworkers;       // every worker, busy or idle, rpc_server_destroy waits for all of them
+    futex_word_t pool_seq; // bumped when a job is queued, or a worker or a connection goes away
+
+    // live connections, rpc_server_destroy closes them, also protected by pool_lock
+    rpc_context_t *connections;
+    bool closing;
 } rpc_server_t;
 
 typedef struct _rpc_args_iter
@@ -95,119 +116,341 @@ struct _rpc_context
     rpc_response_t *response;
     rpc_args_iter_t arg_iter;
     void *data;
+
+    rpc_context_t *connection; // the connection context, which is the context itself unless it's a concurrent call
+
+    // buffers reused across requests handled by this context
+    ipc_msg_t *msg;
+    size_t msg_capacity;
+    rpc_response_t *response_buffer;
+    size_t response_capacity;
+
+    // job queue linkage, see rpc_server_run_job
+    thread_entry_t job;
+    rpc_context_t *next;
+
+    // the following fields are only used by connection contexts
+    mutex_t write_mutex;       // replies of concurrent calls may be written by different threads
+    size_t refcount;           // the reader thread and every in-flight call hold a reference
+    mutex_t free_calls_lock;   // protects free_calls
+    rpc_context_t *free_calls; // idle call contexts, kept for their buffers
+    futex_word_t calls_done;   // bumped when a call finishes, the reader waits for it unless the server is concurrent
+    rpc_context_t *prev_connection, *next_connection; // in server->connections
+    bool fd_closed;                                   // client_fd has been closed, protected by server->pool_lock
 };
 
 static inline rpc_function_info_t *rpc_server_get_function(rpc_server_t *server, u32 function_id)
 {
+    if (server->dispatch_table)
+        return function_id < server->dispatch_table_size ? server->dispatch_table[function_id] : NULL;
+
     for (size_t i = 0; i < server->functions_count; i++)
         if (server->functions[i].function_id == function_id)
             return &server->functions[i];
     return NULL;
 }
 
-static void rpc_handle_client(void *arg)
+static void rpc_worker_main(void *arg)
 {
-    rpc_context_t *context = (rpc_context_t *) arg;
-
-    if (context->server->on_connect)
-        context->server->on_connect(context);
+    rpc_server_t *server = (rpc_server_t *) arg;
 
+    mutex_acquire(&server->pool_lock);
     while (true)
     {
-        ipc_msg_t *const msg = ipc_read_msg(context->client_fd);
-        if (!msg)
-            break;
-
-        if (msg->size < sizeof(rpc_request_t))
+        if (server->queue_head)
         {
-            mos_warn("failed to read message from client");
-            ipc_msg_destroy(msg);
-            break;
+            rpc_context_t *context = server->queue_head;
+            server->queue_head = context->next;
+            if (!server->queue_head)
+                server->queue_tail = NULL;
+            server->queued_jobs--;
+
+            mutex_release(&server->pool_lock);
+            context->job(context);
+            mutex_acquire(&server->pool_lock);
+            continue;
         }
 
-        rpc_request_t *request = (rpc_request_t *) msg->data;
-        if (request->magic != RPC_REQUEST_MAGIC)
-        {
-            mos_warn("invalid magic in rpc request: %x", request->magic);
-            ipc_msg_destroy(msg);
-            break;
-        }
+        if (server->idle_workers >= server->pool_size)
+            break; // there are enough idle workers already
 
-        rpc_function_info_t *function = rpc_server_get_function(context->server, request->function_id);
-        if (!function)
-        {
-            mos_warn("invalid function id in rpc request: %d", request->function_id);
-            ipc_msg_destroy(msg);
-            break;
-        }
+        const futex_word_t seq = __atomic_load_n(&server->pool_seq, __ATOMIC_ACQUIRE);
+        server->idle_workers++;
+        mutex_release(&server->pool_lock);
+        syscall_futex_wait(&server->pool_seq, seq);
+        mutex_acquire(&server->pool_lock);
+        server->idle_workers--;
+    }
 
-        if (request->args_count > RPC_MAX_ARGS)
-        {
-            mos_warn("too many arguments in rpc request: %d", request->args_count);
-            ipc_msg_destroy(msg);
-            break;
-        }
+    // let rpc_server_destroy know that one fewer worker is around
+    server->nworkers--;
+    __atomic_fetch_add(&server->pool_seq, 1, __ATOMIC_RELEASE);
+    syscall_futex_wake(&server->pool_seq, (size_t) -1);
+    mutex_release(&server->pool_lock);
+}
+
+// run job(context) on a worker, a new worker is started if none is idle
+// without a pool, every job gets a new worker which exits once the queue is empty
+static void rpc_server_run_job(rpc_server_t *server, const char *name, thread_entry_t job, rpc_context_t *context)
+{
+    context->job = job;
+    context->next = NULL;
+
+    mutex_acquire(&server->pool_lock);
+    if (server->queue_tail)
+        server->queue_tail->next = context;
+    else
+        server->queue_head = context;
+    server->queue_tail = context;
+    server->queued_jobs++;
+
+    // a call may block for a long time, e.g. on another server, never let jobs wait behind it
+    const bool need_worker = server->queued_jobs > server->idle_workers;
+    if (need_worker)
+        server->nworkers++;
+    __atomic_fetch_add(&server->pool_seq, 1, __ATOMIC_RELEASE);
+    mutex_release(&server->pool_lock);
+
+    if (need_worker)
+        start_thread(name, rpc_worker_main, server);
+    else
+        syscall_futex_wake(&server->pool_seq, 1);
+}
+
+// validate a request message, returns the function to call or NULL if the request is malformed
+static rpc_function_info_t *rpc_server_check_request(rpc_server_t *server, const ipc_msg_t *msg)
+{
+    if (msg->size < sizeof(rpc_request_t))
+    {
+        mos_warn("failed to read message from client");
+        return NULL;
+    }
+
+    const rpc_request_t *request = (const rpc_request_t *) msg->data;
+    if (request->magic != RPC_REQUEST_MAGIC)
+    {
+        mos_warn("invalid magic in rpc request: %x", request->magic);
+        return NULL;
+    }
+
+    rpc_function_info_t *function = rpc_server_get_function(server, request->function_id);
+    if (!function)
+    {
+        mos_warn("invalid function id in rpc request: %d", request->function_id);
+        return NULL;
+    }
+
+    if (request->args_count > RPC_MAX_ARGS)
+    {
+        mos_warn("too many arguments in rpc request: %d", request->args_count);
+        return NULL;
+    }
+
+    if (request->args_count != function->args_count)
+    {
+        mos_warn("invalid number if arguments in rpc request, expected %d, got %d", function->args_count, request->args_count);
+        return NULL;
+    }
 
-        if (request->args_count != function->args_count)
+    // check argument types
+    const char *argptr = request->args_array;
+    for (size_t i = 0; i < request->args_count; i++)
+    {
+        const rpc_arg_t *arg = (const rpc_arg_t *) argptr;
+        if (arg->magic != RPC_ARG_MAGIC)
         {
-            mos_warn("invalid number if arguments in rpc request, expected %d, got %d", function->args_count, request->args_count);
-            ipc_msg_destroy(msg);
-            break;
+            mos_warn("invalid magic in rpc argument: %x", arg->magic);
+            return NULL;
         }
-
-        // check argument types
-        const char *argptr = request->args_array;
-        for (size_t i = 0; i < request->args_count; i++)
+        if (arg->argtype != function->args_type[i])
         {
-            const rpc_arg_t *arg = (const rpc_arg_t *) argptr;
-            if (arg->magic != RPC_ARG_MAGIC)
-            {
-                mos_warn("invalid magic in rpc argument: %x", arg->magic);
-                ipc_msg_destroy(msg);
-                break;
-            }
-            if (arg->argtype != function->args_type[i])
-            {
-                mos_warn("invalid argument type in rpc request, expected %d, got %d", function->args_type[i], arg->argtype);
-                ipc_msg_destroy(msg);
-                break;
-            }
-            argptr += sizeof(rpc_arg_t) + arg->size;
+            mos_warn("invalid argument type in rpc request, expected %d, got %d", function->args_type[i], arg->argtype);
+            return NULL;
         }
-        context->request = request;
-        context->response = NULL;
-        context->arg_iter = (rpc_args_iter_t) { 0 };
+        argptr += sizeof(rpc_arg_t) + arg->size;
+    }
 
-        const rpc_result_code_t result = function->func(context);
+    return function;
+}
 
-        if (context->response == NULL)
-        {
-            context->response = (rpc_response_t *) malloc(sizeof(rpc_response_t));
-            context->response->magic = RPC_RESPONSE_MAGIC;
-            context->response->call_id = request->call_id;
-            context->response->data_size = 0;
-        }
+// make sure the context's response buffer can hold size bytes of data
+static rpc_response_t *rpc_context_get_response_buffer(rpc_context_t *context, size_t size)
+{
+    if (!context->response_buffer || context->response_capacity < size)
+    {
+        free(context->response_buffer);
+        context->response_buffer = (rpc_response_t *) malloc(sizeof(rpc_response_t) + size);
+        context->response_capacity = size;
+    }
+
+    rpc_response_t *response = context->response_buffer;
+    response->magic = RPC_RESPONSE_MAGIC;
+    response->call_id = context->request->call_id;
+    response->data_size = size;
+    return response;
+}
+
+static bool rpc_context_reply(rpc_context_t *context, rpc_result_code_t result)
+{
+    if (context->response == NULL)
+        context->response = rpc_context_get_response_buffer(context, 0);
 
-        context->response->result_code = result;
+    context->response->result_code = result;
 
-        const bool written = ipc_write_as_msg(context->client_fd, (const char *) context->response, sizeof(rpc_response_t) + context->response->data_size);
+    rpc_context_t *connection = context->connection;
+    mutex_acquire(&connection->write_mutex);
+    const bool written = ipc_write_as_msg(context->client_fd, (const char *) context->response, sizeof(rpc_response_t) + context->response->data_size);
+    mutex_release(&connection->write_mutex);
 
-        ipc_msg_destroy(msg);
-        free(context->response);
-        context->response = NULL, context->request = NULL, context->arg_iter = (rpc_args_iter_t) { 0 };
+    context->response = NULL, context->request = NULL, context->arg_iter = (rpc_args_iter_t) { 0 };
+    return written;
+}
+
+static void rpc_context_free(rpc_context_t *context)
+{
+    if (context->msg)
+        ipc_msg_destroy(context->msg);
+    free(context->response_buffer);
+    free(context);
+}
+
+static rpc_context_t *rpc_connection_get_call(rpc_context_t *connection)
+{
+    mutex_acquire(&connection->free_calls_lock);
+    rpc_context_t *call = connection->free_calls;
+    if (call)
+        connection->free_calls = call->next;
+    mutex_release(&connection->free_calls_lock);
+
+    if (!call)
+    {
+        call = (rpc_context_t *) malloc(sizeof(rpc_context_t));
+        memset(call, 0, sizeof(rpc_context_t));
+        call->client_fd = connection->client_fd;
+        call->server = connection->server;
+        call->connection = connection;
+    }
 
-        if (!written)
+    return call;
+}
+
+static void rpc_connection_put_call(rpc_context_t *connection, rpc_context_t *call)
+{
+    mutex_acquire(&connection->free_calls_lock);
+    call->next = connection->free_calls;
+    connection->free_calls = call;
+    mutex_release(&connection->free_calls_lock);
+}
+
+// close the client fd of a connection unless rpc_server_destroy already did, called with pool_lock held
+static void rpc_connection_close_fd_locked(rpc_context_t *connection)
+{
+    if (connection->fd_closed)
+        return;
+
+    connection->fd_closed = true;
+    syscall_io_close(connection->client_fd); // wakes up the reader, the rings are marked as closed too
+}
+
+static void rpc_connection_put(rpc_context_t *connection)
+{
+    if (__atomic_sub_fetch(&connection->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    rpc_server_t *server = connection->server;
+    if (server->on_disconnect)
+        server->on_disconnect(connection);
+
+#ifndef __MOS_KERNEL__
+    ipc_shm_detach(connection->client_fd);
+#endif
+
+    while (connection->free_calls)
+    {
+        rpc_context_t *call = connection->free_calls;
+        connection->free_calls = call->next;
+        rpc_context_free(call);
+    }
+
+    mutex_acquire(&server->pool_lock);
+    rpc_connection_close_fd_locked(connection);
+    if (connection->prev_connection)
+        connection->prev_connection->next_connection = connection->next_connection;
+    else
+        server->connections = connection->next_connection;
+    if (connection->next_connection)
+        connection->next_connection->prev_connection = connection->prev_connection;
+    rpc_context_free(connection);
+
+    // let rpc_server_destroy know that the connection is gone
+    __atomic_fetch_add(&server->pool_seq, 1, __ATOMIC_RELEASE);
+    syscall_futex_wake(&server->pool_seq, (size_t) -1);
+    mutex_release(&server->pool_lock);
+}
+
+static void rpc_handle_call(void *arg)
+{
+    rpc_context_t *context = (rpc_context_t *) arg;
+    rpc_context_t *connection = context->connection;
+    rpc_server_t *server = context->server;
+    rpc_function_info_t *function = rpc_server_get_function(server, context->request->function_id);
+
+    if (!rpc_context_reply(context, function->func(context)))
+        mos_warn("failed to write reply to client");
+
+    rpc_connection_put_call(connection, context);
+
+    // the reader still holds its reference, so the connection stays around for the wake up
+    __atomic_fetch_add(&connection->calls_done, 1, __ATOMIC_RELEASE);
+    if (!server->concurrent)
+        syscall_futex_wake(&connection->calls_done, 1);
+
+    rpc_connection_put(connection);
+}
+
+// the reader of a connection, it only reads the requests and queues each of them as a job for the workers,
+// so no worker is tied up by a connection waiting for its next request
+static void rpc_handle_client(void *arg)
+{
+    rpc_context_t *context = (rpc_context_t *) arg;
+    rpc_server_t *server = context->server;
+
+    if (server->on_connect)
+        server->on_connect(context);
+
+    while (true)
+    {
+        // every call reads its request into its own context, which is kept for its buffers
+        rpc_context_t *call = rpc_connection_get_call(context);
+
+        if (!ipc_read_msg_reuse(context->client_fd, &call->msg, &call->msg_capacity))
         {
-            mos_warn("failed to write reply to client");
+            rpc_connection_put_call(context, call);
+            break;
+        }
+
+        if (!rpc_server_check_request(server, call->msg))
+        {
+            rpc_connection_put_call(context, call);
             break;
         }
-    }
 
-    if (context->server->on_disconnect)
-        context->server->on_disconnect(context);
+        call->request = (rpc_request_t *) call->msg->data;
+        call->response = NULL;
+        call->arg_iter = (rpc_args_iter_t) { 0 };
 
-    syscall_io_close(context->client_fd);
-    free(context);
+        // hand the request over to a worker, replies are matched by call ID on the client side
+        const futex_word_t done = __atomic_load_n(&context->calls_done, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&context->refcount, 1, __ATOMIC_ACQ_REL);
+        rpc_server_run_job(server, "rpc-call", rpc_handle_call, call);
+
+        // unless the server is concurrent, the next request is only read once this one has been replied to
+        if (!server->concurrent)
+            while (__atomic_load_n(&context->calls_done, __ATOMIC_ACQUIRE) == done)
+                syscall_futex_wait(&context->calls_done, done);
+    }
+
+    rpc_connection_put(context);
 }
 
 rpc_server_t *rpc_server_create(const char *server_name, void *data)
@@ -253,11 +496,44 @@ void rpc_server_destroy(rpc_server_t *server)
 {
     if (!IS_ERR_VALUE(server->server_fd))
         syscall_io_close(server->server_fd);
+
+    // close every connection instead of waiting for the clients to disconnect, their readers wake up and exit
+    mutex_acquire(&server->pool_lock);
+    server->closing = true;
+    for (rpc_context_t *connection = server->connections; connection; connection = connection->next_connection)
+        rpc_connection_close_fd_locked(connection);
+
+    // ask the idle workers to exit, and wait for the calls still running and the connections to go away
+    server->pool_size = 0;
+    while (server->nworkers || server->connections)
+    {
+        const futex_word_t seq = __atomic_add_fetch(&server->pool_seq, 1, __ATOMIC_ACQ_REL);
+        mutex_release(&server->pool_lock);
+        syscall_futex_wake(&server->pool_seq, (size_t) -1);
+        syscall_futex_wait(&server->pool_seq, seq);
+        mutex_acquire(&server->pool_lock);
+    }
+    mutex_release(&server->pool_lock);
+
     if (server->functions)
         free(server->functions);
+    if (server->dispatch_table)
+        free(server->dispatch_table);
     free(server);
 }
 
+void rpc_server_set_concurrent(rpc_server_t *server, bool concurrent)
+{
+    server->concurrent = concurrent;
+}
+
+void rpc_server_set_worker_pool(rpc_server_t *server, size_t nworkers)
+{
+    mutex_acquire(&server->pool_lock);
+    server->pool_size = nworkers;
+    mutex_release(&server->pool_lock);
+}
+
 void rpc_server_set_data(rpc_server_t *server, void *data)
 {
     server->data = data;
@@ -272,7 +548,11 @@ void rpc_server_exec(rpc_server_t *server)
 {
     while (true)
     {
+#ifdef __MOS_KERNEL__
         const ipcfd_t client_fd = syscall_ipc_accept(server->server_fd);
+#else
+        const ipcfd_t client_fd = syscall_ipc_accept_ex(server->server_fd, IPC_CONNECT_SHM_RING); // attached to below
+#endif
 
         if (IS_ERR_VALUE(client_fd))
         {
@@ -288,11 +568,40 @@ void rpc_server_exec(rpc_server_t *server)
             break;
         }
 
+#ifndef __MOS_KERNEL__
+        ipc_shm_attach(client_fd, true); // clients that didn't ask for the rings keep using the stream
+#endif
+
         rpc_context_t *context = (rpc_context_t *) malloc(sizeof(rpc_context_t));
         memset(context, 0, sizeof(rpc_context_t));
         context->server = server;
         context->client_fd = client_fd;
-        start_thread("rpc-worker", rpc_handle_client, context);
+        context->connection = context;
+        context->refcount = 1;
+
+        mutex_acquire(&server->pool_lock);
+        const bool closing = server->closing;
+        if (!closing)
+        {
+            context->next_connection = server->connections;
+            if (server->connections)
+                server->connections->prev_connection = context;
+            server->connections = context;
+        }
+        mutex_release(&server->pool_lock);
+
+        if (closing)
+        {
+            // accepted just before the server was destroyed
+#ifndef __MOS_KERNEL__
+            ipc_shm_detach(client_fd);
+#endif
+            syscall_io_close(client_fd);
+            rpc_context_free(context);
+            break;
+        }
+
+        start_thread("rpc-reader", rpc_handle_client, context);
     }
 }
 
@@ -302,21 +611,54 @@ bool rpc_server_register_functions(rpc_server_t *server, const rpc_function_info
     server->functions = (rpc_function_info_t *) malloc(sizeof(rpc_function_info_t) * count);
     memcpy(server->functions, functions, sizeof(rpc_function_info_t) * count);
     server->functions_count = count;
+
+    u32 max_function_id = 0;
+    for (size_t i = 0; i < count; i++)
+        if (functions[i].function_id > max_function_id)
+            max_function_id = functions[i].function_id;
+
+    if (count == 0 || max_function_id >= RPC_SERVER_MAX_DIRECT_FUNCTION_ID)
+        return true; // too sparse for a direct table, use a linear scan
+
+    server->dispatch_table_size = max_function_id + 1;
+    server->dispatch_table = (rpc_function_info_t **) calloc(server->dispatch_table_size, sizeof(rpc_function_info_t *));
+    for (size_t i = 0; i < count; i++)
+    {
+        rpc_function_info_t **slot = &server->dispatch_table[server->functions[i].function_id];
+        if (*slot)
+            mos_warn("duplicate rpc function id %d, only the first one is used", server->functions[i].function_id);
+        else
+            *slot = &server->functions[i];
+    }
+
     return true;
 }
 
 void *rpc_context_get_data(const rpc_context_t *context)
 {
-    return context->data;
+    return __atomic_load_n(&context->connection->data, __ATOMIC_SEQ_CST);
 }
 
 void *rpc_context_set_data(rpc_context_t *context, void *data)
 {
     void *old = NULL;
-    __atomic_exchange(&context->data, &data, &old, __ATOMIC_SEQ_CST);
+    __atomic_exchange(&context->connection->data, &data, &old, __ATOMIC_SEQ_CST);
     return old;
 }
 
+#ifndef __MOS_KERNEL__
+u64 rpc_context_send_fd(rpc_context_t *context, fd_t fd)
+{
+    const long handle = syscall_ipc_send_fd(context->client_fd, fd);
+    return IS_ERR_VALUE(handle) ? 0 : handle;
+}
+
+fd_t rpc_context_receive_fd(rpc_context_t *context, u64 handle)
+{
+    return syscall_ipc_recv_fd(context->client_fd, handle);
+}
+#endif
+
 rpc_server_t *rpc_context_get_server(const rpc_context_t *context)
 {
     return context->server;
@@ -423,11 +765,8 @@ void rpc_write_result(rpc_context_t *context, const void *data, size_t size)
 {
     MOS_LIB_ASSERT_X(context->response == NULL, "rpc_write_result called twice");
 
-    rpc_response_t *response = (rpc_response_t *) malloc(sizeof(rpc_response_t) + size);
-    response->magic = RPC_RESPONSE_MAGIC;
-    response->call_id = context->request->call_id;
+    rpc_response_t *response = rpc_context_get_response_buffer(context, size);
     response->result_code = RPC_RESULT_OK;
-    response->data_size = size;
     memcpy(response->data, data, size);
     context->response = response;
 }
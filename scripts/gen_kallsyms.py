@@ -12,6 +12,8 @@ from sys import argv, stderr
 const kallsyms_t mos_kallsyms[] = {
     { .name = NULL, .address = 0 },
 };
+
+const size_t mos_kallsyms_count = 0;
 """
 
 outfile: io.TextIOBase = None
@@ -47,6 +49,7 @@ def main():
     gen("const kallsyms_t mos_kallsyms[] = {")
 
     should_skip = True
+    n_symbols = 0
 
     for l in lines:
         l = l.strip()
@@ -71,9 +74,12 @@ def main():
 
         gen("    { .address = 0x%s, .name = %s }," %
             (addr, '"' + name + '"'))
+        n_symbols += 1
 
     gen("    { .address = 0, .name = NULL },")
     gen("};")
+    gen("")
+    gen("const size_t mos_kallsyms_count = %d;" % n_symbols)
     pass
 
 
@@ -230,7 +230,8 @@ class SyscallNumberGenerator(BaseAbstractGenerator):
         return "Syscall number definitions"
 
     def generate_epilogue(self):
-        pass
+        self.gen("// the largest syscall number")
+        self.gen("#define SYSCALL_MAX_NR %d" % max(e["number"] for e in j["syscalls"]))
 
     def generate_prologue(self):
         self.gen("// expand to 1 if syscall is defined, 0 otherwise")
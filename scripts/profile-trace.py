@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Convert a kernel profiling trace (/sys/profiling/trace) to the Chrome trace event format,
+# which can be opened in chrome://tracing or https://ui.perfetto.dev.
+#
+# The layout of the trace is defined in kernel/include/public/mos/misc/profiling.h and trace.h.
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = b"MOSPROF1"
+VERSION = 3
+
+HEADER = struct.Struct("<8sIIIIQQII")  # magic, version, n_cpus, n_events, reserved, lost, timestamp_hz, n_names, reserved
+NAME = struct.Struct("<II")  # id, len
+EVENT = struct.Struct("<QQIiII")  # start, end, name, tid, cpu, reserved
+
+
+def parse(data: bytes):
+    magic, version = struct.unpack_from("<8sI", data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a MOS profiling trace")
+    if version != VERSION:
+        raise ValueError(f"unsupported trace version {version}")
+
+    _, _, n_cpus, n_events, _, lost, timestamp_hz, n_names, _ = HEADER.unpack_from(data, 0)
+
+    offset = HEADER.size
+    names: dict[int, str] = {}
+    for _ in range(n_names):
+        id, length = NAME.unpack_from(data, offset)
+        offset += NAME.size
+        names[id] = data[offset : offset + length].decode(errors="replace")
+        offset += length
+
+    events = []
+    for _ in range(n_events):
+        start, end, name, tid, cpu, _ = EVENT.unpack_from(data, offset)
+        offset += EVENT.size
+        events.append((start, end, names.get(name, f"<unknown {name}>"), tid, cpu))
+
+    return n_cpus, lost, timestamp_hz, events
+
+
+def to_chrome_trace(n_cpus: int, events, ticks_per_us: float):
+    base = min((e[0] for e in events), default=0)
+    trace = []
+
+    # one "process" per CPU, so that a thread's events stay nested under the interrupts that led to them
+    for cpu in range(n_cpus):
+        trace.append({"name": "process_name", "ph": "M", "pid": cpu, "args": {"name": f"CPU {cpu}"}})
+
+    for start, end, name, tid, cpu in events:
+        trace.append(
+            {
+                "name": name,
+                "cat": name.split(".")[0],
+                "ph": "X",
+                "ts": (start - base) / ticks_per_us,
+                "dur": max(end - start, 0) / ticks_per_us,
+                "pid": cpu,
+                "tid": tid,
+            }
+        )
+
+    return {"traceEvents": trace, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a MOS profiling trace to Chrome trace JSON")
+    parser.add_argument("trace", help="the trace, as read from /sys/profiling/trace")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.trace, "rb") as f:
+        n_cpus, lost, timestamp_hz, events = parse(f.read())
+
+    if lost:
+        print(f"warning: {lost} events were overwritten before the trace was read", file=sys.stderr)
+
+    result = to_chrome_trace(n_cpus, events, timestamp_hz / 1e6)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(result, f)
+    else:
+        json.dump(result, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
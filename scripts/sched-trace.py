@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Decode a scheduler trace (/sys/sched/trace): print the events in time order, or summarise
+# the run time and wakeup latency of each thread.
+#
+# The layout of the trace is defined in kernel/include/public/mos/tasks/sched_trace.h and misc/trace.h.
+
+import argparse
+import struct
+import sys
+from collections import defaultdict
+
+MAGIC = b"MOSSCHD1"
+VERSION = 2
+
+HEADER = struct.Struct("<8sIIIIQQ")  # magic, version, n_cpus, n_events, reserved, lost, timestamp_hz
+EVENT = struct.Struct("<QIBcHii")  # timestamp, cpu, type, prev_state, reserved, prev_tid, next_tid
+
+SCHED_TRACE_SWITCH = 1
+SCHED_TRACE_WAKEUP = 2
+
+
+def parse(data: bytes):
+    magic, version = struct.unpack_from("<8sI", data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a MOS scheduler trace")
+    if version != VERSION:
+        raise ValueError(f"unsupported trace version {version}")
+
+    _, _, n_cpus, n_events, _, lost, timestamp_hz = HEADER.unpack_from(data, 0)
+
+    events = []
+    for i in range(n_events):
+        ts, cpu, type, prev_state, _, prev_tid, next_tid = EVENT.unpack_from(data, HEADER.size + i * EVENT.size)
+        events.append((ts, cpu, type, prev_state.decode(errors="replace"), prev_tid, next_tid))
+
+    events.sort()
+    return n_cpus, lost, timestamp_hz, events
+
+
+def print_events(events, ticks_per_us: float):
+    base = events[0][0] if events else 0
+    for ts, cpu, type, prev_state, prev_tid, next_tid in events:
+        t = (ts - base) / ticks_per_us
+        if type == SCHED_TRACE_SWITCH:
+            print(f"{t:14.3f} cpu {cpu:<2} switch  {prev_tid:>5} ({prev_state}) -> {next_tid}")
+        elif type == SCHED_TRACE_WAKEUP:
+            print(f"{t:14.3f} cpu {cpu:<2} wakeup  {next_tid:>5} by {prev_tid}")
+
+
+def summarise(events, ticks_per_us: float):
+    running: dict[int, tuple[int, int]] = {}  # cpu -> (tid, since)
+    woken: dict[int, int] = {}  # tid -> when
+    runtime: dict[int, float] = defaultdict(float)
+    latencies: dict[int, list[float]] = defaultdict(list)
+
+    for ts, cpu, type, _, prev_tid, next_tid in events:
+        if type == SCHED_TRACE_WAKEUP:
+            woken[next_tid] = ts
+            continue
+
+        if cpu in running and running[cpu][0] == prev_tid:
+            runtime[prev_tid] += (ts - running[cpu][1]) / ticks_per_us
+        running[cpu] = (next_tid, ts)
+
+        if next_tid in woken:
+            latencies[next_tid].append((ts - woken.pop(next_tid)) / ticks_per_us)
+
+    print(f"{'tid':>6} {'runtime (us)':>14} {'wakeups':>8} {'avg lat (us)':>14} {'max lat (us)':>14}")
+    for tid in sorted(set(runtime) | set(latencies), key=lambda t: -runtime[t]):
+        lat = latencies[tid]
+        avg = sum(lat) / len(lat) if lat else 0
+        print(f"{tid:>6} {runtime[tid]:>14.1f} {len(lat):>8} {avg:>14.1f} {max(lat, default=0):>14.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a MOS scheduler trace")
+    parser.add_argument("trace", help="the trace, as read from /sys/sched/trace")
+    parser.add_argument("-s", "--summary", action="store_true", help="print per-thread run time and wakeup latency")
+    args = parser.parse_args()
+
+    with open(args.trace, "rb") as f:
+        _, lost, timestamp_hz, events = parse(f.read())
+
+    if lost:
+        print(f"warning: {lost} events were overwritten before the trace was read", file=sys.stderr)
+
+    if args.summary:
+        summarise(events, timestamp_hz / 1e6)
+    else:
+        print_events(events, timestamp_hz / 1e6)
+
+
+if __name__ == "__main__":
+    main()
@@ -8,7 +8,7 @@ import argparse
 import logging
 import os
 from time import sleep
-from utils import ScopedTimer, QEMU_ARCH_ARGS, TestFailedError, QemuProcessBuilder
+from utils import ScopedTimer, QEMU_ARCH_ARGS, TestFailedError, QemuProcessBuilder, write_boot_chart
 from models import *
 
 
@@ -174,6 +174,9 @@ def main():
                 RunCommand('mkdir', ['/test-results']),
                 RunCommand('test-launcher').redirect(1, '/test-results/test-launcher.log', write=True),
                 ReadFile('/test-results/test-launcher.log', save_to=RESULTS_DIR + 'test-launcher.log'),
+                ReadFile('/sys/boottime/timeline', save_to=RESULTS_DIR + 'boot-kernel.txt'),
+                RunCommand('sc', ['boottime']).redirect(1, '/test-results/boot-services.txt', write=True),
+                ReadFile('/test-results/boot-services.txt', save_to=RESULTS_DIR + 'boot-services.txt'),
             ]
 
             for test in TESTS:
@@ -185,6 +188,13 @@ def main():
                     raise TestFailedError(f'Test {test} failed')
                 sleep(1)
 
+            try:
+                with open(RESULTS_DIR + 'boot-kernel.txt') as kernel, open(RESULTS_DIR + 'boot-services.txt') as services:
+                    write_boot_chart(RESULTS_DIR + 'boot-chart.svg', kernel.read(), services.read())
+                logging.info('Boot chart written to ' + RESULTS_DIR + 'boot-chart.svg')
+            except ValueError as e:
+                logging.warning(f'No boot chart: {e}')
+
             logging.info('Test completed, waiting for QEMU to shutdown...')
             Shutdown().call(QEMU_IO)
             QEMU_IO.wait()
@@ -0,0 +1,87 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+
+# Draw the boot timeline as an SVG Gantt chart: one row for each kernel boot stage
+# (from /sys/boottime/timeline), then one for each unit started by init (from `sc boottime`).
+
+from html import escape
+
+ROW_HEIGHT = 16
+LABEL_WIDTH = 320
+CHART_WIDTH = 960
+STAGE_COLORS = {
+    'kernel': '#9e9e9e',
+    'early_setup': '#8d6e63',
+    'setup': '#a1887f',
+    'ap': '#ab47bc',
+    'started': '#66bb6a',
+    'starting': '#ffca28',
+    'failed': '#ef5350',
+}
+DEFAULT_COLOR = '#42a5f5'  # init.* stages
+
+
+def parse_kernel_timeline(text: str) -> list[tuple[str, str, float, float]]:
+    """(stage, name, start, duration) in ms, from /sys/boottime/timeline"""
+    records = []
+    ticks_per_ms = None
+    for line in text.splitlines()[1:]:
+        if line.startswith('# timestamp_hz '):
+            ticks_per_ms = int(line.split()[2]) / 1000
+        if not line or line.startswith('#'):
+            continue
+        stage, _, start, duration, name = line.split(maxsplit=4)
+        records.append((stage, name, int(start), int(duration)))
+
+    if not ticks_per_ms:
+        raise ValueError('the kernel timeline has no timestamp frequency')
+    return [(stage, name, start / ticks_per_ms, duration / ticks_per_ms) for stage, name, start, duration in records]
+
+
+def parse_service_timeline(text: str) -> list[tuple[str, str, float, float]]:
+    """(status, unit, start, duration) in ms, from `sc boottime`"""
+    rows = []
+    for line in text.splitlines()[1:]:
+        fields = line.split()
+        if len(fields) != 6:
+            continue
+        unit, _, start, _, time, status = fields
+        rows.append((status, unit, float(start), float(time) if time != '-' else 0.0))
+    return rows
+
+
+def _draw_section(title: str, rows, y: int, unit: str) -> tuple[list[str], int]:
+    out = [f'<text x="4" y="{y + 12}" font-weight="bold">{escape(title)}</text>']
+    y += ROW_HEIGHT + 4
+    end = max((start + duration for _, _, start, duration in rows), default=0) or 1
+    scale = CHART_WIDTH / end
+
+    for i in range(0, 11):
+        x = LABEL_WIDTH + CHART_WIDTH * i / 10
+        out.append(f'<line x1="{x:.1f}" y1="{y}" x2="{x:.1f}" y2="{y + ROW_HEIGHT * len(rows)}" stroke="#e0e0e0"/>')
+        out.append(f'<text x="{x:.1f}" y="{y - 2}" font-size="9" text-anchor="middle">{end * i / 10:.1f}{unit}</text>')
+
+    for kind, name, start, duration in rows:
+        color = STAGE_COLORS.get(kind, DEFAULT_COLOR)
+        x, w = LABEL_WIDTH + start * scale, max(duration * scale, 1)
+        out.append(f'<text x="4" y="{y + 12}">{escape(f"{kind}: {name}")}</text>')
+        out.append(f'<rect x="{x:.1f}" y="{y + 2}" width="{w:.1f}" height="{ROW_HEIGHT - 4}" fill="{color}">'
+                   f'<title>{escape(name)}: {duration:.3f}{unit}</title></rect>')
+        y += ROW_HEIGHT
+
+    return out, y + ROW_HEIGHT
+
+
+def write_boot_chart(path: str, kernel_timeline: str, service_timeline: str):
+    kernel_rows = parse_kernel_timeline(kernel_timeline)
+    service_rows = parse_service_timeline(service_timeline)
+
+    body, y = _draw_section('Kernel (ms since the first boot stage)', sorted(kernel_rows, key=lambda r: r[2]), 0, 'ms')
+    services, y = _draw_section('Init units (ms since init started)', service_rows, y, 'ms')
+    body += services
+
+    with open(path, 'w') as f:
+        f.write(f'<svg xmlns="http://www.w3.org/2000/svg" width="{LABEL_WIDTH + CHART_WIDTH + 40}" height="{y}" '
+                f'font-family="monospace" font-size="11">\n')
+        f.write('<rect width="100%" height="100%" fill="white"/>\n')
+        f.write('\n'.join(body))
+        f.write('\n</svg>\n')
@@ -2,5 +2,6 @@
 
 from .ScopedTimer import *
 from .QemuProcess import *
+from .BootChart import *
 
 # __all__ = ['ScopedTimer', 'QemuProcess', 'QemuDeadError', 'QEMU_ARCH_ARGS', 'QemuProcessBuilder']
@@ -2,6 +2,7 @@
 
 #include "dm/dmrpc.h"
 #include "known_devices.hpp"
+#include "pci_manager.hpp"
 #include "pci_scan.hpp"
 
 #include <fcntl.h>
@@ -139,7 +140,11 @@ int main(int argc, char **argv)
     }
 
     syscall_arch_syscall(X86_SYSCALL_IOPL_ENABLE, 0, 0, 0, 0);
+
+    // drivers started for the devices we register connect to us, so the server must exist before the scan
+    PciManagerServer server;
     scan_pci(scan_callback);
 
+    server.run();
     return 0;
 }
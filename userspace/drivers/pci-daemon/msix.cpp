@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "msix.hpp"
+
+#include "pci_scan.hpp"
+
+#include <fcntl.h>
+#include <mos/mm/mm_types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PCI_OFFSET_COMMAND     0x04
+#define PCI_OFFSET_STATUS      0x06
+#define PCI_OFFSET_BAR0        0x10
+#define PCI_OFFSET_CAPABILITIES 0x34
+
+#define PCI_COMMAND_MEMORY_SPACE  (1 << 1)
+#define PCI_COMMAND_BUS_MASTER    (1 << 2)
+#define PCI_COMMAND_INTX_DISABLE  (1 << 10)
+#define PCI_STATUS_CAPABILITIES   (1 << 4)
+#define PCI_CAPABILITY_ID_MSIX    0x11
+
+#define MSIX_OFFSET_CONTROL     0x02
+#define MSIX_OFFSET_TABLE       0x04
+#define MSIX_CONTROL_TABLE_SIZE 0x07ff
+#define MSIX_CONTROL_FUNC_MASK  (1 << 14)
+#define MSIX_CONTROL_ENABLE     (1 << 15)
+
+typedef struct
+{
+    u32 address_low;
+    u32 address_high;
+    u32 data;
+    u32 vector_control; // bit 0: masked
+} __packed msix_table_entry_t;
+
+static u8 find_capability(u8 bus, u8 device, u8 function, u8 id)
+{
+    if (!(pci_read16(bus, device, function, PCI_OFFSET_STATUS) & PCI_STATUS_CAPABILITIES))
+        return 0;
+
+    u8 offset = pcie_read8(bus, device, function, PCI_OFFSET_CAPABILITIES) & ~0x3;
+    for (int i = 0; offset && i < 48; i++) // the list cannot be longer than the configuration space
+    {
+        if (pcie_read8(bus, device, function, offset) == id)
+            return offset;
+        offset = pcie_read8(bus, device, function, offset + 1) & ~0x3;
+    }
+
+    return 0;
+}
+
+static u64 bar_address(u8 bus, u8 device, u8 function, u8 bar)
+{
+    const u32 low = pci_read32(bus, device, function, PCI_OFFSET_BAR0 + bar * 4);
+    if (low & 0x1)
+        return 0; // I/O space, the MSI-X table is always in memory
+
+    u64 address = low & ~0xfu;
+    if ((low & 0x6) == 0x4 && bar < 5) // 64-bit BAR
+        address |= (u64) pci_read32(bus, device, function, PCI_OFFSET_BAR0 + (bar + 1) * 4) << 32;
+    return address;
+}
+
+bool pci_msix_setup(u8 bus, u8 device, u8 function, u16 entry, u64 address, u32 data, u16 *table_size, std::string *error)
+{
+    const u8 cap = find_capability(bus, device, function, PCI_CAPABILITY_ID_MSIX);
+    if (!cap)
+    {
+        *error = "device has no MSI-X capability";
+        return false;
+    }
+
+    const u16 control = pci_read16(bus, device, function, cap + MSIX_OFFSET_CONTROL);
+    *table_size = (control & MSIX_CONTROL_TABLE_SIZE) + 1;
+    if (entry >= *table_size)
+    {
+        *error = "MSI-X entry out of range";
+        return false;
+    }
+
+    const u32 table = pci_read32(bus, device, function, cap + MSIX_OFFSET_TABLE);
+    const u64 table_base = bar_address(bus, device, function, table & 0x7);
+    if (!table_base)
+    {
+        *error = "invalid MSI-X table BAR";
+        return false;
+    }
+
+    // map only the page that holds the entry
+    const u64 entry_addr = table_base + (table & ~0x7u) + entry * sizeof(msix_table_entry_t);
+    const u64 page = ALIGN_DOWN_TO_PAGE(entry_addr);
+
+    const fd_t memfd = open("/sys/mem", O_RDWR);
+    if (memfd < 0)
+    {
+        *error = "failed to open /sys/mem";
+        return false;
+    }
+
+    void *mapped = mmap(NULL, MOS_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, page);
+    close(memfd);
+    if (mapped == MAP_FAILED)
+    {
+        *error = "failed to map the MSI-X table";
+        return false;
+    }
+
+    // hold all vectors masked while the entry is changed
+    pci_write16(bus, device, function, cap + MSIX_OFFSET_CONTROL, control | MSIX_CONTROL_ENABLE | MSIX_CONTROL_FUNC_MASK);
+
+    volatile msix_table_entry_t *e = (volatile msix_table_entry_t *) ((char *) mapped + (entry_addr - page));
+    e->vector_control = 1;
+    e->address_low = address & 0xffffffff;
+    e->address_high = address >> 32;
+    e->data = data;
+    e->vector_control = 0;
+
+    pci_write16(bus, device, function, cap + MSIX_OFFSET_CONTROL, (control | MSIX_CONTROL_ENABLE) & ~MSIX_CONTROL_FUNC_MASK);
+    munmap(mapped, MOS_PAGE_SIZE);
+
+    const u16 command = pci_read16(bus, device, function, PCI_OFFSET_COMMAND);
+    pci_write16(bus, device, function, PCI_OFFSET_COMMAND, command | PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER | PCI_COMMAND_INTX_DISABLE);
+    return true;
+}
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+#include <string>
+
+/**
+ * @brief Program an entry of the MSI-X table of a device, and enable MSI-X on it
+ *
+ * @details The entry is unmasked and legacy (INTx) interrupts of the device are disabled.
+ *
+ * @param table_size Receives the number of entries in the MSI-X table
+ * @param error Receives a description of the error on failure
+ */
+bool pci_msix_setup(u8 bus, u8 device, u8 function, u16 entry, u64 address, u32 data, u16 *table_size, std::string *error);
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "pci_manager.hpp"
+
+#include "msix.hpp"
+
+#include <cstring>
+
+void PciManagerServer::on_disconnect(rpc_context_t *context)
+{
+    // the driver is gone (or done), another one may take the devices over
+    std::lock_guard<std::mutex> lock(owners_lock);
+    std::erase_if(owners, [context](const auto &owner) { return owner.second == context; });
+}
+
+rpc_result_code_t PciManagerServer::setup_msix(rpc_context_t *context, const mosrpc_pci_setup_msix_request *req, mosrpc_pci_setup_msix_response *resp)
+{
+    const auto &loc = req->location;
+    if (loc.bus > 0xff || loc.device > 31 || loc.function > 7 || req->entry > 0x7ff)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("invalid device location or entry");
+        return RPC_RESULT_OK;
+    }
+
+    {
+        // the device belongs to the first driver that sets it up
+        std::lock_guard<std::mutex> lock(owners_lock);
+        const u32 location = loc.bus << 8 | loc.device << 3 | loc.function;
+        const auto [owner, claimed] = owners.try_emplace(location, context);
+        if (!claimed && owner->second != context)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("device is owned by another driver");
+            return RPC_RESULT_OK;
+        }
+    }
+
+    u16 table_size = 0;
+    std::string error;
+    if (!pci_msix_setup(loc.bus, loc.device, loc.function, req->entry, req->address, req->data, &table_size, &error))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup(error.c_str());
+        return RPC_RESULT_OK;
+    }
+
+    resp->result.success = true;
+    resp->result.error = nullptr;
+    resp->table_size = table_size;
+    return RPC_RESULT_OK;
+}
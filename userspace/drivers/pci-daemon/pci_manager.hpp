@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "proto/pci.service.h"
+
+#include <librpc/rpc.h>
+#include <librpc/rpc_server++.hpp>
+#include <map>
+#include <mutex>
+
+#define PCI_MANAGER_RPC_SERVER_NAME "mos.pci-manager"
+
+/**
+ * @brief Lets drivers change the configuration of their devices, which only the PCI daemon can access
+ */
+class PciManagerServer : public IPciManagerService
+{
+  public:
+    explicit PciManagerServer() : IPciManagerService(PCI_MANAGER_RPC_SERVER_NAME) {};
+
+  private:
+    virtual void on_disconnect(rpc_context_t *context) override;
+    virtual rpc_result_code_t setup_msix(rpc_context_t *context, const mosrpc_pci_setup_msix_request *req, mosrpc_pci_setup_msix_response *resp) override;
+
+  private:
+    std::mutex owners_lock;
+    std::map<u32, rpc_context_t *> owners; // device location -> the connection of the driver that claimed it
+};
@@ -4,16 +4,29 @@
 
 #include <mos/types.h>
 
-static u8 pcie_read8(u8 bus, u8 slot, u8 func, u8 offset)
+static volatile void *pci_config_address(u8 bus, u8 slot, u8 func, u16 offset)
 {
-    const ptr_t addr = mmio_base + (bus << 20) + (slot << 15) + (func << 12) + offset; // PCI Express Extended Configuration Space
-    return *((volatile u8 *) addr);
+    return (volatile void *) (mmio_base + (bus << 20) + (slot << 15) + (func << 12) + offset); // PCI Express Extended Configuration Space
 }
 
-static u16 pci_read16(u8 bus, u8 slot, u8 func, u8 offset)
+u8 pcie_read8(u8 bus, u8 slot, u8 func, u16 offset)
 {
-    const ptr_t addr = mmio_base + (bus << 20) + (slot << 15) + (func << 12) + offset;
-    return *((volatile u16 *) addr);
+    return *((volatile u8 *) pci_config_address(bus, slot, func, offset));
+}
+
+u16 pci_read16(u8 bus, u8 slot, u8 func, u16 offset)
+{
+    return *((volatile u16 *) pci_config_address(bus, slot, func, offset));
+}
+
+u32 pci_read32(u8 bus, u8 slot, u8 func, u16 offset)
+{
+    return *((volatile u32 *) pci_config_address(bus, slot, func, offset));
+}
+
+void pci_write16(u8 bus, u8 slot, u8 func, u16 offset, u16 value)
+{
+    *((volatile u16 *) pci_config_address(bus, slot, func, offset)) = value;
 }
 
 void scan_bus(u8 bus, pci_scan_callback_t callback)
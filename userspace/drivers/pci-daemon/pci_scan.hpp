@@ -17,6 +17,12 @@ typedef void (*pci_scan_callback_t)(u8 bus, u8 device, u8 function, u16 vendor_i
 
 extern ptr_t mmio_base;
 
+// configuration space accessors, through the memory-mapped (ECAM) configuration space at mmio_base
+u8 pcie_read8(u8 bus, u8 slot, u8 func, u16 offset);
+u16 pci_read16(u8 bus, u8 slot, u8 func, u16 offset);
+u32 pci_read32(u8 bus, u8 slot, u8 func, u16 offset);
+void pci_write16(u8 bus, u8 slot, u8 func, u16 offset, u16 value);
+
 void scan_pci(pci_scan_callback_t callback); // scan all buses
 
 void scan_bus(u8 bus, pci_scan_callback_t callback);
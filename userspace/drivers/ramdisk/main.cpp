@@ -1,11 +1,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "blockdev.h"
+#include "blockdev_buffers.hpp"
+#include "blockdev_stats.hpp"
 #include "proto/blockdev.service.h"
 #include "ramdisk.hpp"
 
 #include <iostream>
 #include <librpc/macro_magic.h>
+#include <librpc/rpc_buffer.h>
 #include <librpc/rpc_client.h>
 #include <librpc/rpc_server++.hpp>
 #include <librpc/rpc_server.h>
@@ -21,36 +24,133 @@ class RAMDiskServer : public IBlockdevDeviceService, public RAMDisk
     {
     }
 
-    rpc_result_code_t read_block(rpc_context_t *, const mosrpc_blockdev_read_block_request *req, mosrpc_blockdev_read_block_response *resp) override
+    void on_connect(rpc_context_t *ctx) override
     {
-        if (req->n_boffset + req->n_blocks > nblocks())
+        set_data(ctx, new BlockdevBufferTable(true));
+    }
+
+    void on_disconnect(rpc_context_t *ctx) override
+    {
+        delete get_data<BlockdevBufferTable>(ctx);
+    }
+
+    rpc_result_code_t read_block(rpc_context_t *ctx, const mosrpc_blockdev_read_block_request *req, mosrpc_blockdev_read_block_response *resp) override
+    {
+        auto request = stats.begin(BlockIOType::Read);
+        std::shared_ptr<BlockdevBuffer> buffer;
+        if (!get_data<BlockdevBufferTable>(ctx)->get(ctx, req->buffer, &buffer))
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Invalid buffer");
+            return RPC_RESULT_OK;
+        }
+
+        if (req->n_boffset + req->n_blocks > nblocks() || (buffer && buffer->buffer.size < req->n_blocks * block_size()))
         {
             resp->result.success = false;
             resp->result.error = strdup("Out of bounds");
             return RPC_RESULT_OK;
         }
 
-        resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(req->n_blocks * block_size()));
-        const auto read = RAMDisk::read_block(req->n_boffset, req->n_blocks, resp->data->bytes);
-        resp->data->size = read * block_size();
+        if (buffer)
+        {
+            // read straight into the caller's buffer
+            RAMDisk::read_block(req->n_boffset, req->n_blocks, (uint8_t *) buffer->buffer.data);
+            resp->data = nullptr;
+        }
+        else
+        {
+            resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(req->n_blocks * block_size()));
+            const auto read = RAMDisk::read_block(req->n_boffset, req->n_blocks, resp->data->bytes);
+            resp->data->size = read * block_size();
+        }
 
         resp->result.success = true;
         resp->result.error = nullptr;
+        request.done(true, req->n_blocks * block_size());
 
         return RPC_RESULT_OK;
     }
 
-    rpc_result_code_t write_block(rpc_context_t *, const mosrpc_blockdev_write_block_request *req, mosrpc_blockdev_write_block_response *resp) override
+    rpc_result_code_t write_block(rpc_context_t *ctx, const mosrpc_blockdev_write_block_request *req, mosrpc_blockdev_write_block_response *resp) override
     {
-        RAMDisk::write_block(req->n_boffset, req->n_blocks, req->data->bytes);
+        auto request = stats.begin(BlockIOType::Write);
+        std::shared_ptr<BlockdevBuffer> buffer;
+        if (!get_data<BlockdevBufferTable>(ctx)->get(ctx, req->buffer, &buffer))
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Invalid buffer");
+            return RPC_RESULT_OK;
+        }
+
+        const size_t size = req->n_blocks * block_size();
+        const size_t available = buffer ? buffer->buffer.size : (req->data ? req->data->size : 0);
+        if (req->n_boffset + req->n_blocks > nblocks() || available < size)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Out of bounds");
+            return RPC_RESULT_OK;
+        }
+
+        RAMDisk::write_block(req->n_boffset, req->n_blocks, buffer ? (const uint8_t *) buffer->buffer.data : req->data->bytes);
 
         resp->result.success = true;
         resp->result.error = nullptr;
 
         resp->n_blocks = req->n_blocks;
+        request.done(true, size);
+
+        return RPC_RESULT_OK;
+    }
 
+    rpc_result_code_t map_range(rpc_context_t *ctx, const mosrpc_blockdev_map_range_request *req, mosrpc_blockdev_map_range_response *resp) override
+    {
+        if (req->n_blocks == 0 || req->n_boffset + req->n_blocks > nblocks())
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Out of bounds");
+            return RPC_RESULT_OK;
+        }
+
+        // the whole disk is handed out, the client maps it and finds the blocks at the offset
+        resp->buffer.handle = rpc_context_send_fd(ctx, memfd());
+        if (!resp->buffer.handle)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Failed to send the disk memory");
+            return RPC_RESULT_OK;
+        }
+
+        resp->buffer.size = (u64) nblocks() * block_size();
+        resp->offset = req->n_boffset * block_size();
+        resp->result.success = true;
+        resp->result.error = nullptr;
         return RPC_RESULT_OK;
     }
+
+    rpc_result_code_t flush(rpc_context_t *, const mosrpc_blockdev_flush_request *, mosrpc_blockdev_flush_response *resp) override
+    {
+        // the memory is the disk, every write is already there
+        auto request = stats.begin(BlockIOType::Flush);
+        resp->result.success = true;
+        resp->result.error = nullptr;
+        request.done(true, 0);
+        return RPC_RESULT_OK;
+    }
+
+    rpc_result_code_t get_io_stats(rpc_context_t *, const mosrpc_blockdev_io_stats_request *, mosrpc_blockdev_io_stats_response *resp) override
+    {
+        // accesses through a mapping (see map_range) don't show up here
+        resp->layers_count = 1;
+        resp->layers = (mosrpc_blockdev_io_stats *) calloc(1, sizeof(mosrpc_blockdev_io_stats));
+        stats.to_pb(&resp->layers[0], "ramdisk");
+        resp->result.success = true;
+        resp->result.error = nullptr;
+        return RPC_RESULT_OK;
+    }
+
+  private:
+    BlockIOStats stats;
 };
 
 int main(int argc, char **argv)
@@ -102,6 +202,11 @@ int main(int argc, char **argv)
     }
 
     RAMDiskServer ramdisk_server("ramdisk." + blockdev_name, size);
+    if (!ramdisk_server.valid())
+    {
+        std::cerr << "Failed to allocate " << size << " bytes for the ramdisk" << std::endl;
+        return 1;
+    }
 
     const auto blockdev_manager = std::make_unique<BlockdevManagerStub>(BLOCKDEV_MANAGER_RPC_SERVER_NAME);
 
@@ -111,7 +216,9 @@ int main(int argc, char **argv)
                                                      .size = ramdisk_server.nblocks() * ramdisk_server.block_size(),
                                                      .block_size = ramdisk_server.block_size(),
                                                      .n_blocks = ramdisk_server.nblocks(),
-                                                 } };
+                                                 },
+                                                 .accepts_buffers = true,
+                                                 .mappable = true };
     mosrpc_blockdev_register_device_response resp;
     blockdev_manager->register_device(&req, &resp);
     if (!resp.result.success)
@@ -2,18 +2,19 @@
 
 #include "ramdisk.hpp"
 
-#include <abi-bits/vm-flags.h>
 #include <string.h>
-#include <sys/mman.h>
 
 RAMDisk::RAMDisk(const size_t nbytes) : m_nbytes(nbytes), m_nblocks(nbytes / BLOCKDEV_BLOCK_SIZE)
 {
-    m_data = (uint8_t *) mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (!rpc_buffer_create(&m_buffer, "ramdisk", nbytes))
+        m_buffer = { .fd = -1, .data = nullptr, .size = 0 };
+    m_data = (uint8_t *) m_buffer.data;
 }
 
 RAMDisk::~RAMDisk()
 {
-    munmap(m_data, m_nbytes);
+    if (m_data)
+        rpc_buffer_destroy(&m_buffer);
 }
 
 size_t RAMDisk::read_block(const size_t block, const size_t nblocks, uint8_t *buf)
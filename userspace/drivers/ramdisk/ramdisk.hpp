@@ -4,10 +4,16 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <librpc/rpc_buffer.h>
 #include <mos/types.h>
 
 #define BLOCKDEV_BLOCK_SIZE 512
 
+/**
+ * @brief A block device in memory
+ *
+ * @details The blocks live in a memfd, which clients can map to access them without going through read/write.
+ */
 class RAMDisk
 {
   public:
@@ -27,8 +33,20 @@ class RAMDisk
         return BLOCKDEV_BLOCK_SIZE;
     }
 
+    bool valid() const
+    {
+        return m_data != nullptr;
+    }
+
+    /// the memfd holding the blocks, block n is at offset n * block_size()
+    fd_t memfd() const
+    {
+        return m_buffer.fd;
+    }
+
   private:
     const size_t m_nbytes;
     const size_t m_nblocks;
+    rpc_buffer_t m_buffer;
     uint8_t *m_data;
 };
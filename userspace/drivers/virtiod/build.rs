@@ -44,6 +44,7 @@ fn main() {
         project_dir!("proto/graphics.proto"),
         project_dir!("proto/graphics-gpu.proto"),
         project_dir!("proto/blockdev.proto"),
+        project_dir!("proto/pci.proto"),
         project_dir!("proto/mosrpc.proto"),
         project_dir!("proto/mosrpc-options.proto"),
     ];
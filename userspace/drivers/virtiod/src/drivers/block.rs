@@ -1,51 +1,722 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-use std::sync::{Arc, Mutex};
+use std::{
+    collections::{HashMap, VecDeque},
+    ops::{Deref, DerefMut},
+    sync::{
+        atomic::{AtomicBool, AtomicU32, AtomicU64, Ordering},
+        mpsc, Arc, Condvar, Mutex,
+    },
+    thread,
+    time::{Duration, Instant},
+};
 
 use librpc_rs::{RpcCallResult, RpcPbReply, RpcPbServer, RpcPbServerTrait, RpcResult, RpcStub};
 use protobuf::MessageField;
 use virtio_drivers::{
-    device::blk::{VirtIOBlk, SECTOR_SIZE},
-    transport::pci::{bus::DeviceFunction, PciTransport},
+    device::blk::{BlkReq, BlkResp, VirtIOBlk, SECTOR_SIZE},
+    transport::pci::{
+        bus::{Cam, DeviceFunction, MmioCam, PciRoot},
+        PciTransport,
+    },
 };
 
 use crate::{
-    hal::MOSHal,
+    hal::{DmaPin, MOSHal, PageBuffer},
+    interrupt::DeviceInterrupt,
     mosrpc::blockdev::{
-        Blockdev_info, Read_block_request, Read_block_response, Register_device_request,
+        Blockdev_info, Flush_request, Flush_response, Io_op_stats, Io_stats, Io_stats_request,
+        Io_stats_response, Read_block_request, Read_block_response, Register_device_request,
         Register_device_response, Write_block_request, Write_block_response,
     },
     result_err, result_ok,
 };
 
+/// the largest request (in sectors) that adjacent requests are merged into
+const MAX_MERGE_SECTORS: usize = 256;
+
+/// how long the dispatcher waits before polling the used ring again, when the device has no interrupt
+const POLL_INTERVAL: Duration = Duration::from_micros(50);
+
+/// latency histogram buckets, log2 of microseconds (BLOCKDEV_STATS_BUCKETS in blockdev_stats.hpp)
+const STATS_BUCKETS: usize = 24;
+
 struct SafeVirtIOBlk(VirtIOBlk<MOSHal, PciTransport>);
 unsafe impl Send for SafeVirtIOBlk {}
 
+type IoReply = mpsc::Sender<Result<Vec<u8>, String>>;
+
+/// a request from a client, waiting to be submitted to the device
+struct PendingIo {
+    write: bool,
+    sector: usize,
+    count: usize,
+    data: Vec<u8>, // only for writes
+    reply: IoReply,
+}
+
+/// a client waiting for (a part of) a request that has been submitted
+struct Waiter {
+    offset: usize,
+    len: usize,
+    reply: IoReply,
+}
+
+/// Data of a transfer. It starts on a sector boundary, so every physically contiguous part of it
+/// is made of whole sectors and can be handed to the device in place. A vector that happens to
+/// be aligned like that is used as-is, the data of a read then reaches the client without
+/// another copy.
+enum IoBuffer {
+    Page(PageBuffer),
+    Vec(Vec<u8>),
+}
+
+fn sector_aligned(buf: &[u8]) -> bool {
+    buf.as_ptr() as usize % SECTOR_SIZE == 0
+}
+
+impl IoBuffer {
+    fn zeroed(len: usize) -> Self {
+        let buf = vec![0; len];
+        if sector_aligned(&buf) {
+            IoBuffer::Vec(buf)
+        } else {
+            IoBuffer::Page(PageBuffer::new(len))
+        }
+    }
+
+    /// the data of a write, taken over if it's aligned
+    fn from_vec(data: Vec<u8>) -> Self {
+        if sector_aligned(&data) {
+            return IoBuffer::Vec(data);
+        }
+
+        let mut buf = PageBuffer::new(data.len());
+        buf.copy_from_slice(&data);
+        IoBuffer::Page(buf)
+    }
+
+    fn into_vec(self) -> Vec<u8> {
+        match self {
+            IoBuffer::Page(buf) => buf.to_vec(),
+            IoBuffer::Vec(buf) => buf,
+        }
+    }
+}
+
+impl Deref for IoBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            IoBuffer::Page(buf) => buf,
+            IoBuffer::Vec(buf) => buf,
+        }
+    }
+}
+
+impl DerefMut for IoBuffer {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        match self {
+            IoBuffer::Page(buf) => buf,
+            IoBuffer::Vec(buf) => buf,
+        }
+    }
+}
+
+/// A batch of requests, submitted to the device as one request per physically contiguous part
+/// of its buffer, so that none of it has to be bounced. It completes once all parts have.
+struct Transfer {
+    write: bool,
+    sector: usize,
+    /// keeps the parts where they are until the transfer completes, none if it can't be pinned
+    pin: Option<DmaPin>,
+    buf: IoBuffer,
+    /// (offset, length) in bytes of the parts not submitted yet, the last one goes first
+    unsubmitted: Vec<(usize, usize)>,
+    /// parts that haven't completed, including the unsubmitted ones
+    remaining: usize,
+    error: Option<String>,
+    waiters: Vec<Waiter>,
+}
+
+impl Transfer {
+    fn new(batch: Vec<PendingIo>) -> Transfer {
+        let write = batch[0].write;
+        let sector = batch[0].sector;
+        let count: usize = batch.iter().map(|io| io.count).sum();
+
+        let mut waiters = Vec::with_capacity(batch.len());
+        let mut buf = if write && batch.len() == 1 {
+            let io = batch.into_iter().next().unwrap();
+            waiters.push(Waiter {
+                offset: 0,
+                len: io.count * SECTOR_SIZE,
+                reply: io.reply,
+            });
+            IoBuffer::from_vec(io.data)
+        } else {
+            let mut buf = IoBuffer::zeroed(count * SECTOR_SIZE);
+            let mut offset = 0;
+            for io in batch {
+                let len = io.count * SECTOR_SIZE;
+                if write {
+                    buf[offset..offset + len].copy_from_slice(&io.data);
+                }
+                waiters.push(Waiter {
+                    offset,
+                    len,
+                    reply: io.reply,
+                });
+                offset += len;
+            }
+            buf
+        };
+
+        // the device writes into the buffer of a read
+        let pin = DmaPin::new(&mut buf[..], !write)
+            .filter(|pin| pin.segments.iter().all(|seg| seg.size % SECTOR_SIZE == 0));
+
+        let mut parts = Vec::new();
+        match &pin {
+            Some(pin) => {
+                let mut offset = 0;
+                for seg in &pin.segments {
+                    parts.push((offset, seg.size));
+                    offset += seg.size;
+                }
+            }
+            None => parts.push((0, buf.len())), // in one piece, the HAL bounces it if it has to
+        }
+        parts.reverse();
+
+        Transfer {
+            write,
+            sector,
+            pin,
+            buf,
+            remaining: parts.len(),
+            unsubmitted: parts,
+            error: None,
+            waiters,
+        }
+    }
+
+    fn finish(mut self) {
+        if let Some(e) = self.error {
+            for w in self.waiters {
+                let _ = w.reply.send(Err(e.clone()));
+            }
+            return;
+        }
+
+        if self.write {
+            for w in self.waiters {
+                let _ = w.reply.send(Ok(Vec::new()));
+            }
+        } else if self.waiters.len() == 1 {
+            // not merged, hand over the buffer as-is
+            let w = self.waiters.pop().unwrap();
+            drop(self.pin);
+            let _ = w.reply.send(Ok(self.buf.into_vec()));
+        } else {
+            for w in self.waiters {
+                let _ = w
+                    .reply
+                    .send(Ok(self.buf[w.offset..w.offset + w.len].to_vec()));
+            }
+        }
+    }
+
+    /// fail the transfer without freeing its buffer, the device may still be using it
+    fn abandon(self, error: &str) {
+        let Transfer {
+            pin, buf, waiters, ..
+        } = self;
+        for w in waiters {
+            let _ = w.reply.send(Err(error.to_string()));
+        }
+        std::mem::forget((pin, buf));
+    }
+}
+
+/// a part of a transfer owned by the device, the request and the response must not move until it completes
+struct InflightIo {
+    transfer: u64,
+    write: bool,
+    sector: usize,
+    count: usize,
+    offset: usize, // of the part in the buffer of the transfer, in bytes
+    req: Box<BlkReq>,
+    resp: Box<BlkResp>,
+}
+
+/// a request takes three descriptors: header, data and status
+fn queue_depth(device: &VirtIOBlk<MOSHal, PciTransport>) -> usize {
+    (device.virt_queue_size() as usize / 3).max(1)
+}
+
+fn overlaps(a_start: usize, a_count: usize, b_start: usize, b_count: usize) -> bool {
+    a_start < b_start + b_count && b_start < a_start + a_count
+}
+
+struct QueueState {
+    /// none once the device has failed and couldn't be set up again, requests then fail right away
+    device: Option<SafeVirtIOBlk>,
+    ecam: usize,
+    func: DeviceFunction,
+    pending: VecDeque<PendingIo>,
+    transfers: HashMap<u64, Transfer>,
+    next_transfer: u64,
+    /// a transfer with parts still to submit, it's finished before the next one is started
+    staged: Option<u64>,
+    inflight: HashMap<u16, InflightIo>,
+    depth: usize,
+    /// clients waiting for a flush, which is issued once nothing is in flight
+    flushes: Vec<IoReply>,
+}
+
+impl QueueState {
+    /// whether a request has to wait for an in-flight one, i.e. they overlap and one of them writes
+    fn conflicts_inflight(&self, write: bool, sector: usize, count: usize) -> bool {
+        self.inflight
+            .values()
+            .any(|io| (write || io.write) && overlaps(sector, count, io.sector, io.count))
+    }
+
+    /// take the request at the head of the queue, together with the requests that continue it
+    fn take_batch(&mut self) -> Option<Vec<PendingIo>> {
+        let head = self.pending.front()?;
+        if self.conflicts_inflight(head.write, head.sector, head.count) {
+            return None; // keep the order of dependent requests
+        }
+
+        let first = self.pending.pop_front().unwrap();
+        let write = first.write;
+        let start = first.sector;
+        let mut end = first.sector + first.count;
+        let mut batch = vec![first];
+
+        let mut i = 0;
+        while i < self.pending.len() {
+            let candidate = &self.pending[i];
+            let mergeable = candidate.write == write
+                && candidate.sector == end
+                && end + candidate.count - start <= MAX_MERGE_SECTORS
+                && !self.conflicts_inflight(write, candidate.sector, candidate.count)
+                // must not be reordered before an earlier request it depends on
+                && !self.pending.range(..i).any(|earlier| {
+                    (write || earlier.write)
+                        && overlaps(candidate.sector, candidate.count, earlier.sector, earlier.count)
+                });
+
+            if !mergeable {
+                i += 1;
+                continue;
+            }
+
+            let io = self.pending.remove(i).unwrap();
+            end += io.count;
+            batch.push(io);
+            i = 0; // an earlier request may continue the batch now
+        }
+
+        Some(batch)
+    }
+
+    fn submit_pending(&mut self) {
+        if self.device.is_none() {
+            for io in self.pending.drain(..) {
+                let _ = io
+                    .reply
+                    .send(Err("I/O error: the device is gone".to_string()));
+            }
+            return;
+        }
+
+        // hold new requests back while a flush waits for the device to become idle
+        while self.flushes.is_empty() && self.inflight.len() < self.depth {
+            let id = match self.staged {
+                Some(id) => id,
+                None => {
+                    let Some(batch) = self.take_batch() else {
+                        break;
+                    };
+
+                    let id = self.next_transfer;
+                    self.next_transfer += 1;
+                    self.transfers.insert(id, Transfer::new(batch));
+                    self.staged = Some(id);
+                    id
+                }
+            };
+
+            self.submit_part(id);
+        }
+    }
+
+    fn submit_part(&mut self, id: u64) {
+        let transfer = self.transfers.get_mut(&id).unwrap();
+        let (offset, len) = transfer.unsubmitted.pop().unwrap();
+        if transfer.unsubmitted.is_empty() {
+            self.staged = None;
+        }
+
+        let write = transfer.write;
+        let sector = transfer.sector + offset / SECTOR_SIZE;
+        let part = &mut transfer.buf[offset..offset + len];
+        let mut req = Box::new(BlkReq::default());
+        let mut resp = Box::new(BlkResp::default());
+        let dev = &mut self.device.as_mut().unwrap().0;
+
+        // SAFETY: the request and the response are kept in the in-flight table, the buffer in the
+        //         transfer, none of them is moved or dropped until the device has completed the request
+        let token = unsafe {
+            if write {
+                dev.write_blocks_nb(sector, &mut req, part, &mut resp)
+            } else {
+                dev.read_blocks_nb(sector, &mut req, part, &mut resp)
+            }
+        };
+
+        match token {
+            Ok(token) => {
+                let io = InflightIo {
+                    transfer: id,
+                    write,
+                    sector,
+                    count: len / SECTOR_SIZE,
+                    offset,
+                    req,
+                    resp,
+                };
+                self.inflight.insert(token, io);
+            }
+            Err(e) => {
+                if transfer.error.is_none() {
+                    transfer.error = Some(format!("failed to submit request: {}", e));
+                }
+                self.part_done(id);
+            }
+        }
+    }
+
+    /// a part of a transfer has completed or failed, so has the transfer once it was the last one
+    fn part_done(&mut self, id: u64) {
+        let transfer = self.transfers.get_mut(&id).unwrap();
+        transfer.remaining -= 1;
+        if transfer.remaining == 0 {
+            self.transfers.remove(&id).unwrap().finish();
+        }
+    }
+
+    /// flush the device's write cache for the clients waiting for it, once nothing is in flight,
+    /// the flush request is synchronous and must not see the completions of other requests
+    fn run_flushes(&mut self) {
+        if self.flushes.is_empty() || !self.inflight.is_empty() {
+            return;
+        }
+
+        let result = match &mut self.device {
+            Some(device) => device
+                .0
+                .flush()
+                .map(|_| Vec::new())
+                .map_err(|e| format!("failed to flush: {}", e)),
+            None => Err("I/O error: the device is gone".to_string()),
+        };
+        for reply in self.flushes.drain(..) {
+            let _ = reply.send(result.clone());
+        }
+    }
+
+    /// complete every request the device has finished with, returns whether the device had to be reset
+    fn reap(&mut self) -> bool {
+        while let Some(token) = self.device.as_mut().and_then(|device| device.0.peek_used()) {
+            let Some(mut io) = self.inflight.remove(&token) else {
+                // it can't be popped without the buffers it was submitted with, and every
+                // completion after it is stuck behind it, so the queue has to start over
+                eprintln!(
+                    "virtio-blk: completion for an unknown request {}, resetting the device",
+                    token
+                );
+                self.reset();
+                return true;
+            };
+
+            let transfer = self.transfers.get_mut(&io.transfer).unwrap();
+            let part = &mut transfer.buf[io.offset..io.offset + io.count * SECTOR_SIZE];
+            let dev = &mut self.device.as_mut().unwrap().0;
+
+            // SAFETY: these are the same buffers the request was submitted with
+            let result = unsafe {
+                if io.write {
+                    dev.complete_write_blocks(token, &io.req, part, &mut io.resp)
+                } else {
+                    dev.complete_read_blocks(token, &io.req, part, &mut io.resp)
+                }
+            };
+
+            if let Err(e) = result {
+                let direction = if io.write { "write" } else { "read" };
+                if transfer.error.is_none() {
+                    transfer.error = Some(format!("failed to {}: {}", direction, e));
+                }
+            }
+            self.part_done(io.transfer);
+        }
+
+        false
+    }
+
+    /// reset the device and set up its queue again, every transfer that has been started fails
+    fn reset(&mut self) {
+        // dropping the old driver would unset the queue of the new one, its memory is leaked instead
+        std::mem::forget(self.device.take());
+        self.staged = None;
+
+        let mut root = unsafe { PciRoot::new(MmioCam::new(self.ecam as _, Cam::Ecam)) };
+        let transport = match PciTransport::new::<MOSHal, MmioCam>(&mut root, self.func) {
+            Ok(transport) => transport,
+            Err(e) => {
+                eprintln!(
+                    "virtio-blk: failed to reset the device, giving up on it: {}",
+                    e
+                );
+                for (_, io) in self.inflight.drain() {
+                    std::mem::forget(io);
+                }
+                for (_, transfer) in self.transfers.drain() {
+                    transfer.abandon("I/O error: the device failed");
+                }
+                return;
+            }
+        };
+
+        // this resets the device first, it doesn't touch the old queue or the buffers after that
+        match VirtIOBlk::new(transport) {
+            Ok(mut device) => {
+                device.enable_interrupts();
+                self.depth = queue_depth(&device);
+                self.device = Some(SafeVirtIOBlk(device));
+            }
+            Err(e) => eprintln!(
+                "virtio-blk: failed to set up the device again, giving up on it: {}",
+                e
+            ),
+        }
+
+        self.inflight.clear();
+        for (_, mut transfer) in self.transfers.drain() {
+            transfer.error = Some("I/O error: the device was reset".to_string());
+            transfer.finish();
+        }
+    }
+}
+
+/// Requests from all clients are queued here, adjacent ones are merged, and up to a queue's
+/// worth of them are kept in flight on the device. Completions are returned out of order.
+struct BlockQueue {
+    state: Mutex<QueueState>,
+    wakeup: Condvar,
+    /// whether completions are signalled by the device interrupt, otherwise the dispatcher polls
+    interrupts: AtomicBool,
+}
+
+impl BlockQueue {
+    fn new(
+        device: VirtIOBlk<MOSHal, PciTransport>,
+        ecam: usize,
+        func: DeviceFunction,
+    ) -> Arc<BlockQueue> {
+        Arc::new(BlockQueue {
+            state: Mutex::new(QueueState {
+                depth: queue_depth(&device),
+                device: Some(SafeVirtIOBlk(device)),
+                ecam,
+                func,
+                pending: VecDeque::new(),
+                transfers: HashMap::new(),
+                next_transfer: 0,
+                staged: None,
+                inflight: HashMap::new(),
+                flushes: Vec::new(),
+            }),
+            wakeup: Condvar::new(),
+            interrupts: AtomicBool::new(false),
+        })
+    }
+
+    fn submit(
+        &self,
+        write: bool,
+        sector: usize,
+        count: usize,
+        data: Vec<u8>,
+    ) -> Result<Vec<u8>, String> {
+        let (reply, result) = mpsc::channel();
+
+        self.state.lock().unwrap().pending.push_back(PendingIo {
+            write,
+            sector,
+            count,
+            data,
+            reply,
+        });
+        self.wakeup.notify_one();
+
+        result
+            .recv()
+            .unwrap_or_else(|_| Err("request was dropped".to_string()))
+    }
+
+    /// a barrier: every write that has completed before it is durable when it returns
+    fn flush(&self) -> Result<(), String> {
+        let (reply, result) = mpsc::channel();
+
+        self.state.lock().unwrap().flushes.push(reply);
+        self.wakeup.notify_one();
+
+        result
+            .recv()
+            .unwrap_or_else(|_| Err("flush was dropped".to_string()))
+            .map(|_| ())
+    }
+
+    fn run_dispatcher(&self) {
+        let mut state = self.state.lock().unwrap();
+        loop {
+            // reap first, completions free up room in the queue for pending requests
+            if state.reap() {
+                // the reset took the queue's MSI-X routing with it, poll for completions from now on
+                self.interrupts.store(false, Ordering::Release);
+            }
+            state.run_flushes();
+            state.submit_pending();
+
+            // the lock is held from here until we wait, so a wakeup from the interrupt thread is never lost
+            if state.inflight.is_empty() || self.interrupts.load(Ordering::Acquire) {
+                state = self.wakeup.wait(state).unwrap();
+            } else {
+                state = self.wakeup.wait_timeout(state, POLL_INTERVAL).unwrap().0;
+            }
+        }
+    }
+
+    fn run_interrupts(&self, irq: DeviceInterrupt) {
+        self.interrupts.store(true, Ordering::Release);
+        loop {
+            if let Err(e) = irq.wait() {
+                eprintln!(
+                    "virtio-blk: interrupt failed, falling back to polling: {}",
+                    e
+                );
+                self.interrupts.store(false, Ordering::Release);
+                self.wakeup.notify_one();
+                return;
+            }
+
+            let _state = self.state.lock().unwrap();
+            self.wakeup.notify_one();
+        }
+    }
+}
+
+/// counters and latency histogram of one kind of request
+#[derive(Default)]
+struct OpStats {
+    ops: AtomicU64,
+    bytes: AtomicU64,
+    errors: AtomicU64,
+    total_ns: AtomicU64,
+    max_ns: AtomicU64,
+    histogram: [AtomicU64; STATS_BUCKETS],
+}
+
+impl OpStats {
+    fn account(&self, ok: bool, bytes: u64, elapsed: Duration) {
+        let ns = elapsed.as_nanos() as u64;
+        self.ops.fetch_add(1, Ordering::Relaxed);
+        if ok {
+            self.bytes.fetch_add(bytes, Ordering::Relaxed);
+        } else {
+            self.errors.fetch_add(1, Ordering::Relaxed);
+        }
+        self.total_ns.fetch_add(ns, Ordering::Relaxed);
+        self.max_ns.fetch_max(ns, Ordering::Relaxed);
+
+        let us = ns / 1000;
+        let bucket = if us == 0 { 0 } else { us.ilog2() as usize };
+        self.histogram[bucket.min(STATS_BUCKETS - 1)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn to_pb(&self) -> Io_op_stats {
+        Io_op_stats {
+            ops: self.ops.load(Ordering::Relaxed),
+            bytes: self.bytes.load(Ordering::Relaxed),
+            errors: self.errors.load(Ordering::Relaxed),
+            total_ns: self.total_ns.load(Ordering::Relaxed),
+            max_ns: self.max_ns.load(Ordering::Relaxed),
+            histogram: self
+                .histogram
+                .iter()
+                .map(|b| b.load(Ordering::Relaxed))
+                .collect(),
+            ..Default::default()
+        }
+    }
+}
+
+/// I/O statistics of the device, as seen by the driver: from a request's arrival to its completion
+#[derive(Default)]
+struct IoStats {
+    read: OpStats,
+    write: OpStats,
+    flush: OpStats,
+    in_flight: AtomicU32,
+    max_in_flight: AtomicU32,
+}
+
+impl IoStats {
+    fn begin(&self) -> Instant {
+        let now = self.in_flight.fetch_add(1, Ordering::Relaxed) + 1;
+        self.max_in_flight.fetch_max(now, Ordering::Relaxed);
+        Instant::now()
+    }
+
+    fn end(&self, op: &OpStats, start: Instant, ok: bool, bytes: u64) {
+        op.account(ok, bytes, start.elapsed());
+        self.in_flight.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
 #[derive(Clone)]
 struct BlockServer {
     blockdev_manager: RpcStub,
     devname: String,
     server_name: String,
-    blockdev: Arc<Mutex<SafeVirtIOBlk>>,
+    n_blocks: u64,
+    queue: Arc<BlockQueue>,
+    stats: Arc<IoStats>,
 }
 
 RpcPbServer!(
     BlockServer,
     (1, on_read, (Read_block_request, Read_block_response)),
-    (2, on_write, (Write_block_request, Write_block_response))
+    (2, on_write, (Write_block_request, Write_block_response)),
+    (4, on_io_stats, (Io_stats_request, Io_stats_response)),
+    (5, on_flush, (Flush_request, Flush_response))
 );
 
 impl BlockServer {
     fn register(&mut self) -> RpcResult<()> {
-        let dev = &self.blockdev.lock().unwrap().0;
-
         let request = Register_device_request {
             server_name: self.server_name.clone(),
             device_info: Some(Blockdev_info {
                 name: self.devname.clone(),
                 block_size: SECTOR_SIZE as _, // 512
-                n_blocks: dev.capacity(),
-                size: dev.capacity(),
+                n_blocks: self.n_blocks,
+                size: self.n_blocks,
                 ..Default::default()
             })
             .into(),
@@ -64,19 +735,37 @@ impl BlockServer {
         }
     }
 
+    fn in_range(&self, boffset: u64, nblocks: u64) -> bool {
+        nblocks > 0
+            && boffset
+                .checked_add(nblocks)
+                .is_some_and(|end| end <= self.n_blocks)
+    }
+
     fn on_read(&mut self, req: &Read_block_request) -> Option<Read_block_response> {
-        let mut buf = vec![0u8; 512 * req.n_blocks as usize];
+        if !self.in_range(req.n_boffset, req.n_blocks) {
+            return Some(Read_block_response {
+                result: result_err!("read out of range"),
+                ..Default::default()
+            });
+        }
 
-        let virtioblk = &mut self.blockdev.lock().unwrap().0;
+        let start = self.stats.begin();
+        let result = self
+            .queue
+            .submit(false, req.n_boffset as _, req.n_blocks as _, Vec::new());
+        let bytes = req.n_blocks as u64 * SECTOR_SIZE as u64;
+        self.stats
+            .end(&self.stats.read, start, result.is_ok(), bytes);
 
-        let resp = match virtioblk.read_blocks(req.n_boffset as _, &mut buf) {
-            Ok(()) => Read_block_response {
+        let resp = match result {
+            Ok(buf) => Read_block_response {
                 result: result_ok!(),
                 data: buf,
                 ..Default::default()
             },
             Err(e) => Read_block_response {
-                result: result_err!(format!("failed to read: {}", e)),
+                result: result_err!(e),
                 ..Default::default()
             },
         };
@@ -85,26 +774,82 @@ impl BlockServer {
     }
 
     fn on_write(&mut self, req: &Write_block_request) -> Option<Write_block_response> {
-        assert!(req.data.len() == 512 * req.n_blocks as usize);
+        if !self.in_range(req.n_boffset, req.n_blocks)
+            || req.data.len() != SECTOR_SIZE * req.n_blocks as usize
+        {
+            return Some(Write_block_response {
+                result: result_err!("invalid write request"),
+                ..Default::default()
+            });
+        }
 
-        let virtioblk = &mut self.blockdev.lock().unwrap().0;
+        let start = self.stats.begin();
+        let result = self.queue.submit(
+            true,
+            req.n_boffset as _,
+            req.n_blocks as _,
+            req.data.clone(),
+        );
+        self.stats.end(
+            &self.stats.write,
+            start,
+            result.is_ok(),
+            req.data.len() as u64,
+        );
 
-        let resp = match virtioblk.write_blocks(req.n_boffset as _, &req.data) {
-            Ok(()) => Write_block_response {
+        let resp = match result {
+            Ok(_) => Write_block_response {
                 result: result_ok!(),
                 ..Default::default()
             },
             Err(e) => Write_block_response {
-                result: result_err!(format!("failed to write: {}", e)),
+                result: result_err!(e),
+                ..Default::default()
+            },
+        };
+
+        Some(resp)
+    }
+
+    fn on_flush(&mut self, _req: &Flush_request) -> Option<Flush_response> {
+        let start = self.stats.begin();
+        let result = self.queue.flush();
+        self.stats.end(&self.stats.flush, start, result.is_ok(), 0);
+
+        let resp = match result {
+            Ok(_) => Flush_response {
+                result: result_ok!(),
+                ..Default::default()
+            },
+            Err(e) => Flush_response {
+                result: result_err!(e),
                 ..Default::default()
             },
         };
 
         Some(resp)
     }
+
+    fn on_io_stats(&mut self, _req: &Io_stats_request) -> Option<Io_stats_response> {
+        let stats = Io_stats {
+            layer: "virtio-blk".to_string(),
+            read: Some(self.stats.read.to_pb()).into(),
+            write: Some(self.stats.write.to_pb()).into(),
+            flush: Some(self.stats.flush.to_pb()).into(),
+            in_flight: self.stats.in_flight.load(Ordering::Relaxed),
+            max_in_flight: self.stats.max_in_flight.load(Ordering::Relaxed),
+            ..Default::default()
+        };
+
+        Some(Io_stats_response {
+            result: result_ok!(),
+            layers: vec![stats],
+            ..Default::default()
+        })
+    }
 }
 
-pub fn run_blockdev(transport: PciTransport, func: DeviceFunction) -> RpcResult<()> {
+pub fn run_blockdev(transport: PciTransport, func: DeviceFunction, ecam: usize) -> RpcResult<()> {
     let devlocation = format!("{:02x}:{:02x}:{:02x}", func.bus, func.device, func.function);
 
     let devname = format!("virtblk.{}", devlocation);
@@ -115,19 +860,35 @@ pub fn run_blockdev(transport: PciTransport, func: DeviceFunction) -> RpcResult<
         return Ok(());
     }
 
+    let mut device = VirtIOBlk::new(transport).expect("failed to create blockdev");
+    device.enable_interrupts();
+    let n_blocks = device.capacity();
+    let queue = BlockQueue::new(device, ecam, func);
+
+    match DeviceInterrupt::setup_virtio(ecam, func) {
+        Ok(irq) => {
+            let handler = queue.clone();
+            thread::spawn(move || handler.run_interrupts(irq));
+        }
+        Err(e) => println!("virtio-blk: {}, polling for completions", e),
+    }
+
+    let dispatcher = queue.clone();
+    thread::spawn(move || dispatcher.run_dispatcher());
+
     let server_name = format!("blockdev.virtio.{}", devlocation);
     let mut driver = BlockServer {
         blockdev_manager: RpcStub::new("mos.blockdev-manager")?,
         devname,
         server_name: server_name.clone(),
-        blockdev: Arc::new(Mutex::new(SafeVirtIOBlk(
-            VirtIOBlk::new(transport).expect("failed to create blockdev"),
-        ))),
+        n_blocks,
+        queue,
+        stats: Arc::new(IoStats::default()),
     };
 
     driver.register()?;
 
     let mut rpc_server = RpcPbServer::create(&server_name, Box::new(driver))?;
     libsm_rs::report_service_status(libsm_rs::RpcUnitStatusEnum::Started, "blockdev is online");
-    rpc_server.run()
+    rpc_server.run_concurrent()
 }
@@ -16,13 +16,14 @@ use self::{block::run_blockdev, gpu::run_gpu, netdev::run_netdev};
 pub(crate) fn start_device(
     transport: PciTransport,
     function: DeviceFunction,
+    ecam: usize,
 ) -> Result<(), Box<dyn Error>> {
     let device_type = transport.device_type();
     println!("  Device Type: {:?}", device_type);
     println!("  Device Function: {:?}", function);
 
     match device_type {
-        DeviceType::Block => run_blockdev(transport, function),
+        DeviceType::Block => run_blockdev(transport, function, ecam),
         DeviceType::GPU => run_gpu(transport, function),
         DeviceType::Network => run_netdev(transport, function),
         t => unimplemented!("Unrecognized virtio device: {:?}", t),
@@ -1,8 +1,22 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-use virtio_drivers::{Hal, PAGE_SIZE};
+use virtio_drivers::{BufferDirection, Hal, PAGE_SIZE};
 
 use core::ptr::NonNull;
+use std::{
+    alloc::{alloc_zeroed, dealloc, Layout},
+    collections::BTreeMap,
+    ops::{Deref, DerefMut},
+    sync::Mutex,
+};
+
+/// dma_segment_t
+#[repr(C)]
+#[derive(Default)]
+pub struct DmaSegment {
+    pub address: usize,
+    pub size: usize,
+}
 
 extern "C" {
 
@@ -23,6 +37,18 @@ extern "C" {
     // bool libdma_unshare_buffer(ptr_t phyaddr, void *buffer, size_t size)
     pub fn libdma_unshare_buffer(phyaddr: usize, buffer: *mut u8, size: usize) -> bool;
 
+    // long libdma_pin_buffer(void *buffer, size_t size, bool device_writes, dma_segment_t *segments, size_t max_segments)
+    pub fn libdma_pin_buffer(
+        buffer: *mut u8,
+        size: usize,
+        device_writes: bool,
+        segments: *mut DmaSegment,
+        max_segments: usize,
+    ) -> isize;
+
+    // bool libdma_unpin_buffer(void *buffer, size_t size)
+    pub fn libdma_unpin_buffer(buffer: *mut u8, size: usize) -> bool;
+
     // ptr_t libdma_map_physical_address(ptr_t paddr, size_t size, ptr_t vaddr)
     pub fn libdma_map_physical_address(paddr: usize, size: usize, vaddr: *mut u8) -> usize;
 
@@ -33,6 +59,10 @@ extern "C" {
 
 pub(crate) struct MOSHal {}
 
+/// Buffers that are shared in place, (physical address, buffer, size) -> number of times shared.
+/// Everything else has been bounced through a copy, see MOSHal::share.
+static PINNED: Mutex<BTreeMap<(usize, usize, usize), usize>> = Mutex::new(BTreeMap::new());
+
 macro_rules! align_up {
     ($value:expr, $alignment:expr) => {
         ($value + ($alignment - 1)) & !($alignment - 1)
@@ -74,8 +104,24 @@ unsafe impl Hal for MOSHal {
 
     unsafe fn share(
         buffer: NonNull<[u8]>,
-        _direction: virtio_drivers::BufferDirection,
+        direction: virtio_drivers::BufferDirection,
     ) -> virtio_drivers::PhysAddr {
+        let vaddr = buffer.as_ptr() as *mut u8;
+        let device_writes = direction != BufferDirection::DriverToDevice;
+
+        // a virtqueue descriptor takes a single address, so only buffers that are physically
+        // contiguous can be handed to the device in place, the rest is bounced through a copy;
+        // block transfers are split along their segments beforehand, see DmaPin
+        let mut segment = DmaSegment::default();
+        if libdma_pin_buffer(vaddr, buffer.len(), device_writes, &mut segment, 1) == 1 {
+            *PINNED
+                .lock()
+                .unwrap()
+                .entry((segment.address, vaddr as usize, buffer.len()))
+                .or_insert(0) += 1;
+            return segment.address;
+        }
+
         let mut phyaddr: usize = 0;
         if unsafe { !libdma_share_buffer(buffer.as_ptr() as *mut u8, buffer.len(), &mut phyaddr) } {
             panic!("Failed to share buffer");
@@ -88,8 +134,122 @@ unsafe impl Hal for MOSHal {
         buffer: NonNull<[u8]>,
         _direction: virtio_drivers::BufferDirection,
     ) {
+        let vaddr = buffer.as_ptr() as *mut u8;
+        let key = (paddr as usize, vaddr as usize, buffer.len());
+
+        let pinned = {
+            let mut pinned = PINNED.lock().unwrap();
+            match pinned.get_mut(&key) {
+                Some(count) if *count > 1 => {
+                    *count -= 1;
+                    true
+                }
+                Some(_) => pinned.remove(&key).is_some(),
+                None => false,
+            }
+        };
+
+        if pinned {
+            if !libdma_unpin_buffer(vaddr, buffer.len()) {
+                panic!("Failed to unpin buffer");
+            }
+            return;
+        }
+
         if !libdma_unshare_buffer(paddr as usize, buffer.as_ptr() as *mut u8, buffer.len()) {
             panic!("Failed to unshare buffer");
         }
     }
 }
+
+/// A buffer pinned in memory until this is dropped, with the physically contiguous segments it's
+/// made of. Each segment can be handed to the device in place.
+pub struct DmaPin {
+    ptr: *mut u8,
+    len: usize,
+    pub segments: Vec<DmaSegment>,
+}
+
+unsafe impl Send for DmaPin {}
+
+impl DmaPin {
+    /// None if the buffer can't be pinned, e.g. because we aren't privileged
+    pub fn new(buf: &mut [u8], device_writes: bool) -> Option<DmaPin> {
+        // one segment per page at most, plus one if the buffer doesn't start on a page
+        let max = buf.len() / PAGE_SIZE + 2;
+        let mut segments: Vec<DmaSegment> = std::iter::repeat_with(DmaSegment::default)
+            .take(max)
+            .collect();
+
+        let n = unsafe {
+            libdma_pin_buffer(
+                buf.as_mut_ptr(),
+                buf.len(),
+                device_writes,
+                segments.as_mut_ptr(),
+                max,
+            )
+        };
+        if n <= 0 || n as usize > max {
+            return None; // nothing was pinned
+        }
+
+        segments.truncate(n as usize);
+        Some(DmaPin {
+            ptr: buf.as_mut_ptr(),
+            len: buf.len(),
+            segments,
+        })
+    }
+}
+
+impl Drop for DmaPin {
+    fn drop(&mut self) {
+        if unsafe { !libdma_unpin_buffer(self.ptr, self.len) } {
+            panic!("Failed to unpin buffer");
+        }
+    }
+}
+
+/// A zero-filled heap buffer aligned to a page. One that is no larger than a page is always
+/// physically contiguous, so MOSHal can share it with the device in place.
+pub struct PageBuffer {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+unsafe impl Send for PageBuffer {}
+
+impl PageBuffer {
+    fn layout(len: usize) -> Layout {
+        Layout::from_size_align(len.max(1), PAGE_SIZE).unwrap()
+    }
+
+    pub fn new(len: usize) -> Self {
+        let ptr = unsafe { alloc_zeroed(Self::layout(len)) };
+        PageBuffer {
+            ptr: NonNull::new(ptr).expect("out of memory"),
+            len,
+        }
+    }
+}
+
+impl Deref for PageBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl DerefMut for PageBuffer {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl Drop for PageBuffer {
+    fn drop(&mut self) {
+        unsafe { dealloc(self.ptr.as_ptr(), Self::layout(self.len)) }
+    }
+}
@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+use std::{
+    fs::File,
+    io::Read,
+    os::fd::FromRawFd,
+    ptr::{read_volatile, write_volatile},
+};
+
+use librpc_rs::RpcStub;
+use virtio_drivers::transport::pci::bus::DeviceFunction;
+
+use crate::mosrpc::pci::{Device_location, Setup_msix_request, Setup_msix_response};
+
+extern "C" {
+    // fd_t libdma_irq_open_msi(u64 *address, u32 *data)
+    fn libdma_irq_open_msi(address: *mut u64, data: *mut u32) -> i32;
+}
+
+const PCI_CAPABILITY_ID_VENDOR: u8 = 0x09;
+const VIRTIO_PCI_CAP_COMMON_CFG: u8 = 1;
+
+// offsets in struct virtio_pci_common_cfg
+const COMMON_CFG_MSIX_CONFIG: usize = 0x10;
+const COMMON_CFG_NUM_QUEUES: usize = 0x12;
+const COMMON_CFG_QUEUE_SELECT: usize = 0x16;
+const COMMON_CFG_QUEUE_MSIX_VECTOR: usize = 0x1a;
+const VIRTIO_MSI_NO_VECTOR: u16 = 0xffff;
+
+/// Raw access to the configuration space of a device, through the ECAM mapping
+struct ConfigSpace {
+    base: usize,
+}
+
+impl ConfigSpace {
+    fn new(ecam: usize, func: DeviceFunction) -> Self {
+        let offset = (func.bus as usize) << 20
+            | (func.device as usize) << 15
+            | (func.function as usize) << 12;
+        ConfigSpace {
+            base: ecam + offset,
+        }
+    }
+
+    fn read8(&self, offset: u8) -> u8 {
+        unsafe { read_volatile((self.base + offset as usize) as *const u8) }
+    }
+
+    fn read32(&self, offset: u8) -> u32 {
+        unsafe { read_volatile((self.base + offset as usize) as *const u32) }
+    }
+
+    fn bar_address(&self, bar: u8) -> u64 {
+        let low = self.read32(0x10 + bar * 4);
+        let mut address = (low & !0xf) as u64;
+        if low & 0x6 == 0x4 && bar < 5 {
+            address |= (self.read32(0x10 + (bar + 1) * 4) as u64) << 32;
+        }
+        address
+    }
+
+    /// physical address of the virtio common configuration structure
+    fn virtio_common_cfg(&self) -> Option<u64> {
+        if self.read32(0x04) & (1 << 20) == 0 {
+            return None; // no capability list
+        }
+
+        let mut cap = self.read8(0x34) & !0x3;
+        for _ in 0..48 {
+            if cap == 0 {
+                break;
+            }
+
+            if self.read8(cap) == PCI_CAPABILITY_ID_VENDOR
+                && self.read8(cap + 3) == VIRTIO_PCI_CAP_COMMON_CFG
+            {
+                let bar = self.read8(cap + 4);
+                return Some(self.bar_address(bar) + self.read32(cap + 8) as u64);
+            }
+            cap = self.read8(cap + 1) & !0x3;
+        }
+
+        None
+    }
+}
+
+/// An MSI-X vector of a device, delivered to us through an interrupt file descriptor
+pub struct DeviceInterrupt {
+    file: File,
+    /// the PCI manager only lets the connection that set up the MSI-X entry touch the device again,
+    /// so it's kept open for as long as we drive the device
+    _pci_manager: RpcStub,
+}
+
+impl DeviceInterrupt {
+    /// Route the configuration-change and all queue interrupts of a virtio device to MSI-X entry 0.
+    ///
+    /// Must be called after the device and its queues are set up. The common configuration
+    /// structure is accessed through the identity mapping that the transport has created for it.
+    pub fn setup_virtio(ecam: usize, func: DeviceFunction) -> Result<DeviceInterrupt, String> {
+        let config = ConfigSpace::new(ecam, func);
+        let common_cfg = config
+            .virtio_common_cfg()
+            .ok_or("device has no virtio common configuration")? as usize;
+
+        let mut address: u64 = 0;
+        let mut data: u32 = 0;
+        let fd = unsafe { libdma_irq_open_msi(&mut address, &mut data) };
+        if fd < 0 {
+            return Err(format!("failed to allocate an MSI vector: {}", fd));
+        }
+        let file = unsafe { File::from_raw_fd(fd) };
+
+        let request = Setup_msix_request {
+            location: Some(Device_location {
+                bus: func.bus as _,
+                device: func.device as _,
+                function: func.function as _,
+                ..Default::default()
+            })
+            .into(),
+            entry: 0,
+            address,
+            data,
+            ..Default::default()
+        };
+
+        let mut pci_manager = RpcStub::new("mos.pci-manager").map_err(|e| e.to_string())?;
+        let resp: Setup_msix_response = pci_manager
+            .create_pb_call(1, &request)
+            .map_err(|e| e.to_string())?;
+        if !resp.result.success {
+            return Err(format!("failed to set up MSI-X: {}", resp.result.error));
+        }
+
+        unsafe {
+            let reg = |offset: usize| (common_cfg + offset) as *mut u16;
+
+            // configuration changes are not handled
+            write_volatile(reg(COMMON_CFG_MSIX_CONFIG), VIRTIO_MSI_NO_VECTOR);
+
+            let num_queues = read_volatile(reg(COMMON_CFG_NUM_QUEUES));
+            for queue in 0..num_queues {
+                write_volatile(reg(COMMON_CFG_QUEUE_SELECT), queue);
+                write_volatile(reg(COMMON_CFG_QUEUE_MSIX_VECTOR), 0);
+                if read_volatile(reg(COMMON_CFG_QUEUE_MSIX_VECTOR)) == VIRTIO_MSI_NO_VECTOR {
+                    return Err(format!(
+                        "device refused an MSI-X vector for queue {}",
+                        queue
+                    ));
+                }
+            }
+        }
+
+        Ok(DeviceInterrupt {
+            file,
+            _pci_manager: pci_manager,
+        })
+    }
+
+    /// Block until the device raises the interrupt, returns how many times it did since the last call.
+    pub fn wait(&self) -> std::io::Result<u64> {
+        let mut count = [0u8; 8];
+        (&self.file).read_exact(&mut count)?;
+        Ok(u64::from_ne_bytes(count))
+    }
+}
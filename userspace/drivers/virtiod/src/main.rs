@@ -14,6 +14,7 @@ use virtio_drivers::transport::pci::{
 
 mod drivers;
 mod hal;
+mod interrupt;
 mod mosrpc;
 mod utils;
 
@@ -55,13 +56,11 @@ fn main() -> () {
         location.bus, location.device, location.function
     );
 
-    let mut pci_root = unsafe {
+    let ecam = unsafe {
         libdma_init();
-        PciRoot::new(MmioCam::new(
-            libdma_map_physical_address(args.mmio_base as _, 256, std::ptr::null_mut()) as _,
-            Cam::Ecam,
-        ))
+        libdma_map_physical_address(args.mmio_base as _, 256, std::ptr::null_mut())
     };
+    let mut pci_root = unsafe { PciRoot::new(MmioCam::new(ecam as _, Cam::Ecam)) };
 
     // Enable the device to use its BAR.
     pci_root.set_command(
@@ -71,7 +70,7 @@ fn main() -> () {
 
     let transport = PciTransport::new::<MOSHal, MmioCam>(&mut pci_root, location).unwrap();
 
-    start_device(transport, location).expect("Failed to start device");
+    start_device(transport, location, ecam).expect("Failed to start device");
 
     unsafe {
         libdma_exit();
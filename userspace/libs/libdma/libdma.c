@@ -50,6 +50,20 @@ bool libdma_unshare_buffer(ptr_t phyaddr, void *buffer, size_t size)
     return result;
 }
 
+long libdma_pin_buffer(void *buffer, size_t size, bool device_writes, dma_segment_t *segments, size_t max_segments)
+{
+    long n_segments = syscall_dmabuf_pin(buffer, size, device_writes, segments, max_segments);
+    libdma_debug("pin buffer: buffer=%p, size=%zu, segments=%ld", buffer, size, n_segments);
+    return n_segments;
+}
+
+bool libdma_unpin_buffer(void *buffer, size_t size)
+{
+    bool result = syscall_dmabuf_unpin(buffer, size);
+    libdma_debug("unpin buffer: buffer=%p, size=%zu", buffer, size);
+    return result;
+}
+
 ptr_t libdma_map_physical_address(ptr_t paddr, size_t n_pages, ptr_t vaddr)
 {
     paddr = ALIGN_DOWN_TO_PAGE(paddr);
@@ -59,6 +73,13 @@ ptr_t libdma_map_physical_address(ptr_t paddr, size_t n_pages, ptr_t vaddr)
     return (ptr_t) syscall_mmap_file(vaddr, n_pages * MOS_PAGE_SIZE, MEM_PERM_READ | MEM_PERM_WRITE, flags, sysmem_fd, paddr);
 }
 
+fd_t libdma_irq_open_msi(u64 *address, u32 *data)
+{
+    const fd_t fd = syscall_irq_open_msi(address, data);
+    libdma_debug("msi irq: fd=%d, address=%llx, data=%x", fd, *address, *data);
+    return fd;
+}
+
 void libdma_exit(void)
 {
     close(sysmem_fd);
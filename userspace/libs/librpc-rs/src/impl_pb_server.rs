@@ -107,15 +107,32 @@ impl<T: RpcPbServerTrait + Send> RpcPbServer<T> {
     }
 
     fn handle_call(core: Arc<Mutex<Box<T>>>, ipc: &mut IpcChannel) -> RpcResult<()> {
-        let mut msg = match ipc.recv_message() {
+        let msg = match ipc.recv_message() {
             Ok(msg) => msg,
             Err(err) => {
                 return Err(Box::new(err));
             }
         };
 
+        let reply = Self::process_message(msg, |function_id, data| {
+            let mut core_locked = core.lock().unwrap();
+            core_locked.dispatch(function_id, data)
+        })?;
+
+        match reply {
+            Some((call_id, result, reply)) => Self::send_rpc_response(ipc, call_id, result, reply),
+            None => Ok(()),
+        }
+    }
+
+    fn process_message(
+        mut msg: Vec<u8>,
+        dispatch: impl FnOnce(u32, &Vec<u8>) -> RpcPbReply,
+    ) -> RpcResult<Option<(u32, RpcCallResult, Option<Vec<u8>>)>> {
         if msg.len() < 16 {
-            unreachable!("message too short");
+            // there isn't even a call id to reply to
+            println!("dropping a message that is too short ({} bytes)", msg.len());
+            return Ok(None);
         }
 
         data_slice_and_shift!(msg, magic, 4); // magic
@@ -131,18 +148,16 @@ impl<T: RpcPbServerTrait + Send> RpcPbServer<T> {
         let args_count = u32::from_le_bytes(do_try_into!(args_count, 0, 4));
 
         if magic != RPC_REQUEST_MAGIC {
-            Self::send_rpc_response(ipc, call_id, RpcCallResult::InvalidArg, None)?;
-            return Ok(());
+            return Ok(Some((call_id, RpcCallResult::InvalidArg, None)));
         }
 
         if args_count != 1 {
-            Self::send_rpc_response(ipc, call_id, RpcCallResult::InvalidArg, None)?;
             #[cfg(feature = "debug")]
             println!(
                 "  --> received call for function {} with {} args, but function expects only 1.",
                 function_id, args_count,
             );
-            return Ok(());
+            return Ok(Some((call_id, RpcCallResult::InvalidArg, None)));
         }
 
         #[cfg(feature = "debug")]
@@ -159,19 +174,11 @@ impl<T: RpcPbServerTrait + Send> RpcPbServer<T> {
             println!(" --> data: {:?}", msg);
         }
 
-        let result: RpcPbReply;
-
-        {
-            let mut core_locked = core.lock().unwrap();
-            result = core_locked.dispatch(function_id, &msg[12..].to_vec());
-        }
-
-        match result {
+        match dispatch(function_id, &msg[12..].to_vec()) {
             Err(_err) => {
                 #[cfg(feature = "debug")]
                 println!("function {} failed: {:?}", function_id, _err);
-                Self::send_rpc_response(ipc, call_id, _err, None)?;
-                return Ok(());
+                Ok(Some((call_id, _err, None)))
             }
             Ok(reply) => {
                 #[cfg(feature = "debug")]
@@ -180,11 +187,9 @@ impl<T: RpcPbServerTrait + Send> RpcPbServer<T> {
                     function_id,
                     reply.len()
                 );
-                Self::send_rpc_response(ipc, call_id, RpcCallResult::Ok, Some(reply))?;
+                Ok(Some((call_id, RpcCallResult::Ok, Some(reply))))
             }
         }
-
-        Ok(())
     }
 
     fn send_rpc_response(
@@ -207,3 +212,70 @@ impl<T: RpcPbServerTrait + Send> RpcPbServer<T> {
         Ok(ipc_channel.send_message(&msg)?)
     }
 }
+
+impl<T: RpcPbServerTrait + Send + Clone> RpcPbServer<T> {
+    /// Serve calls without serialising them: every connection works on its own clone of the
+    /// server and every call is dispatched on its own thread, so a slow call doesn't hold up
+    /// the others and replies may be sent out of order.
+    pub fn run_concurrent(&mut self) -> RpcResult<()> {
+        let core = self.core.lock().unwrap().as_ref().clone();
+
+        thread::scope(|s| loop {
+            match self.ipc.accept() {
+                Ok(Some(ipc)) => {
+                    #[cfg(feature = "debug")]
+                    println!("->> accepted new client");
+
+                    let core = core.clone();
+                    s.spawn(move || Self::serve_concurrent(core, ipc));
+                }
+                Ok(None) => {
+                    #[cfg(feature = "debug")]
+                    println!("->> server shutting down");
+                    break;
+                }
+                Err(e) => {
+                    println!("accept failed: {:?}", e);
+                    break;
+                }
+            }
+        });
+
+        Ok(())
+    }
+
+    fn serve_concurrent(core: T, mut ipc: IpcChannel) {
+        let writer = Mutex::new(ipc.clone());
+
+        thread::scope(|s| loop {
+            let msg = match ipc.recv_message() {
+                Ok(msg) => msg,
+                Err(err) => {
+                    if err.kind() != std::io::ErrorKind::UnexpectedEof {
+                        println!("recv_message failed: {:?}", err);
+                    }
+                    break; // client disconnected, in-flight calls are finished before returning
+                }
+            };
+
+            let mut core = core.clone();
+            let writer = &writer;
+            s.spawn(move || {
+                let reply = Self::process_message(msg, |function_id, data| {
+                    core.dispatch(function_id, data)
+                });
+
+                let sent = reply.and_then(|reply| match reply {
+                    Some((call_id, result, data)) => {
+                        Self::send_rpc_response(&mut writer.lock().unwrap(), call_id, result, data)
+                    }
+                    None => Ok(()),
+                });
+
+                if let Err(err) = sent {
+                    println!("handle_call failed: {:?}", err);
+                }
+            });
+        });
+    }
+}
@@ -210,7 +210,9 @@ impl<'a, T: Send + Sync + Clone> RpcServer<'a, T> {
         };
 
         if msg.len() < 16 {
-            unreachable!("message too short");
+            // there isn't even a call id to reply to
+            println!("dropping a message that is too short ({} bytes)", msg.len());
+            return Ok(());
         }
 
         data_slice_and_shift!(msg, magic, 4); // magic
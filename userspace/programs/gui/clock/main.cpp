@@ -6,6 +6,7 @@
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <librpc/rpc_buffer.h>
 #include <thread>
 
 using namespace std::chrono_literals;
@@ -60,10 +61,15 @@ int main(int, char **)
 
     printf("Created window with ID: %lu\n", create_window_response.window_id);
 
-    auto buffer_data = static_cast<pb_bytes_array_t *>(malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(CLOCK_SIZE * CLOCK_SIZE * sizeof(u32))));
-    buffer_data->size = CLOCK_SIZE * CLOCK_SIZE * sizeof(u32);
+    // draw into a shared buffer, the window manager reads the frame from it directly
+    rpc_buffer_t content;
+    if (!rpc_buffer_create(&content, "clock", CLOCK_SIZE * CLOCK_SIZE * sizeof(u32)))
+    {
+        fprintf(stderr, "Failed to create content buffer\n");
+        return 1;
+    }
 
-    u32 *buffer = (u32 *) buffer_data->bytes;
+    u32 *buffer = (u32 *) content.data;
 
     auto time = std::chrono::system_clock::now();
     while (true)
@@ -102,7 +108,9 @@ int main(int, char **)
         update_request.region.y = 0;
         update_request.region.w = CLOCK_SIZE;
         update_request.region.h = CLOCK_SIZE;
-        update_request.content = buffer_data;
+        update_request.content = nullptr;
+        update_request.content_buffer.handle = rpc_client_send_fd(wm.get(), content.fd);
+        update_request.content_buffer.size = content.size;
         UpdateWindowContentResponse update_response;
         wm.update_window_content(&update_request, &update_response);
     }
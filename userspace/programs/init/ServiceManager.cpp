@@ -7,8 +7,10 @@
 #include "logging.hpp"
 #include "units/unit.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <set>
+#include <thread>
 
 using namespace std::string_literals;
 
@@ -43,25 +45,47 @@ void ServiceManagerImpl::OnProcessExit(pid_t pid, int status)
     }
 }
 
-std::vector<std::string> ServiceManagerImpl::GetStartupOrder(const std::string &id) const
+ServiceManagerImpl::StartGraph ServiceManagerImpl::GetStartGraph(const std::string &id) const
 {
-    std::set<std::string> visited;
-    std::vector<std::string> order;
+    StartGraph graph;
+    std::set<std::string> visiting; // the units on the current path, an edge back to one of them would be a cycle
 
     std::function<void(const std::string &)> visit = [&](const std::string &id)
     {
-        if (visited.contains(id))
+        if (graph.contains(id))
             return;
 
-        visited.insert(id);
         const auto unit = ConfigurationManager->GetUnit(id);
+        std::vector<StartEdge> edges;
         for (const auto &dep_id : unit->GetDependencies())
-            visit(dep_id);
-        order.push_back(id);
+            edges.push_back({ .id = dep_id, .required = true });
+
+        // a target is reached once its members have been started, they are part of the same graph so that they start
+        // in parallel with everything else, and not one after the other
+        if (const auto target = std::dynamic_pointer_cast<Target>(unit))
+            for (const auto &member_id : target->GetMembers())
+                edges.push_back({ .id = member_id, .required = false });
+
+        visiting.insert(id);
+        graph[id] = {}; // visited
+        std::vector<StartEdge> acyclic;
+        for (const auto &edge : edges)
+        {
+            if (visiting.contains(edge.id))
+            {
+                std::cerr << "ignoring dependency cycle between " << id << " and " << edge.id << std::endl;
+                continue;
+            }
+
+            visit(edge.id);
+            acyclic.push_back(edge);
+        }
+        visiting.erase(id);
+        graph[id] = std::move(acyclic);
     };
 
     visit(id);
-    return order;
+    return graph;
 }
 
 bool ServiceManagerImpl::StartUnit(const std::string &id) const
@@ -82,36 +106,123 @@ bool ServiceManagerImpl::StartUnit(const std::string &id) const
         return true;
     }
 
-    const auto order = GetStartupOrder(id);
-    for (const auto &unit_id : order)
+    // claim every unit of the dependency graph that isn't already up or being started by someone else, each of them is
+    // then started by its own job as soon as its dependencies are up, so independent units start in parallel
+    const auto graph = GetStartGraph(id);
+    std::vector<std::thread> jobs;
+    for (const auto &[unit_id, edges] : graph)
     {
         const auto unit = ConfigurationManager->GetUnit(unit_id);
+        if (ClaimStartJob(unit))
+            jobs.emplace_back([this, unit, &edges] { RunStartJob(unit, edges); });
+    }
+
+    for (auto &job : jobs)
+        job.join();
+
+    return WaitForStartJob(id);
+}
+
+bool ServiceManagerImpl::ClaimStartJob(const std::shared_ptr<IUnit> &unit) const
+{
+    std::lock_guard lock(state_lock);
+    if (const auto it = start_jobs.find(unit->id); it != start_jobs.end() && it->second == StartJobState::Running)
+        return false; // someone else is starting it, we'll wait for them
+
+    if (unit->GetStatus().status == UnitStatus::UnitStarted)
+    {
+        start_jobs[unit->id] = StartJobState::Succeeded;
+        return false;
+    }
 
-        Debug << STARTING() << "Starting " << unit->GetDescription() << " (" << unit->id << ")" << std::endl;
-        if (unit->GetStatus().status == UnitStatus::UnitStarted)
+    start_jobs[unit->id] = StartJobState::Running;
+    return true;
+}
+
+void ServiceManagerImpl::RunStartJob(const std::shared_ptr<IUnit> &unit, const std::vector<StartEdge> &edges) const
+{
+    for (const auto &edge : edges)
+    {
+        if (WaitForStartJob(edge.id))
             continue;
-        if (!unit->Start())
-        {
-            std::cerr << std::endl << FAILED() << " Failed to start " << unit->GetDescription() << ": " << *unit->GetFailReason() << std::endl;
-            return false;
-        }
 
-        // timed wait for the unit to start
-        for (int i = 0; i < 10; i++)
+        if (!edge.required)
         {
-            if (unit->GetStatus().status != UnitStatus::UnitStarting)
-                break;
-            Debug << STARTING() << "Waiting for " << unit->GetDescription() << " to start, n = " << i << std::endl;
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            std::cerr << "Failed to start unit " << edge.id << " while starting target " << unit->id << std::endl;
+            continue;
         }
 
-        if (unit->GetStatus().status == UnitStatus::UnitFailed)
-        {
-            std::cerr << FAILED() << " Failed to start " << unit->GetDescription() << ": " << unit->GetStatus().status << std::endl;
-            return false;
-        }
+        std::cerr << FAILED() << " Not starting " << unit->GetDescription() << ": dependency " << edge.id << " failed" << std::endl;
+        FinishStartJob(unit->id, false);
+        return;
     }
-    return true;
+
+    Debug << STARTING() << "Starting " << unit->GetDescription() << " (" << unit->id << ")" << std::endl;
+    OnUnitStarting(unit.get());
+    if (!unit->Start())
+    {
+        OnUnitFailed(unit.get());
+        std::cerr << std::endl << FAILED() << " Failed to start " << unit->GetDescription() << ": " << *unit->GetFailReason() << std::endl;
+        FinishStartJob(unit->id, false);
+        return;
+    }
+
+    auto timeout = DefaultStartTimeout;
+    if (const auto service = std::dynamic_pointer_cast<Service>(unit))
+        timeout = service->GetStartTimeout();
+
+    // a notify-type service stays in Starting until it reports its state
+    std::unique_lock lock(state_lock);
+    const bool settled = state_changed.wait_for(lock, timeout, [&] { return unit->GetStatus().status != UnitStatus::UnitStarting; });
+    lock.unlock();
+
+    if (!settled)
+    {
+        OnUnitFailed(unit.get());
+        std::cerr << FAILED() << " Timed out starting " << unit->GetDescription() << " after " << timeout.count() << "ms" << std::endl;
+        // its dependents are failed as well, don't leave it running, it could still come up later without them
+        unit->Stop();
+        FinishStartJob(unit->id, false);
+        return;
+    }
+
+    if (unit->GetStatus().status == UnitStatus::UnitFailed)
+    {
+        OnUnitFailed(unit.get());
+        std::cerr << FAILED() << " Failed to start " << unit->GetDescription() << ": " << unit->GetStatus().message << std::endl;
+        FinishStartJob(unit->id, false);
+        return;
+    }
+
+    FinishStartJob(unit->id, true);
+}
+
+void ServiceManagerImpl::FinishStartJob(const std::string &id, bool succeeded) const
+{
+    std::lock_guard lock(state_lock);
+    start_jobs[id] = succeeded ? StartJobState::Succeeded : StartJobState::Failed;
+    state_changed.notify_all();
+}
+
+bool ServiceManagerImpl::WaitForStartJob(const std::string &id) const
+{
+    std::unique_lock lock(state_lock);
+    state_changed.wait(lock,
+                       [&]
+                       {
+                           const auto it = start_jobs.find(id);
+                           return it == start_jobs.end() || it->second != StartJobState::Running;
+                       });
+
+    const auto it = start_jobs.find(id);
+    return it != start_jobs.end() && it->second == StartJobState::Succeeded;
+}
+
+void ServiceManagerImpl::OnUnitStateChanged() const
+{
+    // a waiter checks the state under the lock, so it either sees the new state or is already waiting
+    std::lock_guard lock(state_lock);
+    state_changed.notify_all();
 }
 
 bool ServiceManagerImpl::StopUnit(const std::string &id) const
@@ -161,12 +272,38 @@ bool ServiceManagerImpl::StopUnit(const std::string &id) const
     return true;
 }
 
+void ServiceManagerImpl::OnUnitStarting(const Unit *unit) const
+{
+    auto [timeline, lock] = boot_timeline.BeginWrite();
+    if (std::ranges::any_of(timeline, [&](const auto &entry) { return entry.id == unit->id; }))
+        return; // only the first start of a unit is part of the boot
+
+    timeline.push_back({ .id = unit->id, .type = unit->GetType(), .start = std::chrono::steady_clock::now() });
+}
+
+void ServiceManagerImpl::OnUnitFailed(const Unit *unit) const
+{
+    auto [timeline, lock] = boot_timeline.BeginWrite();
+    const auto it = std::ranges::find_if(timeline, [&](const auto &entry) { return entry.id == unit->id; });
+    if (it != timeline.end() && !it->started)
+        it->failed = true;
+}
+
 void ServiceManagerImpl::OnUnitStarted(Unit *unit)
 {
+    {
+        auto [timeline, lock] = boot_timeline.BeginWrite();
+        const auto it = std::ranges::find_if(timeline, [&](const auto &entry) { return entry.id == unit->id; });
+        if (it != timeline.end() && !it->started && !it->failed)
+            it->started = std::chrono::steady_clock::now();
+    }
+
     if (unit->GetType() == UnitType::Target)
         std::cout << OK() << " Reached target " << unit->description << std::endl;
     else
         std::cout << OK() << " Started " << unit->description << std::endl;
+
+    OnUnitStateChanged();
 }
 
 void ServiceManagerImpl::OnUnitStopped(Unit *unit)
@@ -177,6 +314,8 @@ void ServiceManagerImpl::OnUnitStopped(Unit *unit)
         std::cout << OK() << " Stopped " << unit->description << std::endl;
     else
         std::cout << OK() << " Stopped " << unit->description << std::endl;
+
+    OnUnitStateChanged();
 }
 
 bool ServiceManagerImpl::StartDefaultTarget() const
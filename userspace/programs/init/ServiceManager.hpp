@@ -10,7 +10,12 @@
 #include "units/target.hpp"
 #include "units/unit.hpp"
 
+#include <chrono>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <shared_mutex>
 #include <string>
 #include <toml++/impl/table.hpp>
@@ -44,6 +49,15 @@ struct Locked
     mutable std::shared_mutex lock;
 };
 
+struct BootTimelineEntry
+{
+    std::string id;
+    UnitType type;
+    std::chrono::steady_clock::time_point start;                  ///< for a service, right before it's forked
+    std::optional<std::chrono::steady_clock::time_point> started; ///< when the unit reached Started, if it did
+    bool failed = false;
+};
+
 class ServiceManagerImpl final
 {
     friend Unit;
@@ -65,15 +79,53 @@ class ServiceManagerImpl final
 
     void OnProcessExit(pid_t pid, int status);
 
+    /// the first start of each unit since init was started, in the order the units were started
+    std::vector<BootTimelineEntry> GetBootTimeline() const
+    {
+        return boot_timeline.Clone();
+    }
+
+    std::chrono::steady_clock::time_point GetBootTime() const
+    {
+        return boot_time;
+    }
+
   private:
+    void OnUnitStarting(const Unit *unit) const;
+    void OnUnitFailed(const Unit *unit) const;
     void OnUnitStarted(Unit *unit);
     void OnUnitStopped(Unit *unit);
+    void OnUnitStateChanged() const;
 
   private:
-    std::vector<std::string> GetStartupOrder(const std::string &id) const;
+    enum class StartJobState
+    {
+        Running,
+        Succeeded,
+        Failed,
+    };
+
+    struct StartEdge
+    {
+        std::string id; ///< the unit to wait for
+        bool required;  ///< a dependency, otherwise a member of a target, which doesn't fail the target
+    };
+
+    using StartGraph = std::map<std::string, std::vector<StartEdge>>; ///< every unit to start, and the units it waits for
+
+    StartGraph GetStartGraph(const std::string &id) const;
+    bool ClaimStartJob(const std::shared_ptr<IUnit> &unit) const;
+    void RunStartJob(const std::shared_ptr<IUnit> &unit, const std::vector<StartEdge> &edges) const;
+    void FinishStartJob(const std::string &id, bool succeeded) const;
+    bool WaitForStartJob(const std::string &id) const;
 
   private:
-    Locked<std::vector<std::thread>> startup_jobs;
+    mutable std::mutex state_lock; ///< protects start_jobs, and is taken before waking up the waiters of a unit state change
+    mutable std::condition_variable state_changed;
+    mutable std::map<std::string, StartJobState> start_jobs; ///< the last start job of each unit
+
+    const std::chrono::steady_clock::time_point boot_time = std::chrono::steady_clock::now();
+    mutable Locked<std::vector<BootTimelineEntry>> boot_timeline;
 };
 
 inline const std::unique_ptr<ServiceManagerImpl> ServiceManager = std::make_unique<ServiceManagerImpl>();
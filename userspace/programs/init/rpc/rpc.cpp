@@ -222,3 +222,30 @@ rpc_result_code_t ServiceManagerServer::get_unit_overrides(rpc_context_t *ctx, c
 
     return RPC_RESULT_OK;
 }
+
+rpc_result_code_t ServiceManagerServer::get_boot_timeline(rpc_context_t *ctx, const GetBootTimelineRequest *req, GetBootTimelineResponse *resp)
+{
+    (void) ctx;
+    (void) req;
+
+    using namespace std::chrono;
+    const auto timeline = ServiceManager->GetBootTimeline();
+    const auto bootTime = ServiceManager->GetBootTime();
+
+    resp->entries_count = timeline.size();
+    resp->entries = static_cast<RpcBootTimelineEntry *>(malloc(timeline.size() * sizeof(RpcBootTimelineEntry)));
+    if (!resp->entries)
+        return RPC_RESULT_SERVER_INTERNAL_ERROR;
+
+    for (size_t i = 0; i < timeline.size(); i++)
+    {
+        const auto &entry = timeline[i];
+        resp->entries[i].unit_id = strdup(entry.id.c_str());
+        resp->entries[i].type = static_cast<RpcUnitType>(entry.type);
+        resp->entries[i].start_us = duration_cast<microseconds>(entry.start - bootTime).count();
+        resp->entries[i].started_us = entry.started ? duration_cast<microseconds>(*entry.started - bootTime).count() : -1;
+        resp->entries[i].failed = entry.failed;
+    }
+
+    return RPC_RESULT_OK;
+}
@@ -21,6 +21,7 @@ class ServiceManagerServer : public IServiceManagerService
     rpc_result_code_t stop_unit(rpc_context_t *ctx, const StopUnitRequest *req, StopUnitResponse *resp) override;
     rpc_result_code_t instantiate_unit(rpc_context_t *ctx, const InstantiateUnitRequest *req, InstantiateUnitResponse *resp) override;
     rpc_result_code_t get_unit_overrides(rpc_context_t *ctx, const GetUnitOverridesRequest *req, GetUnitOverridesResponse *resp) override;
+    rpc_result_code_t get_boot_timeline(rpc_context_t *ctx, const GetBootTimelineRequest *req, GetBootTimelineResponse *resp) override;
 };
 
 inline const std::unique_ptr<ServiceManagerServer> RpcServer = std::make_unique<ServiceManagerServer>(SERVICE_MANAGER_RPC_NAME);
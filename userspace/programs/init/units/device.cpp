@@ -26,6 +26,7 @@ Device::Device(const std::string &id, toml::table &table, std::shared_ptr<const
     {
         toml::table service;
         service.emplace("state-change", "notify"s);
+        service.emplace("privileged", true); // drivers need irq_open, dmabuf_pin...
         root.emplace("service", service);
     }
 
@@ -1,8 +1,15 @@
 #include "service.hpp"
 
 #include "ServiceManager.hpp"
+#include "mos/syscall/usermode.h"
 #include "utils/ExecUtils.hpp"
 
+#include <cerrno>
+#include <thread>
+#include <unistd.h>
+
+constexpr size_t ON_DEMAND_MAX_PENDING = 32; // connections queued until the service takes over its server name
+
 RegisterUnit(service, Service);
 RegisterUnit(driver, Service);
 
@@ -38,6 +45,48 @@ ServiceOptions::ServiceOptions(toml::node_view<toml::node> table_in)
         table.erase("redirect");
     }
 
+    if (table.contains("privileged"))
+    {
+        if (table["privileged"].is_boolean())
+            privileged = table["privileged"].as_boolean()->get();
+        else
+            std::cerr << "service: bad privileged" << std::endl;
+        table.erase("privileged");
+    }
+
+    if (table.contains("start-timeout"))
+    {
+        const double seconds = table["start-timeout"].value_or(0.0);
+        if (seconds > 0)
+            startTimeout = std::chrono::milliseconds(static_cast<long>(seconds * 1000));
+        else
+            std::cerr << "service: bad start-timeout" << std::endl;
+        table.erase("start-timeout");
+    }
+
+    if (table.contains("on-demand"))
+    {
+        if (table["on-demand"].is_string())
+        {
+            onDemand.push_back(table["on-demand"].as_string()->get());
+        }
+        else if (table["on-demand"].is_array())
+        {
+            for (const auto &name : *table["on-demand"].as_array())
+            {
+                if (name.is_string())
+                    onDemand.push_back(name.as_string()->get());
+                else
+                    std::cerr << "service: bad on-demand server name" << std::endl;
+            }
+        }
+        else
+        {
+            std::cerr << "service: bad on-demand" << std::endl;
+        }
+        table.erase("on-demand");
+    }
+
     // warn if table["service"] contains unknown keys
     for (const auto &kv : table)
         std::cerr << "service: unknown key " << kv.first << std::endl;
@@ -64,9 +113,23 @@ bool Service::Start()
         return false;
     }
 
+    if (!service_options.onDemand.empty())
+        return ArmActivation();
+
+    return Spawn();
+}
+
+bool Service::Spawn()
+{
     status.Starting("starting...");
     token = ExecUtils::GetRandomString();
-    const auto pid = ExecUtils::DoFork(exec, token, GetBaseId(), service_options.redirect);
+    std::vector<int> fds;
+    {
+        std::lock_guard<std::mutex> lock(activation_lock);
+        fds = activation_fds; // empty unless the service is started on demand
+    }
+
+    const auto pid = ExecUtils::DoFork(exec, token, GetBaseId(), service_options.redirect, fds, service_options.privileged);
     if (pid < 0)
     {
         std::cerr << "failed to start service " << id << std::endl;
@@ -84,10 +147,93 @@ bool Service::Start()
     return true;
 }
 
+bool Service::ArmActivation()
+{
+    std::vector<fd_t> fds;
+    for (const auto &name : service_options.onDemand)
+    {
+        const fd_t fd = syscall_ipc_register(name.c_str(), ON_DEMAND_MAX_PENDING);
+        if (fd < 0)
+        {
+            std::cerr << "service " << id << ": failed to register " << name << " to be served on demand" << std::endl;
+            for (const auto registered : fds)
+                close(registered);
+            status.Failed("failed to register " + name);
+            return false;
+        }
+        fds.push_back(fd);
+    }
+
+    unsigned generation;
+    {
+        std::lock_guard<std::mutex> lock(activation_lock);
+        activation_fds.assign(fds.begin(), fds.end());
+        generation = ++activation_generation;
+    }
+
+    activation = ActivationState::Armed;
+    status.Started("waiting for a connection");
+    ServiceManager->OnUnitStarted(this);
+
+    for (const auto fd : fds)
+        std::thread([this, fd, generation] { WaitForActivation(fd, generation); }).detach();
+    return true;
+}
+
+void Service::WaitForActivation(int fd, unsigned generation)
+{
+    // the first read returns once a client has connected, the next one returns 0 once the service has taken over the name,
+    // and a read fails once CloseActivation has closed the fd, which is the only place the fd is closed
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(activation_lock);
+            if (generation != activation_generation)
+                return; // closed and re-armed, the fd number may have been reused
+        }
+
+        u64 pending = 0;
+        const auto ret = read(fd, &pending, sizeof(pending));
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret != (ssize_t) sizeof(pending))
+            return;
+
+        auto expected = ActivationState::Armed;
+        if (activation.compare_exchange_strong(expected, ActivationState::Activated))
+        {
+            std::cout << "activating service " << id << " for " << pending << " pending connection(s)" << std::endl;
+            if (!Spawn())
+            {
+                CloseActivation(); // refuse the queued clients
+                return;
+            }
+        }
+        else if (expected == ActivationState::Cancelled)
+        {
+            return;
+        }
+    }
+}
+
+void Service::CloseActivation()
+{
+    std::lock_guard<std::mutex> lock(activation_lock);
+    for (const auto fd : activation_fds)
+        close(fd); // refuses the clients still queued, if the service never took over the name, and wakes up the waiters
+    activation_fds.clear();
+    activation_generation++;
+}
+
 bool Service::Stop()
 {
     status.Stopping("stopping...");
     std::cout << "stopping service " << id << std::endl;
+
+    auto armed = ActivationState::Armed;
+    activation.compare_exchange_strong(armed, ActivationState::Cancelled);
+    CloseActivation();
+
     const int pid = main_pid;
     if (pid == -1)
     {
@@ -106,6 +252,13 @@ void Service::onPrint(std::ostream &os) const
     for (const auto &e : this->exec)
         os << e << " ";
     os << std::endl;
+    if (!this->service_options.onDemand.empty())
+    {
+        os << "  on-demand: ";
+        for (const auto &name : this->service_options.onDemand)
+            os << name << " ";
+        os << std::endl;
+    }
     if (this->status.status == UnitStatus::UnitFailed)
         os << "failed: " << this->status.message << ", exit status: " << this->exit_status;
     os << std::endl;
@@ -113,6 +266,7 @@ void Service::onPrint(std::ostream &os) const
 
 void Service::OnExited(int status)
 {
+    const bool stopping = this->status.status == UnitStatus::UnitStopping;
     status = status == W_EXITCODE(0, SIGTERM) ? 0 : status;
     this->exit_status = status;
     if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
@@ -132,7 +286,16 @@ void Service::OnExited(int status)
     {
         this->status.Failed("unknown exit status: " + std::to_string(status));
     }
+    // if the service died before taking over its names, the clients queued on them are refused rather than left hanging
+    CloseActivation();
     ServiceManager->OnUnitStopped(this);
+
+    // serve the names on demand again, unless the service has been stopped or has failed
+    if (!service_options.onDemand.empty() && !stopping && this->status.status == UnitStatus::UnitStopped)
+    {
+        main_pid = -1;
+        ArmActivation();
+    }
 }
 
 void Service::ChangeState(const UnitStatus &status)
@@ -148,4 +311,6 @@ void Service::ChangeState(const UnitStatus &status)
 
     if (status.status == UnitStatus::UnitStarted)
         ServiceManager->OnUnitStarted(this);
+    else
+        ServiceManager->OnUnitStateChanged();
 }
@@ -3,6 +3,11 @@
 #include "unit.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
+
+/// how long a unit may take to reach Started (or Failed) before its start is considered failed
+constexpr std::chrono::milliseconds DefaultStartTimeout = std::chrono::seconds(30);
 
 enum class StateChangeNotifyType
 {
@@ -16,6 +21,9 @@ struct ServiceOptions
 
     StateChangeNotifyType stateChangeNotifyType = StateChangeNotifyType::Immediate;
     bool redirect = true; ///< Redirect stdout/stderr to syslog daemon
+    std::chrono::milliseconds startTimeout = DefaultStartTimeout; ///< 'start-timeout', in seconds
+    std::vector<std::string> onDemand; ///< 'on-demand', IPC server names whose first client starts the service
+    bool privileged = false;           ///< 'privileged', true to keep the privilege to use system-wide syscalls
 };
 
 struct Service : public Unit
@@ -35,6 +43,11 @@ struct Service : public Unit
         return main_pid.load();
     }
 
+    std::chrono::milliseconds GetStartTimeout() const
+    {
+        return service_options.startTimeout;
+    }
+
     void ChangeState(const UnitStatus &status);
 
   private:
@@ -47,8 +60,24 @@ struct Service : public Unit
     bool Stop() override;
     void onPrint(std::ostream &os) const override;
 
+    bool Spawn();
+    bool ArmActivation();
+    void WaitForActivation(int fd, unsigned generation);
+    void CloseActivation();
+
   private:
+    enum class ActivationState
+    {
+        Armed,     ///< the server names are registered, the service is started by the first client
+        Activated, ///< a client has connected and the service has been started
+        Cancelled, ///< stopped before any client connected
+    };
+
     std::atomic<pid_t> main_pid = -1;
+    std::atomic<ActivationState> activation = ActivationState::Cancelled;
+    std::mutex activation_lock;         ///< protects activation_fds and activation_generation
+    std::vector<int> activation_fds;    ///< registrations of the on-demand names, closed by CloseActivation
+    unsigned activation_generation = 0; ///< bumped by ArmActivation, so that stale waiter threads stop
     int exit_status = -1;
     std::string token;
     ServiceOptions service_options;
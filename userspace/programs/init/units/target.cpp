@@ -11,14 +11,7 @@ Target::Target(const std::string &id, toml::table &table, std::shared_ptr<const
 
 bool Target::Start()
 {
-    for (const auto &partOf : GetMembers())
-    {
-        if (!ServiceManager->StartUnit(partOf))
-        {
-            std::cerr << "Failed to start unit " << partOf << " while stopping target " << id << std::endl;
-        }
-    }
-
+    // the members have already been started, they are part of the target's start graph, see ServiceManagerImpl::GetStartGraph
     status.Started("reached");
     ServiceManager->OnUnitStarted(this);
     return true;
@@ -42,7 +42,8 @@ namespace ExecUtils
         return s;
     }
 
-    pid_t DoFork(const std::vector<std::string> &exec, const std::string &token, const std::string &baseId, bool redirect)
+    pid_t DoFork(const std::vector<std::string> &exec, const std::string &token, const std::string &baseId, bool redirect, const std::vector<int> &activationFds,
+                 bool privileged)
     {
         int fds[2];
         if (pipe(fds) == -1)
@@ -68,6 +69,14 @@ namespace ExecUtils
 
             setenv("MOS_SERVICE_TOKEN", token.c_str(), true);
 
+            // done before execve, so the service can't race with init to take over its names
+            const pid_t self = getpid();
+            for (const auto fd : activationFds)
+                write(fd, &self, sizeof(self));
+
+            if (!privileged)
+                syscall_privilege_drop();
+
             const auto err = execve(exec[0].c_str(), (char **) args.data(), environ);
             if (err == -1)
             {
@@ -21,7 +21,10 @@ namespace ExecUtils
      * @param exec the command to execute, as a vector of strings
      * @param token the token to set in the MOS_SERVICE_TOKEN environment variable
      * @param baseId the base ID of the unit, used to create the log directory
+     * @param activationFds on-demand registrations (see syscall_ipc_register) whose names the child may take over
+     * @param privileged true to keep the privilege to use system-wide syscalls, dropped otherwise, see syscall_privilege_drop
      * @return pid_t the PID of the child process, or -1 on error
      */
-    pid_t DoFork(const std::vector<std::string> &exec, const std::string &token, const std::string &baseId, bool redirect = true);
+    pid_t DoFork(const std::vector<std::string> &exec, const std::string &token, const std::string &baseId, bool redirect = true,
+                 const std::vector<int> &activationFds = {}, bool privileged = false);
 } // namespace ExecUtils
@@ -75,6 +75,187 @@ static void do_memstat(void)
     open_and_print_file("/sys/mmstat/stat");
 }
 
+static void do_syscalls(void)
+{
+    open_and_print_file("/sys/syscall/stat");
+    puts("");
+    open_and_print_file("/sys/syscall/processes");
+}
+
+static void do_syslat(void)
+{
+    // each line is "<name> <bucket>:<count>...", bucket n holds latencies in [2^n, 2^(n+1)) timestamp ticks
+    FILE *f = fopen("/sys/syscall/latency", "r");
+    if (!f)
+    {
+        fprintf(stderr, "failed to open '/sys/syscall/latency'\n");
+        return;
+    }
+
+    char line[BUFSIZE];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *saveptr;
+        const char *name = strtok_r(line, " \n", &saveptr);
+        if (!name)
+            continue;
+
+        unsigned long long counts[64] = { 0 }, max = 0;
+        int first = 64, last = -1;
+        for (char *tok; (tok = strtok_r(NULL, " \n", &saveptr));)
+        {
+            int bucket;
+            unsigned long long count;
+            if (sscanf(tok, "%d:%llu", &bucket, &count) != 2 || bucket < 0 || bucket >= 64)
+                continue;
+
+            counts[bucket] = count;
+            max = count > max ? count : max;
+            first = bucket < first ? bucket : first;
+            last = bucket > last ? bucket : last;
+        }
+
+        printf("%s:\n", name);
+        for (int i = first; i <= last; i++)
+        {
+            char bar[41] = { 0 };
+            memset(bar, '@', max ? counts[i] * 40 / max : 0);
+            printf("  [%12llu, %12llu) %10llu |%-40s|\n", i ? 1ULL << i : 0, 1ULL << (i + 1), counts[i], bar);
+        }
+    }
+
+    fclose(f);
+}
+
+typedef struct
+{
+    int tid, pid;
+    char state;
+    unsigned long long ticks; // user + sys
+    unsigned long long user, sys;
+    char name[64];
+} thread_sample_t;
+
+#define TOP_MAX_THREADS 256
+
+static size_t read_thread_samples(thread_sample_t *samples, size_t max)
+{
+    FILE *f = fopen("/sys/sched/threads", "r");
+    if (!f)
+    {
+        fprintf(stderr, "failed to open '/sys/sched/threads'\n");
+        return 0;
+    }
+
+    char line[BUFSIZE];
+    fgets(line, sizeof(line), f); // header
+
+    size_t n = 0;
+    while (n < max && fgets(line, sizeof(line), f))
+    {
+        thread_sample_t *s = &samples[n];
+        int name_offset = 0;
+        if (sscanf(line, "%d %d %c %llu %llu %*llu %*llu %*llu %*llu %*llu %n", &s->tid, &s->pid, &s->state, &s->user, &s->sys, &name_offset) < 5 || !name_offset)
+            continue;
+
+        s->ticks = s->user + s->sys;
+        snprintf(s->name, sizeof(s->name), "%s", line + name_offset);
+        s->name[strcspn(s->name, "\n")] = '\0';
+        n++;
+    }
+
+    fclose(f);
+    return n;
+}
+
+typedef struct
+{
+    int ncpus;
+    unsigned long long tick_hz;
+    unsigned long long time_ns; // since boot
+} sched_stat_sample_t;
+
+static bool read_sched_stat(sched_stat_sample_t *stat)
+{
+    FILE *f = fopen("/sys/sched/stat", "r");
+    if (!f)
+    {
+        fprintf(stderr, "failed to open '/sys/sched/stat'\n");
+        return false;
+    }
+
+    char line[BUFSIZE];
+    *stat = (sched_stat_sample_t){ 0 };
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned long long value;
+        if (sscanf(line, "tick_hz %llu", &value) == 1)
+            stat->tick_hz = value;
+        else if (sscanf(line, "time_ns %llu", &value) == 1)
+            stat->time_ns = value;
+        else if (sscanf(line, "%*u %llu", &value) == 1)
+            stat->ncpus++;
+    }
+
+    fclose(f);
+    return stat->tick_hz && stat->time_ns;
+}
+
+static int compare_thread_usage(const void *a, const void *b)
+{
+    const thread_sample_t *x = a, *y = b;
+    return (y->ticks > x->ticks) - (y->ticks < x->ticks);
+}
+
+static void do_top(void)
+{
+    // sample the timer ticks charged to each thread over one second, 100% is one whole CPU, i.e. a tick every
+    // tick period of the elapsed time, idle CPUs may not tick at all so their tick counts can't be used for that
+    static thread_sample_t before[TOP_MAX_THREADS], after[TOP_MAX_THREADS];
+    sched_stat_sample_t stat_before, stat_after;
+    const size_t n_before = read_thread_samples(before, TOP_MAX_THREADS);
+    const bool have_before = read_sched_stat(&stat_before);
+    sleep(1);
+    const size_t n_after = read_thread_samples(after, TOP_MAX_THREADS);
+    const bool have_after = read_sched_stat(&stat_after);
+
+    if (!have_before || !have_after || stat_after.time_ns <= stat_before.time_ns)
+    {
+        puts("failed to read the elapsed time");
+        return;
+    }
+
+    const double elapsed_ns = stat_after.time_ns - stat_before.time_ns;
+    const double ticks_per_cpu = elapsed_ns * stat_after.tick_hz / 1e9;
+
+    // turn 'after' into the deltas, threads that didn't exist before started from 0
+    for (size_t i = 0; i < n_after; i++)
+    {
+        for (size_t j = 0; j < n_before; j++)
+        {
+            if (before[j].tid == after[i].tid)
+            {
+                after[i].ticks -= before[j].ticks;
+                after[i].user -= before[j].user;
+                after[i].sys -= before[j].sys;
+                break;
+            }
+        }
+    }
+
+    qsort(after, n_after, sizeof(after[0]), compare_thread_usage);
+
+    clear_console();
+    printf("%d CPUs, %.0f ms elapsed, %llu ticks per second\n\n", stat_after.ncpus, elapsed_ns / 1e6, stat_after.tick_hz);
+    printf("%-6s %-6s %-5s %7s %7s %7s  %s\n", "TID", "PID", "STATE", "%CPU", "%USR", "%SYS", "NAME");
+    for (size_t i = 0; i < n_after && i < 20; i++)
+    {
+        const thread_sample_t *s = &after[i];
+        printf("%-6d %-6d %-5c %7.1f %7.1f %7.1f  %s\n", s->tid, s->pid, s->state, 100.0 * s->ticks / ticks_per_cpu, 100.0 * s->user / ticks_per_cpu,
+               100.0 * s->sys / ticks_per_cpu, s->name);
+    }
+}
+
 static void do_leave(void)
 {
     exit(0);
@@ -148,6 +329,9 @@ const struct
     { "pstat", do_pstat },         //
     { "pagetable", do_pagetable }, //
     { "vmaps", do_vmaps },         //
+    { "syscalls", do_syscalls },   //
+    { "syslat", do_syslat },       //
+    { "top", do_top },             //
     { "help", do_help },           //
     { "h", do_help },              //
     { NULL, NULL },                //
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mosapi.h"
+
+#include <mos/syscall/usermode.h>
+
+#define SWAP_STAT_FILE "/sys/swap/stat"
+
+int main(int argc, char **argv)
+{
+    // swapon <blockdev>
+    if (argc == 1)
+    {
+        // show swap usage
+        auto fd = open(SWAP_STAT_FILE, OPEN_READ);
+        if (!fd)
+        {
+            printf("Failed to open " SWAP_STAT_FILE ", %s\n", strerror(-fd));
+            return -1;
+        }
+
+        char line[256];
+        while (fdgets(line, sizeof(line), fd))
+            fputs(line, stdout);
+
+        close(fd);
+        return 0;
+    }
+
+    if (argc != 2)
+    {
+        puts("Usage: swapon <blockdev>");
+        return -1;
+    }
+
+    const long ret = syscall_swapon(argv[1]);
+    if (ret < 0)
+    {
+        printf("Failed to enable swap on %s: %ld (%s)\n", argv[1], ret, strerror(-ret));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "blockdev.h"
+#include "blockdev_client.hpp"
+#include "proto/blockdev.pb.h"
+#include "proto/blockdev.service.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <librpc/rpc.h>
+#include <memory>
+#include <mos/mm/swap.h>
+#include <mos/mos_global.h>
+#include <string>
+
+using namespace mosrpc::blockdev;
+
+int main(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::cout << "Set up a swap area" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <blockdev> [size in pages]" << std::endl;
+        std::cerr << "Example: " << argv[0] << " ramdisk" << std::endl;
+        return 1;
+    }
+
+    auto manager = std::make_unique<BlockdevManagerStub>(BLOCKDEV_MANAGER_RPC_SERVER_NAME);
+    BlockdevClient device(manager.get());
+    if (!device.open(argv[1]))
+        return 1;
+
+    const u32 block_size = device.block_size();
+    if (!block_size || MOS_PAGE_SIZE % block_size)
+    {
+        std::cerr << "Unsupported block size " << block_size << std::endl;
+        return 1;
+    }
+
+    u64 n_slots = device.n_blocks() * block_size / MOS_PAGE_SIZE;
+    if (argc == 3)
+        n_slots = std::min<u64>(n_slots, std::stoull(argv[2]));
+
+    if (n_slots < 2)
+    {
+        std::cerr << "Device is too small for a swap area" << std::endl;
+        return 1;
+    }
+
+    // the header takes the whole first page, zero-padded
+    write_block::request req{};
+    req.n_boffset = 0;
+    req.n_blocks = MOS_PAGE_SIZE / block_size;
+    req.data = (pb_bytes_array_t *) calloc(1, PB_BYTES_ARRAY_T_ALLOCSIZE(MOS_PAGE_SIZE));
+    req.data->size = MOS_PAGE_SIZE;
+
+    swap_header_t header{};
+    memcpy(header.magic, SWAP_MAGIC, sizeof(header.magic));
+    header.version = SWAP_VERSION;
+    header.page_size = MOS_PAGE_SIZE;
+    header.n_slots = n_slots;
+    memcpy(req.data->bytes, &header, sizeof(header));
+
+    write_block::response resp{};
+    const auto result = device.write_block(&req, &resp);
+    const bool ok = result == RPC_RESULT_OK && resp.result.success;
+    if (!ok)
+    {
+        std::cerr << "Failed to write the swap header";
+        if (result == RPC_RESULT_OK && resp.result.error)
+            std::cerr << ": " << resp.result.error;
+        std::cerr << std::endl;
+    }
+
+    pb_release(mosrpc_blockdev_write_block_request_fields, &req);
+    pb_release(mosrpc_blockdev_write_block_response_fields, &resp);
+    if (!ok)
+        return 1;
+
+    if (!device.flush())
+    {
+        std::cerr << "Failed to flush " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::cout << "Swap area on " << argv[1] << ": " << (n_slots - 1) << " pages (" << (n_slots - 1) * MOS_PAGE_SIZE / 1024 << " KiB)" << std::endl;
+    return 0;
+}
@@ -1,9 +1,13 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "blockdev.h"
+#include "blockdev_client.hpp"
 #include "proto/blockdev.pb.h"
 #include "proto/blockdev.service.h"
 
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
 #include <iomanip>
 #include <iostream>
 #include <librpc/macro_magic.h>
@@ -11,44 +15,25 @@
 #include <librpc/rpc_client.h>
 #include <memory>
 #include <mos/mos_global.h>
-#include <optional>
 #include <pb_decode.h>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace mosrpc::blockdev;
 
 std::unique_ptr<BlockdevManagerStub> manager = nullptr;
 
-static const std::optional<mosrpc_blockdev_blockdev> do_open_device(const char *device_name)
-{
-    open_device::request request{ .device_name = strdup(device_name) };
-    open_device::response response;
-    const auto result = manager->open_device(&request, &response);
-    if (result != RPC_RESULT_OK || !response.result.success)
-    {
-        std::cerr << "Failed to open blockdev: error " << result << std::endl;
-        if (response.result.error)
-            std::cerr << "Error: " << response.result.error << std::endl;
-        return std::nullopt;
-    }
-
-    const auto dev = response.device;
-    pb_release(mosrpc_blockdev_open_device_request_fields, &request);
-    pb_release(mosrpc_blockdev_open_device_response_fields, &response);
-    return dev;
-}
-
-static void do_peek_blocks(const mosrpc_blockdev_blockdev &device, size_t start, u32 n_blocks)
+static void do_peek_blocks(BlockdevClient &device, size_t start, u32 n_blocks)
 {
     auto read_req = read_block::request{
-        .device = device,
         .n_boffset = start,
         .n_blocks = n_blocks,
     };
 
     read_block::response read_resp;
 
-    const auto result = manager->read_block(&read_req, &read_resp);
+    const auto result = device.read_block(&read_req, &read_resp);
     if (result != RPC_RESULT_OK)
     {
         std::cerr << "Failed to read block: error " << result << std::endl;
@@ -77,27 +62,210 @@ static void do_peek_blocks(const mosrpc_blockdev_blockdev &device, size_t start,
     pb_release(mosrpc_blockdev_read_block_response_fields, &read_resp);
 }
 
+static int do_cache_stats(const char *name)
+{
+    get_cache_stats::request req{ .device_name = strdup(name) };
+    get_cache_stats::response resp{};
+
+    const auto result = manager->get_cache_stats(&req, &resp);
+    free(req.device_name);
+    if (result != RPC_RESULT_OK || !resp.result.success)
+    {
+        std::cerr << "Failed to get cache statistics";
+        if (result == RPC_RESULT_OK && resp.result.error)
+            std::cerr << ": " << resp.result.error;
+        std::cerr << std::endl;
+        pb_release(mosrpc_blockdev_cache_stats_response_fields, &resp);
+        return 1;
+    }
+
+    const auto total = resp.hits + resp.misses;
+    std::cout << "Block cache of " << name << ":" << std::endl;
+    std::cout << "  hits:       " << resp.hits << " blocks";
+    if (total)
+        std::cout << " (" << resp.hits * 100 / total << "%)";
+    std::cout << std::endl;
+    std::cout << "  misses:     " << resp.misses << " blocks" << std::endl;
+    std::cout << "  writebacks: " << resp.writebacks << " blocks" << std::endl;
+    std::cout << "  evictions:  " << resp.evictions << std::endl;
+    std::cout << "  cached:     " << resp.cached / 1024 << " KiB of " << resp.capacity / 1024 << " KiB, " << resp.dirty / 1024 << " KiB dirty" << std::endl;
+
+    pb_release(mosrpc_blockdev_cache_stats_response_fields, &resp);
+    return 0;
+}
+
+static bool fetch_io_stats(const char *name, get_io_stats::response *resp)
+{
+    get_io_stats::request req{ .device_name = strdup(name), .partition = {} };
+    const auto result = manager->get_io_stats(&req, resp);
+    free(req.device_name);
+    if (result != RPC_RESULT_OK || !resp->result.success || !resp->layers_count)
+    {
+        std::cerr << "Failed to get I/O statistics of " << name;
+        if (result == RPC_RESULT_OK && resp->result.error)
+            std::cerr << ": " << resp->result.error;
+        std::cerr << std::endl;
+        pb_release(mosrpc_blockdev_io_stats_response_fields, resp);
+        return false;
+    }
+
+    return true;
+}
+
+// the same fields as /sys/block/<dev>/stat, the time columns in milliseconds
+static void print_stat_line(const mosrpc_blockdev_io_stats &s)
+{
+    const auto ms = [](u64 ns) { return ns / 1000000; };
+    std::cout << s.read.ops << " 0 " << s.read.bytes / 512 << " " << ms(s.read.total_ns) << " ";
+    std::cout << s.write.ops << " 0 " << s.write.bytes / 512 << " " << ms(s.write.total_ns) << " ";
+    std::cout << s.in_flight << " " << ms(s.read.total_ns + s.write.total_ns) << " " << ms(s.read.total_ns + s.write.total_ns) << " ";
+    std::cout << "0 0 0 0 " << s.flush.ops << " " << ms(s.flush.total_ns) << std::endl;
+}
+
+static void print_histogram(const char *op, const mosrpc_blockdev_io_op_stats &s)
+{
+    if (!s.ops)
+        return;
+
+    std::cout << "    " << op << ": " << s.ops << " ops, " << s.bytes / 1024 << " KiB, " << s.errors << " errors, ";
+    std::cout << "avg " << s.total_ns / s.ops / 1000 << " us, max " << s.max_ns / 1000 << " us" << std::endl;
+
+    u64 peak = 0;
+    for (size_t i = 0; i < s.histogram_count; i++)
+        peak = std::max(peak, s.histogram[i]);
+
+    for (size_t i = 0; i < s.histogram_count; i++)
+    {
+        if (!s.histogram[i])
+            continue;
+        const std::string bar(s.histogram[i] * 40 / peak + 1, '#');
+        std::cout << "      < " << std::setw(9) << (2ull << i) << " us " << std::setw(8) << s.histogram[i] << " " << bar << std::endl;
+    }
+}
+
+static int do_stat(const char *name)
+{
+    get_io_stats::response resp{};
+    if (!fetch_io_stats(name, &resp))
+        return 1;
+
+    for (size_t i = 0; i < resp.layers_count; i++)
+    {
+        const auto &layer = resp.layers[i];
+        std::cout << layer.layer << ": ";
+        print_stat_line(layer);
+        print_histogram("read", layer.read);
+        print_histogram("write", layer.write);
+        print_histogram("flush", layer.flush);
+        std::cout << "    in flight: " << layer.in_flight << ", at most " << layer.max_in_flight << std::endl;
+    }
+
+    pb_release(mosrpc_blockdev_io_stats_response_fields, &resp);
+    return 0;
+}
+
+struct IOStatSample
+{
+    u64 reads, read_bytes, read_ns;
+    u64 writes, write_bytes, write_ns;
+    u32 in_flight;
+};
+
+static std::vector<std::string> list_devices()
+{
+    std::vector<std::string> names;
+    DIR *dir = opendir("/dev/block");
+    if (!dir)
+        return names;
+
+    while (const auto entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+
+    closedir(dir);
+    return names;
+}
+
+static int do_iostat(int interval)
+{
+    const auto devices = list_devices();
+    std::vector<IOStatSample> last(devices.size());
+
+    while (true)
+    {
+        std::cout << std::left << std::setw(16) << "Device" << std::right;
+        std::cout << std::setw(10) << (interval ? "r/s" : "reads") << std::setw(10) << (interval ? "rKB/s" : "rKB");
+        std::cout << std::setw(10) << (interval ? "w/s" : "writes") << std::setw(10) << (interval ? "wKB/s" : "wKB");
+        std::cout << std::setw(12) << "r_await_us" << std::setw(12) << "w_await_us" << std::setw(8) << "queue" << std::endl;
+
+        for (size_t i = 0; i < devices.size(); i++)
+        {
+            get_io_stats::response resp{};
+            if (!fetch_io_stats(devices[i].c_str(), &resp))
+                continue;
+
+            // the lowest layer that keeps statistics is the closest to what the hardware sees
+            const auto &s = resp.layers[resp.layers_count - 1];
+            const IOStatSample now = {
+                s.read.ops, s.read.bytes, s.read.total_ns, s.write.ops, s.write.bytes, s.write.total_ns, s.in_flight,
+            };
+            pb_release(mosrpc_blockdev_io_stats_response_fields, &resp);
+
+            const auto &prev = last[i];
+            const u64 reads = now.reads - prev.reads, writes = now.writes - prev.writes;
+            const u64 div = interval ? interval : 1;
+            std::cout << std::left << std::setw(16) << devices[i] << std::right;
+            std::cout << std::setw(10) << reads / div << std::setw(10) << (now.read_bytes - prev.read_bytes) / 1024 / div;
+            std::cout << std::setw(10) << writes / div << std::setw(10) << (now.write_bytes - prev.write_bytes) / 1024 / div;
+            std::cout << std::setw(12) << (reads ? (now.read_ns - prev.read_ns) / reads / 1000 : 0);
+            std::cout << std::setw(12) << (writes ? (now.write_ns - prev.write_ns) / writes / 1000 : 0);
+            std::cout << std::setw(8) << now.in_flight << std::endl;
+            last[i] = now;
+        }
+
+        if (!interval)
+            return 0;
+
+        std::cout << std::endl;
+        std::this_thread::sleep_for(std::chrono::seconds(interval));
+    }
+}
+
 int main(int argc, char **argv)
 {
-    if (argc != 4)
+    if (argc >= 2 && strcmp(argv[1], "--iostat") == 0)
+    {
+        manager = std::make_unique<BlockdevManagerStub>(BLOCKDEV_MANAGER_RPC_SERVER_NAME);
+        return do_iostat(argc >= 3 ? atoi(argv[2]) : 0);
+    }
+
+    const bool cache_stats = argc == 3 && strcmp(argv[1], "--cache") == 0;
+    const bool io_stats = argc == 3 && strcmp(argv[1], "--stat") == 0;
+    if (argc != 4 && !cache_stats && !io_stats)
     {
         std::cout << "Peek Blocks" << std::endl;
         std::cerr << "Usage: " << argv[0] << " <blockdev> <start> <count>" << std::endl;
+        std::cerr << "       " << argv[0] << " --cache <blockdev>" << std::endl;
+        std::cerr << "       " << argv[0] << " --stat <blockdev>" << std::endl;
+        std::cerr << "       " << argv[0] << " --iostat [interval]" << std::endl;
         std::cerr << "Example: " << argv[0] << " ramdisk 0 1" << std::endl;
         return 1;
     }
 
     manager = std::make_unique<BlockdevManagerStub>(BLOCKDEV_MANAGER_RPC_SERVER_NAME);
+    if (cache_stats)
+        return do_cache_stats(argv[2]);
+    if (io_stats)
+        return do_stat(argv[2]);
 
-    const auto device = do_open_device(argv[1]);
-    if (!device)
-    {
-        std::cerr << "Failed to query server name" << std::endl;
+    BlockdevClient device(manager.get());
+    if (!device.open(argv[1]))
         return 1;
-    }
 
     const auto start = std::stoll(argv[2]);
     const auto count = std::stoll(argv[3]);
-    do_peek_blocks(*device, start, count);
+    do_peek_blocks(device, start, count);
     return 0;
 }
@@ -69,9 +69,9 @@ static std::string GetUnitStatus(const struct _RpcUnit &unit)
     __builtin_unreachable();
 }
 
-static const char *GetUnitType(const struct _RpcUnit &unit)
+static const char *GetUnitType(RpcUnitType type)
 {
-    switch (unit.type)
+    switch (type)
     {
         case RpcUnitType_Service: return "Service"; break;
         case RpcUnitType_Target: return "Target"; break;
@@ -123,7 +123,7 @@ static int do_list(int, char **)
                color,
                unitNameLen - 2,                         //
                unit.name,                               //
-               GetUnitType(unit),                       //
+               GetUnitType(unit.type),                  //
                color,                                   //
                statusmsg.c_str(),                       //
                C_RESET,                                 //
@@ -316,6 +316,37 @@ static int do_instantiate(int argc, char **argv)
     return err;
 }
 
+static int do_boottime(int, char **)
+{
+    GetBootTimelineRequest req;
+    GetBootTimelineResponse resp;
+    const auto err = ServiceManager->get_boot_timeline(&req, &resp);
+    if (err != RPC_RESULT_OK)
+    {
+        std::cerr << "Failed to get boot timeline: error " << err << std::endl;
+        return 1;
+    }
+
+    // plain columns, parsed by tools/testing to draw the boot chart; times are in ms since init was started
+    int unitNameLen = UnitNameLength;
+    for (size_t i = 0; i < resp.entries_count; i++)
+        unitNameLen = std::max(unitNameLen, int(strlen(resp.entries[i].unit_id)));
+
+    printf("%-*s %-10s %12s %12s %12s %s\n", unitNameLen, "unit", "type", "start", "started", "time", "status");
+    for (size_t i = 0; i < resp.entries_count; i++)
+    {
+        const auto &entry = resp.entries[i];
+        const char *status = entry.failed ? "failed" : entry.started_us < 0 ? "starting" : "started";
+        if (entry.started_us < 0)
+            printf("%-*s %-10s %12.3f %12s %12s %s\n", unitNameLen, entry.unit_id, GetUnitType(entry.type), entry.start_us / 1000.0, "-", "-", status);
+        else
+            printf("%-*s %-10s %12.3f %12.3f %12.3f %s\n", unitNameLen, entry.unit_id, GetUnitType(entry.type), entry.start_us / 1000.0, entry.started_us / 1000.0,
+                   (entry.started_us - entry.start_us) / 1000.0, status);
+    }
+
+    return 0;
+}
+
 static int do_listall(int, char **)
 {
     puts("List of current units:");
@@ -339,6 +370,7 @@ const std::vector<Command> commands = {
     { "start", "Start unit", do_start_unit },
     { "stop", "Stop unit", do_stop_unit },
     { "instantiate", "Instantiate unit from template", do_instantiate },
+    { "boottime", "Show how long each unit took to start during boot", do_boottime },
     { "help", "Show help", do_help },
 };
 
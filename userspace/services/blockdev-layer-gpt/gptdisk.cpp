@@ -41,7 +41,7 @@ static std::optional<GPT::Header> gpt_read_header(const void *data)
     return *header;
 }
 
-GPTDisk::GPTDisk(const blockdev_handle handle, const std::string &disk_name) : device_handle(handle), disk_name(disk_name)
+GPTDisk::GPTDisk(std::unique_ptr<BlockdevClient> device, const std::string &disk_name) : device(std::move(device)), disk_name(disk_name)
 {
 }
 
@@ -76,14 +76,13 @@ u32 GPTDisk::get_partition_count() const
 
 bool GPTDisk::disk_read_header()
 {
-    const read_block::request read_request = {
-        .device = device_handle,
+    read_block::request read_request = {
         .n_boffset = 1,
         .n_blocks = 1,
     };
 
     read_block::response read_resp;
-    const auto result = manager->read_block(&read_request, &read_resp);
+    const auto result = device->read_block(&read_request, &read_resp);
     if (result != RPC_RESULT_OK || !read_resp.result.success)
     {
         std::cout << " (failed to read block)" << std::endl;
@@ -104,14 +103,13 @@ bool GPTDisk::disk_read_header()
 bool GPTDisk::disk_read_partitions()
 {
     // continue reading the partition table
-    const read_block::request read_request{
-        .device = device_handle,
+    read_block::request read_request{
         .n_boffset = header.partition_table_lba,
         .n_blocks = header.partition_count * header.partition_entry_size / 512,
     };
     read_block::response read_resp;
 
-    const auto result3 = manager->read_block(&read_request, &read_resp);
+    const auto result3 = device->read_block(&read_request, &read_resp);
     if (result3 != RPC_RESULT_OK || !read_resp.result.success)
     {
         std::cout << " (failed to read partition table)" << std::endl;
@@ -145,40 +143,17 @@ bool GPTDisk::disk_read_partitions()
     return true;
 }
 
-size_t GPTDisk::read_partition_block(size_t partition_index, u64 blockoffset, u8 *buffer, u32 nblocks)
+bool GPTDisk::translate(size_t partition_index, u64 blockoffset, u32 nblocks, u64 *disk_block) const
 {
     assert(ready);
-    const auto &partition = partitions.at(partition_index);
-
-    const read_block::request read_request = {
-        .device = device_handle,
-        .n_boffset = partition.first_lba + blockoffset,
-        .n_blocks = nblocks,
-    };
-
-    read_block::response read_resp;
-    const auto result = manager->read_block(&read_request, &read_resp);
-    if (result != RPC_RESULT_OK || !read_resp.result.success)
-    {
-        std::cout << " (failed to read partition block)" << std::endl;
-        if (read_resp.result.error)
-            std::cout << "    " << read_resp.result.error << std::endl;
-        return 0;
-    }
-
-    const auto datasize = read_resp.data->size;
-    memcpy(buffer, read_resp.data->bytes, datasize);
-    pb_release(mosrpc_blockdev_read_block_response_fields, &read_resp);
+    if (partition_index >= partitions.size() || nblocks == 0)
+        return false;
 
-    return datasize;
-}
+    const auto &partition = partitions[partition_index];
+    const u64 partition_blocks = partition.last_lba - partition.first_lba + 1;
+    if (blockoffset >= partition_blocks || nblocks > partition_blocks - blockoffset)
+        return false;
 
-size_t GPTDisk::write_partition_block(size_t partition_index, u64 blockoffset, const u8 *buffer, u32 nblocks)
-{
-    MOS_UNUSED(partition_index);
-    MOS_UNUSED(blockoffset);
-    MOS_UNUSED(buffer);
-    MOS_UNUSED(nblocks);
-    assert(ready);
-    return 0;
+    *disk_block = partition.first_lba + blockoffset;
+    return true;
 }
@@ -2,15 +2,15 @@
 
 #pragma once
 
+#include "blockdev_client.hpp"
 #include "proto/blockdev.pb.h"
 
 #include <cstddef>
+#include <memory>
 #include <mos/types.h>
 #include <string>
 #include <vector>
 
-using blockdev_handle = mosrpc_blockdev_blockdev;
-
 namespace GPT
 {
     struct Header
@@ -46,7 +46,7 @@ namespace GPT
 class GPTDisk
 {
   public:
-    explicit GPTDisk(const blockdev_handle handle, const std::string &disk_name);
+    explicit GPTDisk(std::unique_ptr<BlockdevClient> device, const std::string &disk_name);
     ~GPTDisk() = default;
 
     bool initialise_gpt();
@@ -54,8 +54,13 @@ class GPTDisk
     u32 get_partition_count() const;
     GPT::PartitionEntry get_partition(size_t index) const;
 
-    size_t read_partition_block(size_t partition_index, u64 blockoffset, u8 *buffer, u32 nblocks);
-    size_t write_partition_block(size_t partition_index, u64 blockoffset, const u8 *buffer, u32 nblocks);
+    /// translate a range of partition blocks to disk blocks, false if it's not within the partition
+    bool translate(size_t partition_index, u64 blockoffset, u32 nblocks, u64 *disk_block) const;
+
+    BlockdevClient *get_device() const
+    {
+        return device.get();
+    }
 
     size_t get_block_size() const
     {
@@ -72,7 +77,7 @@ class GPTDisk
     bool disk_read_partitions();
 
   private:
-    const blockdev_handle device_handle;
+    const std::unique_ptr<BlockdevClient> device;
     std::string disk_name;
 
     bool ready = false;
@@ -3,10 +3,15 @@
 #include "layer-gpt.hpp"
 
 #include "blockdev.h"
+#include "blockdev_buffers.hpp"
 #include "gptdisk.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <librpc/rpc_buffer.h>
+#include <librpc/rpc_server.h>
 #include <memory>
+#include <unistd.h>
 
 using namespace std::string_literals;
 
@@ -14,10 +19,14 @@ std::unique_ptr<BlockdevManagerStub> manager = nullptr;
 
 GPTLayerServer::GPTLayerServer(std::shared_ptr<GPTDisk> disk, const std::string &servername) : IBlockdevLayerService(servername), disk(disk)
 {
+    for (size_t i = 0; i < disk->get_partition_count(); i++)
+        stats.push_back(std::make_unique<BlockIOStats>());
+
     const register_layer_server::request req = {
         .server_name = strdup(servername.c_str()),
         .partitions_count = disk->get_partition_count(),
         .partitions = new mosrpc_blockdev_partition_info[disk->get_partition_count()],
+        .accepts_buffers = true, // passed on to the disk, see pass_buffer
     };
 
     for (size_t i = 0; i < disk->get_partition_count(); i++)
@@ -40,23 +49,177 @@ GPTLayerServer::GPTLayerServer(std::shared_ptr<GPTDisk> disk, const std::string
     delete[] req.partitions;
 }
 
+// A direct channel, opened by the manager and handed to a client, is bound to the partition the client opened.
+// Connections that are never bound (the manager's own) may access every partition.
+struct LayerConnection
+{
+    std::optional<u32> partition;
+    BlockdevBufferTable buffers;
+};
+
+void GPTLayerServer::on_connect(rpc_context_t *context)
+{
+    // a buffer is only mapped here if the disk can't take it, see pass_buffer
+    set_data(context, new LayerConnection{ .partition = std::nullopt, .buffers = BlockdevBufferTable(!disk->get_device()->accepts_buffers()) });
+}
+
+void GPTLayerServer::on_disconnect(rpc_context_t *context)
+{
+    delete get_data<LayerConnection>(context);
+}
+
+bool GPTLayerServer::may_access(rpc_context_t *context, u32 partid)
+{
+    const auto connection = get_data<LayerConnection>(context);
+    return !connection->partition || *connection->partition == partid;
+}
+
+// A buffer passed by the client goes on to the disk as it is, so the data never passes through us.
+// Only if the disk doesn't take buffers, it's mapped here and the data copied, like the manager does.
+static bool pass_buffer(BlockdevClient *device, const BlockdevBuffer *buffer, mosrpc_buffer_handle *out)
+{
+    *out = {};
+    if (!buffer || buffer->buffer.data)
+        return true;
+
+    // the slot keeps the buffer on the disk's connection too, for as long as the client keeps it here
+    const auto handle = device->pass_buffer(buffer->slot, buffer->serial, buffer->buffer.fd, buffer->buffer.size);
+    if (!handle)
+        return false;
+
+    *out = *handle;
+    return true;
+}
+
 rpc_result_code_t GPTLayerServer::read_partition_block(rpc_context_t *context, const mosrpc_blockdev_read_partition_block_request *req, read_block::response *resp)
 {
-    MOS_UNUSED(context);
-    const auto datasize = req->n_blocks * disk->get_block_size();
-    resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(datasize));
-    resp->data->size = datasize;
-    disk->read_partition_block(req->partition.partid, req->n_boffset, resp->data->bytes, req->n_blocks);
+    std::shared_ptr<BlockdevBuffer> buffer;
+    const bool buffer_valid = get_data<LayerConnection>(context)->buffers.get(context, req->buffer, &buffer);
+
+    u64 disk_block;
+    if (!may_access(context, req->partition.partid) || !disk->translate(req->partition.partid, req->n_boffset, req->n_blocks, &disk_block) ||
+        !buffer_valid || (buffer && buffer->buffer.size < req->n_blocks * disk->get_block_size()))
+    {
+        if (req->partition.partid < stats.size())
+            stats[req->partition.partid]->begin(BlockIOType::Read); // counted as a failed request
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid partition read request");
+        return RPC_RESULT_OK;
+    }
+
+    auto request = stats[req->partition.partid]->begin(BlockIOType::Read);
+    read_block::request dev_req{ .n_boffset = disk_block, .n_blocks = req->n_blocks };
+    if (!pass_buffer(disk->get_device(), buffer.get(), &dev_req.buffer))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid buffer");
+        return RPC_RESULT_OK;
+    }
+
+    // the disk's response is ours, the data goes straight back to the client
+    const auto result = disk->get_device()->read_block(&dev_req, resp);
+
+    if (buffer && buffer->buffer.data && result == RPC_RESULT_OK && resp->data)
+    {
+        memcpy(buffer->buffer.data, resp->data->bytes, std::min<size_t>(resp->data->size, buffer->buffer.size));
+        free(resp->data);
+        resp->data = nullptr;
+    }
+
+    request.done(result == RPC_RESULT_OK && resp->result.success, req->n_blocks * disk->get_block_size());
+    return result;
+}
+
+rpc_result_code_t GPTLayerServer::write_partition_block(rpc_context_t *context, const mosrpc_blockdev_write_partition_block_request *req, write_block::response *resp)
+{
+    std::shared_ptr<BlockdevBuffer> buffer;
+    const bool buffer_valid = get_data<LayerConnection>(context)->buffers.get(context, req->buffer, &buffer);
+
+    const size_t size = req->n_blocks * disk->get_block_size();
+    u64 disk_block;
+    if (!may_access(context, req->partition.partid) || !disk->translate(req->partition.partid, req->n_boffset, req->n_blocks, &disk_block) ||
+        !buffer_valid || (buffer ? buffer->buffer.size < size : (!req->data || req->data->size < size)))
+    {
+        if (req->partition.partid < stats.size())
+            stats[req->partition.partid]->begin(BlockIOType::Write); // counted as a failed request
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid partition write request");
+        return RPC_RESULT_OK;
+    }
+
+    auto request = stats[req->partition.partid]->begin(BlockIOType::Write);
+    write_block::request dev_req{ .data = req->data, .n_boffset = disk_block, .n_blocks = req->n_blocks };
+    if (!pass_buffer(disk->get_device(), buffer.get(), &dev_req.buffer))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid buffer");
+        return RPC_RESULT_OK;
+    }
+
+    if (buffer && buffer->buffer.data)
+    {
+        dev_req.data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(size));
+        dev_req.data->size = size;
+        memcpy(dev_req.data->bytes, buffer->buffer.data, size);
+    }
+
+    // the disk's result (and the number of blocks written) is reported as is
+    const auto result = disk->get_device()->write_block(&dev_req, resp);
+
+    if (dev_req.data != req->data)
+        free(dev_req.data);
+
+    request.done(result == RPC_RESULT_OK && resp->result.success, size);
+    return result;
+}
+
+rpc_result_code_t GPTLayerServer::get_io_stats(rpc_context_t *context, const get_io_stats::request *req, get_io_stats::response *resp)
+{
+    if (req->partition.partid >= stats.size() || !may_access(context, req->partition.partid))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid partition");
+        return RPC_RESULT_OK;
+    }
+
+    resp->layers_count = 1;
+    resp->layers = (mosrpc_blockdev_io_stats *) calloc(1, sizeof(mosrpc_blockdev_io_stats));
+    stats[req->partition.partid]->to_pb(&resp->layers[0], "gpt");
 
     resp->result.success = true;
     resp->result.error = nullptr;
     return RPC_RESULT_OK;
 }
 
-rpc_result_code_t GPTLayerServer::write_partition_block(rpc_context_t *context, const mosrpc_blockdev_write_partition_block_request *req, write_block::response *resp)
+rpc_result_code_t GPTLayerServer::flush(rpc_context_t *context, const flush::request *req, flush::response *resp)
+{
+    if (req->partition.partid >= stats.size() || !may_access(context, req->partition.partid))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid partition");
+        return RPC_RESULT_OK;
+    }
+
+    // partitions share the disk, and with it its write cache
+    auto request = stats[req->partition.partid]->begin(BlockIOType::Flush);
+    resp->result.success = disk->get_device()->flush();
+    resp->result.error = resp->result.success ? nullptr : strdup("Failed to flush the disk");
+    request.done(resp->result.success, 0);
+    return RPC_RESULT_OK;
+}
+
+rpc_result_code_t GPTLayerServer::bind_partition(rpc_context_t *context, const bind_partition::request *req, bind_partition::response *resp)
 {
-    MOS_UNUSED(context);
-    MOS_UNUSED(resp);
-    disk->write_partition_block(req->partition.partid, req->n_boffset, req->data->bytes, req->n_blocks);
+    const auto connection = get_data<LayerConnection>(context);
+    if (req->partition.partid >= stats.size() || connection->partition)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup(connection->partition ? "Connection already bound to a partition" : "Invalid partition");
+        return RPC_RESULT_OK;
+    }
+
+    connection->partition = req->partition.partid;
+    resp->result.success = true;
+    resp->result.error = nullptr;
     return RPC_RESULT_OK;
 }
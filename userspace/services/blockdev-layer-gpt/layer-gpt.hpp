@@ -3,6 +3,7 @@
 #pragma once
 
 #include "blockdev.h"
+#include "blockdev_stats.hpp"
 #include "gptdisk.hpp"
 #include "proto/blockdev.service.h"
 
@@ -10,7 +11,9 @@
 #include <librpc/rpc_client.h>
 #include <librpc/rpc_server++.hpp>
 #include <memory>
+#include <optional>
 #include <pb_decode.h>
+#include <vector>
 
 using namespace mosrpc::blockdev;
 
@@ -25,7 +28,17 @@ class GPTLayerServer : public IBlockdevLayerService
     virtual rpc_result_code_t read_partition_block(rpc_context_t *context, const mosrpc_blockdev_read_partition_block_request *req, read_block::response *resp) override;
     virtual rpc_result_code_t write_partition_block(rpc_context_t *context, const mosrpc_blockdev_write_partition_block_request *req,
                                                     write_block::response *resp) override;
+    virtual rpc_result_code_t get_io_stats(rpc_context_t *context, const get_io_stats::request *req, get_io_stats::response *resp) override;
+    virtual rpc_result_code_t flush(rpc_context_t *context, const flush::request *req, flush::response *resp) override;
+    virtual rpc_result_code_t bind_partition(rpc_context_t *context, const bind_partition::request *req, bind_partition::response *resp) override;
+
+    virtual void on_connect(rpc_context_t *context) override;
+    virtual void on_disconnect(rpc_context_t *context) override;
+
+    /// whether the connection may access the partition, see bind_partition
+    bool may_access(rpc_context_t *context, u32 partid);
 
   private:
     std::shared_ptr<GPTDisk> disk;
+    std::vector<std::unique_ptr<BlockIOStats>> stats; // per partition
 };
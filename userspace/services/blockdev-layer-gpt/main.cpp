@@ -16,17 +16,14 @@ static std::shared_ptr<GPTDisk> open_gpt_disk(const std::string_view disk_path)
     std::filesystem::path disk_path_fs = disk_path;
     const auto disk_name = disk_path_fs.filename().string();
 
-    open_device::request req = { .device_name = strdup(disk_name.c_str()) };
-    open_device::response resp;
-    const auto result = manager->open_device(&req, &resp);
-    if (result != RPC_RESULT_OK || !resp.result.success)
+    auto device = std::make_unique<BlockdevClient>(manager.get());
+    if (!device->open(disk_name))
     {
         std::cerr << "Error: failed to open device" << std::endl;
         return nullptr;
     }
 
-    free(req.device_name);
-    return std::make_shared<GPTDisk>(resp.device, disk_name);
+    return std::make_shared<GPTDisk>(std::move(device), disk_name);
 }
 
 static void do_gpt_scan()
@@ -74,6 +71,11 @@ static void do_gpt_serve(const std::string_view disk_path)
 
     GPTLayerServer server(disk, disk->name() + ".gpt");
 
+    // requests are only translated and passed on, serving them concurrently keeps several in flight to the disk,
+    // where the driver can queue and merge them
+    server.set_concurrent(true);
+    server.set_worker_pool(4);
+
     std::cout << "Serving GPT partition layer for device " << disk->name() << std::endl;
     server.run();
 }
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "block_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+BlockCache::BlockCache(size_t block_size, u64 n_blocks, size_t capacity, BackingIO read, BackingIO write)
+    : block_size(block_size), blocks_per_chunk(BLOCK_CACHE_CHUNK_SIZE / block_size), n_blocks(n_blocks),
+      capacity(std::max<size_t>(capacity / BLOCK_CACHE_CHUNK_SIZE, 1)), backing_read(read), backing_write(write)
+{
+    statistics.capacity = this->capacity;
+}
+
+u32 BlockCache::block_mask(u64 chunk, u64 block, u64 end) const
+{
+    const u64 chunk_start = chunk * blocks_per_chunk;
+    const u64 first = std::max(block, chunk_start) - chunk_start;
+    const u64 last = std::min(end, chunk_start + blocks_per_chunk) - chunk_start;
+    const u32 all = last >= 32 ? ~0u : (1u << last) - 1;
+    return all & ~((1u << first) - 1);
+}
+
+BlockCache::Chunk &BlockCache::get_chunk(u64 index)
+{
+    if (auto it = chunks.find(index); it != chunks.end())
+    {
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return it->second;
+    }
+
+    lru.push_front(index);
+    auto &chunk = chunks[index];
+    chunk.data.resize(BLOCK_CACHE_CHUNK_SIZE);
+    chunk.lru = lru.begin();
+    return chunk;
+}
+
+void BlockCache::copy_out(u64 c, u64 block, u64 end, u8 *data)
+{
+    auto &chunk = get_chunk(c);
+    const u64 from = std::max(block, c * blocks_per_chunk);
+    const u64 to = std::min(end, (c + 1) * blocks_per_chunk);
+    memcpy(data + (from - block) * block_size, chunk.data.data() + (from - c * blocks_per_chunk) * block_size, (to - from) * block_size);
+}
+
+void BlockCache::shrink(std::unique_lock<std::mutex> &guard)
+{
+    while (chunks.size() > capacity)
+    {
+        // the least recently used chunk that isn't busy, if they all are, the next request shrinks the cache
+        const auto victim = std::find_if(lru.rbegin(), lru.rend(), [this](u64 index) { return !chunks.at(index).busy; });
+        if (victim == lru.rend())
+            return;
+
+        const u64 index = *victim;
+        if (const auto it = chunks.find(index); !it->second.dirty)
+        {
+            lru.erase(it->second.lru);
+            chunks.erase(it);
+            statistics.evictions++;
+            continue;
+        }
+
+        if (!write_back(guard, index, index + 1))
+        {
+            // keep it, the data would be lost otherwise, the cache grows over its capacity until the device recovers
+            std::cerr << "blockdev-manager: failed to write back chunk " << index << ", keeping it" << std::endl;
+            lru.splice(lru.begin(), lru, chunks.at(index).lru);
+            return;
+        }
+
+        // the lock was dropped for the write, the chunk may have been used or written to again, so look again
+    }
+}
+
+bool BlockCache::fill(std::unique_lock<std::mutex> &guard, u64 first, u64 n_chunks)
+{
+    const u64 start = first * blocks_per_chunk;
+    const u64 end = std::min((first + n_chunks) * blocks_per_chunk, n_blocks);
+
+    // none of them is busy (the caller waited for that), and busy chunks are never evicted
+    std::vector<Chunk *> filling;
+    for (u64 i = 0; i < n_chunks; i++)
+    {
+        auto &chunk = get_chunk(first + i);
+        chunk.busy = true;
+        filling.push_back(&chunk);
+    }
+
+    guard.unlock();
+    std::vector<u8> buffer((end - start) * block_size);
+    const bool ok = backing_read(start, end - start, buffer.data());
+    guard.lock();
+
+    for (u64 i = 0; i < n_chunks; i++)
+    {
+        auto &chunk = *filling[i];
+        chunk.busy = false;
+        if (!ok)
+            continue;
+
+        // blocks that are already cached may be newer than the device's copy, they may even have been written meanwhile
+        const u32 fetched = block_mask(first + i, start, end);
+        for (size_t b = 0; b < blocks_per_chunk; b++)
+        {
+            if (!(fetched & (1u << b)) || (chunk.valid & (1u << b)))
+                continue;
+            memcpy(chunk.data.data() + b * block_size, buffer.data() + (i * blocks_per_chunk + b) * block_size, block_size);
+        }
+        chunk.valid |= fetched;
+    }
+
+    idle.notify_all();
+    return ok;
+}
+
+bool BlockCache::read(u64 block, u32 count, u8 *data)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    const u64 end = block + count;
+    const u64 last_chunk = (end - 1) / blocks_per_chunk;
+
+    const auto missing = [&](u64 chunk)
+    {
+        const u32 wanted = block_mask(chunk, block, end);
+        const auto it = chunks.find(chunk);
+        return it == chunks.end() || (it->second.valid & wanted) != wanted;
+    };
+
+    const auto busy = [&](u64 chunk)
+    {
+        const auto it = chunks.find(chunk);
+        return it != chunks.end() && it->second.busy;
+    };
+
+    // chunks are copied out as soon as they're there, fetching the next ones drops the lock, they could be evicted
+    for (u64 c = block / blocks_per_chunk; c <= last_chunk;)
+    {
+        if (!missing(c))
+        {
+            statistics.hits += __builtin_popcount(block_mask(c, block, end));
+            copy_out(c, block, end, data);
+            c++;
+            continue;
+        }
+
+        if (busy(c))
+        {
+            idle.wait(guard); // someone else is fetching or writing back the chunk, look again once they're done
+            continue;
+        }
+
+        // fetch the missing chunks, runs of them with one request each
+        u64 run = 1;
+        while (c + run <= last_chunk && run < BLOCK_CACHE_MAX_TRANSFER && missing(c + run) && !busy(c + run))
+            run++;
+
+        for (u64 i = 0; i < run; i++)
+            statistics.misses += __builtin_popcount(block_mask(c + i, block, end));
+
+        if (!fill(guard, c, run))
+            return false;
+
+        for (u64 i = 0; i < run; i++)
+            copy_out(c + i, block, end, data);
+        c += run;
+    }
+
+    shrink(guard);
+    return true;
+}
+
+bool BlockCache::write(u64 block, u32 count, const u8 *data)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    const u64 end = block + count;
+
+    // busy chunks are written to as well, a fill keeps these blocks and a write-back leaves them dirty
+    for (u64 c = block / blocks_per_chunk; c <= (end - 1) / blocks_per_chunk; c++)
+    {
+        auto &chunk = get_chunk(c);
+        const u64 from = std::max(block, c * blocks_per_chunk);
+        const u64 to = std::min(end, (c + 1) * blocks_per_chunk);
+        memcpy(chunk.data.data() + (from - c * blocks_per_chunk) * block_size, data + (from - block) * block_size, (to - from) * block_size);
+
+        const u32 mask = block_mask(c, block, end);
+        chunk.valid |= mask;
+        chunk.dirty |= mask;
+        chunk.written |= mask;
+    }
+
+    shrink(guard);
+    return true;
+}
+
+bool BlockCache::write_back(std::unique_lock<std::mutex> &guard, u64 first, u64 end)
+{
+    // an earlier write-back of these chunks may still be on its way, the device has to see the writes in order
+    idle.wait(guard, [&]() { return std::none_of(chunks.lower_bound(first), chunks.lower_bound(end), [](const auto &it) { return it.second.busy; }); });
+
+    struct Run
+    {
+        u64 start, count; // in blocks
+        std::vector<u8> data;
+    };
+
+    struct Pending
+    {
+        Chunk *chunk;
+        u32 dirty;
+        size_t last_run; // the chunk is clean once this run is written
+    };
+
+    // take a copy of the dirty blocks, adjacent ones form a run that is written with a single request
+    std::vector<Run> runs;
+    std::vector<Pending> pending;
+    for (auto it = chunks.lower_bound(first); it != chunks.lower_bound(end); ++it)
+    {
+        auto &[index, chunk] = *it;
+        if (!chunk.dirty)
+            continue;
+
+        for (size_t b = 0; b < blocks_per_chunk; b++)
+        {
+            if (!(chunk.dirty & (1u << b)))
+                continue;
+
+            const u64 blk = index * blocks_per_chunk + b;
+            if (runs.empty() || blk != runs.back().start + runs.back().count || runs.back().count >= BLOCK_CACHE_MAX_TRANSFER * blocks_per_chunk)
+                runs.push_back({ .start = blk, .count = 0, .data = {} });
+
+            auto &run = runs.back();
+            run.data.insert(run.data.end(), chunk.data.begin() + b * block_size, chunk.data.begin() + (b + 1) * block_size);
+            run.count++;
+        }
+
+        chunk.busy = true;
+        chunk.written = 0;
+        pending.push_back({ .chunk = &chunk, .dirty = chunk.dirty, .last_run = runs.size() - 1 });
+    }
+
+    if (runs.empty())
+        return true;
+
+    guard.unlock();
+    size_t done = 0;
+    while (done < runs.size() && backing_write(runs[done].start, runs[done].count, runs[done].data.data()))
+        done++;
+    guard.lock();
+
+    for (size_t i = 0; i < done; i++)
+        statistics.writebacks += runs[i].count;
+
+    for (const auto &[chunk, dirty, last_run] : pending)
+    {
+        // blocks written to meanwhile have newer data than what reached the device, they stay dirty
+        if (last_run < done)
+            chunk->dirty &= ~(dirty & ~chunk->written);
+        chunk->busy = false;
+    }
+
+    idle.notify_all();
+    return done == runs.size();
+}
+
+bool BlockCache::flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    return write_back(guard, 0, std::numeric_limits<u64>::max());
+}
+
+BlockCacheStats BlockCache::stats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto stats = statistics;
+    stats.cached = chunks.size();
+    stats.dirty = 0;
+    for (const auto &[index, chunk] : chunks)
+        stats.dirty += __builtin_popcount(chunk.dirty);
+    return stats;
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mos/types.h>
+#include <mutex>
+#include <vector>
+
+#define BLOCK_CACHE_CHUNK_SIZE    4096 // the cache holds (and reads from the device) 4K chunks of blocks
+#define BLOCK_CACHE_MAX_TRANSFER  256  // max number of chunks read or written back to the device at once
+#define BLOCK_CACHE_FLUSH_SECONDS 5 // dirty blocks are written back at least this often
+
+struct BlockCacheStats
+{
+    u64 hits, misses;      // in blocks
+    u64 writebacks;        // blocks written to the device
+    u64 evictions;         // chunks
+    size_t cached;         // chunks
+    size_t dirty;          // blocks
+    size_t capacity;       // chunks
+};
+
+/**
+ * @brief A write-back LRU cache in front of a block device
+ *
+ * @details Blocks are grouped into chunks of BLOCK_CACHE_CHUNK_SIZE bytes. A read miss fetches whole chunks,
+ *          writes only mark the blocks dirty. Dirty blocks reach the device when their chunk is evicted, on
+ *          flush(), or by the periodic flusher; adjacent dirty blocks are written back with a single request.
+ *          flush() is a barrier: every write that completed before it is on the device when it returns.
+ *
+ *          The lock is not held while the device is accessed. A chunk being read from or written to the device is
+ *          marked busy instead, so that requests to other chunks (and cache hits on it) carry on meanwhile.
+ */
+class BlockCache
+{
+  public:
+    /// read or write n_blocks blocks starting at block, from or to data
+    using BackingIO = std::function<bool(u64 block, u32 n_blocks, u8 *data)>;
+
+    explicit BlockCache(size_t block_size, u64 n_blocks, size_t capacity, BackingIO read, BackingIO write);
+
+    /// whether a device with this block size can be cached
+    static bool supports(size_t block_size)
+    {
+        return block_size && BLOCK_CACHE_CHUNK_SIZE % block_size == 0 && BLOCK_CACHE_CHUNK_SIZE / block_size <= 32;
+    }
+
+    bool read(u64 block, u32 n_blocks, u8 *data);
+    bool write(u64 block, u32 n_blocks, const u8 *data);
+    bool flush();
+    BlockCacheStats stats();
+
+  private:
+    struct Chunk
+    {
+        std::vector<u8> data;
+        u32 valid = 0; // bitmap of blocks with data
+        u32 dirty = 0; // bitmap of blocks not yet written to the device
+        u32 written = 0; // bitmap of blocks written since the last write-back started, they stay dirty after it
+        bool busy = false; // being filled or written back, it's not evicted and no other I/O is started on it
+        std::list<u64>::iterator lru;
+    };
+
+    // these take the locked lock, and drop it while the device is accessed
+    bool fill(std::unique_lock<std::mutex> &guard, u64 first, u64 n_chunks); // keeps the blocks already cached
+    bool write_back(std::unique_lock<std::mutex> &guard, u64 first, u64 end); // dirty blocks of chunks [first, end)
+    void shrink(std::unique_lock<std::mutex> &guard); // evict chunks until the cache fits its capacity
+
+    Chunk &get_chunk(u64 index); // lookup or insert, and mark as most recently used
+    void copy_out(u64 chunk, u64 block, u64 end, u8 *data); // blocks of [block, end) in the chunk, to data
+    u32 block_mask(u64 chunk, u64 block, u64 end) const;   // blocks of [block, end) in the chunk
+
+  private:
+    const size_t block_size, blocks_per_chunk;
+    const u64 n_blocks;
+    const size_t capacity; // in chunks
+    const BackingIO backing_read, backing_write;
+
+    std::mutex lock;
+    std::condition_variable idle; // a chunk is no longer busy
+    std::map<u64, Chunk> chunks;  // ordered, so that flushes write in ascending order
+    std::list<u64> lru;          // most recently used first
+    BlockCacheStats statistics{};
+};
@@ -2,27 +2,42 @@
 
 #include "blockdev_manager.hpp"
 
+#include "blockdev_buffers.hpp"
 #include "proto/blockdev.pb.h"
 #include "proto/blockdev.service.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <iostream>
 #include <librpc/rpc.h>
+#include <librpc/rpc_buffer.h>
 #include <librpc/rpc_server++.hpp>
 #include <librpc/rpc_server.h>
 #include <map>
 #include <memory>
+#include <mos/ipc/ipc_types.h>
+#include <mos/syscall/usermode.h>
 #include <mos/types.h>
 #include <mutex>
 #include <pb.h>
 #include <pb_decode.h>
 #include <pb_encode.h>
 #include <string>
+#include <vector>
 
 std::map<std::string, BlockInfo> devices;      // blockdev id -> blockdev info
+std::mutex devices_lock;
+size_t block_cache_size = 0;
 static std::atomic_ulong next_blockdev_id = 2; // 1 is reserved for the root directory
 
+const BlockInfo *find_device(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(devices_lock);
+    const auto it = devices.find(name);
+    return it == devices.end() ? nullptr : &it->second;
+}
+
 static std::shared_ptr<BlockdevLayerStub> get_layer_server(const std::string &name)
 {
     static std::map<std::string, std::shared_ptr<BlockdevLayerStub>> layer_servers; // server name -> server
@@ -47,12 +62,183 @@ static std::shared_ptr<BlockdevDeviceStub> get_device_server(const std::string &
     return device_servers[name];
 }
 
+static std::shared_ptr<BlockCache> get_cache(const BlockInfo &device)
+{
+    if (device.type != BlockInfo::BLOCKDEV_DEVICE)
+        return nullptr;
+    return std::get<BlockDeviceInfo>(device.info).cache;
+}
+
+static bool is_mappable(const BlockInfo &device)
+{
+    return device.type == BlockInfo::BLOCKDEV_DEVICE && std::get<BlockDeviceInfo>(device.info).mappable;
+}
+
+// Only whole devices are cached, partitions reach them through their layer server, which then talks to us
+// instead of the driver. So every path to the device goes through the same cache.
+static std::shared_ptr<BlockCache> create_cache(const std::string &server_name, size_t block_size, u64 n_blocks)
+{
+    if (!block_cache_size || !BlockCache::supports(block_size))
+        return nullptr;
+
+    const auto read = [server_name, block_size](u64 block, u32 n_blocks, u8 *data)
+    {
+        read_block::request req{ .n_boffset = block, .n_blocks = n_blocks };
+        read_block::response resp{};
+        const auto result = get_device_server(server_name)->read_block(&req, &resp);
+
+        const bool ok = result == RPC_RESULT_OK && resp.result.success && resp.data && resp.data->size == n_blocks * block_size;
+        if (ok)
+            memcpy(data, resp.data->bytes, resp.data->size);
+        pb_release(&mosrpc_blockdev_read_block_response_msg, &resp);
+        return ok;
+    };
+
+    const auto write = [server_name, block_size](u64 block, u32 n_blocks, u8 *data)
+    {
+        const size_t size = n_blocks * block_size;
+        write_block::request req{ .data = nullptr, .n_boffset = block, .n_blocks = n_blocks };
+        req.data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(size));
+        req.data->size = size;
+        memcpy(req.data->bytes, data, size);
+
+        write_block::response resp{};
+        const auto result = get_device_server(server_name)->write_block(&req, &resp);
+        const bool ok = result == RPC_RESULT_OK && resp.result.success;
+        free(req.data);
+        pb_release(&mosrpc_blockdev_write_block_response_msg, &resp);
+        return ok;
+    };
+
+    return std::make_shared<BlockCache>(block_size, n_blocks, block_cache_size, read, write);
+}
+
+bool flush_block_caches()
+{
+    // devices are never removed, collect the caches and write them back without holding the lock
+    std::vector<std::pair<std::string, std::shared_ptr<BlockCache>>> caches;
+    {
+        std::lock_guard<std::mutex> lock(devices_lock);
+        for (const auto &[name, device] : devices)
+            if (const auto cache = get_cache(device))
+                caches.emplace_back(name, cache);
+    }
+
+    bool ok = true;
+    for (const auto &[name, cache] : caches)
+    {
+        if (!cache->flush())
+        {
+            std::cerr << "Failed to write back cached blocks of " << name << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// write back the cached blocks of a device, then have the server below make them durable
+static bool flush_device(const BlockInfo &device)
+{
+    if (const auto cache = get_cache(device); cache && !cache->flush())
+        return false;
+
+    flush::response resp{};
+    rpc_result_code_t result;
+    switch (device.type)
+    {
+        case BlockInfo::BLOCKDEV_LAYER:
+        {
+            // the layer flushes the whole disk, through us, so its cache is written back as well
+            const auto &info = std::get<BlockLayerInfo>(device.info);
+            flush::request req{ .device = { .devid = (u32) -1 }, .partition = { .partid = info.partid } };
+            result = get_layer_server(info.server_name)->flush(&req, &resp);
+            break;
+        }
+        case BlockInfo::BLOCKDEV_DEVICE:
+        {
+            flush::request req{};
+            result = get_device_server(std::get<BlockDeviceInfo>(device.info).server_name)->flush(&req, &resp);
+            break;
+        }
+        default: __builtin_unreachable();
+    }
+
+    const bool ok = result == RPC_RESULT_OK && resp.result.success;
+    pb_release(&mosrpc_blockdev_flush_response_msg, &resp);
+    return ok;
+}
+
 struct ClientFDTable
 {
     fd_t next_fd = 0;
     std::map<int, std::string> fd_to_device;
+
+    // The device and layer servers may not understand buffer handles, so a buffer passed by the client
+    // is mapped here and the data is forwarded the usual way.
+    BlockdevBufferTable buffers{ true };
 };
 
+// Connect to the server backing a device on behalf of the client and hand the connection over,
+// so that the client's I/O goes straight to the driver (or the layer, which translates partition offsets).
+static bool open_direct_channel(rpc_context_t *ctx, const BlockInfo &device, mosrpc_blockdev_direct_channel *channel)
+{
+    std::string server_name;
+    switch (device.type)
+    {
+        case BlockInfo::BLOCKDEV_LAYER:
+        {
+            const auto &info = std::get<BlockLayerInfo>(device.info);
+            server_name = info.server_name;
+            channel->is_layer = true;
+            channel->partition.partid = info.partid;
+            channel->accepts_buffers = info.accepts_buffers;
+            break;
+        }
+        case BlockInfo::BLOCKDEV_DEVICE:
+        {
+            const auto &info = std::get<BlockDeviceInfo>(device.info);
+            server_name = info.server_name;
+            channel->is_layer = false;
+            channel->accepts_buffers = info.accepts_buffers;
+            channel->mappable = info.mappable;
+            break;
+        }
+        default: __builtin_unreachable();
+    }
+
+    const fd_t fd = syscall_ipc_connect_ex(server_name.c_str(), MOS_PAGE_SIZE, IPC_CONNECT_SHM_RING);
+    if (IS_ERR_VALUE(fd))
+        return false;
+
+    // the stub owns (and eventually closes) the fd, the in-flight handle keeps the connection alive until the client receives it
+    const auto stub = rpc_client_create_fd(server_name.c_str(), fd);
+    if (channel->is_layer)
+    {
+        // a layer serves every partition it registered, bind the connection to the one the client opened before handing it out
+        BlockdevLayerStub layer(stub);
+        const bind_partition::request req{ .partition = channel->partition };
+        bind_partition::response resp{};
+        const auto result = layer.bind_partition(&req, &resp);
+        const bool bound = result == RPC_RESULT_OK && resp.result.success;
+        pb_release(&mosrpc_blockdev_bind_partition_response_msg, &resp);
+        if (!bound)
+            return false;
+
+        channel->connection = rpc_context_send_fd(ctx, fd);
+    }
+    else
+    {
+        channel->connection = rpc_context_send_fd(ctx, fd);
+        rpc_client_destroy(stub);
+    }
+
+    if (!channel->connection)
+        return false;
+
+    channel->server_name = strdup(server_name.c_str());
+    return true;
+}
+
 void BlockManager::on_connect(rpc_context_t *ctx)
 {
     // allocate a new FD table for this client
@@ -68,6 +254,7 @@ void BlockManager::on_disconnect(rpc_context_t *ctx)
 
 rpc_result_code_t BlockManager::register_layer_server(rpc_context_t *, const register_layer_server::request *req, register_layer_server::response *resp)
 {
+    std::lock_guard<std::mutex> lock(devices_lock);
     for (size_t i = 0; i < req->partitions_count; i++)
     {
         const auto part = req->partitions[i];
@@ -77,7 +264,7 @@ rpc_result_code_t BlockManager::register_layer_server(rpc_context_t *, const reg
             .n_blocks = part.size / 512,
             .block_size = 512,
             .type = BlockInfo::BLOCKDEV_LAYER,
-            .info = BlockLayerInfo{ .server_name = req->server_name, .partid = part.partid },
+            .info = BlockLayerInfo{ .server_name = req->server_name, .partid = part.partid, .accepts_buffers = req->accepts_buffers },
         };
 
         devices.emplace(part.name, info);
@@ -90,6 +277,7 @@ rpc_result_code_t BlockManager::register_layer_server(rpc_context_t *, const reg
 
 rpc_result_code_t BlockManager::register_device(rpc_context_t *, const register_device::request *req, register_device::response *resp)
 {
+    std::unique_lock<std::mutex> lock(devices_lock);
     if (devices.contains(req->device_info.name))
     {
         std::cout << "Device " << req->device_info.name << " already registered" << std::endl;
@@ -104,10 +292,18 @@ rpc_result_code_t BlockManager::register_device(rpc_context_t *, const register_
         .n_blocks = req->device_info.n_blocks,
         .block_size = req->device_info.block_size,
         .type = BlockInfo::BLOCKDEV_DEVICE,
-        .info = BlockDeviceInfo{ .server_name = req->server_name },
+        .info =
+            BlockDeviceInfo{
+                .server_name = req->server_name,
+                .accepts_buffers = req->accepts_buffers,
+                .mappable = req->mappable,
+                // writes through a mapping would bypass the cache, and memory needs no cache anyway
+                .cache = req->mappable ? nullptr : create_cache(req->server_name, req->device_info.block_size, req->device_info.n_blocks),
+            },
     };
 
     devices.emplace(req->device_info.name, info);
+    lock.unlock();
 
     std::cout << "block device '" << req->device_info.name << "' with " << req->device_info.n_blocks << " blocks of size " << req->device_info.block_size << " bytes"
               << std::endl;
@@ -122,7 +318,8 @@ rpc_result_code_t BlockManager::register_device(rpc_context_t *, const register_
 rpc_result_code_t BlockManager::open_device(rpc_context_t *ctx, const open_device::request *req, open_device::response *resp)
 {
     const auto name = req->device_name;
-    if (!devices.contains(name))
+    const auto device = find_device(name);
+    if (!device)
     {
         std::cout << "Device " << name << " not found" << std::endl;
         resp->result.success = false;
@@ -134,6 +331,17 @@ rpc_result_code_t BlockManager::open_device(rpc_context_t *ctx, const open_devic
     const auto fd = fdtable->next_fd++;
     fdtable->fd_to_device[fd] = name;
     resp->device.devid = fd;
+
+    resp->block_size = device->block_size;
+    resp->n_blocks = device->n_blocks;
+
+    resp->channel = {};
+    if (req->manager_only || get_cache(*device))
+        ; // all I/O has to go through the manager (and its cache)
+    else if (!open_direct_channel(ctx, *device, &resp->channel))
+        std::cout << "No direct channel for device " << name << ", I/O will go through the manager" << std::endl;
+    resp->channel.mappable = is_mappable(*device); // MapRange also works through the manager
+
     resp->result.success = true;
     resp->result.error = NULL;
     return RPC_RESULT_OK;
@@ -142,6 +350,8 @@ rpc_result_code_t BlockManager::open_device(rpc_context_t *ctx, const open_devic
 rpc_result_code_t BlockManager::read_block(rpc_context_t *ctx, const read_block::request *req, read_block::response *resp)
 {
     auto fdtable = get_data<ClientFDTable>(ctx);
+    std::shared_ptr<BlockdevBuffer> buffer;
+    const bool buffer_valid = fdtable->buffers.get(ctx, req->buffer, &buffer);
     if (!fdtable->fd_to_device.contains(req->device.devid))
     {
         std::cout << "Invalid device handle " << req->device.devid << std::endl;
@@ -150,7 +360,8 @@ rpc_result_code_t BlockManager::read_block(rpc_context_t *ctx, const read_block:
         return RPC_RESULT_OK;
     }
 
-    auto &device = devices[fdtable->fd_to_device[req->device.devid]];
+    const auto &device = *find_device(fdtable->fd_to_device[req->device.devid]);
+    auto request = device.stats->begin(BlockIOType::Read);
     if (req->n_boffset >= device.n_blocks)
     {
         std::cout << "Block offset " << req->n_boffset << " out of range" << std::endl;
@@ -159,6 +370,38 @@ rpc_result_code_t BlockManager::read_block(rpc_context_t *ctx, const read_block:
         return RPC_RESULT_OK;
     }
 
+    if (!buffer_valid || (buffer && buffer->buffer.size < req->n_blocks * device.block_size))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid buffer");
+        return RPC_RESULT_OK;
+    }
+
+    if (const auto cache = get_cache(device))
+    {
+        if (req->n_blocks == 0 || req->n_boffset + req->n_blocks > device.n_blocks)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Block range out of range");
+            return RPC_RESULT_OK;
+        }
+
+        const size_t size = req->n_blocks * device.block_size;
+        u8 *data = buffer ? (u8 *) buffer->buffer.data : nullptr;
+        if (!data)
+        {
+            resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(size));
+            resp->data->size = size;
+            data = resp->data->bytes;
+        }
+
+        resp->result.success = cache->read(req->n_boffset, req->n_blocks, data);
+        resp->result.error = resp->result.success ? NULL : strdup("I/O error");
+        request.done(resp->result.success, size);
+        return RPC_RESULT_OK;
+    }
+
+    rpc_result_code_t result;
     switch (device.type)
     {
         case BlockInfo::BLOCKDEV_LAYER:
@@ -173,22 +416,39 @@ rpc_result_code_t BlockManager::read_block(rpc_context_t *ctx, const read_block:
                 .n_blocks = req->n_blocks,
             };
 
-            return server->read_partition_block(&part_req, resp);
+            result = server->read_partition_block(&part_req, resp);
+            break;
         }
 
         case BlockInfo::BLOCKDEV_DEVICE:
         {
             const auto server = get_device_server(std::get<BlockDeviceInfo>(device.info).server_name);
-            return server->read_block(req, resp);
+            mosrpc_blockdev_read_block_request dev_req = *req;
+            dev_req.buffer = {};
+            result = server->read_block(&dev_req, resp);
+            break;
         }
 
         default: __builtin_unreachable();
     };
+
+    if (buffer && result == RPC_RESULT_OK && resp->data)
+    {
+        // hand the data back through the client's buffer instead of the response
+        memcpy(buffer->buffer.data, resp->data->bytes, std::min<size_t>(resp->data->size, buffer->buffer.size));
+        free(resp->data);
+        resp->data = nullptr;
+    }
+
+    request.done(result == RPC_RESULT_OK && resp->result.success, req->n_blocks * device.block_size);
+    return result;
 }
 
 rpc_result_code_t BlockManager::write_block(rpc_context_t *ctx, const write_block::request *req, write_block::response *resp)
 {
     auto fdtable = get_data<ClientFDTable>(ctx);
+    std::shared_ptr<BlockdevBuffer> buffer;
+    const bool buffer_valid = fdtable->buffers.get(ctx, req->buffer, &buffer);
 
     if (!fdtable->fd_to_device.contains(req->device.devid))
     {
@@ -198,7 +458,8 @@ rpc_result_code_t BlockManager::write_block(rpc_context_t *ctx, const write_bloc
         return RPC_RESULT_OK;
     }
 
-    auto &device = devices[fdtable->fd_to_device[req->device.devid]];
+    const auto &device = *find_device(fdtable->fd_to_device[req->device.devid]);
+    auto request = device.stats->begin(BlockIOType::Write);
     if (req->n_boffset >= device.n_blocks)
     {
         std::cout << "Block offset " << req->n_boffset << " out of range" << std::endl;
@@ -207,6 +468,40 @@ rpc_result_code_t BlockManager::write_block(rpc_context_t *ctx, const write_bloc
         return RPC_RESULT_OK;
     }
 
+    const size_t size = req->n_blocks * device.block_size;
+    if (!buffer_valid || (buffer && buffer->buffer.size < size))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid buffer");
+        return RPC_RESULT_OK;
+    }
+
+    if (const auto cache = get_cache(device))
+    {
+        const u8 *data = buffer ? (const u8 *) buffer->buffer.data : (req->data && req->data->size >= size) ? req->data->bytes : nullptr;
+        if (req->n_blocks == 0 || req->n_boffset + req->n_blocks > device.n_blocks || !data)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Invalid write request");
+            return RPC_RESULT_OK;
+        }
+
+        resp->result.success = cache->write(req->n_boffset, req->n_blocks, data);
+        resp->result.error = resp->result.success ? NULL : strdup("I/O error");
+        resp->n_blocks = req->n_blocks;
+        request.done(resp->result.success, size);
+        return RPC_RESULT_OK;
+    }
+
+    pb_bytes_array_t *data = req->data;
+    if (buffer)
+    {
+        data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(size));
+        data->size = size;
+        memcpy(data->bytes, buffer->buffer.data, size);
+    }
+
+    rpc_result_code_t result;
     switch (device.type)
     {
         case BlockInfo::BLOCKDEV_LAYER:
@@ -219,23 +514,178 @@ rpc_result_code_t BlockManager::write_block(rpc_context_t *ctx, const write_bloc
             mosrpc_blockdev_write_partition_block_request part_req = {
                 .device = { .devid = (u32) -1 },
                 .partition = { .partid = info.partid },
-                .data = req->data,
+                .data = data,
                 .n_boffset = req->n_boffset,
                 .n_blocks = req->n_blocks,
             };
 
-            return server->write_partition_block(&part_req, resp);
+            result = server->write_partition_block(&part_req, resp);
+            break;
         }
 
         case BlockInfo::BLOCKDEV_DEVICE:
         {
             const auto servername = std::get<BlockDeviceInfo>(device.info).server_name;
             const auto server = get_device_server(servername);
-            return server->write_block(req, resp);
+            mosrpc_blockdev_write_block_request dev_req = *req;
+            dev_req.data = data;
+            dev_req.buffer = {};
+            result = server->write_block(&dev_req, resp);
+            break;
         }
 
         default: __builtin_unreachable();
     };
 
+    if (data != req->data)
+        free(data);
+
+    request.done(result == RPC_RESULT_OK && resp->result.success, size);
+    return result;
+}
+
+rpc_result_code_t BlockManager::flush(rpc_context_t *ctx, const flush::request *req, flush::response *resp)
+{
+    auto fdtable = get_data<ClientFDTable>(ctx);
+    if (!fdtable->fd_to_device.contains(req->device.devid))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid device handle");
+        return RPC_RESULT_OK;
+    }
+
+    const auto &device = *find_device(fdtable->fd_to_device[req->device.devid]);
+    auto request = device.stats->begin(BlockIOType::Flush);
+    resp->result.success = flush_device(device);
+    resp->result.error = resp->result.success ? NULL : strdup("Failed to flush the device");
+    request.done(resp->result.success, 0);
+    return RPC_RESULT_OK;
+}
+
+rpc_result_code_t BlockManager::get_cache_stats(rpc_context_t *, const get_cache_stats::request *req, get_cache_stats::response *resp)
+{
+    const auto device = find_device(req->device_name);
+    const auto cache = device ? get_cache(*device) : nullptr;
+    if (!cache)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup(!device ? "Device not found" : "Device is not cached");
+        return RPC_RESULT_OK;
+    }
+
+    const auto stats = cache->stats();
+    resp->hits = stats.hits;
+    resp->misses = stats.misses;
+    resp->writebacks = stats.writebacks;
+    resp->evictions = stats.evictions;
+    resp->cached = stats.cached * BLOCK_CACHE_CHUNK_SIZE;
+    resp->dirty = stats.dirty * device->block_size;
+    resp->capacity = stats.capacity * BLOCK_CACHE_CHUNK_SIZE;
+
+    resp->result.success = true;
+    resp->result.error = NULL;
+    return RPC_RESULT_OK;
+}
+
+rpc_result_code_t BlockManager::map_range(rpc_context_t *ctx, const map_range::request *req, map_range::response *resp)
+{
+    auto fdtable = get_data<ClientFDTable>(ctx);
+    if (!fdtable->fd_to_device.contains(req->device.devid))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Invalid device handle");
+        return RPC_RESULT_OK;
+    }
+
+    const auto &device = *find_device(fdtable->fd_to_device[req->device.devid]);
+    if (!is_mappable(device))
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Device can't be mapped");
+        return RPC_RESULT_OK;
+    }
+
+    const auto server = get_device_server(std::get<BlockDeviceInfo>(device.info).server_name);
+    map_range::request dev_req = *req;
+    const auto result = server->map_range(&dev_req, resp);
+    if (result != RPC_RESULT_OK || !resp->result.success)
+        return result;
+
+    // the driver sent the memory to us, pass it on to the client
+    const fd_t fd = rpc_client_receive_fd(server->get(), resp->buffer.handle);
+    resp->buffer.handle = fd >= 0 ? rpc_context_send_fd(ctx, fd) : 0;
+    if (fd >= 0)
+        close(fd);
+
+    if (!resp->buffer.handle)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Failed to pass the device memory on");
+    }
+
+    return RPC_RESULT_OK;
+}
+
+// move the layers of a response from a server below us to the end of ours
+static void append_io_stats(get_io_stats::response *resp, get_io_stats::response *below)
+{
+    if (below->layers_count)
+    {
+        const size_t count = resp->layers_count + below->layers_count;
+        resp->layers = (mosrpc_blockdev_io_stats *) realloc(resp->layers, count * sizeof(mosrpc_blockdev_io_stats));
+        memcpy(resp->layers + resp->layers_count, below->layers, below->layers_count * sizeof(mosrpc_blockdev_io_stats));
+        resp->layers_count = count;
+
+        free(below->layers); // the contents belong to resp now
+        below->layers = nullptr;
+        below->layers_count = 0;
+    }
+
+    pb_release(&mosrpc_blockdev_io_stats_response_msg, below);
+}
+
+rpc_result_code_t BlockManager::get_io_stats(rpc_context_t *, const get_io_stats::request *req, get_io_stats::response *resp)
+{
+    const auto device_ptr = find_device(req->device_name);
+    if (!device_ptr)
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Device not found");
+        return RPC_RESULT_OK;
+    }
+
+    const auto &device = *device_ptr;
+    resp->layers_count = 1;
+    resp->layers = (mosrpc_blockdev_io_stats *) calloc(1, sizeof(mosrpc_blockdev_io_stats));
+    device.stats->to_pb(&resp->layers[0], "manager");
+
+    // then the servers below, those that don't keep statistics are left out
+    get_io_stats::response below{};
+    rpc_result_code_t result;
+    switch (device.type)
+    {
+        case BlockInfo::BLOCKDEV_LAYER:
+        {
+            const auto &info = std::get<BlockLayerInfo>(device.info);
+            get_io_stats::request layer_req{ .device_name = nullptr, .partition = { .partid = info.partid } };
+            result = get_layer_server(info.server_name)->get_io_stats(&layer_req, &below);
+            break;
+        }
+        case BlockInfo::BLOCKDEV_DEVICE:
+        {
+            get_io_stats::request dev_req{};
+            result = get_device_server(std::get<BlockDeviceInfo>(device.info).server_name)->get_io_stats(&dev_req, &below);
+            break;
+        }
+        default: __builtin_unreachable();
+    }
+
+    if (result == RPC_RESULT_OK && below.result.success)
+        append_io_stats(resp, &below);
+    else if (result == RPC_RESULT_OK)
+        pb_release(&mosrpc_blockdev_io_stats_response_msg, &below);
+
+    resp->result.success = true;
+    resp->result.error = NULL;
     return RPC_RESULT_OK;
 }
@@ -2,7 +2,9 @@
 
 #pragma once
 
+#include "block_cache.hpp"
 #include "blockdev.h"
+#include "blockdev_stats.hpp"
 #include "proto/blockdev.service.h"
 
 #include <abi-bits/ino_t.h>
@@ -10,6 +12,8 @@
 #include <librpc/rpc_server++.hpp>
 #include <librpc/rpc_server.h>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <pb_decode.h>
 #include <pb_encode.h>
 #include <string>
@@ -20,12 +24,16 @@ using namespace mosrpc::blockdev;
 struct BlockDeviceInfo
 {
     std::string server_name;
+    bool accepts_buffers = false;
+    bool mappable = false;             // clients can map its blocks, see MapRange
+    std::shared_ptr<BlockCache> cache; // null if the device is not cached
 };
 
 struct BlockLayerInfo
 {
     std::string server_name;
     u32 partid;
+    bool accepts_buffers = false;
 };
 
 struct BlockInfo
@@ -42,9 +50,19 @@ struct BlockInfo
     } type;
 
     std::variant<BlockLayerInfo, BlockDeviceInfo> info;
+    std::shared_ptr<BlockIOStats> stats = std::make_shared<BlockIOStats>(); // of the I/O that goes through the manager
 };
 
-extern std::map<std::string, BlockInfo> devices; // blockdev name -> blockdev info
+extern std::map<std::string, BlockInfo> devices; // blockdev name -> blockdev info, entries are never changed or removed once added
+extern std::mutex devices_lock;                  // protects the devices map, requests are served by several workers
+extern size_t block_cache_size;                  // per device, 0 (the default) disables the cache
+
+/**
+ * @brief Look up a block device by name
+ *
+ * @return const BlockInfo* The device, which stays valid since devices are never removed, or nullptr
+ */
+const BlockInfo *find_device(const std::string &name);
 
 class BlockManager : public IBlockdevManagerService
 {
@@ -60,6 +78,15 @@ class BlockManager : public IBlockdevManagerService
     virtual rpc_result_code_t open_device(rpc_context_t *ctx, const open_device::request *req, open_device::response *resp) override;
     virtual rpc_result_code_t read_block(rpc_context_t *, const read_block::request *req, read_block::response *resp) override;
     virtual rpc_result_code_t write_block(rpc_context_t *, const write_block::request *req, write_block::response *resp) override;
+    virtual rpc_result_code_t flush(rpc_context_t *ctx, const flush::request *req, flush::response *resp) override;
+    virtual rpc_result_code_t get_cache_stats(rpc_context_t *, const get_cache_stats::request *req, get_cache_stats::response *resp) override;
+    virtual rpc_result_code_t map_range(rpc_context_t *ctx, const map_range::request *req, map_range::response *resp) override;
+    virtual rpc_result_code_t get_io_stats(rpc_context_t *, const get_io_stats::request *req, get_io_stats::response *resp) override;
 };
 
 bool register_blockdevfs();
+
+/**
+ * @brief Write back the dirty blocks of all cached devices
+ */
+bool flush_block_caches();
@@ -81,6 +81,7 @@ rpc_result_code_t BlockdevFSServer::readdir(rpc_context_t *, const mosrpc_fs_rea
         return RPC_RESULT_OK;
     }
 
+    std::lock_guard<std::mutex> lock(devices_lock);
     const size_t count = devices.size();
     resp->entries_count = count;
     resp->entries = (mosrpc_fs_pb_dirent *) malloc(count * sizeof(mosrpc_fs_pb_dirent));
@@ -108,14 +109,15 @@ rpc_result_code_t BlockdevFSServer::lookup(rpc_context_t *, const mosrpc_fs_look
         return RPC_RESULT_OK;
     }
 
-    if (!devices.contains(req->name))
+    const auto device = find_device(req->name);
+    if (!device)
     {
         resp->result.success = false;
         resp->result.error = strdup("blockdevfs: no such block device");
         return RPC_RESULT_OK;
     }
 
-    const auto &info = devices[req->name];
+    const auto &info = *device;
 
     mosrpc_fs_inode_info *i = &resp->i_info;
     i->ino = info.ino;
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "proto/blockdev.pb.h"
+
+#include <librpc/rpc_buffer.h>
+#include <librpc/rpc_server.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief A shared buffer a client passed with a read or write request
+ */
+struct BlockdevBuffer
+{
+    rpc_buffer_t buffer{ .fd = -1, .data = nullptr, .size = 0 }; ///< data is only set if the table maps its buffers
+    u64 slot = 0;   ///< unique among all connections while it's kept, 0 if the buffer was only for one request
+    u64 serial = 0; ///< unique for every buffer received
+
+    BlockdevBuffer() = default;
+    BlockdevBuffer(const BlockdevBuffer &) = delete;
+    BlockdevBuffer &operator=(const BlockdevBuffer &) = delete;
+
+    ~BlockdevBuffer()
+    {
+        rpc_buffer_destroy(&buffer);
+    }
+};
+
+/**
+ * @brief The shared buffers a client has passed on one connection
+ *
+ * @details A buffer with an id is kept until the connection goes away, so its fd is only sent (and mapped)
+ *          the first time and whenever the client replaces it, see mosrpc.buffer_handle.
+ *          A server passing the buffers on (see BlockdevClient::pass_buffer) uses the slot as the id and
+ *          the serial as the version, slots are reused once their connection is gone.
+ */
+class BlockdevBufferTable
+{
+  public:
+    /// @param map whether the buffers are mapped, or only their fds kept to be passed on
+    explicit BlockdevBufferTable(bool map) : map(map) {};
+
+    BlockdevBufferTable(const BlockdevBufferTable &) = delete;
+    BlockdevBufferTable &operator=(const BlockdevBufferTable &) = delete;
+
+    ~BlockdevBufferTable()
+    {
+        std::lock_guard guard(ids_lock);
+        for (const auto &[id, buffer] : buffers)
+            free_slots.push_back(buffer->slot);
+    }
+
+    /**
+     * @brief Look up the buffer passed with a request, receiving and mapping it if its fd came along
+     *
+     * @return false if the buffer is invalid, *out is nullptr if there's none
+     */
+    bool get(rpc_context_t *ctx, const mosrpc_buffer_handle &handle, std::shared_ptr<BlockdevBuffer> *out)
+    {
+        out->reset();
+        if (!handle.handle)
+        {
+            if (!handle.id)
+                return true;
+
+            std::lock_guard guard(lock);
+            const auto it = buffers.find(handle.id);
+            if (it == buffers.end() || it->second->buffer.size != handle.size)
+                return false;
+            *out = it->second;
+            return true;
+        }
+
+        // always receive the fd, even if the request turns out to be invalid, so it doesn't linger on the connection
+        const fd_t fd = rpc_context_receive_fd(ctx, handle.handle);
+        if (fd < 0)
+            return false;
+
+        auto buffer = std::make_shared<BlockdevBuffer>();
+        if (!map)
+        {
+            buffer->buffer.fd = fd;
+            buffer->buffer.size = handle.size;
+        }
+        else if (!rpc_buffer_map(&buffer->buffer, fd, handle.size))
+        {
+            close(fd);
+            return false;
+        }
+
+        std::lock_guard guard(lock);
+        {
+            std::lock_guard ids_guard(ids_lock);
+            buffer->serial = ++next_id;
+            if (handle.id)
+            {
+                const auto it = buffers.find(handle.id);
+                if (it != buffers.end())
+                {
+                    buffer->slot = it->second->slot; // replaced, the slot stays
+                }
+                else if (!free_slots.empty())
+                {
+                    buffer->slot = free_slots.back();
+                    free_slots.pop_back();
+                }
+                else
+                {
+                    buffer->slot = ++next_id;
+                }
+            }
+        }
+
+        if (handle.id)
+            buffers[handle.id] = buffer;
+        *out = std::move(buffer);
+        return true;
+    }
+
+  private:
+    // shared by all the tables of a server, slots and serials come from the same counter
+    static inline std::mutex ids_lock;
+    static inline u64 next_id = 0;
+    static inline std::vector<u64> free_slots;
+
+    const bool map;
+    std::mutex lock;
+    std::map<u64, std::shared_ptr<BlockdevBuffer>> buffers; ///< by the client's id
+};
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "blockdev.h"
+#include "proto/blockdev.pb.h"
+#include "proto/blockdev.service.h"
+
+#include <cstring>
+#include <iostream>
+#include <librpc/rpc_buffer.h>
+#include <librpc/rpc_client.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+/**
+ * @brief A block device opened through the blockdev manager
+ *
+ * @details The manager hands out a direct connection to the driver (or the partition layer) backing the
+ *          device when it can, reads and writes then go straight there. Otherwise they go through the manager.
+ */
+class BlockdevClient
+{
+  public:
+    explicit BlockdevClient(BlockdevManagerStub *manager) : manager(manager) {};
+
+    bool open(const std::string &name)
+    {
+        mosrpc_blockdev_open_device_request req{ .device_name = strdup(name.c_str()) };
+        mosrpc_blockdev_open_device_response resp{};
+        const auto result = manager->open_device(&req, &resp);
+        free(req.device_name);
+
+        if (result != RPC_RESULT_OK || !resp.result.success)
+        {
+            std::cerr << "Failed to open block device '" << name << "'";
+            if (result == RPC_RESULT_OK && resp.result.error)
+                std::cerr << ": " << resp.result.error;
+            std::cerr << std::endl;
+            pb_release(&mosrpc_blockdev_open_device_response_msg, &resp);
+            return false;
+        }
+
+        handle = resp.device;
+        blksize = resp.block_size;
+        nblocks = resp.n_blocks;
+        mappable = resp.channel.mappable;
+        if (resp.channel.connection)
+        {
+            const fd_t fd = rpc_client_receive_fd(manager->get(), resp.channel.connection);
+            if (fd >= 0)
+            {
+                server_name = resp.channel.server_name ? resp.channel.server_name : name;
+                const auto stub = rpc_client_create_fd(server_name.c_str(), fd);
+                if (resp.channel.is_layer)
+                    layer = std::make_unique<BlockdevLayerStub>(stub);
+                else
+                    device = std::make_unique<BlockdevDeviceStub>(stub);
+                partition = resp.channel.partition;
+                buffers = resp.channel.accepts_buffers;
+            }
+        }
+
+        pb_release(&mosrpc_blockdev_open_device_response_msg, &resp);
+        return true;
+    }
+
+    mosrpc_blockdev_blockdev get_handle() const
+    {
+        return handle;
+    }
+
+    u32 block_size() const
+    {
+        return blksize;
+    }
+
+    u64 n_blocks() const
+    {
+        return nblocks;
+    }
+
+    /// whether the server accepts buffer handles, which are then sent over get_stub()
+    bool accepts_buffers() const
+    {
+        return (device || layer) ? buffers : true; // the manager always does
+    }
+
+    rpc_server_stub_t *get_stub() const
+    {
+        return device ? device->get() : layer ? layer->get() : manager->get();
+    }
+
+    /**
+     * @brief Pass a shared buffer with a read or write request, see accepts_buffers
+     *
+     * @details The server keeps a buffer with an id, its fd is only sent if the server doesn't have this version yet.
+     *
+     * @param id identifies the buffer on this connection, 0 to pass it with this request only
+     * @param version changes whenever another buffer is put behind the id
+     * @return the handle to put in the request, nullopt if the fd couldn't be sent
+     */
+    std::optional<mosrpc_buffer_handle> pass_buffer(u64 id, u64 version, fd_t fd, u64 size)
+    {
+        mosrpc_buffer_handle buffer{ .handle = 0, .size = size, .id = id };
+
+        std::lock_guard guard(buffers_lock);
+        const auto it = id ? sent_buffers.find(id) : sent_buffers.end();
+        if (it != sent_buffers.end() && it->second == version)
+            return buffer;
+
+        buffer.handle = rpc_client_send_fd(get_stub(), fd);
+        if (!buffer.handle)
+            return std::nullopt;
+
+        if (id)
+            sent_buffers[id] = version;
+        return buffer;
+    }
+
+    rpc_result_code_t read_block(mosrpc_blockdev_read_block_request *req, mosrpc_blockdev_read_block_response *resp)
+    {
+        req->device = handle;
+        rpc_result_code_t result;
+        if (device)
+        {
+            result = device->read_block(req, resp);
+        }
+        else if (layer)
+        {
+            const mosrpc_blockdev_read_partition_block_request part_req = {
+                .device = handle,
+                .partition = partition,
+                .n_boffset = req->n_boffset,
+                .n_blocks = req->n_blocks,
+                .buffer = req->buffer,
+            };
+            result = layer->read_partition_block(&part_req, resp);
+        }
+        else
+        {
+            result = manager->read_block(req, resp);
+        }
+
+        buffer_done(req->buffer, result == RPC_RESULT_OK && resp->result.success);
+        return result;
+    }
+
+    rpc_result_code_t write_block(mosrpc_blockdev_write_block_request *req, mosrpc_blockdev_write_block_response *resp)
+    {
+        req->device = handle;
+        rpc_result_code_t result;
+        if (device)
+        {
+            result = device->write_block(req, resp);
+        }
+        else if (layer)
+        {
+            const mosrpc_blockdev_write_partition_block_request part_req = {
+                .device = handle,
+                .partition = partition,
+                .data = req->data,
+                .n_boffset = req->n_boffset,
+                .n_blocks = req->n_blocks,
+                .buffer = req->buffer,
+            };
+            result = layer->write_partition_block(&part_req, resp);
+        }
+        else
+        {
+            result = manager->write_block(req, resp);
+        }
+
+        buffer_done(req->buffer, result == RPC_RESULT_OK && resp->result.success);
+        return result;
+    }
+
+    /**
+     * @brief Map blocks of a memory-backed device (e.g. a ramdisk) into our address space
+     *
+     * @return the first block, nullptr if the device can't be mapped; rpc_buffer_destroy(mapping) unmaps it
+     */
+    u8 *map_range(u64 n_boffset, u32 n_blocks, rpc_buffer_t *mapping)
+    {
+        if (!mappable)
+            return nullptr;
+
+        mosrpc_blockdev_map_range_request req{ .device = handle, .n_boffset = n_boffset, .n_blocks = n_blocks };
+        mosrpc_blockdev_map_range_response resp{};
+        const auto result = device ? device->map_range(&req, &resp) : manager->map_range(&req, &resp);
+
+        u8 *data = nullptr;
+        if (result == RPC_RESULT_OK && resp.result.success)
+        {
+            const fd_t fd = rpc_client_receive_fd(device ? device->get() : manager->get(), resp.buffer.handle);
+            if (fd >= 0 && rpc_buffer_map(mapping, fd, resp.buffer.size))
+                data = (u8 *) mapping->data + resp.offset;
+            else if (fd >= 0)
+                close(fd);
+        }
+
+        pb_release(&mosrpc_blockdev_map_range_response_msg, &resp);
+        return data;
+    }
+
+    /// write back blocks cached by the manager, always through the manager since only it caches
+    bool flush()
+    {
+        mosrpc_blockdev_flush_request req{ .device = handle };
+        mosrpc_blockdev_flush_response resp{};
+        const auto result = manager->flush(&req, &resp);
+        const bool ok = result == RPC_RESULT_OK && resp.result.success;
+        pb_release(&mosrpc_blockdev_flush_response_msg, &resp);
+        return ok;
+    }
+
+  private:
+    // the server may not have (kept) the buffer of a failed request, send it again next time
+    void buffer_done(const mosrpc_buffer_handle &buffer, bool ok)
+    {
+        if (ok || !buffer.id)
+            return;
+
+        std::lock_guard guard(buffers_lock);
+        sent_buffers.erase(buffer.id);
+    }
+
+  private:
+    BlockdevManagerStub *const manager;
+    mosrpc_blockdev_blockdev handle{};
+    u32 blksize = 0;
+    u64 nblocks = 0;
+    std::string server_name; // must outlive the stubs
+    std::unique_ptr<BlockdevDeviceStub> device;
+    std::unique_ptr<BlockdevLayerStub> layer;
+    mosrpc_blockdev_partition partition{};
+    bool buffers = false;
+    bool mappable = false;
+    std::mutex buffers_lock;
+    std::map<u64, u64> sent_buffers; ///< id -> version, of the buffers the server keeps
+};
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "proto/blockdev.pb.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mos/types.h>
+
+#define BLOCKDEV_STATS_BUCKETS 24 // log2 of the latency in microseconds, the last bucket takes everything above 8s
+
+enum class BlockIOType
+{
+    Read,
+    Write,
+    Flush,
+};
+
+/**
+ * @brief I/O counters and latency histograms of a block device (or a partition) at one layer
+ *
+ * @details Each layer a request passes through (the manager, a partition layer, the driver) keeps its own,
+ *          comparing them tells where the time goes. Updates are lock-free, they happen on every request.
+ */
+class BlockIOStats
+{
+  public:
+    /// one request, timed from begin() to done()
+    class Request
+    {
+      public:
+        Request(BlockIOStats *stats, BlockIOType type) : stats(stats), type(type), start(std::chrono::steady_clock::now())
+        {
+            const u32 now = stats->in_flight.fetch_add(1, std::memory_order_relaxed) + 1;
+            u32 max = stats->max_in_flight.load(std::memory_order_relaxed);
+            while (now > max && !stats->max_in_flight.compare_exchange_weak(max, now, std::memory_order_relaxed))
+                ;
+        }
+
+        ~Request()
+        {
+            if (!finished)
+                done(false, 0); // bailed out early, that's an error
+        }
+
+        Request(const Request &) = delete;
+        Request &operator=(const Request &) = delete;
+
+        void done(bool success, u64 bytes)
+        {
+            const u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            stats->account(type, success, bytes, ns);
+            stats->in_flight.fetch_sub(1, std::memory_order_relaxed);
+            finished = true;
+        }
+
+      private:
+        BlockIOStats *const stats;
+        const BlockIOType type;
+        const std::chrono::steady_clock::time_point start;
+        bool finished = false;
+    };
+
+    Request begin(BlockIOType type)
+    {
+        return Request(this, type);
+    }
+
+    /// fill in a snapshot, the strings and arrays are allocated for pb_release
+    void to_pb(mosrpc_blockdev_io_stats *pb, const char *layer) const
+    {
+        pb->layer = strdup(layer);
+        op_to_pb(ops[(int) BlockIOType::Read], &pb->read);
+        op_to_pb(ops[(int) BlockIOType::Write], &pb->write);
+        op_to_pb(ops[(int) BlockIOType::Flush], &pb->flush);
+        pb->in_flight = in_flight.load(std::memory_order_relaxed);
+        pb->max_in_flight = max_in_flight.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct OpStats
+    {
+        std::atomic<u64> ops{ 0 }, bytes{ 0 }, errors{ 0 };
+        std::atomic<u64> total_ns{ 0 }, max_ns{ 0 };
+        std::atomic<u64> histogram[BLOCKDEV_STATS_BUCKETS] = {};
+    };
+
+    void account(BlockIOType type, bool success, u64 bytes, u64 ns)
+    {
+        auto &op = ops[(int) type];
+        op.ops.fetch_add(1, std::memory_order_relaxed);
+        if (success)
+            op.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        else
+            op.errors.fetch_add(1, std::memory_order_relaxed);
+
+        op.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        u64 max = op.max_ns.load(std::memory_order_relaxed);
+        while (ns > max && !op.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+            ;
+
+        const u64 us = ns / 1000;
+        const size_t bucket = us ? 63 - __builtin_clzll(us) : 0;
+        op.histogram[bucket < BLOCKDEV_STATS_BUCKETS ? bucket : BLOCKDEV_STATS_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void op_to_pb(const OpStats &op, mosrpc_blockdev_io_op_stats *pb)
+    {
+        pb->ops = op.ops.load(std::memory_order_relaxed);
+        pb->bytes = op.bytes.load(std::memory_order_relaxed);
+        pb->errors = op.errors.load(std::memory_order_relaxed);
+        pb->total_ns = op.total_ns.load(std::memory_order_relaxed);
+        pb->max_ns = op.max_ns.load(std::memory_order_relaxed);
+        pb->histogram_count = BLOCKDEV_STATS_BUCKETS;
+        pb->histogram = (uint64_t *) malloc(sizeof(uint64_t) * BLOCKDEV_STATS_BUCKETS);
+        for (size_t i = 0; i < BLOCKDEV_STATS_BUCKETS; i++)
+            pb->histogram[i] = op.histogram[i].load(std::memory_order_relaxed);
+    }
+
+  private:
+    OpStats ops[3];
+    std::atomic<u32> in_flight{ 0 }, max_in_flight{ 0 };
+};
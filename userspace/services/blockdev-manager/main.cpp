@@ -3,14 +3,24 @@
 #include "blockdev_manager.hpp"
 #include "libsm.h"
 
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
 
 int main(int argc, char **argv)
 {
-    MOS_UNUSED(argc);
-    MOS_UNUSED(argv);
-
     std::cout << "Block Device Manager for MOS" << std::endl;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            block_cache_size = std::stoul(argv[++i]) * 1 KB; // in KiB, cached devices get no direct channel
+        else
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+    }
+
     BlockManager manager;
 
     if (!register_blockdevfs())
@@ -20,7 +30,22 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (block_cache_size)
+    {
+        std::thread(
+            []()
+            {
+                while (true)
+                {
+                    std::this_thread::sleep_for(std::chrono::seconds(BLOCK_CACHE_FLUSH_SECONDS));
+                    flush_block_caches();
+                }
+            })
+            .detach();
+    }
+
     ReportServiceState(UnitStatus::Started, "manager started");
+    manager.set_worker_pool(4); // most clients only connect to open a device
     manager.run();
 
     std::cout << "Block Device Manager exiting" << std::endl;
@@ -15,6 +15,7 @@ int main(int argc, const char *argv[])
     DeviceManagerServer dm_server;
     ReportServiceState(UnitStatus::Started, "DM started");
 
+    dm_server.set_worker_pool(4); // drivers and clients come and go, don't start a thread for each of them
     dm_server.run();
     fputs("device_manager: server exited\n", stderr);
 
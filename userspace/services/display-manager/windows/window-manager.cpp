@@ -12,6 +12,7 @@
 
 #include <iostream>
 #include <librpc/rpc.h>
+#include <librpc/rpc_buffer.h>
 #include <pb.h>
 #include <vector>
 
@@ -128,11 +129,30 @@ rpc_result_code_t WindowManagerClass::create_window(rpc_context_t *ctx, const Cr
     return RPC_RESULT_OK;
 }
 
-rpc_result_code_t WindowManagerClass::update_window_content(rpc_context_t *, const UpdateWindowContentRequest *req, UpdateWindowContentResponse *resp)
+rpc_result_code_t WindowManagerClass::update_window_content(rpc_context_t *context, const UpdateWindowContentRequest *req, UpdateWindowContentResponse *resp)
 {
+    // the content may come in a shared buffer instead of the message, which saves copying whole frames through the connection
+    rpc_buffer_t buffer{ .fd = -1, .data = nullptr, .size = 0 };
+    if (req->content_buffer.handle)
+    {
+        const fd_t fd = rpc_context_receive_fd(context, req->content_buffer.handle);
+        if (fd < 0 || !rpc_buffer_map(&buffer, fd, req->content_buffer.size))
+        {
+            if (fd >= 0)
+                close(fd);
+            resp->result.success = false;
+            resp->result.error = strdup("Invalid content buffer");
+            return RPC_RESULT_OK;
+        }
+    }
+
+    const void *content = buffer.data ? buffer.data : (req->content ? req->content->bytes : nullptr);
+    const size_t content_size = buffer.data ? buffer.size : (req->content ? req->content->size : 0);
+
     const auto windowIt = windows.find(req->window_id);
     if (windowIt == windows.end())
     {
+        rpc_buffer_destroy(&buffer);
         resp->result.success = false;
         resp->result.error = strdup("Window not found");
         return RPC_RESULT_OK;
@@ -140,7 +160,9 @@ rpc_result_code_t WindowManagerClass::update_window_content(rpc_context_t *, con
 
     auto &window = windowIt->second;
     const auto region = Region(Point(req->region.x, req->region.y), Size(req->region.w, req->region.h));
-    if (!window->UpdateContent(region, req->content->bytes, req->content->size))
+    const bool updated = content && window->UpdateContent(region, content, content_size);
+    rpc_buffer_destroy(&buffer);
+    if (!updated)
     {
         resp->result.success = false;
         resp->result.error = strdup("Range out of bounds or invalid content");
@@ -8,15 +8,21 @@
 #include "ext4_dir.h"
 #include "ext4_fs.h"
 #include "ext4_inode.h"
+#include "ext4_super.h"
 #include "ext4_types.h"
 #include "proto/blockdev.pb.h"
 #include "proto/filesystem.pb.h"
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <librpc/rpc.h>
+#include <librpc/rpc_buffer.h>
+#include <mos/mos_global.h>
 #include <optional>
 #include <string>
+#include <utility>
 
 #undef __unused
 #include <sys/stat.h>
@@ -31,23 +37,11 @@ mosrpc_fs_inode_ref make_inode_ref(ext4_inode_ref &ref) { return { .data = ref.i
 mosrpc_fs_inode_ref make_inode_ref(u64 index) { return { .data = index }; }
 // clang-format on
 
-static std::optional<mosrpc_blockdev_blockdev> open_blockdev(const std::string &name)
+static std::unique_ptr<BlockdevClient> open_blockdev(const std::string &name)
 {
-    open_device::request req{ .device_name = strdup(name.c_str()) };
-    open_device::response resp;
-    const auto result = blockdev_manager->open_device(&req, &resp);
-
-    if (result != RPC_RESULT_OK || !resp.result.success)
-    {
-        std::cerr << "Failed to open block device" << std::endl;
-        if (resp.result.error)
-            std::cerr << "Error: " << resp.result.error << std::endl;
-        return std::nullopt;
-    }
-
-    auto dev = resp.device;
-    pb_release(&mosrpc_blockdev_open_device_request_msg, &req);
-    pb_release(&mosrpc_blockdev_open_device_response_msg, &resp);
+    auto dev = std::make_unique<BlockdevClient>(blockdev_manager.get());
+    if (!dev->open(name))
+        return nullptr;
 
     std::cout << "Block Device '" << name << "' opened" << std::endl;
     return dev;
@@ -70,57 +64,65 @@ static int no_op(struct ext4_blockdev *)
     return 0;
 }
 
-static int blockdev_bread(struct ext4_blockdev *bdev, void *buf, uint64_t blk_id, uint32_t blk_cnt)
+#define BLOCKDEV_BUFFER_THRESHOLD (16 KB) // transfers of at least this size go through a shared buffer
+
+// a shared buffer per thread, reused across transfers and grown as needed
+struct TransferBuffer
 {
-    const auto state = static_cast<ext4_context_state *>(bdev->bdif->p_user);
+    rpc_buffer_t buffer = { .fd = -1, .data = nullptr, .size = 0 };
+    u64 id = 0;      // the same on every connection, the servers keep the buffer (see BlockdevClient::pass_buffer)
+    u64 version = 0; // bumped when the buffer is grown
+};
 
-    read_block::request req{ .device = state->blockdev, .n_boffset = blk_id, .n_blocks = blk_cnt };
-    read_block::response resp;
+static std::atomic<u64> next_transfer_buffer_id = 1;
+static thread_local TransferBuffer transfer_buffer;
 
-    const auto result = blockdev_manager->read_block(&req, &resp);
+static std::optional<mosrpc_buffer_handle> get_transfer_buffer(BlockdevClient *dev, size_t size)
+{
+    if (size < BLOCKDEV_BUFFER_THRESHOLD || !dev->accepts_buffers())
+        return std::nullopt;
 
-    if (result != RPC_RESULT_OK || !resp.result.success)
+    if (transfer_buffer.buffer.size < size)
     {
-        std::cerr << "Failed to read block" << std::endl;
-        if (result == RPC_RESULT_OK && resp.result.error)
-            std::cerr << "Error: " << resp.result.error << std::endl;
-        return EIO;
-    }
-
-    assert(resp.data->size == 512 * blk_cnt); // 512 bytes per block (hardcoded)
+        rpc_buffer_destroy(&transfer_buffer.buffer);
+        if (!rpc_buffer_create(&transfer_buffer.buffer, "ext4-transfer", ALIGN_UP_TO_PAGE(size)))
+            return std::nullopt;
 
-    memcpy(buf, resp.data->bytes, resp.data->size);
-
-    pb_release(&mosrpc_blockdev_read_block_request_msg, &req);
-    pb_release(&mosrpc_blockdev_read_block_response_msg, &resp);
+        if (!transfer_buffer.id)
+            transfer_buffer.id = next_transfer_buffer_id++;
+        transfer_buffer.version++;
+    }
 
-    return EOK;
+    // fall back to sending the data in the message if the fd can't be sent
+    return dev->pass_buffer(transfer_buffer.id, transfer_buffer.version, transfer_buffer.buffer.fd, transfer_buffer.buffer.size);
 }
 
-static int blockdev_bwrite(struct ext4_blockdev *bdev, const void *buf, uint64_t blk_id, uint32_t blk_cnt)
+static int write_blocks(ext4_context_state *state, const void *buf, uint64_t blk_id, uint32_t blk_cnt)
 {
-    const auto state = static_cast<ext4_context_state *>(bdev->bdif->p_user);
-
     const auto data_size = 512 * blk_cnt; // 512 bytes per block (hardcoded)
+    const auto buffer = get_transfer_buffer(state->blockdev.get(), data_size);
 
     write_block::request req{
-        .device = state->blockdev,
-        .data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(data_size)),
+        .data = nullptr,
         .n_boffset = blk_id,
         .n_blocks = blk_cnt,
     };
 
-    // std::cout << "Writing " << blk_cnt << " blocks at offset " << blk_id << std::endl;
-    // std::cout << "  buffer: " << buf << std::endl;
-    // std::cout << "  to: " << req.data << std::endl;
-    // std::cout << std::flush;
-
-    req.data->size = data_size;
-    memcpy(req.data->bytes, buf, data_size);
+    if (buffer)
+    {
+        memcpy(transfer_buffer.buffer.data, buf, data_size);
+        req.buffer = *buffer;
+    }
+    else
+    {
+        req.data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(data_size));
+        req.data->size = data_size;
+        memcpy(req.data->bytes, buf, data_size);
+    }
 
     write_block::response resp;
 
-    const auto result = blockdev_manager->write_block(&req, &resp);
+    const auto result = state->blockdev->write_block(&req, &resp);
 
     if (result != RPC_RESULT_OK || !resp.result.success)
     {
@@ -135,8 +137,156 @@ static int blockdev_bwrite(struct ext4_blockdev *bdev, const void *buf, uint64_t
 
     pb_release(&mosrpc_blockdev_write_block_request_msg, &req);
     pb_release(&mosrpc_blockdev_write_block_response_msg, &resp);
+    return EOK;
+}
+
+static int submit_write_batch(ext4_context_state *state)
+{
+    auto &batch = state->pending;
+    if (batch.count == 0)
+        return EOK;
+
+    const int err = write_blocks(state, batch.data.data(), batch.start, batch.count);
+    batch.count = 0;
+    batch.data.clear();
+    return err;
+}
+
+static int flush_write_batch(ext4_context_state *state)
+{
+    std::lock_guard<std::mutex> guard(state->pending.lock);
+    const int err = submit_write_batch(state);
+
+    // a batch written back by the flusher in the meantime has to fail this flush too, nobody else was told about it
+    const int deferred = std::exchange(state->pending.error, EOK);
+    return err != EOK ? err : deferred;
+}
+
+static void run_write_batch_flusher(ext4_context_state *state)
+{
+    auto &batch = state->pending;
+    std::unique_lock<std::mutex> guard(batch.lock);
+    while (!batch.stopping)
+    {
+        if (batch.count == 0)
+        {
+            batch.changed.wait(guard);
+            continue;
+        }
+
+        const auto deadline = batch.since + EXT4_WRITE_BATCH_TIMEOUT;
+        if (std::chrono::steady_clock::now() < deadline)
+        {
+            batch.changed.wait_until(guard, deadline); // the batch may have been sent and replaced meanwhile, look again
+            continue;
+        }
+
+        if (const int err = submit_write_batch(state); err != EOK)
+        {
+            std::cerr << "Failed to write back pending blocks" << std::endl;
+            batch.error = err;
+        }
+    }
+}
+
+// read blocks from the device, for lwext4 and for the file data read by get_page
+static int read_blocks(ext4_context_state *state, void *buf, uint64_t blk_id, uint32_t blk_cnt)
+{
+    if (state->mapped)
+    {
+        if ((blk_id + blk_cnt) * 512 > state->mapped_size)
+            return EIO;
+        memcpy(buf, state->mapped + blk_id * 512, blk_cnt * 512);
+        return EOK;
+    }
+
+    {
+        // the blocks may still be waiting in the batch, the device must have them before they're read back
+        std::lock_guard<std::mutex> guard(state->pending.lock);
+        const auto &batch = state->pending;
+        if (batch.count && blk_id < batch.start + batch.count && batch.start < blk_id + blk_cnt)
+        {
+            if (const int err = submit_write_batch(state); err != EOK)
+                return err;
+        }
+    }
+
+    const auto data_size = 512 * blk_cnt; // 512 bytes per block (hardcoded)
+    const auto buffer = get_transfer_buffer(state->blockdev.get(), data_size);
+
+    read_block::request req{ .n_boffset = blk_id, .n_blocks = blk_cnt };
+    if (buffer)
+        req.buffer = *buffer;
+    read_block::response resp;
+
+    const auto result = state->blockdev->read_block(&req, &resp);
+
+    if (result != RPC_RESULT_OK || !resp.result.success)
+    {
+        std::cerr << "Failed to read block" << std::endl;
+        if (result == RPC_RESULT_OK && resp.result.error)
+            std::cerr << "Error: " << resp.result.error << std::endl;
+        return EIO;
+    }
+
+    if (buffer)
+    {
+        memcpy(buf, transfer_buffer.buffer.data, data_size);
+    }
+    else
+    {
+        assert(resp.data->size == data_size);
+        memcpy(buf, resp.data->bytes, resp.data->size);
+    }
+
+    pb_release(&mosrpc_blockdev_read_block_request_msg, &req);
+    pb_release(&mosrpc_blockdev_read_block_response_msg, &resp);
 
-    // std::cout << "  ok" << std::endl;
+    return EOK;
+}
+
+static int blockdev_bread(struct ext4_blockdev *bdev, void *buf, uint64_t blk_id, uint32_t blk_cnt)
+{
+    return read_blocks(static_cast<ext4_context_state *>(bdev->bdif->p_user), buf, blk_id, blk_cnt);
+}
+
+static int blockdev_bwrite(struct ext4_blockdev *bdev, const void *buf, uint64_t blk_id, uint32_t blk_cnt)
+{
+    const auto state = static_cast<ext4_context_state *>(bdev->bdif->p_user);
+    const auto data = static_cast<const uint8_t *>(buf);
+    const auto data_size = 512 * blk_cnt; // 512 bytes per block (hardcoded)
+
+    if (state->mapped)
+    {
+        // nothing to batch, the write is a memcpy
+        if ((blk_id + blk_cnt) * 512 > state->mapped_size)
+            return EIO;
+        memcpy(state->mapped + blk_id * 512, buf, data_size);
+        return EOK;
+    }
+
+    auto &batch = state->pending;
+    std::lock_guard<std::mutex> guard(batch.lock);
+
+    // consecutive put_page calls write consecutive blocks, they are sent to the device in one request
+    if (batch.count && blk_id == batch.start + batch.count && batch.data.size() + data_size <= EXT4_WRITE_BATCH_MAX)
+    {
+        batch.data.insert(batch.data.end(), data, data + data_size);
+        batch.count += blk_cnt;
+        return EOK;
+    }
+
+    if (const int err = submit_write_batch(state); err != EOK)
+        return err;
+
+    if (data_size >= EXT4_WRITE_BATCH_MAX)
+        return write_blocks(state, buf, blk_id, blk_cnt);
+
+    batch.start = blk_id;
+    batch.count = blk_cnt;
+    batch.data.assign(data, data + data_size);
+    batch.since = std::chrono::steady_clock::now();
+    batch.changed.notify_one();
     return EOK;
 }
 
@@ -146,12 +296,26 @@ Ext4UserFS::Ext4UserFS(const std::string &name) : IUserFSService(name)
 
 void Ext4UserFS::on_connect(rpc_context_t *ctx)
 {
-    set_data(ctx, new ext4_context_state());
+    const auto state = new ext4_context_state();
+    state->pending.flusher = std::thread(run_write_batch_flusher, state);
+    set_data(ctx, state);
 }
 
 void Ext4UserFS::on_disconnect(rpc_context_t *ctx)
 {
-    delete get_data<ext4_context_state>(ctx);
+    const auto state = get_data<ext4_context_state>(ctx);
+    {
+        std::lock_guard<std::mutex> guard(state->pending.lock);
+        state->pending.stopping = true;
+        state->pending.changed.notify_one();
+    }
+    state->pending.flusher.join();
+
+    if (flush_write_batch(state) != EOK)
+        std::cerr << "Failed to write back pending blocks" << std::endl;
+    if (state->mapped)
+        rpc_buffer_destroy(&state->mapping);
+    delete state;
 }
 
 void Ext4UserFS::populate_mosrpc_fs_inode_info(mosrpc_fs_inode_info &info, ext4_sblock *sb, ext4_inode *inode, int ino)
@@ -195,19 +359,25 @@ rpc_result_code_t Ext4UserFS::mount(rpc_context_t *ctx, const mosrpc_fs_mount_re
     }
 
     auto state = get_data<ext4_context_state>(ctx);
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
 
-    const auto dev = open_blockdev(req->device);
-    if (!dev)
+    state->blockdev = open_blockdev(req->device);
+    if (!state->blockdev)
     {
         resp->result.success = false;
         resp->result.error = strdup("Failed to open block device");
         return RPC_RESULT_OK;
     }
 
-    state->blockdev = dev.value();
-
     const auto devsize = blockdev_size(req->device);
 
+    state->mapped = state->blockdev->map_range(0, devsize / 512, &state->mapping);
+    if (state->mapped)
+    {
+        state->mapped_size = devsize;
+        std::cout << "Block Device '" << req->device << "' is mapped, blocks are accessed directly" << std::endl;
+    }
+
     state->ext4_dev_iface.open = no_op;
     state->ext4_dev_iface.close = no_op;
     state->ext4_dev_iface.lock = no_op;
@@ -257,6 +427,8 @@ rpc_result_code_t Ext4UserFS::mount(rpc_context_t *ctx, const mosrpc_fs_mount_re
 rpc_result_code_t Ext4UserFS::readdir(rpc_context_t *ctx, const mosrpc_fs_readdir_request *req, mosrpc_fs_readdir_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto dir_guard = state->inode_locks.shared(inode_index_from_data(req->i_ref));
+    std::unique_lock<std::mutex> fs_guard(state->fs_lock);
 
     ext4_inode_ref dir;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &dir) != EOK)
@@ -292,8 +464,17 @@ rpc_result_code_t Ext4UserFS::readdir(rpc_context_t *ctx, const mosrpc_fs_readdi
             resp->entries[resp->entries_count - 1] = dirent;
         }
 
+        const auto current_block = iter.curr_blk.lb_id;
         if (ext4_dir_iterator_next(&iter) != EOK)
             break; // got some error
+
+        // let other requests in between directory blocks, the block we're on stays referenced, and nobody
+        // changes the directory while we hold its lock
+        if (iter.curr_blk.lb_id != current_block)
+        {
+            fs_guard.unlock();
+            fs_guard.lock();
+        }
     }
 
     if (ext4_dir_iterator_fini(&iter) != EOK)
@@ -314,6 +495,8 @@ rpc_result_code_t Ext4UserFS::readdir(rpc_context_t *ctx, const mosrpc_fs_readdi
 rpc_result_code_t Ext4UserFS::lookup(rpc_context_t *ctx, const mosrpc_fs_lookup_request *req, mosrpc_fs_lookup_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto parent_guard = state->inode_locks.shared(inode_index_from_data(req->i_ref));
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
 
     ext4_inode_ref parent_inode_ref;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &parent_inode_ref) != EOK)
@@ -354,6 +537,8 @@ rpc_result_code_t Ext4UserFS::lookup(rpc_context_t *ctx, const mosrpc_fs_lookup_
 rpc_result_code_t Ext4UserFS::readlink(rpc_context_t *ctx, const mosrpc_fs_readlink_request *req, mosrpc_fs_readlink_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto inode_guard = state->inode_locks.shared(inode_index_from_data(req->i_ref));
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
 
     ext4_inode_ref inode_ref;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &inode_ref) != EOK)
@@ -402,49 +587,144 @@ rpc_result_code_t Ext4UserFS::readlink(rpc_context_t *ctx, const mosrpc_fs_readl
 rpc_result_code_t Ext4UserFS::get_page(rpc_context_t *ctx, const mosrpc_fs_getpage_request *req, mosrpc_fs_getpage_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
-    ext4_inode_ref inode_ref;
-    if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &inode_ref) != EOK)
+    const auto inode_guard = state->inode_locks.shared(inode_index_from_data(req->i_ref));
+
+    const uint64_t pos = req->pgoff * MOS_PAGE_SIZE;
+    size_t read_size = 0;
+    uint32_t block_size = 0;
+    std::vector<ext4_fsblk_t> blocks; // the file system blocks covering the page, 0 for holes
+
     {
-        resp->result.success = false;
-        resp->result.error = strdup("Failed to get inode reference");
-        return RPC_RESULT_OK;
-    }
+        std::lock_guard<std::mutex> fs_guard(state->fs_lock);
 
-    ext4_inode *inode = inode_ref.inode;
-    const size_t file_size = ext4_inode_get_size(&state->fs->sb, inode);
+        ext4_inode_ref inode_ref;
+        if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &inode_ref) != EOK)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Failed to get inode reference");
+            return RPC_RESULT_OK;
+        }
 
-    ext4_file file = {
-        .mp = state->mp,
-        .inode = inode_ref.index,
-        .flags = O_RDONLY,
-        .fsize = file_size,
-        .fpos = req->pgoff * MOS_PAGE_SIZE,
-    };
+        ext4_inode *inode = inode_ref.inode;
+        const size_t file_size = ext4_inode_get_size(&state->fs->sb, inode);
+        read_size = pos < file_size ? std::min((size_t) MOS_PAGE_SIZE, file_size - pos) : 0;
+        resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(read_size));
+        resp->data->size = 0;
 
-    const size_t read_size = std::min((size_t) MOS_PAGE_SIZE, file_size - file.fpos);
+        if (!ext4_inode_is_type(&state->fs->sb, inode, EXT4_INODE_MODE_FILE))
+        {
+            // e.g. fast symlinks keep their data in the inode, let lwext4 handle those
+            ext4_file file = {
+                .mp = state->mp,
+                .inode = inode_ref.index,
+                .flags = O_RDONLY,
+                .fsize = file_size,
+                .fpos = pos,
+            };
+
+            size_t read_cnt = 0; // should zero-initialize if read_size is zero
+            if (ext4_fread(&file, resp->data->bytes, read_size, &read_cnt) != EOK)
+            {
+                resp->result.success = false;
+                resp->result.error = strdup("Failed to read file");
+                ext4_fs_put_inode_ref(&inode_ref);
+                return RPC_RESULT_OK;
+            }
+
+            assert(read_cnt <= MOS_PAGE_SIZE);
+            resp->data->size = read_cnt;
+            resp->result.success = true;
+            resp->result.error = nullptr;
+            ext4_fs_put_inode_ref(&inode_ref);
+            return RPC_RESULT_OK;
+        }
+
+        block_size = ext4_sb_get_block_size(&state->fs->sb);
+        for (uint64_t iblock = pos / block_size; iblock * block_size < pos + read_size; iblock++)
+        {
+            ext4_fsblk_t fblock = 0;
+            if (ext4_fs_get_inode_dblk_idx(&inode_ref, iblock, &fblock, true) != EOK)
+            {
+                resp->result.success = false;
+                resp->result.error = strdup("Failed to map file block");
+                ext4_fs_put_inode_ref(&inode_ref);
+                return RPC_RESULT_OK;
+            }
+            blocks.push_back(fblock);
+        }
 
-    resp->data = (pb_bytes_array_t *) malloc(PB_BYTES_ARRAY_T_ALLOCSIZE(read_size));
-    size_t read_cnt = 0; // should zero-initialize if read_size is zero
-    if (ext4_fread(&file, resp->data->bytes, read_size, &read_cnt) != EOK)
-    {
-        resp->result.success = false;
-        resp->result.error = strdup("Failed to read file");
         ext4_fs_put_inode_ref(&inode_ref);
+    }
+
+    // the data itself is read without the fs lock, so reads of other files go on in parallel;
+    // the blocks can't be freed or reused meanwhile, that needs the inode lock exclusively
+    if (state->mapped)
+    {
+        // the device is in our address space, copy the file data straight out of it
+        for (size_t done = 0; done < read_size;)
+        {
+            const size_t index = (pos + done) / block_size - pos / block_size;
+            const size_t offset = (pos + done) % block_size;
+            const size_t n = std::min<size_t>(block_size - offset, read_size - done);
+
+            if (blocks[index] == 0)
+                memset(resp->data->bytes + done, 0, n);
+            else if ((blocks[index] + 1) * block_size <= state->mapped_size)
+                memcpy(resp->data->bytes + done, state->mapped + blocks[index] * block_size + offset, n);
+            else
+            {
+                resp->result.success = false;
+                resp->result.error = strdup("File block out of range");
+                return RPC_RESULT_OK;
+            }
+            done += n;
+        }
+
+        resp->data->size = read_size;
+        resp->result.success = true;
+        resp->result.error = nullptr;
         return RPC_RESULT_OK;
     }
 
-    assert(read_cnt <= MOS_PAGE_SIZE);
-    resp->data->size = read_cnt;
+    std::vector<uint8_t> data(blocks.size() * block_size);
+    const uint32_t sectors_per_block = block_size / 512;
+    for (size_t i = 0; i < blocks.size();)
+    {
+        if (blocks[i] == 0)
+        {
+            memset(data.data() + i * block_size, 0, block_size);
+            i++;
+            continue;
+        }
+
+        // physically contiguous blocks are read with one request
+        size_t n = 1;
+        while (i + n < blocks.size() && blocks[i + n] == blocks[i] + n)
+            n++;
+
+        if (read_blocks(state, data.data() + i * block_size, blocks[i] * sectors_per_block, n * sectors_per_block) != EOK)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Failed to read file");
+            return RPC_RESULT_OK;
+        }
+        i += n;
+    }
+
+    if (read_size)
+        memcpy(resp->data->bytes, data.data() + pos % block_size, read_size);
+    resp->data->size = read_size;
 
     resp->result.success = true;
     resp->result.error = nullptr;
-    ext4_fs_put_inode_ref(&inode_ref);
     return RPC_RESULT_OK;
 }
 
 rpc_result_code_t Ext4UserFS::create_file(rpc_context_t *ctx, const mosrpc_fs_create_file_request *req, mosrpc_fs_create_file_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto dir_guard = state->inode_locks.exclusive(inode_index_from_data(req->i_ref));
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
     ext4_inode_ref inode_ref;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &inode_ref) != EOK)
     {
@@ -509,6 +789,8 @@ rpc_result_code_t Ext4UserFS::create_file(rpc_context_t *ctx, const mosrpc_fs_cr
 rpc_result_code_t Ext4UserFS::put_page(rpc_context_t *ctx, const mosrpc_fs_putpage_request *req, mosrpc_fs_putpage_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto inode_guard = state->inode_locks.exclusive(inode_index_from_data(req->i_ref));
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
     ext4_inode_ref inode_ref;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &inode_ref) != EOK)
     {
@@ -577,18 +859,40 @@ rpc_result_code_t Ext4UserFS::put_page(rpc_context_t *ctx, const mosrpc_fs_putpa
 rpc_result_code_t Ext4UserFS::sync_inode(rpc_context_t *ctx, const mosrpc_fs_sync_inode_request *req, mosrpc_fs_sync_inode_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto inode_guard = state->inode_locks.exclusive(req->i_info.ino);
 
-    ext4_inode_ref inode_ref;
-    if (ext4_fs_get_inode_ref(state->fs, req->i_info.ino, &inode_ref) != EOK)
+    {
+        std::lock_guard<std::mutex> fs_guard(state->fs_lock);
+
+        ext4_inode_ref inode_ref;
+        if (ext4_fs_get_inode_ref(state->fs, req->i_info.ino, &inode_ref) != EOK)
+        {
+            resp->result.success = false;
+            resp->result.error = strdup("Failed to get inode reference");
+            return RPC_RESULT_OK;
+        }
+
+        save_inode_info(&state->fs->sb, inode_ref.inode, req->i_info);
+        inode_ref.dirty = true;
+        ext4_fs_put_inode_ref(&inode_ref);
+        ext4_block_cache_flush(state->mp->bc.bdev);
+    }
+
+    // this is how fsync reaches us, so the blocks must be on the device before we return
+    if (flush_write_batch(state) != EOK)
     {
         resp->result.success = false;
-        resp->result.error = strdup("Failed to get inode reference");
+        resp->result.error = strdup("Failed to write back pending blocks");
+        return RPC_RESULT_OK;
+    }
+
+    if (!state->blockdev->flush())
+    {
+        resp->result.success = false;
+        resp->result.error = strdup("Failed to flush the block device");
         return RPC_RESULT_OK;
     }
 
-    save_inode_info(&state->fs->sb, inode_ref.inode, req->i_info);
-    inode_ref.dirty = true;
-    ext4_fs_put_inode_ref(&inode_ref);
     resp->result.success = true;
     resp->result.error = nullptr;
     return RPC_RESULT_OK;
@@ -597,6 +901,9 @@ rpc_result_code_t Ext4UserFS::sync_inode(rpc_context_t *ctx, const mosrpc_fs_syn
 rpc_result_code_t Ext4UserFS::unlink(rpc_context_t *ctx, const mosrpc_fs_unlink_request *req, mosrpc_fs_unlink_response *resp)
 {
     auto state = get_data<ext4_context_state>(ctx);
+    const auto dir_guard = state->inode_locks.exclusive(inode_index_from_data(req->i_ref));
+    const auto child_guard = state->inode_locks.exclusive(req->dentry.inode_id);
+    std::lock_guard<std::mutex> fs_guard(state->fs_lock);
 
     ext4_inode_ref dir;
     if (ext4_fs_get_inode_ref(state->fs, inode_index_from_data(req->i_ref), &dir) != EOK)
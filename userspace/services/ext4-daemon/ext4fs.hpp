@@ -2,9 +2,11 @@
 
 #pragma once
 
+#include "blockdev_client.hpp"
 #include "ext4.h"
 #include "ext4_blockdev.h"
 #include "ext4_types.h"
+#include "inode_locks.hpp"
 #include "proto/blockdev.pb.h"
 #include "proto/blockdev.service.h"
 #include "proto/filesystem.pb.h"
@@ -12,28 +14,64 @@
 #include "proto/userfs-manager.service.h"
 #undef __unused
 
+#include <chrono>
+#include <condition_variable>
 #include <librpc/macro_magic.h>
 #include <librpc/rpc.h>
+#include <librpc/rpc_buffer.h>
 #include <librpc/rpc_client.h>
 #include <librpc/rpc_server++.hpp>
 #include <memory>
 #include <mos/filesystem/fs_types.h>
+#include <mutex>
 #include <pb_decode.h>
+#include <thread>
+#include <vector>
 
 using namespace std::string_literals;
 
 extern std::unique_ptr<UserFSManagerStub> userfs_manager;
 extern std::unique_ptr<BlockdevManagerStub> blockdev_manager;
 
+#define EXT4_WRITE_BATCH_MAX (256 KB) // adjacent block writes are coalesced into requests of up to this size
+
+constexpr std::chrono::milliseconds EXT4_WRITE_BATCH_TIMEOUT{ 200 }; // a batch is sent to the device after this long at the latest
+
+/// adjacent block writes not yet sent to the device
+struct ext4_write_batch
+{
+    std::mutex lock;
+    uint64_t start = 0; // in 512-byte blocks
+    uint32_t count = 0;
+    std::vector<uint8_t> data;
+    std::chrono::steady_clock::time_point since; // when the first block of the batch was written
+    int error = EOK; // the flusher failed to send a batch, reported (and cleared) by the next flush
+
+    // a batch that isn't followed by an fsync or a non-adjacent write is sent by the flusher once it times out
+    std::thread flusher;
+    std::condition_variable changed; // a new batch was started, or the flusher has to stop
+    bool stopping = false;
+};
+
 struct ext4_context_state
 {
-    mosrpc_blockdev_blockdev blockdev;
+    std::unique_ptr<BlockdevClient> blockdev;
 
     uint8_t ext4_buf[512] = { 0 };
     ext4_blockdev_iface ext4_dev_iface;
     ext4_blockdev ext4_dev;
     ext4_fs *fs;
     ext4_mountpoint *mp;
+
+    // requests of a connection are handled concurrently, locks are always taken in this order
+    InodeLocks inode_locks;   // keeps requests on the same inode apart
+    std::mutex fs_lock;       // lwext4 itself is not thread safe, held around every call into it
+    ext4_write_batch pending; // written by lwext4 (with fs_lock held), flushed before overlapping reads
+
+    // memory-backed devices are mapped, blocks are then copied in and out directly instead of via RPC
+    rpc_buffer_t mapping = { .fd = -1, .data = nullptr, .size = 0 };
+    uint8_t *mapped = nullptr; // block 0 of the device
+    size_t mapped_size = 0;
 };
 
 class Ext4UserFS : public IUserFSService
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <map>
+#include <mos/types.h>
+#include <mutex>
+#include <shared_mutex>
+
+/**
+ * @brief Reader/writer locks keyed by inode number
+ *
+ * @details A lock only exists while it's held or waited for. Requests that only read an inode (lookup, readdir,
+ *          get_page) take it shared, requests that modify it take it exclusive. When two inodes are locked,
+ *          the directory is always locked before its child.
+ */
+class InodeLocks
+{
+  public:
+    class Guard
+    {
+      public:
+        Guard(InodeLocks *table, u64 ino, bool exclusive) : table(table), ino(ino), exclusive(exclusive), lock(table->get(ino))
+        {
+            exclusive ? lock.lock() : lock.lock_shared();
+        }
+
+        ~Guard()
+        {
+            exclusive ? lock.unlock() : lock.unlock_shared();
+            table->put(ino);
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+      private:
+        InodeLocks *const table;
+        const u64 ino;
+        const bool exclusive;
+        std::shared_mutex &lock; // the entry stays while we hold a reference to it
+    };
+
+    Guard shared(u64 ino)
+    {
+        return Guard(this, ino, false);
+    }
+
+    Guard exclusive(u64 ino)
+    {
+        return Guard(this, ino, true);
+    }
+
+  private:
+    struct Entry
+    {
+        std::shared_mutex lock;
+        size_t users = 0;
+    };
+
+    std::shared_mutex &get(u64 ino)
+    {
+        std::lock_guard<std::mutex> guard(table_lock);
+        auto &entry = locks[ino]; // std::map never moves its elements
+        entry.users++;
+        return entry.lock;
+    }
+
+    void put(u64 ino)
+    {
+        std::lock_guard<std::mutex> guard(table_lock);
+        if (--locks.at(ino).users == 0)
+            locks.erase(ino);
+    }
+
+  private:
+    std::mutex table_lock;
+    std::map<u64, Entry> locks;
+};
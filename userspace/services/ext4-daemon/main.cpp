@@ -48,6 +48,8 @@ int main(int argc, char **)
     pb_release(&mosrpc_userfs_register_response_msg, &resp);
 
     Ext4UserFS ext4_userfs(server_name);
+    ext4_userfs.set_concurrent(true); // requests on different inodes don't wait for each other
+    ext4_userfs.set_worker_pool(4);
 
     ReportServiceState(UnitStatus::Started, "ext4fs started");
     ext4_userfs.run();
@@ -19,6 +19,18 @@ static IO *server = nullptr;
 
 spinlock_t syslog_lock;
 
+static bool get_unix_time(u64 *timestamp)
+{
+    timeval_t tv;
+    platform_get_time(&tv);
+    if (tv.day == 0)
+        return false;
+
+    const auto days = days_from_civil(tv.year, tv.month, tv.day);
+    *timestamp = (days * 86400) + (tv.hour * 60 * 60) + (tv.minute * 60) + tv.second;
+    return true;
+}
+
 static long handle_log(void *arg, size_t argSize)
 {
     SpinLocker locker(&syslog_lock);
@@ -33,12 +45,10 @@ static long handle_log(void *arg, size_t argSize)
         mWarn << "Empty log message, nothing to write";
         return -EINVAL; // Invalid message
     }
-    timeval_t tv;
-    platform_get_time(&tv);
-    if (tv.day == 0)
+    u64 timestamp;
+    if (!get_unix_time(&timestamp))
         return -ENOTSUP;
 
-    const auto days = days_from_civil(tv.year, tv.month, tv.day);
     const auto message = mos::string{ logMessage->message, logMessage->messageSize };
 
     pb_syslog_message val = {};
@@ -48,7 +58,7 @@ static long handle_log(void *arg, size_t argSize)
     val.thread.name = const_cast<char *>(current_thread->name.value_or("unknown").data());
     val.process.pid = current_process->pid;
     val.process.name = const_cast<char *>(current_process->name.value_or("unknown").data());
-    val.timestamp = (days * 86400) + (tv.hour * 60 * 60) + (tv.minute * 60) + tv.second;
+    val.timestamp = timestamp;
     val.info.level = static_cast<syslog_level>(logMessage->level);
     val.info.featid = 0; // Feature ID can be set to 0 or a specific value if needed
 
@@ -66,6 +76,27 @@ static long handle_log(void *arg, size_t argSize)
     return message.size(); // Return the number of bytes written
 }
 
+// kernel messages, called by klogd after printing them
+static void forward_kernel_log(const pb_syslog_message *msg)
+{
+    SpinLocker locker(&syslog_lock);
+    if (!server)
+        return;
+
+    pb_syslog_message val = *msg;
+    if (!get_unix_time(&val.timestamp))
+        return;
+
+    size_t bufsize;
+    pb_get_encoded_size(&bufsize, pb_syslog_message_fields, &val);
+    pb_byte_t buffer[bufsize];
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer, bufsize);
+    pb_encode(&stream, pb_syslog_message_fields, &val);
+
+    // don't complain on failure, the warning would come back here
+    ipc_write_as_msg(server, buffer, bufsize);
+}
+
 struct SyslogIO : public IO, public mos::NamedType<"module.syslog.io">
 {
     SyslogIO() : IO(IO_WRITABLE, IO_IPC) {};
@@ -144,6 +175,7 @@ static void syslogd_ipc_accepter(void *arg)
     }
 
     server = acc.get();
+    syslog_set_sink(forward_kernel_log);
 }
 
 static void syslogd_kmod_entrypoint(ptr<mos::kmods::Module> self)
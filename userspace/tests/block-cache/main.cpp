@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "block_cache.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define BLOCK_SIZE       512
+#define BLOCKS_PER_CHUNK (BLOCK_CACHE_CHUNK_SIZE / BLOCK_SIZE)
+#define DISK_BLOCKS      (16 * BLOCKS_PER_CHUNK)
+
+// a disk in memory, counting the requests that reach it
+struct FakeDisk
+{
+    std::vector<u8> data = std::vector<u8>(DISK_BLOCKS * BLOCK_SIZE);
+    size_t reads = 0, writes = 0;
+    size_t blocks_written = 0;
+
+    BlockCache make_cache(size_t capacity_chunks)
+    {
+        const auto read = [this](u64 block, u32 n_blocks, u8 *buf)
+        {
+            reads++;
+            memcpy(buf, data.data() + block * BLOCK_SIZE, n_blocks * BLOCK_SIZE);
+            return true;
+        };
+
+        const auto write = [this](u64 block, u32 n_blocks, u8 *buf)
+        {
+            writes++;
+            blocks_written += n_blocks;
+            memcpy(data.data() + block * BLOCK_SIZE, buf, n_blocks * BLOCK_SIZE);
+            return true;
+        };
+
+        return BlockCache(BLOCK_SIZE, DISK_BLOCKS, capacity_chunks * BLOCK_CACHE_CHUNK_SIZE, read, write);
+    }
+
+    u8 &at(u64 block)
+    {
+        return data[block * BLOCK_SIZE];
+    }
+};
+
+static void test_miss_then_hit()
+{
+    FakeDisk disk;
+    disk.at(3) = 0x42;
+    auto cache = disk.make_cache(4);
+
+    u8 buf[BLOCK_SIZE];
+    assert(cache.read(3, 1, buf));
+    assert(buf[0] == 0x42);
+    assert(disk.reads == 1);
+
+    // the whole chunk was fetched, so its other blocks hit as well
+    assert(cache.read(3, 1, buf));
+    assert(cache.read(0, 1, buf));
+    assert(disk.reads == 1);
+
+    const auto stats = cache.stats();
+    assert(stats.misses == 1);
+    assert(stats.hits == 2);
+    assert(stats.cached == 1);
+}
+
+static void test_write_back()
+{
+    FakeDisk disk;
+    auto cache = disk.make_cache(4);
+
+    u8 buf[3 * BLOCK_SIZE];
+    memset(buf, 0x5a, sizeof(buf));
+    assert(cache.write(1, 3, buf));
+
+    // nothing reaches the disk before the flush, but reads see the new data
+    assert(disk.writes == 0);
+    assert(cache.stats().dirty == 3);
+
+    u8 out[BLOCK_SIZE];
+    assert(cache.read(2, 1, out));
+    assert(out[0] == 0x5a);
+
+    // adjacent dirty blocks go out in a single request
+    assert(cache.flush());
+    assert(disk.writes == 1);
+    assert(disk.blocks_written == 3);
+    assert(disk.at(1) == 0x5a && disk.at(3) == 0x5a && disk.at(4) == 0);
+
+    const auto stats = cache.stats();
+    assert(stats.dirty == 0);
+    assert(stats.writebacks == 3);
+
+    // clean blocks aren't written again
+    assert(cache.flush());
+    assert(disk.writes == 1);
+}
+
+static void test_eviction()
+{
+    FakeDisk disk;
+    auto cache = disk.make_cache(2);
+
+    u8 buf[BLOCK_SIZE];
+    memset(buf, 0x17, sizeof(buf));
+    assert(cache.write(0, 1, buf)); // chunk 0, dirty
+
+    assert(cache.read(1 * BLOCKS_PER_CHUNK, 1, buf)); // chunk 1
+    assert(cache.read(2 * BLOCKS_PER_CHUNK, 1, buf)); // chunk 2 evicts chunk 0, the least recently used
+
+    auto stats = cache.stats();
+    assert(stats.evictions == 1);
+    assert(stats.cached == 2);
+
+    // the dirty block was written back when its chunk was evicted
+    assert(disk.writes == 1);
+    assert(disk.at(0) == 0x17);
+    assert(stats.dirty == 0);
+
+    // and it's read from the disk again
+    const size_t reads = disk.reads;
+    assert(cache.read(0, 1, buf));
+    assert(buf[0] == 0x17);
+    assert(disk.reads == reads + 1);
+}
+
+static void test_io_outside_lock()
+{
+    FakeDisk disk;
+    std::atomic_bool writing = false, release = false;
+
+    // a device write that only completes once the other chunk has been read
+    const auto read = [&](u64 block, u32 n_blocks, u8 *buf)
+    {
+        memcpy(buf, disk.data.data() + block * BLOCK_SIZE, n_blocks * BLOCK_SIZE);
+        return true;
+    };
+    const auto write = [&](u64 block, u32 n_blocks, u8 *buf)
+    {
+        writing = true;
+        while (!release)
+            std::this_thread::yield();
+        memcpy(disk.data.data() + block * BLOCK_SIZE, buf, n_blocks * BLOCK_SIZE);
+        return true;
+    };
+    BlockCache cache(BLOCK_SIZE, DISK_BLOCKS, 4 * BLOCK_CACHE_CHUNK_SIZE, read, write);
+
+    u8 buf[BLOCK_SIZE];
+    memset(buf, 0x33, sizeof(buf));
+    assert(cache.write(0, 1, buf));
+
+    std::thread flusher([&]() { assert(cache.flush()); });
+    while (!writing)
+        std::this_thread::yield();
+
+    // the flush is stuck on the device, other chunks are still read and written
+    disk.at(BLOCKS_PER_CHUNK) = 0x44;
+    assert(cache.read(BLOCKS_PER_CHUNK, 1, buf));
+    assert(buf[0] == 0x44);
+    assert(cache.write(2 * BLOCKS_PER_CHUNK, 1, buf));
+
+    // and the chunk being written back can be written to, it then stays dirty
+    memset(buf, 0x55, sizeof(buf));
+    assert(cache.write(1, 1, buf));
+
+    release = true;
+    flusher.join();
+    assert(disk.at(0) == 0x33);
+    assert(cache.stats().dirty == 2); // blocks 1 and 2 * BLOCKS_PER_CHUNK
+
+    assert(cache.flush());
+    assert(disk.at(1) == 0x55 && disk.at(2 * BLOCKS_PER_CHUNK) == 0x44);
+    assert(cache.stats().dirty == 0);
+}
+
+int main(void)
+{
+    test_miss_then_hit();
+    test_write_back();
+    test_eviction();
+    test_io_outside_lock();
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include "librpc/rpc_server.h"
 
 #include <librpc/internal.h>
+#include <librpc/rpc_buffer.h>
 #include <mos/syscall/usermode.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,7 @@ enum
     TESTSERVER_ECHO = 1,
     TESTSERVER_CALCULATE = 2,
     TESTSERVER_CLOSE = 3,
+    TESTSERVER_FILL = 4,
 };
 
 enum
@@ -70,6 +72,24 @@ static rpc_result_code_t testserver_calculation(rpc_context_t *context)
     return 0;
 }
 
+static rpc_result_code_t testserver_fill(rpc_context_t *context)
+{
+    const u64 handle = rpc_arg_s64(context, 0);
+    const u64 size = rpc_arg_s64(context, 1);
+
+    rpc_buffer_t buffer;
+    const fd_t fd = rpc_context_receive_fd(context, handle);
+    if (fd < 0 || !rpc_buffer_map(&buffer, fd, size))
+    {
+        printf("fill server: failed to receive buffer\n");
+        return RPC_RESULT_SERVER_INTERNAL_ERROR;
+    }
+
+    memset(buffer.data, 'x', buffer.size);
+    rpc_buffer_destroy(&buffer);
+    return 0;
+}
+
 static rpc_result_code_t rpc_server_do_close(rpc_context_t *context)
 {
     puts("rpc_server_close");
@@ -84,6 +104,7 @@ void run_server(void)
         { TESTSERVER_ECHO, testserver_echo, 1, .args_type = { RPC_ARGTYPE_STRING } },
         { TESTSERVER_CALCULATE, testserver_calculation, 3, .args_type = { RPC_ARGTYPE_INT32, RPC_ARGTYPE_INT32, RPC_ARGTYPE_INT32 } },
         { TESTSERVER_CLOSE, rpc_server_do_close, 0, .args_type = { 0 } },
+        { TESTSERVER_FILL, testserver_fill, 2, .args_type = { RPC_ARGTYPE_INT64, RPC_ARGTYPE_INT64 } },
     };
 
     rpc_server_t *server = rpc_server_create(RPC_TEST_SERVERNAME, NULL);
@@ -95,6 +116,18 @@ void run_server(void)
     printf("rpc_server_destroy done\n");
 }
 
+static void calculation_callback(rpc_result_code_t result, const void *data, size_t size, void *arg)
+{
+    MOS_UNUSED(size);
+    if (result != RPC_RESULT_OK || !data)
+    {
+        printf("calculation client (callback %s): failed (result_code=%d)\n", (const char *) arg, result);
+        return;
+    }
+
+    printf("calculation client (callback %s): received '%d' (result_code=%d)\n", (const char *) arg, *(const int *) data, result);
+}
+
 void run_client(void)
 {
     rpc_server_stub_t *stub = rpc_client_create(RPC_TEST_SERVERNAME);
@@ -166,6 +199,71 @@ void run_client(void)
         printf("calculation client (spec): received '%d' (result_code=%d)\n", *(int *) result.data, result_code);
     }
 
+    // pipelined calls, waited for in reverse order
+    {
+        rpc_pending_call_t *pending[4];
+        for (int i = 0; i < 4; i++)
+        {
+            rpc_call_t *call = rpc_call_create(stub, TESTSERVER_CALCULATE);
+            rpc_call_arg_s32(call, 100);
+            rpc_call_arg_s32(call, CALC_ADD);
+            rpc_call_arg_s32(call, i);
+            pending[i] = rpc_call_submit(call);
+            rpc_call_destroy(call);
+        }
+
+        for (int i = 3; i >= 0; i--)
+        {
+            if (!pending[i])
+            {
+                printf("calculation client (pipelined %d): submit failed\n", i);
+                continue;
+            }
+
+            int *result;
+            size_t result_size;
+            rpc_result_code_t result_code = rpc_call_wait(pending[i], (void *) &result, &result_size);
+            if (result_code != RPC_RESULT_OK || !result)
+            {
+                printf("calculation client (pipelined %d): failed (result_code=%d)\n", i, result_code);
+                continue;
+            }
+
+            printf("calculation client (pipelined %d): received '%d' (result_code=%d)\n", i, *result, result_code);
+            free(result);
+        }
+    }
+
+    // calls completed by callbacks
+    {
+        rpc_call_t *call = rpc_call_create(stub, TESTSERVER_CALCULATE);
+        rpc_call_arg_s32(call, 6);
+        rpc_call_arg_s32(call, CALC_MUL);
+        rpc_call_arg_s32(call, 7);
+        rpc_call_submit_cb(call, calculation_callback, "1");
+        rpc_call_submit_cb(call, calculation_callback, "2");
+        rpc_call_destroy(call);
+        rpc_client_wait_all(stub);
+    }
+
+    // buffer passed by file descriptor
+    {
+        rpc_buffer_t buffer;
+        if (!rpc_buffer_create(&buffer, "librpc-test", 2 * MOS_PAGE_SIZE))
+        {
+            printf("rpc_buffer_create failed\n");
+        }
+        else
+        {
+            const u64 handle = rpc_client_send_fd(stub, buffer.fd);
+            rpc_result_code_t result_code = rpc_simple_call(stub, TESTSERVER_FILL, NULL, "ll", handle, (u64) buffer.size);
+            const char *data = buffer.data;
+            printf("fill client: handle %llu, result_code=%d, filled: %s\n", (unsigned long long) handle, result_code,
+                   data[0] == 'x' && data[buffer.size - 1] == 'x' ? "yes" : "no");
+            rpc_buffer_destroy(&buffer);
+        }
+    }
+
     // close
     {
         rpc_simple_call(stub, TESTSERVER_CLOSE, NULL, "");
@@ -13,15 +13,16 @@ struct
     const char *name;
     const char *executable;
 } const tests[] = {
-    { "fork", "/initrd/tests/fork-test" },     //
-    { "rpc", "/initrd/tests/rpc-test" },       //
-    { "libc", "/initrd/tests/libc-test" },     //
-    { "c++", "/initrd/tests/libstdc++-test" }, //
-    { "rust", "/initrd/tests/rust-test" },     //
-    { "pipe", "/initrd/tests/pipe-test" },     //
-    { "signal", "/initrd/tests/signal" },      //
-    { "syslog", "/initrd/tests/syslog-test" }, //
-    { "memfd", "/initrd/tests/memfd-test" },   //
+    { "fork", "/initrd/tests/fork-test" },               //
+    { "rpc", "/initrd/tests/rpc-test" },                 //
+    { "libc", "/initrd/tests/libc-test" },               //
+    { "c++", "/initrd/tests/libstdc++-test" },           //
+    { "rust", "/initrd/tests/rust-test" },               //
+    { "pipe", "/initrd/tests/pipe-test" },               //
+    { "signal", "/initrd/tests/signal" },                //
+    { "syslog", "/initrd/tests/syslog-test" },           //
+    { "memfd", "/initrd/tests/memfd-test" },             //
+    { "block-cache", "/initrd/tests/block-cache-test" }, //
     { 0 },
 };
 